@@ -0,0 +1,28 @@
+# - Try to find libdeflate
+# Once done this will define
+#
+#  LIBDEFLATE_FOUND - system has libdeflate
+#  LIBDEFLATE_INCLUDE_DIR - the libdeflate include directory
+#  LIBDEFLATE_LIBRARIES - Link these to use libdeflate
+#
+# Redistribution and use is allowed according to the terms of the BSD license.
+
+find_path(LIBDEFLATE_INCLUDE_DIR libdeflate.h
+    PATHS
+    $ENV{LIBDEFLATE}
+    ${GNUWIN32_DIR}/include
+    /opt/local/include
+)
+
+find_library(LIBDEFLATE_LIBRARIES NAMES deflate libdeflate
+    PATHS
+    $ENV{LIBDEFLATE}
+    ${GNUWIN32_DIR}/lib
+    /opt/local/lib
+)
+
+include(FindPackageHandleStandardArgs)
+
+find_package_handle_standard_args(LibDeflate
+    REQUIRED_VARS LIBDEFLATE_LIBRARIES LIBDEFLATE_INCLUDE_DIR)
+mark_as_advanced(LIBDEFLATE_INCLUDE_DIR LIBDEFLATE_LIBRARIES)
@@ -28,10 +28,10 @@
 #include <QFileInfo>
 #include <QRgb>
 #include <QUuid>
+#include <cassert>
 #include <valarray>
 
 #include <Core/IOWorker.h>
-#include <Exif/ExifOperations.h>
 #include <Libpfs/colorspace/colorspace.h>
 #include <Libpfs/colorspace/convert.h>
 #include <Libpfs/colorspace/normalizer.h>
@@ -245,6 +245,91 @@ void computeAutolevels(const QImage *data, const float threshold,
     gamma = 1.f;  // TODO Let's return gamma = 1
 }
 
+//! \brief HSL lightness as computed by QColor, indexed by the sum of the
+//! largest and the smallest 8 bit component
+static const valarray<uint8_t> &lightness_table() {
+    static const valarray<uint8_t> table = [] {
+        valarray<uint8_t> t(511);
+        for (int sum = 0; sum < 511; sum++) {
+            t[sum] = QColor::fromRgb(sum - sum / 2, sum / 2, sum / 2)
+                         .toHsl()
+                         .lightness();
+        }
+        return t;
+    }();
+    return table;
+}
+
+void computeAutolevels(const pfs::Frame *frame, const float threshold,
+                       float &minHist, float &maxHist, float &gamma) {
+    // same histograms as computeAutolevels(const QImage*, ...) on the image
+    // returned by fromLDRPFStoQImage(frame), built in a single pass over the
+    // float data without creating the QImage
+    const int COLOR_DEPTH = 256;
+
+    const pfs::Channel *Rc, *Gc, *Bc;
+    frame->getXYZChannels(Rc, Gc, Bc);
+    assert(Rc != NULL && Gc != NULL && Bc != NULL);
+
+    const float *R = Rc->data();
+    const float *G = Gc->data();
+    const float *B = Bc->data();
+    const size_t size = Rc->size();
+
+    const valarray<uint8_t> &lightness = lightness_table();
+
+    // L, R, G, B
+    valarray<uint32_t> histInt(0u, 4 * COLOR_DEPTH);
+
+#pragma omp parallel
+{
+    valarray<uint32_t> histThr(0u, 4 * COLOR_DEPTH);
+    uint32_t *histL = &histThr[0];
+    uint32_t *histR = histL + COLOR_DEPTH;
+    uint32_t *histG = histR + COLOR_DEPTH;
+    uint32_t *histB = histG + COLOR_DEPTH;
+
+    #pragma omp for nowait
+    for (size_t i = 0; i < size; i++) {
+        const uint8_t r = colorspace::convertSample<uint8_t>(
+            std::max(0.f, std::min(R[i], 1.f)));
+        const uint8_t g = colorspace::convertSample<uint8_t>(
+            std::max(0.f, std::min(G[i], 1.f)));
+        const uint8_t b = colorspace::convertSample<uint8_t>(
+            std::max(0.f, std::min(B[i], 1.f)));
+
+        histL[lightness[std::max(r, std::max(g, b)) +
+                        std::min(r, std::min(g, b))]]++;
+        histR[r]++;
+        histG[g]++;
+        histB[b]++;
+    }
+
+    // add per thread histograms to global histograms
+    #pragma omp critical
+    histInt += histThr;
+}
+
+    float minMax[4][2];
+    for (int c = 0; c < 4; c++) {
+        valarray<float> hist(0.f, COLOR_DEPTH);
+        for (int i = 0; i < COLOR_DEPTH; i++) {
+            hist[i] = histInt[c * COLOR_DEPTH + i];
+        }
+        // normalize in the range [0...1]
+        hist /= hist.max();
+
+        compute_histogram_minmax(hist, threshold, minMax[c][0], minMax[c][1]);
+    }
+
+    minHist = min(min(minMax[0][0], minMax[1][0]),
+                  min(minMax[2][0], minMax[3][0]));
+    maxHist = max(max(minMax[0][1], minMax[1][1]),
+                  max(minMax[2][1], minMax[3][1]));
+
+    gamma = 1.f;  // TODO Let's return gamma = 1
+}
+
 ConvertToQRgb::ConvertToQRgb(float gamma) : gamma(1.0f / gamma) {}
 
 void ConvertToQRgb::operator()(float r, float g, float b, QRgb &rgb) const {
@@ -285,9 +370,10 @@ void LoadFile::operator()(HdrCreationItem &currentItem) {
         pfs::exif::ExifData exifData(currentItem.filename().toStdString());
         currentItem.setAverageLuminance(exifData.getAverageSceneLuminance());
 
-        // read Exposure Time
+        // read Exposure Time from the file just loaded: the reader has parsed
+        // its metadata already
         currentItem.setExposureTime(
-            ExifOperations::getExposureTime(filePath.constData()));
+            pfs::exif::ExifData(filePath.constData()).getExposureTime());
 
         qDebug() << QStringLiteral("LoadFile: Average Luminance for %1 is %2")
                         .arg(currentItem.filename())
@@ -446,6 +532,8 @@ QString getQString(libhdr::fusion::FusionOperator fo) {
             return QObject::tr("Robertson");
         case ROBERTSON_AUTO:
             return QObject::tr("Robertson Response Calculation");
+        case LINEAR:
+            return QObject::tr("Linear");
     }
 
     return QString();
@@ -34,6 +34,11 @@
 void computeAutolevels(const QImage *data, const float threshold, float &minL,
                        float &maxL, float &gammaL);
 
+//! \brief same as above, on the image fromLDRPFStoQImage(frame) would return
+//! with the default arguments, without building it
+void computeAutolevels(const pfs::Frame *frame, const float threshold,
+                       float &minL, float &maxL, float &gammaL);
+
 inline void rgb2hsl(float r, float g, float b, float &h, float &s, float &l) {
     float v, m, vm, r2, g2, b2;
     h = 0.0f;
@@ -32,7 +32,9 @@
 #include <QStringList>
 #include <QUrl>
 
-enum InterpolationMethod { LanczosInterp, BilinearInterp };
+//! \brief AreaInterp averages the source pixels covered by every output pixel,
+//! weighted by their overlap: exact and alias free when shrinking
+enum InterpolationMethod { LanczosInterp, BilinearInterp, AreaInterp };
 
 bool matchesLdrFilename(const QString &file);
 bool matchesHdrFilename(const QString &file);
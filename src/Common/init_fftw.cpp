@@ -30,7 +30,7 @@ using namespace std;
 
 boost::mutex FFTW_MUTEX::fftw_mutex_global;
 boost::mutex FFTW_MUTEX::fftw_mutex_plan;
-boost::mutex FFTW_MUTEX::fftw_mutex_destroy_plan;
+boost::mutex &FFTW_MUTEX::fftw_mutex_destroy_plan = FFTW_MUTEX::fftw_mutex_plan;
 boost::mutex FFTW_MUTEX::fftw_mutex_alloc;
 boost::mutex FFTW_MUTEX::fftw_mutex_free;
 
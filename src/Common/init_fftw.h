@@ -28,7 +28,9 @@ class FFTW_MUTEX {
    public:
     static boost::mutex fftw_mutex_global;
     static boost::mutex fftw_mutex_plan;
-    static boost::mutex fftw_mutex_destroy_plan;
+    //! \brief the FFTW planner is not reentrant and destroying a plan touches
+    //! its state too: this is an alias of fftw_mutex_plan
+    static boost::mutex &fftw_mutex_destroy_plan;
     static boost::mutex fftw_mutex_alloc;
     static boost::mutex fftw_mutex_free;
 };
@@ -309,8 +309,11 @@ pfs::Params getRawSettings(const LuminanceOptions &opts) {
     //    if ( opts.isRawDoNotUseFujiRotate() )
     //    { p.set("raw.fuji_rotate", 0); }
 
-    //    p.set("raw.user_quality", opts.getRawUserQuality());
-    //    p.set("raw.med_passes", opts.getRawMedPasses());
+    // demosaicing: half size and bilinear are the fast choices
+    p.set("raw.user_quality", opts.getRawUserQuality());
+    p.set("raw.med_passes", opts.getRawMedPasses());
+    p.set("raw.half_size", opts.getRawHalfSize());
+    p.set("raw.output_color", opts.getRawOutputColor());
 
     // white balance
     p.set("raw.wb_method", opts.getRawWhiteBalanceMethod());
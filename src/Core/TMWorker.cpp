@@ -25,33 +25,41 @@
 
 #include <Core/TMWorker.h>
 
+#include <algorithm>
+
 #ifdef QT_DEBUG
 #include <QDebug>
 #endif
 #include <QDir>
+#include <QRect>
+#include <QScopedPointer>
 #include <QVector>
 
 #include <Core/IOWorker.h>
 #include <Libpfs/frame.h>
 #include <Libpfs/manip/copy.h>
 #include <Libpfs/manip/cut.h>
-#include <Libpfs/manip/gamma.h>
+#include <Libpfs/manip/pointpipeline.h>
+#include <Libpfs/manip/pyramid.h>
 #include <Libpfs/manip/resize.h>
-#include <Libpfs/manip/saturation.h>
 #include <Libpfs/params.h>
 #include <Libpfs/tm/TonemapOperator.h>
 #include <Common/ProgressHelper.h>
 #include <Core/TonemappingOptions.h>
 
 TMWorker::TMWorker(QObject *parent)
-    : QObject(parent), m_Callback(new ProgressHelper) {
+    : QObject(parent),
+      m_Callback(new ProgressHelper),
+      m_jobsAnnounced(0),
+      m_jobsStarted(0),
+      m_jobsTerminated(0) {
 #ifdef QT_DEBUG
     qDebug() << "TMWorker::TMWorker() ctor";
 #endif
 
     connect(this, &QObject::destroyed, m_Callback, &QObject::deleteLater);
-    connect(this, &TMWorker::tonemapRequestTermination, m_Callback,
-            &ProgressHelper::qtCancel, Qt::DirectConnection);
+    connect(this, &TMWorker::tonemapRequestTermination, this,
+            &TMWorker::terminateJobs, Qt::DirectConnection);
     connect(m_Callback, &ProgressHelper::qtSetValue, this,
             &TMWorker::tonemapSetValue, Qt::DirectConnection);
     connect(m_Callback, &ProgressHelper::qtSetMinimum, this,
@@ -66,6 +74,27 @@ TMWorker::~TMWorker() {
 #endif
 }
 
+void TMWorker::announceJob() {
+    QMutexLocker locker(&m_jobMutex);
+    ++m_jobsAnnounced;
+}
+
+void TMWorker::beginJob() {
+    QMutexLocker locker(&m_jobMutex);
+    ++m_jobsStarted;
+    m_jobsAnnounced = std::max(m_jobsAnnounced, m_jobsStarted);
+    m_Callback->cancel(m_jobsStarted <= m_jobsTerminated);
+}
+
+void TMWorker::terminateJobs(bool terminate) {
+    if (!terminate) return;
+
+    QMutexLocker locker(&m_jobMutex);
+    m_jobsTerminated = m_jobsAnnounced;
+    // the running job, if any, was announced already
+    m_Callback->cancel(true);
+}
+
 pfs::Frame *TMWorker::computeTonemap(/* const */ pfs::Frame *in_frame,
                                      TonemappingOptions *tm_options,
                                      InterpolationMethod m) {
@@ -73,6 +102,7 @@ pfs::Frame *TMWorker::computeTonemap(/* const */ pfs::Frame *in_frame,
     qDebug() << "TMWorker::getTonemappedFrame()";
 #endif
 
+    beginJob();
     pfs::Frame *working_frame = preprocessFrame(in_frame, tm_options, m);
     if (working_frame == NULL) return NULL;
     try {
@@ -85,7 +115,6 @@ pfs::Frame *TMWorker::computeTonemap(/* const */ pfs::Frame *in_frame,
 
     if (m_Callback->canceled()) {
         emit tonemapFailed(QStringLiteral("Canceled"));
-        m_Callback->cancel(false);  // double check this
         delete working_frame;
         return NULL;
     }
@@ -96,12 +125,76 @@ pfs::Frame *TMWorker::computeTonemap(/* const */ pfs::Frame *in_frame,
     return working_frame;
 }
 
+pfs::Frame *TMWorker::computeTonemapProgressive(
+    /* const */ pfs::Frame *in_frame, TonemappingOptions *tm_options,
+    InterpolationMethod m) {
+    // a crop is tonemapped in one go, as is anything too small to gain from
+    // a coarse pass
+    if (tm_options->tonemapSelection ||
+        tm_options->xsize < 2 * s_progressiveWidth) {
+        return computeTonemap(in_frame, tm_options, m);
+    }
+
+    QVector<int> widths;
+    for (int width = s_progressiveWidth; 2 * width <= tm_options->xsize;
+         width *= 4) {
+        widths.push_back(width);
+    }
+    widths.push_back(tm_options->xsize);
+
+    beginJob();
+    emit tonemapBegin();
+
+    for (int pass = 0; pass < widths.size(); ++pass) {
+        TonemappingOptions pass_options(*tm_options);
+        pass_options.xsize = widths[pass];
+
+        pfs::Frame *working_frame =
+            preprocessFrame(in_frame, &pass_options, m);
+        if (working_frame == NULL) {
+            emit tonemapEnd();
+            return NULL;
+        }
+        try {
+            runOperator(working_frame, &pass_options);
+        } catch (...) {
+            emit tonemapEnd();
+            emit tonemapFailed(QStringLiteral("Tonemap failed!"));
+            delete working_frame;
+            return NULL;
+        }
+
+        if (m_Callback->canceled()) {
+            emit tonemapEnd();
+            emit tonemapFailed(QStringLiteral("Canceled"));
+            delete working_frame;
+            return NULL;
+        }
+
+        postprocessFrame(working_frame, &pass_options);
+
+        if (pass + 1 == widths.size()) {
+            emit tonemapEnd();
+            emit tonemapSuccess(working_frame, tm_options);
+            return working_frame;
+        }
+
+        // shown at the requested size until the next pass replaces it
+        pfs::Frame *upscaled_frame =
+            pfs::resize(working_frame, tm_options->xsize, BilinearInterp);
+        delete working_frame;
+        emit tonemapRefined(upscaled_frame, tm_options);
+    }
+    return NULL;
+}
+
 void TMWorker::computeTonemapAndExport(/* const */ pfs::Frame *in_frame,
                                        TonemappingOptions *tm_options,
                                        pfs::Params params, QString exportDir,
                                        QString hdrName, QString inputfname,
                                        QVector<float> inputExpoTimes,
                                        InterpolationMethod m) {
+    beginJob();
     pfs::Frame *working_frame = preprocessFrame(in_frame, tm_options, m);
     if (working_frame == NULL) return;
     try {
@@ -113,7 +206,6 @@ void TMWorker::computeTonemapAndExport(/* const */ pfs::Frame *in_frame,
     }
 
     if (m_Callback->canceled()) {
-        m_Callback->cancel(false);  // double check this
         delete working_frame;
         return;
     }
@@ -160,47 +252,119 @@ void TMWorker::computeTonemapAndExport(/* const */ pfs::Frame *in_frame,
 
 void TMWorker::tonemapFrame(pfs::Frame *working_frame,
                             TonemappingOptions *tm_options) {
-    m_Callback->cancel(false);
-
     emit tonemapBegin();
-    // build tonemap object
-    TonemapOperator *tmEngine =
-        TonemapOperator::getTonemapOperator(tm_options->tmoperator);
+    runOperator(working_frame, tm_options);
+    emit tonemapEnd();
+}
 
-    // build object, pass new frame to it and collect the result
+TonemapOperator *TMWorker::operatorFor(TMOperator tmo) {
+    std::unique_ptr<TonemapOperator> &tmEngine = m_operators[tmo];
+    if (!tmEngine) {
+        tmEngine.reset(TonemapOperator::getTonemapOperator(tmo));
+    }
+    return tmEngine.get();
+}
+
+void TMWorker::runOperator(pfs::Frame *working_frame,
+                           TonemappingOptions *tm_options) {
+    TonemapOperator *tmEngine = operatorFor(tm_options->tmoperator);
+
+    // a selection cut by cutSelection(): tonemap it with the statistics of
+    // the whole frame, then drop the halo
+    QScopedPointer<TonemapStatistics> statistics(m_statistics.take());
+    if (statistics) {
+        tmEngine->tonemapRegion(*working_frame, tm_options, *statistics,
+                                *m_Callback);
+
+        QScopedPointer<pfs::Frame> selection(
+            pfs::cut(working_frame, m_selection.left(), m_selection.top(),
+                     m_selection.left() + m_selection.width(),
+                     m_selection.top() + m_selection.height()));
+        working_frame->swap(*selection);
+        return;
+    }
+
+    // pass new frame to the operator, and what it derived from the same
+    // input in the previous runs
+    tmEngine->setInput(m_input);
     tmEngine->tonemapFrame(*working_frame, tm_options, *m_Callback);
 
-    emit tonemapEnd();
-    delete tmEngine;
+    // release what was derived from images since closed, and what the run
+    // added past the budget
+    for (auto &op : m_operators) {
+        op.second->trimCache();
+    }
+}
+
+pfs::Frame *TMWorker::cutSelection(pfs::Frame *input_frame,
+                                   TonemappingOptions *tm_options,
+                                   const pfs::PointPipeline &pregamma) {
+    const int x_ul = tm_options->selection_x_up_left;
+    const int y_ul = tm_options->selection_y_up_left;
+    const int x_br = tm_options->selection_x_bottom_right;
+    const int y_br = tm_options->selection_y_bottom_right;
+
+    TonemapOperator *tmEngine = operatorFor(tm_options->tmoperator);
+    if (!tmEngine->tonemapsRegions()) {
+        return pfs::cut(input_frame, x_ul, y_ul, x_br, y_br);
+    }
+
+    // statistics of the whole frame, from a reduced copy
+    std::shared_ptr<const pfs::Frame> level =
+        input_frame->pyramid()->levelFor(s_statisticsWidth);
+    pfs::Frame proxy(level->getWidth(), level->getHeight());
+    pregamma.apply(*level, proxy);
+    m_statistics.reset(
+        tmEngine->computeStatistics(proxy, tm_options, *m_Callback));
+
+    const int halo = tmEngine->regionHalo(tm_options);
+    const int left = std::max(x_ul - halo, 0);
+    const int top = std::max(y_ul - halo, 0);
+    const int right = std::min(x_br + halo, int(input_frame->getWidth()));
+    const int bottom = std::min(y_br + halo, int(input_frame->getHeight()));
+
+    m_selection = QRect(x_ul - left, y_ul - top, x_br - x_ul, y_br - y_ul);
+    return pfs::cut(input_frame, left, top, right, bottom);
 }
 
 pfs::Frame *TMWorker::preprocessFrame(pfs::Frame *input_frame,
                                       TonemappingOptions *tm_options,
                                       InterpolationMethod m) {
     pfs::Frame *working_frame = NULL;
+    m_statistics.reset();
 
+    pfs::PointPipeline pregamma;
+    pregamma.gamma(1.0f / tm_options->pregamma);
+
+    m_input = TonemapInput();
+    m_input.content = input_frame->contentKey();
+    m_input.pregamma = tm_options->pregamma;
+    m_input.interpolation = m;
     if (tm_options->tonemapSelection) {
-        // workingframe = "crop"
-        // std::cout << "crop:[" << opts.selection_x_up_left <<", " <<
-        // opts.selection_y_up_left <<"],";
-        // std::cout << "[" << opts.selection_x_bottom_right <<", " <<
-        // opts.selection_y_bottom_right <<"]" << std::endl;
-        working_frame = pfs::cut(input_frame, tm_options->selection_x_up_left,
-                                 tm_options->selection_y_up_left,
-                                 tm_options->selection_x_bottom_right,
-                                 tm_options->selection_y_bottom_right);
-    } else if (tm_options->xsize != tm_options->origxsize) {
-        // workingframe = "resize"
-        working_frame = pfs::resize(input_frame, tm_options->xsize, m);
+        m_input.left = tm_options->selection_x_up_left;
+        m_input.top = tm_options->selection_y_up_left;
+        m_input.width = tm_options->selection_x_bottom_right - m_input.left;
+        m_input.height = tm_options->selection_y_bottom_right - m_input.top;
     } else {
-        // workingframe = "full res"
-        working_frame = pfs::copy(input_frame);
+        m_input.width = tm_options->xsize;
     }
 
-    if (tm_options->pregamma != 1.0f) {
-        pfs::applyGamma(working_frame, tm_options->pregamma);
+    if (tm_options->tonemapSelection) {
+        // workingframe = "crop", with its halo
+        working_frame = cutSelection(input_frame, tm_options, pregamma);
+    } else if (tm_options->xsize != tm_options->origxsize) {
+        // workingframe = "resize", from the nearest level of the pyramid
+        working_frame = input_frame->pyramid()->resize(tm_options->xsize, m);
+    } else {
+        // workingframe = "full res", pre-gamma applied while copying
+        working_frame = new pfs::Frame(input_frame->getWidth(),
+                                       input_frame->getHeight());
+        pregamma.apply(*input_frame, *working_frame);
+        return working_frame;
     }
 
+    pregamma.apply(*working_frame);
+
     return working_frame;
 }
 
@@ -208,11 +372,9 @@ void TMWorker::postprocessFrame(pfs::Frame *working_frame, TonemappingOptions *t
     // auto-level?
     // black-point?
     // white-point?
-    if (tm_options->postsaturation != 1.0) {
-        pfs::applySaturation(working_frame, tm_options->postsaturation);
-    }
-    if (tm_options->postgamma != 1.0) {
-        pfs::applyGamma(working_frame, tm_options->postgamma);
-    }
-
+    // saturation and gamma in a single pass over the frame
+    pfs::PointPipeline post;
+    post.saturation(tm_options->postsaturation)
+        .gamma(1.0f / tm_options->postgamma);
+    post.apply(*working_frame);
 }
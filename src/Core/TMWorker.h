@@ -26,15 +26,23 @@
 #ifndef TMWORKER_H
 #define TMWORKER_H
 
+#include <QMutex>
 #include <QObject>
+#include <QRect>
+#include <QScopedPointer>
 #include <QString>
 
+#include <map>
+#include <memory>
+
 #include <Common/global.h>
 #include <Libpfs/params.h>
+#include <Libpfs/tm/TonemapOperator.h>
 
 // Forward declaration
 namespace pfs {
 class Frame;
+class PointPipeline;
 }
 
 class TonemappingOptions;
@@ -47,6 +55,21 @@ class TMWorker : public QObject {
     TMWorker(QObject *parent = 0);
     ~TMWorker();
 
+    //! \brief width of the first pass of computeTonemapProgressive()
+    static const int s_progressiveWidth = 512;
+
+    //! \brief minimum width of the reduced copy of the frame the statistics
+    //! of the whole image are computed from, when tonemapping a selection
+    static const int s_statisticsWidth = 1024;
+
+    //! \brief announce a job about to be given to this worker. Call it from
+    //! the thread that creates the job, before the job is queued or run.
+    //! tonemapRequestTermination() cancels the jobs announced before it,
+    //! running or still queued, and none of those announced after it. Jobs
+    //! run in the order they are announced; a job that was not announced
+    //! counts as announced when it starts.
+    void announceJob();
+
    public Q_SLOTS:
     //!
     //!  This function creates a copy of the input frame, tonemap the copy
@@ -55,6 +78,17 @@ class TMWorker : public QObject {
     pfs::Frame *computeTonemap(/* const */ pfs::Frame *, TonemappingOptions *,
                                InterpolationMethod m);
 
+    //!
+    //!  As computeTonemap(), but the frame is first tonemapped at
+    //!  s_progressiveWidth, then at widths four times larger up to the
+    //!  requested one. Every intermediate result is scaled up to the requested
+    //!  size and sent through tonemapRefined(); the last one goes through
+    //!  tonemapSuccess(). A cancel request stops the passes still to run.
+    //!
+    pfs::Frame *computeTonemapProgressive(/* const */ pfs::Frame *,
+                                          TonemappingOptions *,
+                                          InterpolationMethod m);
+
     void computeTonemapAndExport(/* const */ pfs::Frame *, TonemappingOptions *,
                                  pfs::Params, QString exportDir,
                                  QString hdrName, QString inputfname,
@@ -62,17 +96,39 @@ class TMWorker : public QObject {
                                  InterpolationMethod m);
 
     //!
-    //! This function tonemap the input frame
+    //! This function tonemap the input frame, as part of the job started by
+    //! one of the functions above: it leaves the cancel flag alone
     //!
     void tonemapFrame(pfs::Frame *, TonemappingOptions *);
 
    private:
+    //! \brief start the next job: cancel it if a termination was requested
+    //! after it was announced, clear the cancel flag otherwise
+    void beginJob();
+
+    //! \brief handler of tonemapRequestTermination()
+    void terminateJobs(bool);
+
+    //! \brief the instance of \a tmo kept for the lifetime of the worker,
+    //! along with what it derived from the last inputs it was given
+    TonemapOperator *operatorFor(TMOperator tmo);
+
+    //! \brief run the operator, leaving the cancel flag alone
+    void runOperator(pfs::Frame *, TonemappingOptions *);
+
+    //! \brief cut the selection out of the frame. If the operator can
+    //! tonemap regions, the selection comes with the halo the operator needs
+    //! and m_statistics and m_selection are set for runOperator()
+    pfs::Frame *cutSelection(pfs::Frame *, TonemappingOptions *,
+                             const pfs::PointPipeline &pregamma);
+
     pfs::Frame *preprocessFrame(pfs::Frame *, TonemappingOptions *,
                                 InterpolationMethod m);
     void postprocessFrame(pfs::Frame *, TonemappingOptions *);
 
    Q_SIGNALS:
     void tonemapSuccess(pfs::Frame *, TonemappingOptions *);
+    void tonemapRefined(pfs::Frame *, TonemappingOptions *);
     void tonemapFailed(QString);
 
     void tonemapBegin();
@@ -84,6 +140,23 @@ class TMWorker : public QObject {
 
    private:
     ProgressHelper *m_Callback;
+
+    //! \brief count of the jobs announced and started, and of the jobs the
+    //! last termination request applies to
+    QMutex m_jobMutex;
+    quint64 m_jobsAnnounced;
+    quint64 m_jobsStarted;
+    quint64 m_jobsTerminated;
+
+    //! \brief statistics of the whole frame and position of the selection
+    //! inside the frame returned by cutSelection()
+    QScopedPointer<TonemapStatistics> m_statistics;
+    QRect m_selection;
+
+    //! \brief the input preprocessFrame() last prepared, see
+    //! TonemapOperator::setInput()
+    TonemapInput m_input;
+    std::map<TMOperator, std::unique_ptr<TonemapOperator> > m_operators;
 };
 
 #endif  // TMWORKER_H
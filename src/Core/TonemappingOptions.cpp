@@ -117,6 +117,7 @@ void TonemappingOptions::setDefaultTonemapParameters() {
 
     // Lischinski
     operator_options.lischinskioptions.alpha =  LISCHINSKI06_ALPHA;
+    operator_options.lischinskioptions.solve_width = LISCHINSKI06_SOLVE_WIDTH;
 }
 
 void TonemappingOptions::setDefaultParameters() {
@@ -138,6 +138,7 @@ class TonemappingOptions {
         } vanhaterenoptions;
         struct {
             float alpha;
+            int solve_width;
         } lischinskioptions;
     } operator_options;
 
@@ -38,6 +38,8 @@
 #include <exiv2/exiv2.hpp>
 #include <image.hpp>
 
+#include <Libpfs/exif/exifdata.hpp>
+
 #include "Common/config.h"
 #include "ExifOperations.h"
 #include "arch/math.h"
@@ -108,17 +110,14 @@ void copyExifData(const std::string &from, const std::string &to,
 #endif
 
     try {
-        Exiv2::Image::AutoPtr sourceImage;
-        Exiv2::ExifData srcExifData;
+        // the source has usually been parsed already, when it was loaded
+        static const Exiv2::ExifData noExifData;
+        std::shared_ptr<const Exiv2::ExifData> sourceExifData;
 
         if (!from.empty()) {
-            // get source exif data
-            sourceImage = Exiv2::ImageFactory::open(from);
-
-            sourceImage->readMetadata();
-            srcExifData = sourceImage->exifData();
+            sourceExifData = pfs::exif::ExifData(from).getExiv2Data();
 
-            if (srcExifData.empty()) {
+            if (!sourceExifData) {
 #ifndef NDEBUG
                 std::clog << "No exif data found in the image: " << from
                           << std::endl;
@@ -126,6 +125,8 @@ void copyExifData(const std::string &from, const std::string &to,
                 return;
             }
         }
+        const Exiv2::ExifData &srcExifData =
+            sourceExifData ? *sourceExifData : noExifData;
 
         // get destination exif data
         Exiv2::Image::AutoPtr destinationImage = Exiv2::ImageFactory::open(to);
@@ -212,6 +213,7 @@ void copyExifData(const std::string &from, const std::string &to,
             destinationImage->setExifData(srcExifData);
         }
         destinationImage->writeMetadata();
+        pfs::exif::ExifData::forget(to);
     } catch (Exiv2::AnyError &e) {
 #ifndef NDEBUG
         qDebug() << e.what();
@@ -337,75 +339,34 @@ allowed for ev computation purposes.
 */
 
 float getExposureTime(const std::string &filename) {
-    try {
-        Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(filename);
-        image->readMetadata();
-        Exiv2::ExifData &exifData = image->exifData();
-        if (exifData.empty()) return -1;
-
-        Exiv2::ExifData::const_iterator iexpo =
-            exifData.findKey(Exiv2::ExifKey("Exif.Photo.ExposureTime"));
-        Exiv2::ExifData::const_iterator iexpo2 =
-            exifData.findKey(Exiv2::ExifKey("Exif.Photo.ShutterSpeedValue"));
-        // Exiv2::ExifData::const_iterator iiso  =
-        // exifData.findKey(Exiv2::ExifKey("Exif.Photo.ISOSpeedRatings"));
-        // Exiv2::ExifData::const_iterator ifnum =
-        // exifData.findKey(Exiv2::ExifKey("Exif.Photo.FNumber"));
-        // Exiv2::ExifData::const_iterator ifnum2 =
-        // exifData.findKey(Exiv2::ExifKey("Exif.Photo.ApertureValue"));
-
-        float expo = -1;
-
-        if (iexpo != exifData.end()) {
-            expo = iexpo->toFloat();
-        } else if (iexpo2 != exifData.end()) {
-            long num = 1;
-            long div = 1;
-            double tmp = std::exp(std::log(2.0) * iexpo2->toFloat());
-            if (tmp > 1) {
-                div = static_cast<long>(tmp + 0.5);
-            } else {
-                num = static_cast<long>(1 / tmp + 0.5);
-            }
-            expo = static_cast<float>(num) / static_cast<float>(div);
-        }
-        if (expo != -1) {
-            return expo;
-        } else {
-            return -1;
-        }
-    } catch (Exiv2::AnyError &e) {
-        return -1;
-    }
+    return pfs::exif::ExifData(filename).getExposureTime();
 }
 
 float getAverageLuminance(const std::string &filename) {
-    try {
-        Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(filename);
-        image->readMetadata();
-        Exiv2::ExifData &exifData = image->exifData();
+    std::shared_ptr<const Exiv2::ExifData> exifData =
+        pfs::exif::ExifData(filename).getExiv2Data();
+    if (!exifData) {
+        return -1.0;
+    }
 
-        // Exif.Image.ExposureBiasValue
-        Exiv2::ExifData::const_iterator itExpValue =
-            exifData.findKey(Exiv2::ExifKey("Exif.Image.ExposureBiasValue"));
-        if (itExpValue != exifData.end()) {
-            return pow(2.0f, itExpValue->toFloat());
-        }
+    // Exif.Image.ExposureBiasValue
+    Exiv2::ExifData::const_iterator itExpValue =
+        exifData->findKey(Exiv2::ExifKey("Exif.Image.ExposureBiasValue"));
+    if (itExpValue != exifData->end()) {
+        return pow(2.0f, itExpValue->toFloat());
+    }
 
-        // Exif.Photo.ExposureBiasValue
-        itExpValue =
-            exifData.findKey(Exiv2::ExifKey("Exif.Photo.ExposureBiasValue"));
-        if (itExpValue != exifData.end()) {
-            return pow(2.0f, itExpValue->toFloat());
-        }
+    // Exif.Photo.ExposureBiasValue
+    itExpValue =
+        exifData->findKey(Exiv2::ExifKey("Exif.Photo.ExposureBiasValue"));
+    if (itExpValue != exifData->end()) {
+        return pow(2.0f, itExpValue->toFloat());
+    }
 
-        std::clog << "Cannot find ExposureBiasValue for " << filename
-                  << std::endl;
+    std::clog << "Cannot find ExposureBiasValue for " << filename
+              << std::endl;
 
-        return -1.0;
-    } catch (Exiv2::AnyError &e) {
-        return -1.0;
-    }
+    return -1.0;
 }
 
 }  // ExifOperations
@@ -46,6 +46,7 @@
 #include <Libpfs/frame.h>
 #include <Libpfs/utils/msec_timer.h>
 #include <Libpfs/utils/transform.h>
+#include "opthelper.h"
 
 using namespace std;
 using namespace pfs;
@@ -63,6 +64,114 @@ void QRgbRemapper::operator()(float r, float g, float b, QRgb &qrgb) const {
     qrgb = qRgb(m_remapper(r), m_remapper(g), m_remapper(b));
 }
 
+namespace {
+//! \brief QRgbRemapper on whole rows: the normalisation and the quantisation
+//! to 8 bits run on 4 samples at a time, then the 256 possible results of the
+//! mapping are looked up in tables already shifted into place in a QRgb
+class QRgbRowRemapper {
+   public:
+    QRgbRowRemapper(float minLuminance, float maxLuminance,
+                    RGBMappingType mappingType)
+        : m_normalizer(minLuminance, maxLuminance),
+          m_min(minLuminance),
+          m_range(maxLuminance - minLuminance) {
+        const Remapper<uint8_t> remapper(mappingType);
+        for (int i = 0; i < 256; i++) {
+            const QRgb v = remapper(float(i) / 255.f);
+            m_red[i] = qRgb(v, 0, 0);
+            m_green[i] = v << 8;
+            m_blue[i] = v;
+        }
+    }
+
+    void operator()(const float *r, const float *g, const float *b, QRgb *out,
+                    int size) const {
+        int x = 0;
+#ifdef __SSE2__
+        const vfloat minv = F2V(m_min);
+        const vfloat rangev = F2V(m_range);
+        const vfloat onev = F2V(1.f);
+        const vfloat scalev = F2V(255.f);
+        const vfloat halfv = F2V(0.5f);
+        int ri[4] ALIGNED16;
+        int gi[4] ALIGNED16;
+        int bi[4] ALIGNED16;
+        for (; x + 3 < size; x += 4) {
+            _mm_store_si128(
+                reinterpret_cast<vint *>(ri),
+                _mm_cvttps_epi32(
+                    vmaxf(vminf((LVFU(r[x]) - minv) / rangev, onev), ZEROV) *
+                        scalev +
+                    halfv));
+            _mm_store_si128(
+                reinterpret_cast<vint *>(gi),
+                _mm_cvttps_epi32(
+                    vmaxf(vminf((LVFU(g[x]) - minv) / rangev, onev), ZEROV) *
+                        scalev +
+                    halfv));
+            _mm_store_si128(
+                reinterpret_cast<vint *>(bi),
+                _mm_cvttps_epi32(
+                    vmaxf(vminf((LVFU(b[x]) - minv) / rangev, onev), ZEROV) *
+                        scalev +
+                    halfv));
+            for (int k = 0; k < 4; k++) {
+                out[x + k] = m_red[ri[k]] | m_green[gi[k]] | m_blue[bi[k]];
+            }
+        }
+#endif
+        for (; x < size; x++) {
+            out[x] = m_red[index(r[x])] | m_green[index(g[x])] |
+                     m_blue[index(b[x])];
+        }
+    }
+
+   private:
+    uint8_t index(float sample) const {
+        return colorspace::convertSample<uint8_t>(
+            utils::CLAMP_F32(m_normalizer(sample)));
+    }
+
+    colorspace::Normalizer m_normalizer;
+    float m_min;
+    float m_range;
+    QRgb m_red[256];
+    QRgb m_green[256];
+    QRgb m_blue[256];
+};
+}
+
+void mapFrameToQImage(const pfs::Frame &in_frame, const QRect &rect,
+                      QImage &out, float min_luminance, float max_luminance,
+                      RGBMappingType mapping_method) {
+    assert(rect.left() >= 0 && rect.right() < int(in_frame.getWidth()));
+    assert(rect.top() >= 0 && rect.bottom() < int(in_frame.getHeight()));
+    assert(out.format() == QImage::Format_RGB32);
+    assert(out.width() >= rect.width() && out.height() >= rect.height());
+
+    const pfs::Channel *Xc, *Yc, *Zc;
+    in_frame.getXYZChannels(Xc, Yc, Zc);
+    assert(Xc != NULL && Yc != NULL && Zc != NULL);
+
+    const QRgbRowRemapper remapper(min_luminance, max_luminance,
+                                   mapping_method);
+    const int width = rect.width();
+    const int height = rect.height();
+    uchar *bits = out.bits();
+    const int bytesPerLine = out.bytesPerLine();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (int y = 0; y < height; y++) {
+        const size_t offset =
+            size_t(rect.top() + y) * in_frame.getWidth() + rect.left();
+        remapper(Xc->data() + offset, Yc->data() + offset, Zc->data() + offset,
+                 reinterpret_cast<QRgb *>(bits + size_t(y) * bytesPerLine),
+                 width);
+    }
+}
+
 QImage *fromLDRPFStoQImage(pfs::Frame *in_frame, float min_luminance,
                            float max_luminance, RGBMappingType mapping_method) {
 #ifdef TIMER_PROFILING
@@ -76,16 +185,13 @@ QImage *fromLDRPFStoQImage(pfs::Frame *in_frame, float min_luminance,
 
     assert(in_frame != NULL);
 
-    pfs::Channel *Xc, *Yc, *Zc;
-    in_frame->getXYZChannels(Xc, Yc, Zc);
-    assert(Xc != NULL && Yc != NULL && Zc != NULL);
-
     QImage *temp_qimage = new QImage(
         in_frame->getWidth(), in_frame->getHeight(), QImage::Format_RGB32);
 
-    QRgbRemapper remapper(min_luminance, max_luminance, mapping_method);
-    utils::transform(Xc->begin(), Xc->end(), Yc->begin(), Zc->begin(),
-                     reinterpret_cast<QRgb *>(temp_qimage->bits()), remapper);
+    mapFrameToQImage(*in_frame,
+                     QRect(0, 0, in_frame->getWidth(), in_frame->getHeight()),
+                     *temp_qimage, min_luminance, max_luminance,
+                     mapping_method);
 
 #ifdef TIMER_PROFILING
     stop_watch.stop_and_update();
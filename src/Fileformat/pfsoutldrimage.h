@@ -31,6 +31,7 @@
 #define FROMLDRPFSTOQIMAGE
 
 #include <QImage>
+#include <QRect>
 #include <QRgb>
 
 #include <Libpfs/colorspace/normalizer.h>
@@ -66,4 +67,11 @@ QImage *fromLDRPFStoQImage(pfs::Frame *in_frame, float min_luminance = 0.0f,
                            float max_luminance = 1.0f,
                            RGBMappingType mapping_method = MAP_LINEAR);
 
+//! \brief Map the pixels of \a rect, a rectangle inside \a in_frame, into the
+//! top left corner of \a out, a Format_RGB32 image at least as large as
+//! \a rect. Every pixel gets the same value as through QRgbRemapper
+void mapFrameToQImage(const pfs::Frame &in_frame, const QRect &rect,
+                      QImage &out, float min_luminance, float max_luminance,
+                      RGBMappingType mapping_method);
+
 #endif
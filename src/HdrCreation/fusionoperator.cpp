@@ -21,6 +21,7 @@
 
 #include "fusionoperator.h"
 #include "debevec.h"
+#include "linear.h"
 #include "robertson02.h"
 
 #include <boost/assign.hpp>
@@ -56,6 +57,9 @@ FusionOperatorPtr IFusionOperator::build(FusionOperator type) {
         case ROBERTSON:
             return std::make_shared<RobertsonOperator>();
             break;
+        case LINEAR:
+            return std::make_shared<LinearOperator>();
+            break;
         case DEBEVEC:
         default:
             return std::make_shared<DebevecOperator>();
@@ -66,7 +70,7 @@ FusionOperatorPtr IFusionOperator::build(FusionOperator type) {
 FusionOperator IFusionOperator::fromString(const std::string &type) {
     typedef map<string, FusionOperator, pfs::utils::StringUnsensitiveComp> Dict;
     static Dict v = map_list_of("debevec", DEBEVEC)("robertson", ROBERTSON)(
-        "robertson-auto", ROBERTSON_AUTO);
+        "robertson-auto", ROBERTSON_AUTO)("linear", LINEAR);
 
     Dict::const_iterator it = v.find(type);
     if (it != v.end()) {
@@ -51,7 +51,12 @@ class FrameEnhanced {
     float m_averageLuminance;
 };
 
-enum FusionOperator { DEBEVEC = 0, ROBERTSON = 1, ROBERTSON_AUTO = 2 };
+enum FusionOperator {
+    DEBEVEC = 0,
+    ROBERTSON = 1,
+    ROBERTSON_AUTO = 2,
+    LINEAR = 3
+};
 
 class IFusionOperator;
 
@@ -66,7 +71,7 @@ class IFusionOperator {
     static FusionOperatorPtr build(FusionOperator type);
 
     //! \brief retrieve the right \c FusionOperator value for the input string.
-    //! Valid values are "debevec", "robertson" and "robertson-auto"
+    //! Valid values are "debevec", "robertson", "robertson-auto" and "linear"
     static FusionOperator fromString(const std::string &type);
 
     pfs::Frame *computeFusion(ResponseCurve &response, WeightFunction &weight,
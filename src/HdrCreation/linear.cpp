@@ -0,0 +1,159 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#include "linear.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include <Libpfs/frame.h>
+#include <Libpfs/manip/demosaic.h>
+
+using namespace pfs;
+using namespace std;
+
+namespace libhdr {
+namespace fusion {
+
+namespace {
+
+//! \brief LDR samples this close to white are treated as clipped
+const float s_ldrSaturation = 0.98f;
+
+struct Identity {
+    float operator()(float v) const { return v; }
+};
+
+struct ResponseLookup {
+    ResponseLookup(const ResponseCurve &response, ResponseChannel channel)
+        : m_response(response), m_channel(channel) {}
+
+    float operator()(float v) const {
+        return m_response(std::min(std::max(v, 0.f), 1.f), m_channel);
+    }
+
+   private:
+    const ResponseCurve &m_response;
+    ResponseChannel m_channel;
+};
+
+template <typename Linearize>
+void mergeSamples(const vector<const float *> &inputs,
+                  const vector<float> &exposures,
+                  const vector<float> &saturation, size_t size,
+                  const Linearize &linearize, float *output) {
+    assert(inputs.size() == exposures.size());
+    assert(inputs.size() == saturation.size());
+
+    const size_t count = inputs.size();
+    const size_t shortest =
+        min_element(exposures.begin(), exposures.end()) - exposures.begin();
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (long k = 0; k < long(size); ++k) {
+        float value = 0.f;
+        float time = 0.f;
+        for (size_t i = 0; i < count; ++i) {
+            const float v = inputs[i][k];
+            if (v < saturation[i]) {
+                value += linearize(v);
+                time += exposures[i];
+            }
+        }
+        output[k] = (time > 0.f)
+                        ? value / time
+                        : linearize(inputs[shortest][k]) / exposures[shortest];
+    }
+}
+}
+
+void LinearOperator::computeFusion(ResponseCurve &response,
+                                   WeightFunction & /*weight*/,
+                                   const vector<FrameEnhanced> &frames,
+                                   pfs::Frame &frame) {
+    assert(frames.size() != 0);
+
+    const size_t W = frames[0].frame()->getWidth();
+    const size_t H = frames[0].frame()->getHeight();
+
+    vector<float> exposures;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        exposures.push_back(frames[i].averageLuminance());
+    }
+    const vector<float> saturation(frames.size(), s_ldrSaturation);
+
+    DataList inputs[3] = {DataList(frames.size()), DataList(frames.size()),
+                          DataList(frames.size())};
+    fillDataLists(frames, inputs[0], inputs[1], inputs[2]);
+
+    frame.resize(W, H);
+    Channel *C[3];
+    frame.createXYZChannels(C[0], C[1], C[2]);
+
+    for (int c = 0; c < 3; ++c) {
+        const vector<const float *> data(inputs[c].begin(), inputs[c].end());
+        mergeSamples(data, exposures, saturation, W * H,
+                     ResponseLookup(response, ResponseChannel(c)),
+                     C[c]->data());
+    }
+}
+
+void mergeBayerFrames(const vector<BayerFrame> &frames,
+                      const vector<float> &exposures, BayerFrame &out) {
+    assert(frames.size() != 0);
+    assert(frames.size() == exposures.size());
+
+    const size_t W = frames[0].data.getCols();
+    const size_t H = frames[0].data.getRows();
+
+    vector<const float *> data;
+    vector<float> saturation;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const BayerFrame &f = frames[i];
+        if (f.data.getCols() != W || f.data.getRows() != H ||
+            !std::equal(&f.cfa[0][0], &f.cfa[0][0] + 4, &frames[0].cfa[0][0])) {
+            throw std::runtime_error(
+                "mergeBayerFrames: the RAW frames have different sensors");
+        }
+        data.push_back(f.data.data());
+        saturation.push_back(f.saturation);
+    }
+
+    const size_t shortest =
+        min_element(exposures.begin(), exposures.end()) - exposures.begin();
+
+    out.data.resize(W, H);
+    std::copy(&frames[0].cfa[0][0], &frames[0].cfa[0][0] + 4, &out.cfa[0][0]);
+    std::copy(frames[0].whiteBalance, frames[0].whiteBalance + 3,
+              out.whiteBalance);
+    std::copy(&frames[0].rgbCam[0][0], &frames[0].rgbCam[0][0] + 9,
+              &out.rgbCam[0][0]);
+    out.saturation = saturation[shortest] / exposures[shortest];
+
+    mergeSamples(data, exposures, saturation, W * H, Identity(),
+                 out.data.data());
+}
+
+}  // fusion
+}  // libhdr
@@ -0,0 +1,65 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#ifndef LIBHDR_FUSION_LINEAR_H
+#define LIBHDR_FUSION_LINEAR_H
+
+#include <vector>
+
+#include <HdrCreation/fusionoperator.h>
+
+namespace pfs {
+struct BayerFrame;
+}
+
+namespace libhdr {
+namespace fusion {
+
+//! \brief Merge of linear exposures without weighting function: every sample
+//! that is not clipped contributes in proportion to its exposure, which is
+//! the maximum likelihood estimate of the radiance under photon noise.
+//! Samples clipped in every input take the value of the shortest exposure.
+//! The response curve only linearises the input; RAW brackets skip it
+//! altogether through mergeBayerFrames()
+class LinearOperator : public IFusionOperator {
+   public:
+    LinearOperator() : IFusionOperator() {}
+
+    FusionOperator getType() const { return LINEAR; }
+
+   private:
+    void computeFusion(ResponseCurve &response, WeightFunction &weight,
+                       const std::vector<FrameEnhanced> &frames,
+                       pfs::Frame &frame);
+};
+
+//! \brief Merge RAW brackets photosite by photosite, before demosaicing.
+//! \a exposures are relative, as FrameEnhanced::averageLuminance(). All the
+//! frames must have the same size and colour filter array; white balance and
+//! colour matrix of \a out are those of the first frame
+void mergeBayerFrames(const std::vector<pfs::BayerFrame> &frames,
+                      const std::vector<float> &exposures,
+                      pfs::BayerFrame &out);
+
+}  // fusion
+}  // libhdr
+
+#endif  // LIBHDR_FUSION_LINEAR_H
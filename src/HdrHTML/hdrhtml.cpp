@@ -27,7 +27,9 @@
 
 #include <QtGlobal>
 #include "hdrhtml.h"
+#include "hdrhtmlbasis.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
@@ -39,6 +41,7 @@
 #include <vector>
 
 #include "Libpfs/exception.h"
+#include "opthelper.h"
 
 #if defined(Q_OS_WIN) || defined(Q_OS_MACOS)
 #include <QCoreApplication>
@@ -46,7 +49,11 @@
 #include "HdrHTML/hdrhtml-path.hxx"
 
 #include <QImage>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QString>
+#include <QThread>
+#include <QThreadPool>
 
 using namespace std;
 
@@ -93,6 +100,9 @@ class Histogram {
             min_val = numeric_limits<T>::max();
             max_val = numeric_limits<T>::min();
 
+#ifdef _OPENMP
+#pragma omp parallel for reduction(min : min_val) reduction(max : max_val)
+#endif
             for (size_t k = 0; k < d_size; k++) {
                 if (data[k] > max_val) max_val = data[k];
                 if (data[k] < min_val) min_val = data[k];
@@ -113,28 +123,32 @@ class Histogram {
             n[k] = 0;
         }
 
-        if (reject_outofrange) {
-            for (size_t k = 0; k < d_size; k++) {
-                int ind = floor((data[k] - min_val) / (max_val - min_val) *
-                                (float)bins);
-                if (ind < 0) continue;
-                if (ind >= bins) continue;
-                n[ind]++;
-            }
-        } else {
+        // counted by each thread, then merged
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            vector<size_t> n_thr(bins, 0);
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
             for (size_t k = 0; k < d_size; k++) {
                 int ind = floor((data[k] - min_val) / (max_val - min_val) *
                                 (float)bins);
                 if (ind < 0) {
-                    n[0]++;
+                    if (!reject_outofrange) n_thr[0]++;
                     continue;
                 }
                 if (ind >= bins) {
-                    n[bins - 1]++;
+                    if (!reject_outofrange) n_thr[bins - 1]++;
                     continue;
                 }
-                n[ind]++;
+                n_thr[ind]++;
             }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            for (int k = 0; k < bins; k++) n[k] += n_thr[k];
         }
     }
 };
@@ -143,80 +157,6 @@ class Histogram {
 //                  Lookup table
 // ================================================
 
-/**
- * Lookup table on a uniform array & interpolation
- *
- * x_i must be at least two elements
- * y_i must be initialized after creating an object
- */
-class UniformArrayLUT {
-   public:
-    float *y_i;
-
-    UniformArrayLUT(size_t lut_size, const float *x_i, float *y_i = NULL)
-        : y_i(NULL), x_i(x_i), lut_size(lut_size), delta(x_i[1] - x_i[0]) {
-        if (y_i == NULL) {
-            this->y_i = new float[lut_size];
-            own_y_i = true;
-        } else {
-            this->y_i = y_i;
-            own_y_i = false;
-        }
-    }
-
-    UniformArrayLUT() : y_i(NULL), x_i(0), lut_size(0), delta(0.), own_y_i(false) {}
-
-    UniformArrayLUT(const UniformArrayLUT &other)
-        : y_i(NULL),
-          x_i(other.x_i),
-          lut_size(other.lut_size),
-          delta(other.delta) {
-        this->y_i = new float[lut_size];
-        own_y_i = true;
-        memcpy(this->y_i, other.y_i, lut_size * sizeof(float));
-    }
-
-    UniformArrayLUT &operator=(const UniformArrayLUT &other) {
-        if (this != &other) {
-            this->lut_size = other.lut_size;
-            this->delta = other.delta;
-            this->x_i = other.x_i;
-            this->y_i = new float[lut_size];
-            own_y_i = true;
-            memcpy(this->y_i, other.y_i, lut_size * sizeof(float));
-        }
-        return *this;
-    }
-
-    ~UniformArrayLUT() {
-        if (own_y_i) delete[] y_i;
-    }
-
-    float interp(float x) {
-        const float ind_f = (x - x_i[0]) / delta;
-        const size_t ind_low = (size_t)(ind_f);
-        const size_t ind_hi = (size_t)ceil(ind_f);
-
-        if ((ind_f < 0))  // Out of range checks
-            return y_i[0];
-        if ((ind_hi >= lut_size)) return y_i[lut_size - 1];
-
-        if ((ind_low == ind_hi))
-            return y_i[ind_low];  // No interpolation necessary
-
-        return y_i[ind_low] +
-               (y_i[ind_hi] - y_i[ind_low]) *
-                   (ind_f - (float)ind_low);  // Interpolation
-    }
-
-   private:
-    const float *x_i;
-    size_t lut_size;
-    float delta;
-
-    bool own_y_i;
-};
-
 template <class T>
 inline T clamp(T x, T min, T max) {
     if (x < min) return min;
@@ -575,6 +515,125 @@ class CSVTable {
     }
 };
 
+// ================================================
+//                 Basis images
+// ================================================
+
+void compute_basis_images(const float *R, const float *G, const float *B,
+                          int pixels, float exp_multip,
+                          const float *const *basis_table, int lut_size,
+                          int max_basis,
+                          vector<vector<unsigned char> > &images) {
+    const float max_value = (float)numeric_limits<unsigned char>::max();
+    const float x_0 = basis_table[0][0];
+    const float delta = basis_table[0][1] - basis_table[0][0];
+    const float max_ind = (float)(lut_size - 1);
+
+    // value and slope of every basis tone-curve at every node, the curves
+    // at the same node next to each other
+    vector<float> lut(2 * lut_size * max_basis);
+    for (int i = 0; i < lut_size; i++) {
+        for (int b = 0; b < max_basis; b++) {
+            const float *y_i = basis_table[b + 1];
+            lut[(i * max_basis + b) * 2] = y_i[i];
+            lut[(i * max_basis + b) * 2 + 1] =
+                (i + 1 < lut_size) ? y_i[i + 1] - y_i[i] : 0.f;
+        }
+    }
+
+    vector<unsigned char *> out(max_basis);
+    for (int b = 0; b < max_basis; b++) out[b] = images[b].data();
+
+    const float *channels[] = {R, G, B};
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        int ind[4] ALIGNED16;
+        float frac[4] ALIGNED16;
+#ifdef __SSE2__
+        const vfloat expv = F2V(exp_multip);
+        const vfloat x_0v = F2V(x_0);
+        const vfloat deltav = F2V(delta);
+        const vfloat max_indv = F2V(max_ind);
+#endif
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int pix = 0; pix < pixels; pix += 4) {
+            const int count = min(4, pixels - pix);
+            for (int c = 0; c < 3; c++) {
+                const float *x = channels[c] + pix;
+#ifdef __SSE2__
+                if (count == 4) {
+                    // same operations as UniformArrayLUT::interp(), clamped
+                    const vfloat ind_f = vminf(
+                        vmaxf((LVFU(x[0]) + expv - x_0v) / deltav, ZEROV),
+                        max_indv);
+                    const vint ind_low = _mm_cvttps_epi32(ind_f);
+                    _mm_store_si128(reinterpret_cast<vint *>(ind), ind_low);
+                    _mm_store_ps(frac, ind_f - _mm_cvtepi32_ps(ind_low));
+                } else
+#endif
+                {
+                    for (int p = 0; p < count; p++) {
+                        const float exposure_comp_v = x[p] + exp_multip;
+                        const float ind_f =
+                            clamp((exposure_comp_v - x_0) / delta, 0.f,
+                                  max_ind);
+                        ind[p] = (int)ind_f;
+                        frac[p] = ind_f - (float)ind[p];
+                    }
+                }
+
+                for (int p = 0; p < count; p++) {
+                    const float *node = &lut[ind[p] * max_basis * 2];
+                    const size_t o = (size_t)(pix + p) * 3 + c;
+                    for (int b = 0; b < max_basis; b++) {
+                        out[b][o] = (unsigned char)((node[2 * b] +
+                                                     node[2 * b + 1] * frac[p]) *
+                                                    max_value);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Encodes and writes one basis image. Runs on the thread pool of
+ * HDRHTMLSet::add_image() and gives its buffer back to \a free_buffers
+ * when done.
+ */
+class BasisImageWriter : public QRunnable {
+   public:
+    BasisImageWriter(vector<unsigned char> &buffer, int width, int height,
+                     const string &file_name, QSemaphore &free_buffers)
+        : width(width),
+          height(height),
+          file_name(file_name),
+          free_buffers(free_buffers) {
+        this->buffer.swap(buffer);
+    }
+
+    void run() {
+        QImage image(buffer.data(), width, height, width * 3,
+                     QImage::Format_RGB888);
+        image.save(QString::fromStdString(file_name));
+
+        vector<unsigned char>().swap(buffer);
+        free_buffers.release();
+    }
+
+   private:
+    vector<unsigned char> buffer;
+    int width, height;
+    string file_name;
+    QSemaphore &free_buffers;
+};
+
 // ================================================
 //                 HDR HTML code
 // ================================================
@@ -623,6 +682,9 @@ void HDRHTMLSet::add_image(int width, int height, float *R, float *G, float *B,
             float *x = arrays[k];
             float min_val = numeric_limits<float>::max(),
                   max_val = numeric_limits<float>::min();
+#ifdef _OPENMP
+#pragma omp parallel for reduction(min : min_val) reduction(max : max_val)
+#endif
             for (int i = 0; i < pixels; i++) {
                 if (x[i] < min_val && x[i] > 0) min_val = x[i];
                 if (x[i] > max_val) max_val = x[i];
@@ -630,6 +692,9 @@ void HDRHTMLSet::add_image(int width, int height, float *R, float *G, float *B,
             img_max = max(img_max, log2f(max_val));
             img_min = min(img_min, log2f(min_val));
 
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
             for (int i = 0; i < pixels; i++) {
                 if (x[i] < min_val)
                     x[i] = log2f(min_val);
@@ -700,7 +765,7 @@ void HDRHTMLSet::add_image(int width, int height, float *R, float *G, float *B,
         // imwrite( hist_img, plot_name );
 
         QImage hist_image(hist_buffer_c, hist_width, hist_height,
-                          QImage::Format_RGB888);
+                          hist_width * 3, QImage::Format_RGB888);
         ostringstream img_filename;
         if (out_dir != NULL) img_filename << out_dir << "/";
         if (image_dir != NULL) img_filename << image_dir << "/";
@@ -713,16 +778,16 @@ void HDRHTMLSet::add_image(int width, int height, float *R, float *G, float *B,
         delete[] hist_buffer;
     }
 
-    // generate basis images
+    // generate basis images: each 8-fstop segment is computed in one pass,
+    // then its images are encoded and written concurrently while the next
+    // segments are computed. Every image waiting to be written holds a
+    // buffer of pixels*3 bytes: their number is bounded.
+    const int threads = max(1, QThread::idealThreadCount());
+    QThreadPool writers;
+    writers.setMaxThreadCount(threads);
+    QSemaphore free_buffers(basis_no + threads);
 
-    // unsigned short *imgBuffer =
-    // new unsigned short[pixels*3];
-    vector<float> imgBuffer(pixels * 3);
-    vector<unsigned char> imgBuffer_c(pixels * 3);
     for (int k = 1; k <= f8_stops + 1; k++) {
-        float max_value =
-            (float)numeric_limits<unsigned char>::max();  //(1<<16) -1;
-
         float exp_multip = log2f(1 / powf(2, l_start + k * 8));
 
         int max_basis = basis_no;
@@ -731,30 +796,13 @@ void HDRHTMLSet::add_image(int width, int height, float *R, float *G, float *B,
                 1)  // Do only one shared basis for the last 8-fstop segment
             max_basis = 1;
 
-        for (int b = 0; b < max_basis; b++) {
-            UniformArrayLUT basis_lut(basis_table.rows, basis_table.data[0],
-                                      basis_table.data[b + 1]);
-
-            int i = 0;
-            for (int pix = 0; pix < pixels; pix++) {
-                float rgb[3];
-                rgb[0] = R[pix];
-                rgb[1] = G[pix];
-                rgb[2] = B[pix];
-
-                for (int c = 0; c < 3; c++) {
-                    float exposure_comp_v = rgb[c] + exp_multip;
-                    float v = (basis_lut.interp(exposure_comp_v) * max_value);
-                    imgBuffer[i++] = v;
-                }
-            }
-            for (int pix = 0; pix < pixels * 3; pix++) {
-                float r = imgBuffer[pix];
-                imgBuffer_c[pix] = (unsigned char)r;
-            }
-            QImage imImage(imgBuffer_c.data(), width, height,
-                           QImage::Format_RGB888);
+        free_buffers.acquire(max_basis);
+        vector<vector<unsigned char> > images(
+            max_basis, vector<unsigned char>((size_t)pixels * 3));
+        compute_basis_images(R, G, B, pixels, exp_multip, basis_table.data,
+                             basis_table.rows, max_basis, images);
 
+        for (int b = 0; b < max_basis; b++) {
             ostringstream img_filename;
             if (out_dir != NULL) img_filename << out_dir << "/";
             if (image_dir != NULL) img_filename << image_dir << "/";
@@ -762,9 +810,12 @@ void HDRHTMLSet::add_image(int width, int height, float *R, float *G, float *B,
             if (verbose)
                 cout << QObject::tr("Writing: ").toStdString()
                      << img_filename.str() << endl;
-            imImage.save(QString::fromStdString(img_filename.str()));
+            writers.start(new BasisImageWriter(images[b], width, height,
+                                               img_filename.str(),
+                                               free_buffers));
         }
     }
+    writers.waitForDone();
 
     HDRHTMLImage new_image(base_name, width, height);
 
@@ -0,0 +1,130 @@
+/**
+ * @brief Basis images of the HDR viewer web page
+ *
+ * This file is a part of LuminanceHDR package, based on pfstools.
+ * ----------------------------------------------------------------------
+ * Copyright (C) 2009 Rafal Mantiuk
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ * @author Rafal Mantiuk, <mantiuk@mpi-sb.mpg.de>
+ */
+
+#ifndef HDRHTMLBASIS_H
+#define HDRHTMLBASIS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace hdrhtml {
+
+/**
+ * Lookup table on a uniform array & interpolation
+ *
+ * x_i must be at least two elements
+ * y_i must be initialized after creating an object
+ */
+class UniformArrayLUT {
+   public:
+    float *y_i;
+
+    UniformArrayLUT(size_t lut_size, const float *x_i, float *y_i = NULL)
+        : y_i(NULL), x_i(x_i), lut_size(lut_size), delta(x_i[1] - x_i[0]) {
+        if (y_i == NULL) {
+            this->y_i = new float[lut_size];
+            own_y_i = true;
+        } else {
+            this->y_i = y_i;
+            own_y_i = false;
+        }
+    }
+
+    UniformArrayLUT() : y_i(NULL), x_i(0), lut_size(0), delta(0.), own_y_i(false) {}
+
+    UniformArrayLUT(const UniformArrayLUT &other)
+        : y_i(NULL),
+          x_i(other.x_i),
+          lut_size(other.lut_size),
+          delta(other.delta) {
+        this->y_i = new float[lut_size];
+        own_y_i = true;
+        std::memcpy(this->y_i, other.y_i, lut_size * sizeof(float));
+    }
+
+    UniformArrayLUT &operator=(const UniformArrayLUT &other) {
+        if (this != &other) {
+            this->lut_size = other.lut_size;
+            this->delta = other.delta;
+            this->x_i = other.x_i;
+            this->y_i = new float[lut_size];
+            own_y_i = true;
+            std::memcpy(this->y_i, other.y_i, lut_size * sizeof(float));
+        }
+        return *this;
+    }
+
+    ~UniformArrayLUT() {
+        if (own_y_i) delete[] y_i;
+    }
+
+    float interp(float x) {
+        const float ind_f = (x - x_i[0]) / delta;
+        const size_t ind_low = (size_t)(ind_f);
+        const size_t ind_hi = (size_t)std::ceil(ind_f);
+
+        if ((ind_f < 0))  // Out of range checks
+            return y_i[0];
+        if ((ind_hi >= lut_size)) return y_i[lut_size - 1];
+
+        if ((ind_low == ind_hi))
+            return y_i[ind_low];  // No interpolation necessary
+
+        return y_i[ind_low] +
+               (y_i[ind_hi] - y_i[ind_low]) *
+                   (ind_f - (float)ind_low);  // Interpolation
+    }
+
+   private:
+    const float *x_i;
+    size_t lut_size;
+    float delta;
+
+    bool own_y_i;
+};
+
+/**
+ * Computes all basis images of one 8 f-stop segment in a single pass
+ * over the pixels. The basis tone-curves share their input nodes, so
+ * the position of a sample in the lookup table is found once for all of
+ * them. Gives the same result as one UniformArrayLUT::interp() per
+ * basis image.
+ *
+ * @param R, G, B log2 of the pixel values
+ * @param exp_multip exposure compensation of the segment (log2)
+ * @param basis_table lut_size nodes (first column), then the max_basis
+ *        tone-curves of the basis, one column each
+ * @param images max_basis RGB888 buffers of pixels*3 bytes
+ */
+void compute_basis_images(const float *R, const float *G, const float *B,
+                          int pixels, float exp_multip,
+                          const float *const *basis_table, int lut_size,
+                          int max_basis,
+                          std::vector<std::vector<unsigned char> > &images);
+}
+
+#endif
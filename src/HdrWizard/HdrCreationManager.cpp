@@ -46,6 +46,7 @@
 #include <vector>
 
 #include <Common/CommonFunctions.h>
+#include <Core/IOWorker.h>
 #include <Libpfs/colorspace/colorspace.h>
 #include <Libpfs/colorspace/convert.h>
 #include <Libpfs/colorspace/normalizer.h>
@@ -54,15 +55,18 @@
 #include <Libpfs/io/framereaderfactory.h>
 #include <Libpfs/io/framewriter.h>
 #include <Libpfs/io/framewriterfactory.h>
+#include <Libpfs/io/rawreader.h>
 #include <Libpfs/io/tiffreader.h>
 #include <Libpfs/io/tiffwriter.h>
 #include <Libpfs/manip/copy.h>
 #include <Libpfs/manip/cut.h>
+#include <Libpfs/manip/demosaic.h>
 #include <Libpfs/manip/shift.h>
 #include <Libpfs/utils/msec_timer.h>
 #include <Libpfs/utils/transform.h>
 
 #include <Exif/ExifOperations.h>
+#include <HdrCreation/linear.h>
 #include <HdrCreation/mtb_alignment.h>
 #include <HdrWizard/WhiteBalance.h>
 #include <TonemappingOperators/fattal02/pde.h>
@@ -114,6 +118,37 @@ void shiftItem(HdrCreationItem &item, int dx, int dy) {
     item.qimage().swap(*img);
     img.reset();  // release memory
 }
+
+struct BayerItem {
+    BayerItem(const QString &filename, pfs::BayerFrame *bayer)
+        : filename(filename), bayer(bayer), valid(false) {}
+
+    QString filename;
+    pfs::BayerFrame *bayer;
+    bool valid;
+};
+
+struct LoadBayer {
+    explicit LoadBayer(const pfs::Params &params) : m_params(params) {}
+
+    void operator()(BayerItem &item) const {
+        try {
+            FrameReaderPtr reader = FrameReaderFactory::open(
+                QFile::encodeName(item.filename).constData());
+            RAWReader *rawReader = dynamic_cast<RAWReader *>(reader.get());
+            if (rawReader) {
+                rawReader->readBayer(*item.bayer, m_params);
+                item.valid = true;
+            }
+        } catch (std::exception &err) {
+            qDebug() << QStringLiteral("LoadBayer: Cannot load %1: %2")
+                            .arg(item.filename,
+                                 QString::fromStdString(err.what()));
+        }
+    }
+
+    pfs::Params m_params;
+};
 }
 
 static bool checkFileName(const HdrCreationItem &item, const QString &str) {
@@ -274,6 +309,7 @@ HdrCreationManager::HdrCreationManager(bool fromCommandLine)
       m_align(),
       m_ais_crop_flag(false),
       fromCommandLine(fromCommandLine),
+      m_isDataEdited(false),
       m_isLoadResponseCurve(false) {
     // setConfig(predef_confs[0]);
     setFusionOperator(predef_confs[0].fusionOperator);
@@ -339,6 +375,7 @@ void HdrCreationManager::align_with_mtb() {
 
     // run MTB
     libhdr::mtb_alignment(frames);
+    m_isDataEdited = true;
 
     // rebuild previews
     QFutureWatcher<void> futureWatcher;
@@ -355,6 +392,7 @@ void HdrCreationManager::set_ais_crop_flag(bool flag) {
 }
 
 void HdrCreationManager::align_with_ais() {
+    m_isDataEdited = true;
     m_align.reset(new Align(m_data, fromCommandLine, 1));
     connect(m_align.get(), &Align::finishedAligning, this,
             &HdrCreationManager::finishedAligning);
@@ -374,6 +412,16 @@ void HdrCreationManager::ais_failed_slot(QProcess::ProcessError error) {
 }
 
 pfs::Frame *HdrCreationManager::createHdr() {
+    if (m_fusionOperator == LINEAR && !m_isDataEdited) {
+        pfs::Frame *outputFrame = createHdrFromBayer();
+        if (outputFrame) {
+            return outputFrame;
+        }
+    }
+    return createHdrFromFrames();
+}
+
+pfs::Frame *HdrCreationManager::createHdrFromFrames() {
     std::vector<FrameEnhanced> frames;
 
     for (size_t idx = 0; idx < m_data.size(); ++idx) {
@@ -395,6 +443,47 @@ pfs::Frame *HdrCreationManager::createHdr() {
     return outputFrame;
 }
 
+pfs::Frame *HdrCreationManager::createHdrFromBayer() {
+    std::vector<pfs::BayerFrame> bayers(m_data.size());
+    std::vector<BayerItem> items;
+    for (size_t idx = 0; idx < m_data.size(); ++idx) {
+        items.push_back(BayerItem(m_data[idx].filename(), &bayers[idx]));
+    }
+
+    // one LibRaw instance per bracket, unpacked concurrently
+    QtConcurrent::blockingMap(items, LoadBayer(getRawSettings()));
+
+    const size_t W = m_data[0].frame()->getWidth();
+    const size_t H = m_data[0].frame()->getHeight();
+    std::vector<float> exposures;
+    for (size_t idx = 0; idx < items.size(); ++idx) {
+        // the demosaiced frames must cover the same pixels: rotated Fuji
+        // sensors or half-size decoding take the usual path
+        if (!items[idx].valid || bayers[idx].data.getCols() != W ||
+            bayers[idx].data.getRows() != H) {
+            qDebug() << "HdrCreationManager::createHdrFromBayer(): "
+                        "not a Bayer RAW set, merging the decoded frames";
+            return NULL;
+        }
+        exposures.push_back(std::pow(2.f, m_data[idx].getEV() - m_evOffset));
+    }
+
+    try {
+        pfs::BayerFrame merged;
+        mergeBayerFrames(bayers, exposures, merged);
+        bayers.clear();
+
+        pfs::Frame *outputFrame = new pfs::Frame;
+        pfs::demosaic(merged, *outputFrame);
+        return outputFrame;
+    } catch (std::runtime_error &err) {
+        qDebug() << QStringLiteral(
+                        "HdrCreationManager::createHdrFromBayer(): %1")
+                        .arg(QString::fromStdString(err.what()));
+    }
+    return NULL;
+}
+
 void HdrCreationManager::applyShiftsToItems(
     const QList<QPair<int, int>> &hvOffsets) {
     int size = m_data.size();
@@ -405,10 +494,12 @@ void HdrCreationManager::applyShiftsToItems(
             continue;
         }
         shiftItem(m_data[i], hvOffsets[i].first, hvOffsets[i].second);
+        m_isDataEdited = true;
     }
 }
 
 void HdrCreationManager::cropItems(const QRect &ca) {
+    m_isDataEdited = true;
     // crop all frames and images
     int size = m_data.size();
     for (int idx = 0; idx < size; idx++) {
@@ -560,7 +651,9 @@ pfs::Frame *HdrCreationManager::doAntiGhosting(bool patches[][agGridSize],
 
     const Channel *Rc, *Gc, *Bc;
     Channel *Ch[3];
-    std::unique_ptr<Frame> ghosted(createHdr());
+    // the patches are blended against the decoded frames: the HDR must be
+    // merged from the same frames
+    std::unique_ptr<Frame> ghosted(createHdrFromFrames());
     ghosted->getXYZChannels(Ch[0], Ch[1], Ch[2]);
 
     for (int c = 0; c < 3; c++) {
@@ -840,4 +933,5 @@ void HdrCreationManager::reset() {
                &HdrCreationManager::loadFilesDone);
     m_data.clear();
     m_tmpdata.clear();
+    m_isDataEdited = false;
 }
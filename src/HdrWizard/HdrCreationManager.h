@@ -70,6 +70,7 @@ class HdrCreationManager : public QObject {
     void clearFiles() {
         m_data.clear();
         m_tmpdata.clear();
+        m_isDataEdited = false;
     }
     size_t availableInputFiles() const { return m_data.size(); }
 
@@ -120,6 +121,9 @@ class HdrCreationManager : public QObject {
 
     void setConfig(const FusionOperatorConfig &cfg);
 
+    //! \brief merge the input files with the current fusion operator. With
+    //! \c LINEAR, RAW files that have not been aligned or cropped are merged
+    //! from their sensor data and demosaiced once
     pfs::Frame *createHdr();
 
     void set_ais_crop_flag(bool flag);
@@ -177,6 +181,11 @@ class HdrCreationManager : public QObject {
    private:
     bool framesHaveSameSize();
     void refreshEVOffset();
+    //! \brief linear merge of the Bayer data of the RAW input files,
+    //! NULL if some of them cannot take this path
+    pfs::Frame *createHdrFromBayer();
+    //! \brief merge of the decoded frames, as they are in m_data
+    pfs::Frame *createHdrFromFrames();
 
     float m_evOffset;
 
@@ -197,6 +206,10 @@ class HdrCreationManager : public QObject {
 
     bool m_ais_crop_flag;
     bool fromCommandLine;
+    //! \brief frames no longer match their files (aligned, shifted, cropped).
+    //! Removing or adding files keeps it: the frames already there stay
+    //! edited. Only clearFiles() and reset() clear it.
+    bool m_isDataEdited;
     int m_agGoodImageIndex;
     bool m_patches[agGridSize][agGridSize];
     bool m_isLoadResponseCurve;
@@ -69,7 +69,7 @@ static const ResponseCurveType responses_in_gui[] = {
 };
 
 static const FusionOperator models_in_gui[] = {DEBEVEC, ROBERTSON,
-                                               ROBERTSON_AUTO};
+                                               ROBERTSON_AUTO, LINEAR};
 
 static const WeightFunctionType weights_in_gui[] = {
     WEIGHT_TRIANGULAR, WEIGHT_GAUSSIAN, WEIGHT_PLATEAU, WEIGHT_FLAT};
@@ -37,6 +37,7 @@
 #include <map>
 
 #include "Libpfs/array2d.h"
+#include "Libpfs/frame.h"
 #include "Libpfs/pfs.h"
 #include "Libpfs/utils/msec_timer.h"
 
@@ -304,4 +305,13 @@ void transformColorSpace(ColorSpace inCS, const Array2Df *inC1,
     // CSTransformFunc func =
     (itTransform->second)(inC1, inC2, inC3, outC1, outC2, outC3);
 }
+
+void transformColorSpace(ColorSpace inCS, ColorSpace outCS, Frame &frame) {
+    Channel *X, *Y, *Z;
+    frame.getXYZChannels(X, Y, Z);
+    if (!X || !Y || !Z) {
+        throw Exception("Missing X, Y, Z channels in the PFS stream");
+    }
+    transformColorSpace(inCS, X, Y, Z, outCS, X, Y, Z);
+}
 }  // namespace pfs
@@ -38,6 +38,8 @@
 
 namespace pfs {
 
+class Frame;
+
 //! This enum is used to specify color spaces for transformColorSpace function
 enum ColorSpace {
     CS_XYZ = 0,  //!< Absolute XYZ space, reference white - D65, Y is calibrated
@@ -116,6 +118,13 @@ void transformColorSpace(ColorSpace inCS, const Array2Df *inC1,
                          const Array2Df *inC2, const Array2Df *inC3,
                          ColorSpace outCS, Array2Df *outC1, Array2Df *outC2,
                          Array2Df *outC3);
+
+//! \brief Transform the X, Y and Z channels of \a frame from one color space
+//! into another, in place. The statistics and the pyramid of the frame are
+//! dropped (see Frame::invalidateCaches()).
+//!
+//! \throw pfs::Exception if the frame has no X, Y and Z channels
+void transformColorSpace(ColorSpace inCS, ColorSpace outCS, Frame &frame);
 }
 
 #endif  // COLORSPACE_H
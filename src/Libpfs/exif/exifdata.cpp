@@ -20,11 +20,16 @@
  */
 
 #include "exifdata.hpp"
+#include "filecache.h"
 
 #include <cmath>
 #include <exiv2/exiv2.hpp>
 #include <iostream>
 
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
 namespace pfs {
 namespace exif {
 
@@ -43,6 +48,24 @@ const float DEFAULT_EVCOMP = 0.0f;
 float log_base(float value, float base) {
     return (std::log(value) / std::log(base));
 }
+
+bool getFileStamp(const std::string &filename, FileStamp &stamp) {
+    QFileInfo info(QFile::decodeName(filename.c_str()));
+    if (!info.isFile()) {
+        return false;
+    }
+    stamp.m_size = info.size();
+    stamp.m_modified = info.lastModified().toMSecsSinceEpoch();
+    return true;
+}
+
+//! \brief Exif data of the files parsed last, so that loading, alignment and
+//! saving of a set of images read every file once. With their makernotes,
+//! entries take some tens of kB each.
+FileCache<ExifData> &exifCache() {
+    static FileCache<ExifData> cache(256);
+    return cache;
+}
 }
 
 ExifData::ExifData() { reset(); }
@@ -50,6 +73,23 @@ ExifData::ExifData() { reset(); }
 ExifData::ExifData(const std::string &filename) { fromFile(filename); }
 
 void ExifData::fromFile(const std::string &filename) {
+    FileStamp stamp;
+    if (!getFileStamp(filename, stamp)) {
+        parse(filename);
+        return;
+    }
+    FileCache<ExifData> &cache = exifCache();
+    if (!cache.find(filename, stamp, *this)) {
+        parse(filename);
+        cache.insert(filename, stamp, *this);
+    }
+}
+
+void ExifData::forget(const std::string &filename) {
+    exifCache().erase(filename);
+}
+
+void ExifData::parse(const std::string &filename) {
     reset();
     try {
         ::Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(filename);
@@ -59,6 +99,8 @@ void ExifData::fromFile(const std::string &filename) {
         // if data is empty
         if (exifData.empty()) return;
 
+        m_exiv2Data = std::make_shared<const ::Exiv2::ExifData>(exifData);
+
         // Exiv2 iterator in read-only
         ::Exiv2::ExifData::const_iterator it = exifData.end();
         if ((it = exifData.findKey(Exiv2::ExifKey(
@@ -182,6 +224,10 @@ float ExifData::getAverageSceneLuminance() const {
 
 short ExifData::getOrientationDegree() const { return m_orientation; }
 
+const std::shared_ptr<const ::Exiv2::ExifData> &ExifData::getExiv2Data() const {
+    return m_exiv2Data;
+}
+
 void ExifData::reset() {
     // reset internal value
     m_exposureTime = INVALID_VALUE;
@@ -189,6 +235,7 @@ void ExifData::reset() {
     m_FNumber = INVALID_VALUE;
     m_EVCompensation = DEFAULT_EVCOMP;
     m_orientation = 0;
+    m_exiv2Data.reset();
 }
 
 bool ExifData::isValid() const {
@@ -23,9 +23,14 @@
 #define EXIF_DATA_HPP
 
 #include <iosfwd>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
+namespace Exiv2 {
+class ExifData;
+}
+
 namespace pfs {
 //! \namespace Contains all the operations based on EXIF data
 namespace exif {
@@ -44,8 +49,19 @@ class ExifData {
 
     //! \brief read exif data from file
     //! \param[in] filename Name of source file
+    //! \note files are parsed once: the result is kept, and shared with the
+    //! following reads, as long as the size and the modification time of the
+    //! file do not change. Thread safe.
     void fromFile(const std::string& filename);
 
+    //! \brief drop \a filename from the files already parsed. Call it after
+    //! writing the metadata of \a filename.
+    static void forget(const std::string& filename);
+
+    //! \brief all the tags of the file, as parsed by Exiv2, to be copied to
+    //! another file. NULL when the file has none.
+    const std::shared_ptr<const ::Exiv2::ExifData>& getExiv2Data() const;
+
     const float& getExposureTime() const;
     bool hasExposureTime() const;
     void setExposureTime(float et);
@@ -109,11 +125,15 @@ class ExifData {
                                     const ExifData& exifdata);
 
    private:
+    //! \brief parse \a filename with Exiv2
+    void parse(const std::string& filename);
+
     float m_exposureTime;
     float m_isoSpeed;
     float m_FNumber;
     float m_EVCompensation;
     short m_orientation;
+    std::shared_ptr<const ::Exiv2::ExifData> m_exiv2Data;
 };
 
 std::ostream& operator<<(std::ostream& out, const ExifData& exifdata);
@@ -0,0 +1,123 @@
+/*
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ * Copyright (C) 2012 Davide Anastasia
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef EXIF_FILECACHE_H
+#define EXIF_FILECACHE_H
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+namespace pfs {
+namespace exif {
+
+//! \brief identifies one version of a file
+struct FileStamp {
+    int64_t m_size;
+    int64_t m_modified;
+
+    bool operator==(const FileStamp &other) const {
+        return m_size == other.m_size && m_modified == other.m_modified;
+    }
+};
+
+//! \brief values read from the files used last. An entry is dropped when the
+//! stamp of its file changes, and the least recently used one when more than
+//! \c capacity files are kept. Thread safe.
+template <typename Value>
+class FileCache {
+   public:
+    explicit FileCache(size_t capacity) : m_capacity(capacity) {}
+
+    //! \brief copy the value of \a filename to \a value
+    //! \return false when \a filename is not cached, or was cached with
+    //! another stamp
+    bool find(const std::string &filename, const FileStamp &stamp,
+              Value &value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        typename Entries::iterator it = m_entries.find(filename);
+        if (it == m_entries.end()) {
+            return false;
+        }
+        if (!(it->second.m_stamp == stamp)) {
+            m_order.erase(it->second.m_position);
+            m_entries.erase(it);
+            return false;
+        }
+        // most recently used first
+        m_order.splice(m_order.begin(), m_order, it->second.m_position);
+        value = it->second.m_value;
+        return true;
+    }
+
+    void insert(const std::string &filename, const FileStamp &stamp,
+                const Value &value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        eraseEntry(filename);
+        m_order.push_front(filename);
+        Entry entry = {stamp, value, m_order.begin()};
+        m_entries.insert(std::make_pair(filename, entry));
+        if (m_entries.size() > m_capacity) {
+            eraseEntry(m_order.back());
+        }
+    }
+
+    void erase(const std::string &filename) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        eraseEntry(filename);
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+   private:
+    FileCache(const FileCache &);
+    FileCache &operator=(const FileCache &);
+
+    struct Entry {
+        FileStamp m_stamp;
+        Value m_value;
+        std::list<std::string>::iterator m_position;
+    };
+    typedef std::map<std::string, Entry> Entries;
+
+    void eraseEntry(const std::string &filename) {
+        typename Entries::iterator it = m_entries.find(filename);
+        if (it != m_entries.end()) {
+            m_order.erase(it->second.m_position);
+            m_entries.erase(it);
+        }
+    }
+
+    const size_t m_capacity;
+    mutable std::mutex m_mutex;
+    Entries m_entries;
+    std::list<std::string> m_order;
+};
+
+}  // exif
+}  // pfs
+
+#endif  // EXIF_FILECACHE_H
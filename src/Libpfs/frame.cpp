@@ -32,6 +32,7 @@
 
 #include "channel.h"
 #include "frame.h"
+#include "manip/pyramid.h"
 
 using namespace std;
 
@@ -49,6 +50,7 @@ struct ChannelDeleter {
 }
 
 Frame::~Frame() {
+    invalidateCaches();
     for_each(m_channels.begin(), m_channels.end(), ChannelDeleter());
 }
 
@@ -59,6 +61,8 @@ void Frame::resize(size_t width, size_t height) {
 
     m_width = width;
     m_height = height;
+
+    invalidateCaches();
 }
 
 namespace {
@@ -125,6 +129,9 @@ void Frame::getXYZChannels(const Channel *&X, const Channel *&Y,
 }
 
 void Frame::getXYZChannels(Channel *&X, Channel *&Y, Channel *&Z) {
+    // the caller may write into the channels
+    invalidateCaches();
+
     const Channel *X_;
     const Channel *Y_;
     const Channel *Z_;
@@ -152,6 +159,7 @@ const Channel *Frame::getChannel(const string &name) const {
 }
 
 Channel *Frame::getChannel(const string &name) {
+    invalidateCaches();
     return const_cast<Channel *>(
         static_cast<const Frame &>(*this).getChannel(name));
 }
@@ -166,6 +174,8 @@ Channel *Frame::createChannel(const string &name) {
         ch = new Channel(m_width, m_height, name);
         m_channels.push_back(ch);
     }
+    // new or not, the channel is returned for writing
+    invalidateCaches();
 
     // update the cache, if necessary
     if (name == "X") {
@@ -187,6 +197,8 @@ void Frame::removeChannel(const string &channel) {
         m_channels.erase(it);
         delete ch;
 
+        invalidateCaches();
+
         if (channel == "X") {
             m_X = NULL;
         } else if (channel == "Y") {
@@ -197,7 +209,10 @@ void Frame::removeChannel(const string &channel) {
     }
 }
 
-ChannelContainer &Frame::getChannels() { return this->m_channels; }
+ChannelContainer &Frame::getChannels() {
+    invalidateCaches();
+    return this->m_channels;
+}
 
 const ChannelContainer &Frame::getChannels() const { return this->m_channels; }
 
@@ -216,6 +231,17 @@ void Frame::swap(Frame &other) {
     swap(m_X, other.m_X);
     swap(m_Y, other.m_Y);
     swap(m_Z, other.m_Z);
+
+    invalidateCaches();
+    other.invalidateCaches();
+}
+
+std::shared_ptr<FramePyramid> Frame::pyramid() const {
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    if (!m_pyramid) {
+        m_pyramid = std::make_shared<FramePyramid>(*this);
+    }
+    return m_pyramid;
 }
 
 }  // namespace pfs
@@ -31,6 +31,7 @@
 #define PFS_FRAME_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -39,6 +40,10 @@
 
 namespace pfs {
 
+class FramePyramid;  // #include <Libpfs/manip/pyramid.h>
+class FrameStatistics;  // #include <Libpfs/manip/statistics.h>
+class FrameStatisticsCache;
+
 typedef std::vector<Channel *> ChannelContainer;
 
 //! Interface representing a single PFS frame. Frame may contain 0
@@ -70,6 +75,9 @@ class Frame {
     //! \param X [out] a pointer to store X channel in
     //! \param Y [out] a pointer to store Y channel in
     //! \param Z [out] a pointer to store Z channel in
+    //! \note The channels are returned for writing: the caches of the frame
+    //! are dropped (see invalidateCaches()), as by every non-const accessor
+    //! of the channels
     void getXYZChannels(Channel *&X, Channel *&Y, Channel *&Z);
 
     void getXYZChannels(const Channel *&X, const Channel *&Y,
@@ -127,6 +135,30 @@ class Frame {
 
     void swap(Frame &other);
 
+    //! \brief Returns the memoised octave pyramid of this frame, creating an
+    //! empty one on the first call. It is dropped and detached from the
+    //! frame when the frame changes size or channels, when the channels are
+    //! accessed for writing, or when the frame is destroyed.
+    std::shared_ptr<FramePyramid> pyramid() const;
+
+    //! \brief Returns the memoised statistics of this frame. They are dropped
+    //! and detached together with the pyramid (see invalidateCaches()). They
+    //! are never shared with copies of the frame.
+    FrameStatistics statistics() const;
+
+    //! \brief Returns an object identifying the content of the channels: the
+    //! same one is returned until invalidateCaches() is called
+    std::shared_ptr<const void> contentKey() const;
+
+    //! \brief Drops everything computed from the content of the channels,
+    //! and detaches it from this frame. Called by the member functions that
+    //! change the size or the channels, by those that return them for
+    //! writing, and by the destructor.
+    //! \note Do not write through pointers to the channels taken before a
+    //! read of the statistics or of the pyramid: read them first, or take
+    //! the pointers again after the read.
+    void invalidateCaches();
+
    private:
     size_t m_width;
     size_t m_height;
@@ -138,6 +170,10 @@ class Frame {
     Channel *m_X;
     Channel *m_Y;
     Channel *m_Z;
+
+    mutable std::mutex m_cacheMutex;
+    mutable std::shared_ptr<FramePyramid> m_pyramid;
+    mutable std::shared_ptr<FrameStatisticsCache> m_statistics;
 };
 
 typedef std::shared_ptr<pfs::Frame> FramePtr;
@@ -32,6 +32,7 @@
 #include <ImfStandardAttributes.h>
 #include <ImfStringAttribute.h>
 
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -62,6 +63,43 @@ static string escapeString(const string &src) {
 namespace pfs {
 namespace io {
 
+namespace {
+//! \brief point the R, G and B slices of \a frameBuffer at \a X, \a Y and
+//! \a Z, whose first row is row \a y of the data window \a dtw
+void insertRGBSlices(FrameBuffer &frameBuffer, Channel *X, Channel *Y,
+                     Channel *Z, const Box2i &dtw, size_t width, size_t y) {
+    const char *names[] = {"R", "G", "B"};
+    Channel *channels[] = {X, Y, Z};
+    for (int c = 0; c < 3; c++) {
+        frameBuffer.insert(
+            names[c],     // name
+            Slice(FLOAT,  // type
+                  (char *)(channels[c]->data() - dtw.min.x -
+                           (dtw.min.y + ptrdiff_t(y)) * ptrdiff_t(width)),
+                  sizeof(float),          // xStride
+                  sizeof(float) * width,  // yStride
+                  1, 1,                   // x/y sampling
+                  0.0));                  // fillValue
+    }
+}
+
+//! \brief scale \a X, \a Y and \a Z by the WhiteLuminance of \a header
+//! \return false if \a header has no WhiteLuminance
+bool applyWhiteLuminance(const Header &header, Channel *X, Channel *Y,
+                         Channel *Z) {
+    if (!hasWhiteLuminance(header)) return false;
+
+    const float scaleFactor = whiteLuminance(header);
+    const size_t pixelCount = X->size();
+    for (size_t i = 0; i < pixelCount; i++) {
+        (*X)(i) *= scaleFactor;
+        (*Y)(i) *= scaleFactor;
+        (*Z)(i) *= scaleFactor;
+    }
+    return true;
+}
+}
+
 class EXRReader::EXRReaderData {
    public:
     explicit EXRReaderData(const string &filename)
@@ -147,32 +185,7 @@ void EXRReader::read(Frame &frame, const Params & /*params*/) {
     tempFrame.createXYZChannels(X, Y, Z);
 
     FrameBuffer frameBuffer;
-    frameBuffer.insert(
-        "R",          // name
-        Slice(FLOAT,  // type
-              (char *)(X->data() - dtw.min.x - dtw.min.y * width()),
-              sizeof(float),            // xStride
-              sizeof(float) * width(),  // yStride
-              1, 1,                     // x/y sampling
-              0.0));                    // fillValue
-
-    frameBuffer.insert(
-        "G",          // name
-        Slice(FLOAT,  // type
-              (char *)(Y->data() - dtw.min.x - dtw.min.y * width()),
-              sizeof(float),            // xStride
-              sizeof(float) * width(),  // yStride
-              1, 1,                     // x/y sampling
-              0.0));                    // fillValue
-
-    frameBuffer.insert(
-        "B",          // name
-        Slice(FLOAT,  // type
-              (char *)(Z->data() - dtw.min.x - dtw.min.y * width()),
-              sizeof(float),            // xStride
-              sizeof(float) * width(),  // yStride
-              1, 1,                     // x/y sampling
-              0.0));                    // fillValue
+    insertRGBSlices(frameBuffer, X, Y, Z, dtw, width(), 0);
 
     // I know I have the channels I need because I have checked that I have the
     // RGB channels. Hence, I don't load any further that that...
@@ -237,15 +250,7 @@ void EXRReader::read(Frame &frame, const Params & /*params*/) {
     file.readPixels(dtw.min.y, dtw.max.y);
 
     // Rescale values if WhiteLuminance is present
-    if (hasWhiteLuminance(file.header())) {
-        float scaleFactor = whiteLuminance(file.header());
-        int pixelCount = tempFrame.getHeight() * tempFrame.getWidth();
-
-        for (int i = 0; i < pixelCount; i++) {
-            (*X)(i) *= scaleFactor;
-            (*Y)(i) *= scaleFactor;
-            (*Z)(i) *= scaleFactor;
-        }
+    if (applyWhiteLuminance(file.header(), X, Y, Z)) {
 
         // const StringAttribute *relativeLum =
         // file.header().findTypedAttribute<StringAttribute>("RELATIVE_LUMINANCE");
@@ -261,5 +266,33 @@ void EXRReader::read(Frame &frame, const Params & /*params*/) {
     frame.swap(tempFrame);
 }
 
+void EXRReader::readRows(Frame &frame, size_t y, size_t rows,
+                         const Params & /*params*/) {
+    if (!isOpen()) open();
+
+    if (y + rows > height()) {
+        throw pfs::io::ReadException("Rows out of the image in " +
+                                     filename());
+    }
+
+    InputFile &file = m_data->file_;
+    const Box2i &dtw = m_data->dtw_;
+
+    pfs::Frame tempFrame(width(), rows);
+    pfs::Channel *X, *Y, *Z;
+    tempFrame.createXYZChannels(X, Y, Z);
+
+    FrameBuffer frameBuffer;
+    insertRGBSlices(frameBuffer, X, Y, Z, dtw, width(), y);
+
+    // scanlines are read independently of each other
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dtw.min.y + y, dtw.min.y + y + rows - 1);
+
+    applyWhiteLuminance(file.header(), X, Y, Z);
+
+    frame.swap(tempFrame);
+}
+
 }  // io
 }  // pfs
@@ -38,6 +38,9 @@ class EXRReader : public FrameReader {
     void open();
     void read(Frame &frame, const Params &params);
 
+    bool readsRows() const { return true; }
+    void readRows(Frame &frame, size_t y, size_t rows, const Params &params);
+
    protected:
     class EXRReaderData;
 
@@ -21,6 +21,13 @@
 
 #include <Libpfs/io/fitsreader.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+
 #include <boost/algorithm/minmax_element.hpp>
 
 #include <boost/bind.hpp>
@@ -28,7 +35,9 @@
 
 #include <Libpfs/colorspace/normalizer.h>
 #include <Libpfs/frame.h>
+#include "opthelper.h"
 
+#include <QFile>
 #include <qglobal.h>
 // include windows.h to avoid TBYTE define clashes with fitsio.h
 #ifdef Q_OS_WIN
@@ -48,11 +57,19 @@ namespace io {
 class FitsReaderData {
    public:
     FitsReaderData()
-        : m_format(0), m_status(0), m_bscale(1.f), m_bzero(0.f), m_ptr(NULL) {}
+        : m_format(0),
+          m_status(0),
+          m_bscale(1.f),
+          m_bzero(0.f),
+          m_compressed(true),
+          m_dataOffset(-1),
+          m_ptr(NULL) {}
 
     ~FitsReaderData() {
         if (m_ptr != NULL) {
-            fits_close_file(m_ptr, &m_status);
+            // cfitsio does nothing when it is handed an error status
+            int status = 0;
+            fits_close_file(m_ptr, &status);
         }
     }
 
@@ -61,9 +78,299 @@ class FitsReaderData {
     float m_bscale;
     float m_bzero;
 
+    //! \brief tile compressed image: only cfitsio can decode it
+    bool m_compressed;
+    //! \brief offset in bytes of the data unit in the file, -1 when unknown
+    LONGLONG m_dataOffset;
+
     fitsfile *m_ptr;
 };
 
+namespace {
+
+//! \brief rows handed to cfitsio by each read call
+const size_t s_bandRows = 64;
+
+inline uint16_t swapBytes(uint16_t v) { return uint16_t((v << 8) | (v >> 8)); }
+
+inline uint32_t swapBytes(uint32_t v) {
+    return (v << 24) | ((v << 8) & 0x00ff0000u) | ((v >> 8) & 0x0000ff00u) |
+           (v >> 24);
+}
+
+inline uint64_t swapBytes(uint64_t v) {
+    return (uint64_t(swapBytes(uint32_t(v))) << 32) |
+           swapBytes(uint32_t(v >> 32));
+}
+
+//! \brief FITS samples are stored big endian, whatever the machine
+template <typename T>
+inline T loadSample(const uchar *p);
+
+template <>
+inline uint8_t loadSample<uint8_t>(const uchar *p) {
+    return *p;
+}
+
+template <>
+inline int16_t loadSample<int16_t>(const uchar *p) {
+    return int16_t((uint16_t(p[0]) << 8) | p[1]);
+}
+
+template <>
+inline int32_t loadSample<int32_t>(const uchar *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    v = swapBytes(v);
+#endif
+    return int32_t(v);
+}
+
+template <>
+inline int64_t loadSample<int64_t>(const uchar *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    v = swapBytes(v);
+#endif
+    return int64_t(v);
+}
+
+template <>
+inline float loadSample<float>(const uchar *p) {
+    const uint32_t v = uint32_t(loadSample<int32_t>(p));
+    float f;
+    std::memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+template <>
+inline double loadSample<double>(const uchar *p) {
+    const uint64_t v = uint64_t(loadSample<int64_t>(p));
+    double d;
+    std::memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+//! \brief reverse the bytes of every 16 bit lane
+inline vint swapBytes16(vint v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+//! \brief reverse the bytes of every 32 bit lane
+inline vint swapBytes32(vint v) {
+    v = swapBytes16(v);
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)),
+                               _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+inline void storeSamples(vfloat v, vfloat scale, vfloat zero, float *x,
+                         float *y, float *z) {
+    v = _mm_add_ps(_mm_mul_ps(v, scale), zero);
+    STVFU(x[0], v);
+    STVFU(y[0], v);
+    STVFU(z[0], v);
+}
+
+//! \brief decode the leading samples of a row of \a width samples, return
+//! how many were done
+template <typename T>
+inline size_t decodeSamples(const uchar *, size_t, float, float, float *,
+                            float *, float *) {
+    return 0;
+}
+
+template <>
+inline size_t decodeSamples<int16_t>(const uchar *in, size_t width,
+                                     float bscale, float bzero, float *x,
+                                     float *y, float *z) {
+    const vfloat scale = F2V(bscale);
+    const vfloat zero = F2V(bzero);
+    size_t i = 0;
+    for (; i + 8 <= width; i += 8) {
+        const vint v = swapBytes16(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(in + i * sizeof(int16_t))));
+        // sign extend each half to 32 bits
+        const vint lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const vint hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        storeSamples(_mm_cvtepi32_ps(lo), scale, zero, x + i, y + i, z + i);
+        storeSamples(_mm_cvtepi32_ps(hi), scale, zero, x + i + 4, y + i + 4,
+                     z + i + 4);
+    }
+    return i;
+}
+
+template <>
+inline size_t decodeSamples<int32_t>(const uchar *in, size_t width,
+                                     float bscale, float bzero, float *x,
+                                     float *y, float *z) {
+    const vfloat scale = F2V(bscale);
+    const vfloat zero = F2V(bzero);
+    size_t i = 0;
+    for (; i + 4 <= width; i += 4) {
+        const vint v = swapBytes32(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(in + i * sizeof(int32_t))));
+        storeSamples(_mm_cvtepi32_ps(v), scale, zero, x + i, y + i, z + i);
+    }
+    return i;
+}
+
+template <>
+inline size_t decodeSamples<float>(const uchar *in, size_t width, float bscale,
+                                   float bzero, float *x, float *y, float *z) {
+    const vfloat scale = F2V(bscale);
+    const vfloat zero = F2V(bzero);
+    size_t i = 0;
+    for (; i + 4 <= width; i += 4) {
+        const vint v = swapBytes32(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(in + i * sizeof(float))));
+        storeSamples(_mm_castsi128_ps(v), scale, zero, x + i, y + i, z + i);
+    }
+    return i;
+}
+#endif
+
+//! \brief byte swap, scale and convert one row of raw samples, storing the
+//! result in the three channels
+template <typename T>
+void decodeRow(const uchar *in, size_t width, float bscale, float bzero,
+               float *x, float *y, float *z) {
+    size_t i = 0;
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    i = decodeSamples<T>(in, width, bscale, bzero, x, y, z);
+#endif
+    for (; i < width; ++i) {
+        const float v = bscale * loadSample<T>(in + i * sizeof(T)) + bzero;
+        x[i] = v;
+        y[i] = v;
+        z[i] = v;
+    }
+}
+
+template <typename T>
+void decodeImage(const uchar *in, size_t width, size_t height, float bscale,
+                 float bzero, Channel &X, Channel &Y, Channel &Z) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int r = 0; r < int(height); ++r) {
+        const size_t offset = size_t(r) * width;
+        decodeRow<T>(in + offset * sizeof(T), width, bscale, bzero,
+                     X.data() + offset, Y.data() + offset, Z.data() + offset);
+    }
+}
+
+//! \brief decode an uncompressed data unit straight from the mapped file.
+//! Returns false when the data must go through cfitsio instead.
+bool readMapped(const std::string &filename, const FitsReaderData &data,
+                size_t width, size_t height, Channel &X, Channel &Y,
+                Channel &Z) {
+    if (data.m_compressed || data.m_dataOffset < 0) {
+        return false;
+    }
+
+    size_t sampleSize;
+    switch (data.m_format) {
+        case BYTE_IMG:
+        case SHORT_IMG:
+        case LONG_IMG:
+        case LONGLONG_IMG:
+        case FLOAT_IMG:
+        case DOUBLE_IMG:
+            sampleSize = std::abs(data.m_format) / 8;
+            break;
+        default:
+            return false;
+    }
+
+    // extended file names ("image.fits[1]") do not name a file on disk, and
+    // gzipped files are decompressed in memory by cfitsio: the data offset
+    // is only good in a plain FITS file
+    QFile file(QFile::decodeName(filename.c_str()));
+    if (!file.open(QIODevice::ReadOnly) ||
+        !file.read(9).startsWith("SIMPLE  =")) {
+        return false;
+    }
+    const qint64 bytes = qint64(width) * qint64(height) * sampleSize;
+    if (file.size() < data.m_dataOffset + bytes) {
+        return false;
+    }
+    const uchar *in = file.map(data.m_dataOffset, bytes);
+    if (in == NULL) {
+        return false;
+    }
+
+    const float bscale = data.m_bscale;
+    const float bzero = data.m_bzero;
+    switch (data.m_format) {
+        case BYTE_IMG:
+            decodeImage<uint8_t>(in, width, height, bscale, bzero, X, Y, Z);
+            break;
+        case SHORT_IMG:
+            decodeImage<int16_t>(in, width, height, bscale, bzero, X, Y, Z);
+            break;
+        case LONG_IMG:
+            decodeImage<int32_t>(in, width, height, bscale, bzero, X, Y, Z);
+            break;
+        case LONGLONG_IMG:
+            decodeImage<int64_t>(in, width, height, bscale, bzero, X, Y, Z);
+            break;
+        case FLOAT_IMG:
+            decodeImage<float>(in, width, height, bscale, bzero, X, Y, Z);
+            break;
+        case DOUBLE_IMG:
+            decodeImage<double>(in, width, height, bscale, bzero, X, Y, Z);
+            break;
+    }
+    return true;
+}
+
+//! \brief let cfitsio decode the data unit as floats, band by band, straight
+//! into the first channel, then scale it and copy it to the others
+void readBands(FitsReaderData &data, size_t width, size_t height, Channel &X,
+               Channel &Y, Channel &Z) {
+    // BSCALE and BZERO are applied below, in the same pass as the copy
+    fits_set_bscale(data.m_ptr, 1., 0., &data.m_status);
+
+    const float bscale = data.m_bscale;
+    const float bzero = data.m_bzero;
+    float nullval = 0;  // don't check for null values in the image
+    int anynull;
+    for (size_t r = 0; r < height; r += s_bandRows) {
+        const size_t rows = std::min(s_bandRows, height - r);
+        const size_t offset = r * width;
+        if (fits_read_img(data.m_ptr, TFLOAT, LONGLONG(offset) + 1,
+                          LONGLONG(rows * width), &nullval, X.data() + offset,
+                          &anynull, &data.m_status)) {
+            char error_string[FLEN_ERRMSG];
+            fits_get_errstatus(data.m_status, error_string);
+            throw std::runtime_error("FITS: Cannot read rows " +
+                                     boost::lexical_cast<std::string>(r) +
+                                     "-" +
+                                     boost::lexical_cast<std::string>(
+                                         r + rows - 1) +
+                                     ". " + error_string);
+        }
+
+        float *x = X.data() + offset;
+        float *y = Y.data() + offset;
+        float *z = Z.data() + offset;
+        const int size = int(rows * width);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (int i = 0; i < size; ++i) {
+            const float v = bscale * x[i] + bzero;
+            x[i] = v;
+            y[i] = v;
+            z[i] = v;
+        }
+    }
+}
+}  // anonymous
+
 FitsReader::FitsReader(const std::string &filename) : FrameReader(filename) {
     FitsReader::open();
 }
@@ -86,12 +393,10 @@ void FitsReader::open() {
 
     if (fits_read_keys_lng(m_data->m_ptr, "NAXIS", 1, 2, naxes, &nfound,
                            &m_data->m_status)) {
-        fits_close_file(m_data->m_ptr, &m_data->m_status);
         throw InvalidHeader("Could not find the size of the data range");
     }
 
     if (nfound == 0) {
-        fits_close_file(m_data->m_ptr, &m_data->m_status);
         throw InvalidHeader("No image data array present");
     }
     setWidth(naxes[0]);
@@ -129,10 +434,20 @@ void FitsReader::open() {
 #ifndef NDEBUG
         std::cout << "BITPIX: " << error_string << std::endl;
 #endif
-        fits_close_file(m_data->m_ptr, &status);
         throw InvalidHeader(error_string);
     }
 
+    m_data->m_compressed = fits_is_compressed_image(m_data->m_ptr, &status);
+
+    LONGLONG headStart;
+    LONGLONG dataStart;
+    LONGLONG dataEnd;
+    if (fits_get_hduaddrll(m_data->m_ptr, &headStart, &dataStart, &dataEnd,
+                           &status) == 0) {
+        m_data->m_dataOffset = dataStart;
+    }
+    status = 0;
+
     m_data->m_bscale = bscale;
     m_data->m_bzero = bzero;
     m_data->m_format = bitpix;
@@ -160,138 +475,12 @@ void FitsReader::read(Frame &frame, const Params &) {
     std::cout << "contents.size (pixels) = " << width() * height() << std::endl;
 #endif
 
-    long fpixel = 1;
-    long nbuffer = width();
-    int anynull;
-
     Frame tempFrame(width(), height());
     Channel *Xc, *Yc, *Zc;
     tempFrame.createXYZChannels(Xc, Yc, Zc);
 
-    Channel::iterator it = Xc->begin();
-
-    float bscale = m_data->m_bscale;
-    float bzero = m_data->m_bzero;
-
-    if (m_data->m_format == FLOAT_IMG) {
-        std::vector<float> buffer(width());
-        float nullval = 0;  // don't check for null values in the image
-        for (size_t i = 0; i < height(); ++i, fpixel += nbuffer) {
-            if (fits_read_img(m_data->m_ptr, TFLOAT, fpixel, nbuffer, &nullval,
-                              buffer.data(), &anynull, &m_data->m_status)) {
-                char error_string[FLEN_ERRMSG];
-                fits_get_errstatus(m_data->m_status, error_string);
-                fits_close_file(m_data->m_ptr, &m_data->m_status);
-                throw std::runtime_error("FLOAT: Cannot read strip " +
-                                         boost::lexical_cast<std::string>(i) +
-                                         ". " + error_string);
-            }
-
-            std::transform(
-                buffer.begin(), buffer.end(), buffer.begin(),
-                [bscale, bzero](float c) { return bscale * c + bzero; });
-            it = std::copy(buffer.begin(), buffer.end(), it);
-        }
-    } else if (m_data->m_format == DOUBLE_IMG) {
-        std::vector<double> buffer(width());
-        double nullval = 0;  // don't check for null values in the image
-        for (size_t i = 0; i < height(); ++i, fpixel += nbuffer) {
-            if (fits_read_img(m_data->m_ptr, TDOUBLE, fpixel, nbuffer, &nullval,
-                              buffer.data(), &anynull, &m_data->m_status)) {
-                char error_string[FLEN_ERRMSG];
-                fits_get_errstatus(m_data->m_status, error_string);
-                fits_close_file(m_data->m_ptr, &m_data->m_status);
-                throw std::runtime_error("DOUBLE: Cannot read strip " +
-                                         boost::lexical_cast<std::string>(i) +
-                                         ". " + error_string);
-            }
-
-            std::transform(
-                buffer.begin(), buffer.end(), buffer.begin(),
-                [bscale, bzero](double c) { return bscale * c + bzero; });
-            it = std::copy(buffer.begin(), buffer.end(), it);
-        }
-    } else if (m_data->m_format == BYTE_IMG) {
-        std::vector<short> buffer(width());
-        std::vector<float> buffer_flt(width());
-        short nullval = 0;  // don't check for null values in the image
-        for (size_t i = 0; i < height(); ++i, fpixel += nbuffer) {
-            if (fits_read_img(m_data->m_ptr, TINT, fpixel, nbuffer, &nullval,
-                              buffer.data(), &anynull, &m_data->m_status)) {
-                char error_string[FLEN_ERRMSG];
-                fits_get_errstatus(m_data->m_status, error_string);
-                fits_close_file(m_data->m_ptr, &m_data->m_status);
-                throw std::runtime_error("BYTE: Cannot read strip " +
-                                         boost::lexical_cast<std::string>(i) +
-                                         ". " + error_string);
-            }
-
-            std::transform(
-                buffer.begin(), buffer.end(), buffer_flt.begin(),
-                [bscale, bzero](short c) { return bscale * c + bzero; });
-            it = std::copy(buffer_flt.begin(), buffer_flt.end(), it);
-        }
-    } else if (m_data->m_format == SHORT_IMG) {
-        std::vector<int> buffer(width());
-        std::vector<float> buffer_flt(width());
-        int nullval = 0;  // don't check for null values in the image
-        for (size_t i = 0; i < height(); ++i, fpixel += nbuffer) {
-            if (fits_read_img(m_data->m_ptr, TINT, fpixel, nbuffer, &nullval,
-                              buffer.data(), &anynull, &m_data->m_status)) {
-                char error_string[FLEN_ERRMSG];
-                fits_get_errstatus(m_data->m_status, error_string);
-                fits_close_file(m_data->m_ptr, &m_data->m_status);
-                throw std::runtime_error("SHORT: Cannot read strip " +
-                                         boost::lexical_cast<std::string>(i) +
-                                         ". " + error_string);
-            }
-
-            std::transform(
-                buffer.begin(), buffer.end(), buffer_flt.begin(),
-                [bscale, bzero](int c) { return bscale * c + bzero; });
-            it = std::copy(buffer_flt.begin(), buffer_flt.end(), it);
-        }
-    } else if (m_data->m_format == LONG_IMG) {
-        std::vector<long> buffer(width());
-        std::vector<float> buffer_flt(width());
-        long nullval = 0;  // don't check for null values in the image
-        for (size_t i = 0; i < height(); ++i, fpixel += nbuffer) {
-            if (fits_read_img(m_data->m_ptr, TLONG, fpixel, nbuffer, &nullval,
-                              buffer.data(), &anynull, &m_data->m_status)) {
-                char error_string[FLEN_ERRMSG];
-                fits_get_errstatus(m_data->m_status, error_string);
-                fits_close_file(m_data->m_ptr, &m_data->m_status);
-                throw std::runtime_error("LONG: Cannot read strip " +
-                                         boost::lexical_cast<std::string>(i) +
-                                         ". " + error_string);
-            }
-
-            std::transform(
-                buffer.begin(), buffer.end(), buffer_flt.begin(),
-                [bscale, bzero](long c) { return bscale * c + bzero; });
-            it = std::copy(buffer_flt.begin(), buffer_flt.end(), it);
-        }
-    } else if (m_data->m_format == LONGLONG_IMG) {
-        std::vector<long long> buffer(width());
-        std::vector<float> buffer_flt(width());
-        long long nullval = 0;  // don't check for null values in the image
-        for (size_t i = 0; i < height(); ++i, fpixel += nbuffer) {
-            if (fits_read_img(m_data->m_ptr, TLONGLONG, fpixel, nbuffer,
-                              &nullval, buffer.data(), &anynull,
-                              &m_data->m_status)) {
-                char error_string[FLEN_ERRMSG];
-                fits_get_errstatus(m_data->m_status, error_string);
-                fits_close_file(m_data->m_ptr, &m_data->m_status);
-                throw std::runtime_error("LONG: Cannot read strip " +
-                                         boost::lexical_cast<std::string>(i) +
-                                         ". " + error_string);
-            }
-
-            std::transform(
-                buffer.begin(), buffer.end(), buffer_flt.begin(),
-                [bscale, bzero](long long c) { return bscale * c + bzero; });
-            it = std::copy(buffer_flt.begin(), buffer_flt.end(), it);
-        }
+    if (!readMapped(filename(), *m_data, width(), height(), *Xc, *Yc, *Zc)) {
+        readBands(*m_data, width(), height(), *Xc, *Yc, *Zc);
     }
 
 #ifndef NDEBUG
@@ -301,10 +490,6 @@ void FitsReader::read(Frame &frame, const Params &) {
     std::cout << "FITS max luminance = " << *minmax.second << std::endl;
 #endif
 
-    // copy into other channels
-    std::copy(Xc->begin(), Xc->end(), Yc->begin());
-    std::copy(Xc->begin(), Xc->end(), Zc->begin());
-
     frame.swap(tempFrame);
 }
 
@@ -22,6 +22,7 @@
 #include <Libpfs/io/framereader.h>
 
 #include <Libpfs/frame.h>
+#include <Libpfs/io/ioexception.h>
 #include <Libpfs/manip/rotate.h>
 #include <Libpfs/exif/exifdata.hpp>
 
@@ -49,5 +50,12 @@ void FrameReader::read(pfs::Frame &frame, const pfs::Params &params) {
     }
 }
 
+bool FrameReader::readsRows() const { return false; }
+
+void FrameReader::readRows(pfs::Frame &, size_t, size_t, const pfs::Params &) {
+    throw ReadException("Reading the rows of " + m_filename +
+                        " one band at a time is not supported");
+}
+
 }  // io
 }  // pfs
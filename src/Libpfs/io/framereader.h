@@ -53,6 +53,15 @@ class FrameReader {
     virtual void close() = 0;
     virtual void read(pfs::Frame &frame, const pfs::Params &params);
 
+    //! \brief true if readRows() reads a band of rows without decoding the
+    //! whole file
+    virtual bool readsRows() const;
+    //! \brief read \a rows rows, starting at row \a y, into \a frame: RGB in
+    //! the XYZ channels. The file is not rotated according to its EXIF tags.
+    //! \throw ReadException if !readsRows()
+    virtual void readRows(pfs::Frame &frame, size_t y, size_t rows,
+                          const pfs::Params &params);
+
    protected:
     void setWidth(size_t width) { m_width = width; }
     void setHeight(size_t height) { m_height = height; }
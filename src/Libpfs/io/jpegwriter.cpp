@@ -155,7 +155,9 @@ struct JpegWriterParams {
         : quality_(100),
           minLuminance_(0.f),
           maxLuminance_(1.f),
-          luminanceMapping_(MAP_LINEAR) {}
+          luminanceMapping_(MAP_LINEAR),
+          progressive_(false),
+          optimizeCoding_(false) {}
 
     void parse(const Params &params) {
         for (Params::const_iterator it = params.begin(), itEnd = params.end();
@@ -177,6 +179,14 @@ struct JpegWriterParams {
                     it->second.as<RGBMappingType>(luminanceMapping_);
                 continue;
             }
+            if (it->first == "progressive") {
+                progressive_ = it->second.as<bool>(progressive_);
+                continue;
+            }
+            if (it->first == "optimize_coding") {
+                optimizeCoding_ = it->second.as<bool>(optimizeCoding_);
+                continue;
+            }
         }
     }
 
@@ -184,6 +194,10 @@ struct JpegWriterParams {
     float minLuminance_;
     float maxLuminance_;
     RGBMappingType luminanceMapping_;
+    //! progressive scans: smaller files, slower to encode and decode
+    bool progressive_;
+    //! Huffman tables computed for the image instead of the standard ones
+    bool optimizeCoding_;
 };
 
 ostream &operator<<(ostream &out, const JpegWriterParams &params) {
@@ -192,7 +206,9 @@ ostream &operator<<(ostream &out, const JpegWriterParams &params) {
     ss << "quality: " << params.quality_ << ", ";
     ss << "min_luminance: " << params.minLuminance_ << ", ";
     ss << "max_luminance: " << params.maxLuminance_ << ", ";
-    ss << "mapping_method: " << params.luminanceMapping_ << "]";
+    ss << "mapping_method: " << params.luminanceMapping_ << ", ";
+    ss << "progressive: " << params.progressive_ << ", ";
+    ss << "optimize_coding: " << params.optimizeCoding_ << "]";
 
     return (out << ss.str());
 }
@@ -250,6 +266,10 @@ class JpegWriterImpl {
                 cinfo.comp_info[i].v_samp_factor = 1;
             }
         }
+        cinfo.optimize_coding = params.optimizeCoding_ ? TRUE : FALSE;
+        if (params.progressive_) {
+            jpeg_simple_progression(&cinfo);
+        }
 
         try {
             setupJpegDest(&cinfo, filename);
@@ -265,25 +285,44 @@ class JpegWriterImpl {
 
             // If an exception is raised, this buffer gets automatically
             // destructed!
-            std::vector<JSAMPLE> scanLineOut(cinfo.image_width *
-                                             cinfo.num_components);
-            JSAMPROW scanLineOutArray[1] = {scanLineOut.data()};
+            // libjpeg encodes on the calling thread only: a band of rows is
+            // converted in parallel, then passed to it in one call
+            const int bandRows = 64;
+            const size_t rowSize = cinfo.image_width * cinfo.num_components;
+            std::vector<JSAMPLE> scanLinesOut(bandRows * rowSize);
+            std::vector<JSAMPROW> scanLinesOutArray(bandRows);
+            for (int r = 0; r < bandRows; r++) {
+                scanLinesOutArray[r] = scanLinesOut.data() + r * rowSize;
+            }
 
             while (cinfo.next_scanline < cinfo.image_height) {
-                // copy line from Frame into scanLineOut
-                utils::transform(
-                    rChannel->row_begin(cinfo.next_scanline),
-                    rChannel->row_end(cinfo.next_scanline),
-                    gChannel->row_begin(cinfo.next_scanline),
-                    bChannel->row_begin(cinfo.next_scanline),
-                    FixedStrideIterator<JSAMPLE *, 3>(scanLineOut.data()),
-                    FixedStrideIterator<JSAMPLE *, 3>(scanLineOut.data() + 1),
-                    FixedStrideIterator<JSAMPLE *, 3>(scanLineOut.data() + 2),
-                    utils::chain(colorspace::Normalizer(params.minLuminance_,
-                                                        params.maxLuminance_),
-                                 utils::CLAMP_F32,
-                                 Remapper<JSAMPLE>(params.luminanceMapping_)));
-                jpeg_write_scanlines(&cinfo, scanLineOutArray, 1);
+                const int first = cinfo.next_scanline;
+                const int rows = std::min<int>(bandRows,
+                                               cinfo.image_height - first);
+                // copy lines from Frame into scanLinesOut
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+                for (int r = 0; r < rows; r++) {
+                    JSAMPLE *out = scanLinesOutArray[r];
+                    utils::transform(
+                        rChannel->row_begin(first + r),
+                        rChannel->row_end(first + r),
+                        gChannel->row_begin(first + r),
+                        bChannel->row_begin(first + r),
+                        FixedStrideIterator<JSAMPLE *, 3>(out),
+                        FixedStrideIterator<JSAMPLE *, 3>(out + 1),
+                        FixedStrideIterator<JSAMPLE *, 3>(out + 2),
+                        utils::chain(
+                            colorspace::Normalizer(params.minLuminance_,
+                                                   params.maxLuminance_),
+                            utils::CLAMP_F32,
+                            Remapper<JSAMPLE>(params.luminanceMapping_)));
+                }
+                for (int r = 0; r < rows;) {
+                    r += jpeg_write_scanlines(
+                        &cinfo, scanLinesOutArray.data() + r, rows - r);
+                }
             }
         } catch (const std::runtime_error &err) {
             std::clog << err.what() << std::endl;
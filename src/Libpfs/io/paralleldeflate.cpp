@@ -0,0 +1,168 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#include <Libpfs/io/paralleldeflate.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+#include <Libpfs/io/ioexception.h>
+
+namespace pfs {
+namespace io {
+
+namespace {
+const size_t s_blockSize = 128 * 1024;
+const size_t s_windowSize = 32 * 1024;
+
+//! \brief raw deflate of one block, primed with \a dictionary. The block
+//! ends with a sync flush (or with the final block when \a last is set).
+bool deflateBlock(const unsigned char *dictionary, size_t dictionarySize,
+                  const unsigned char *data, size_t size, int level, bool last,
+                  std::vector<unsigned char> &out) {
+    z_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    if (dictionarySize > 0 &&
+        deflateSetDictionary(&strm, dictionary, (uInt)dictionarySize) !=
+            Z_OK) {
+        deflateEnd(&strm);
+        return false;
+    }
+
+    out.resize(deflateBound(&strm, (uLong)size) + 16);
+    strm.next_in = const_cast<Bytef *>(data);
+    strm.avail_in = (uInt)size;
+    strm.next_out = out.data();
+    strm.avail_out = (uInt)out.size();
+
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    int ret;
+    for (;;) {
+        ret = deflate(&strm, flush);
+        if (ret == Z_STREAM_ERROR || strm.avail_out != 0) break;
+
+        const size_t used = out.size();
+        out.resize(2 * used);
+        strm.next_out = out.data() + used;
+        strm.avail_out = (uInt)(out.size() - used);
+    }
+    out.resize(strm.total_out);
+    deflateEnd(&strm);
+
+    return last ? (ret == Z_STREAM_END) : (ret != Z_STREAM_ERROR);
+}
+}
+
+ParallelDeflate::ParallelDeflate(int level)
+    : m_level(std::max(-1, std::min(level, 9))),
+      m_started(false),
+      m_adler(adler32(0L, Z_NULL, 0)) {}
+
+void ParallelDeflate::append(const unsigned char *data, size_t size,
+                             bool last, std::vector<unsigned char> &out) {
+    if (!m_started) {
+        // CMF: deflate with a 32 KiB window; FLG: the level hint, no
+        // dictionary and the check bits
+        const int level = (m_level < 0) ? 6 : m_level;
+        int flevel = 3;
+        if (level < 2) {
+            flevel = 0;
+        } else if (level < 6) {
+            flevel = 1;
+        } else if (level == 6) {
+            flevel = 2;
+        }
+        unsigned int header = (0x78 << 8) | (flevel << 6);
+        header += 31 - (header % 31);
+        out.push_back((unsigned char)(header >> 8));
+        out.push_back((unsigned char)(header & 0xff));
+        m_started = true;
+    }
+
+    // an empty closing call still needs a final block
+    const int blocks =
+        std::max<int>((int)((size + s_blockSize - 1) / s_blockSize), last);
+    std::vector<std::vector<unsigned char>> compressed(blocks);
+    std::vector<unsigned long> adlers(blocks);
+    int failed = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+ : failed)
+#endif
+    for (int b = 0; b < blocks; b++) {
+        const size_t begin = b * s_blockSize;
+        const size_t end = std::min(size, begin + s_blockSize);
+
+        const unsigned char *dictionary;
+        size_t dictionarySize;
+        if (b == 0) {
+            dictionary = m_window.data();
+            dictionarySize = m_window.size();
+        } else {
+            dictionarySize = std::min(begin, s_windowSize);
+            dictionary = data + begin - dictionarySize;
+        }
+
+        if (!deflateBlock(dictionary, dictionarySize, data + begin,
+                          end - begin, m_level, last && b == blocks - 1,
+                          compressed[b])) {
+            failed++;
+        }
+        adlers[b] = adler32(adler32(0L, Z_NULL, 0), data + begin,
+                            (uInt)(end - begin));
+    }
+    if (failed) {
+        throw WriteException("ParallelDeflate: compression failed");
+    }
+
+    for (int b = 0; b < blocks; b++) {
+        const size_t begin = b * s_blockSize;
+        const size_t length = std::min(size, begin + s_blockSize) - begin;
+        m_adler = adler32_combine(m_adler, adlers[b], (z_off_t)length);
+        out.insert(out.end(), compressed[b].begin(), compressed[b].end());
+    }
+
+    // keep the tail of the stream as dictionary for the next call
+    if (size >= s_windowSize) {
+        m_window.assign(data + size - s_windowSize, data + size);
+    } else {
+        m_window.insert(m_window.end(), data, data + size);
+        if (m_window.size() > s_windowSize) {
+            m_window.erase(m_window.begin(),
+                           m_window.end() - s_windowSize);
+        }
+    }
+
+    if (last) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back((unsigned char)((m_adler >> shift) & 0xff));
+        }
+    }
+}
+
+}  // io
+}  // pfs
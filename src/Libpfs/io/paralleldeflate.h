@@ -0,0 +1,57 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+//! \brief zlib stream compressed by several threads
+//! \note same scheme as pigz: the input is cut into blocks, every block is
+//! deflated on its own thread with the 32 KiB preceding it as dictionary and
+//! ends on a byte boundary, so the pieces concatenate into one valid stream
+
+#ifndef PFS_IO_PARALLELDEFLATE_H
+#define PFS_IO_PARALLELDEFLATE_H
+
+#include <cstddef>
+#include <vector>
+
+namespace pfs {
+namespace io {
+
+class ParallelDeflate {
+   public:
+    //! \param level zlib compression level, -1 (zlib default) to 9
+    explicit ParallelDeflate(int level);
+
+    //! \brief compress the next \a size bytes of the stream and append the
+    //! result to \a out. The first call also emits the zlib header, the call
+    //! with \a last set closes the stream.
+    void append(const unsigned char *data, size_t size, bool last,
+                std::vector<unsigned char> &out);
+
+   private:
+    int m_level;
+    bool m_started;
+    unsigned long m_adler;
+    std::vector<unsigned char> m_window;
+};
+
+}  // io
+}  // pfs
+
+#endif  // PFS_IO_PARALLELDEFLATE_H
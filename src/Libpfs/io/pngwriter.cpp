@@ -23,7 +23,9 @@
 #include "pngwriter.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <vector>
 
@@ -35,6 +37,7 @@
 #include <Libpfs/colorspace/rgbremapper.h>
 #include <Libpfs/fixedstrideiterator.h>
 #include <Libpfs/frame.h>
+#include <Libpfs/io/paralleldeflate.h>
 #include <Libpfs/utils/chain.h>
 #include <Libpfs/utils/clamp.h>
 #include <Libpfs/utils/resourcehandlerlcms.h>
@@ -124,6 +127,64 @@ static void png_write_icc_profile(png_structp png_ptr, png_infop info_ptr) {
                  profileBuffer.data(), (png_uint_32)profileSize);
 }
 
+//! \brief uncompressed bytes handled per band of rows
+static const size_t s_bandSize = 1 << 20;
+
+static inline int filterCost(png_byte v) { return (v < 128) ? v : 256 - v; }
+
+static inline png_byte paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return (png_byte)a;
+    if (pb <= pc) return (png_byte)b;
+    return (png_byte)c;
+}
+
+//! \brief filter one RGB row into \a out (filter type byte + \a bytes),
+//! choosing the filter type with libpng's heuristic: the smallest sum of the
+//! absolute values of the filtered bytes, taken as signed
+static void filterRow(const png_byte *row, const png_byte *above,
+                      size_t bytes, png_byte *out) {
+    const size_t bpp = 3;
+    std::vector<png_byte> candidate(bytes + 1);
+    int bestCost = std::numeric_limits<int>::max();
+
+    for (int type = PNG_FILTER_VALUE_NONE; type <= PNG_FILTER_VALUE_PAETH;
+         type++) {
+        candidate[0] = (png_byte)type;
+        int cost = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            const int a = (i >= bpp) ? row[i - bpp] : 0;
+            const int b = above[i];
+            const int c = (i >= bpp) ? above[i - bpp] : 0;
+            int predictor = 0;
+            switch (type) {
+                case PNG_FILTER_VALUE_SUB:
+                    predictor = a;
+                    break;
+                case PNG_FILTER_VALUE_UP:
+                    predictor = b;
+                    break;
+                case PNG_FILTER_VALUE_AVG:
+                    predictor = (a + b) >> 1;
+                    break;
+                case PNG_FILTER_VALUE_PAETH:
+                    predictor = paeth(a, b, c);
+                    break;
+            }
+            const png_byte v = (png_byte)(row[i] - predictor);
+            candidate[i + 1] = v;
+            cost += filterCost(v);
+        }
+        if (cost < bestCost) {
+            bestCost = cost;
+            std::copy(candidate.begin(), candidate.end(), out);
+        }
+    }
+}
+
 class PngWriterImpl {
    public:
     PngWriterImpl() : m_filesize(0) {}
@@ -176,8 +237,6 @@ class PngWriterImpl {
                      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
                      PNG_FILTER_TYPE_DEFAULT);
 
-        png_set_compression_level(png_ptr, params.compressionLevel());
-        png_set_bgr(png_ptr);
         png_write_icc_profile(png_ptr,
                               info_ptr);  // user defined function, see above
         png_write_info(png_ptr, info_ptr);
@@ -187,22 +246,72 @@ class PngWriterImpl {
         const Channel *bChannel;
         frame.getXYZChannels(rChannel, gChannel, bChannel);
 
-        std::vector<png_byte> scanLineOut(width * 3);
-        for (png_uint_32 row = 0; row < height; ++row) {
-            utils::transform(
-                rChannel->row_begin(row), rChannel->row_end(row),
-                gChannel->row_begin(row), bChannel->row_begin(row),
-                FixedStrideIterator<png_byte *, 3>(scanLineOut.data() + 2),
-                FixedStrideIterator<png_byte *, 3>(scanLineOut.data() + 1),
-                FixedStrideIterator<png_byte *, 3>(scanLineOut.data()),
-                utils::chain(colorspace::Normalizer(params.minLuminance_,
-                                                    params.maxLuminance_),
-                             utils::CLAMP_F32,
-                             Remapper<png_byte>(params.luminanceMapping_)));
-            png_write_row(png_ptr, scanLineOut.data());
+        // libpng compresses on the calling thread only: the image data is
+        // filtered and deflated here, a band of rows at a time, and handed
+        // to libpng as ready IDAT chunks
+        const size_t rowBytes = size_t(width) * 3;
+        const int bandRows =
+            (int)std::max<size_t>(1, s_bandSize / (rowBytes + 1));
+        const bool filter = (params.compressionLevel() > 0);
+
+        // pixels holds the last row of the previous band, then the band
+        std::vector<png_byte> pixels((bandRows + 1) * rowBytes, 0);
+        std::vector<png_byte> filtered(bandRows * (rowBytes + 1));
+        std::vector<png_byte> idat;
+        ParallelDeflate deflater(params.compressionLevel());
+
+        for (png_uint_32 first = 0; first < height; first += bandRows) {
+            const int rows = (int)std::min<png_uint_32>(bandRows,
+                                                        height - first);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int r = 0; r < rows; r++) {
+                png_byte *out = pixels.data() + (r + 1) * rowBytes;
+                utils::transform(
+                    rChannel->row_begin(first + r),
+                    rChannel->row_end(first + r),
+                    gChannel->row_begin(first + r),
+                    bChannel->row_begin(first + r),
+                    FixedStrideIterator<png_byte *, 3>(out),
+                    FixedStrideIterator<png_byte *, 3>(out + 1),
+                    FixedStrideIterator<png_byte *, 3>(out + 2),
+                    utils::chain(
+                        colorspace::Normalizer(params.minLuminance_,
+                                               params.maxLuminance_),
+                        utils::CLAMP_F32,
+                        Remapper<png_byte>(params.luminanceMapping_)));
+            }
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int r = 0; r < rows; r++) {
+                const png_byte *row = pixels.data() + (r + 1) * rowBytes;
+                png_byte *out = filtered.data() + r * (rowBytes + 1);
+                if (filter) {
+                    // the row above the image is all zeros
+                    filterRow(row, pixels.data() + r * rowBytes, rowBytes,
+                              out);
+                } else {
+                    out[0] = PNG_FILTER_VALUE_NONE;
+                    std::copy(row, row + rowBytes, out + 1);
+                }
+            }
+
+            idat.clear();
+            deflater.append(filtered.data(), rows * (rowBytes + 1),
+                            first + rows == height, idat);
+            png_write_chunk(png_ptr, (png_bytep) "IDAT", idat.data(),
+                            idat.size());
+
+            std::copy(pixels.begin() + rows * rowBytes,
+                      pixels.begin() + (rows + 1) * rowBytes, pixels.begin());
         }
 
-        png_write_end(png_ptr, info_ptr);
+        // png_write_end() refuses to close a file whose IDAT it did not
+        // write itself
+        png_write_chunk(png_ptr, (png_bytep) "IEND", NULL, 0);
         png_destroy_write_struct(&png_ptr, &info_ptr);
 
         computeSize();
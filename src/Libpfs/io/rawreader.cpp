@@ -22,6 +22,7 @@
  *
  */
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <sstream>
@@ -29,10 +30,9 @@
 
 #include <Libpfs/colorspace/copy.h>
 #include <Libpfs/colorspace/gamma.h>
-#include <Libpfs/fixedstrideiterator.h>
 #include <Libpfs/frame.h>
 #include <Libpfs/io/rawreader.h>
-#include <Libpfs/utils/transform.h>
+#include <Libpfs/manip/demosaic.h>
 
 using namespace pfs;
 
@@ -112,6 +112,8 @@ struct RAWReaderParams {
           gamma1_(12.92),
           fourColorRGB_(0),
           useFujiRotate_(-1),
+          halfSize_(0),
+          outputColor_(1),
           userQuality_(USER_QUALITY),
           medPasses_(0),
           wbMethod_(1),
@@ -145,6 +147,12 @@ struct RAWReaderParams {
         if (params.get("raw.fuji_rotate", tempInt)) {
             useFujiRotate_ = tempInt;
         }
+        if (params.get("raw.half_size", tempInt)) {
+            halfSize_ = tempInt;
+        }
+        if (params.get("raw.output_color", tempInt)) {
+            outputColor_ = tempInt;
+        }
         if (params.get("raw.user_quality", tempInt)) {
             userQuality_ = tempInt;
         }
@@ -233,6 +241,10 @@ struct RAWReaderParams {
 
     int fourColorRGB_;
     int useFujiRotate_;
+    // 1: half-size image, no demosaicing
+    int halfSize_;
+    // 0: camera colour space, 1: sRGB
+    int outputColor_;
 
     int userQuality_;
     int medPasses_;
@@ -267,6 +279,8 @@ ostream &operator<<(ostream &out, const RAWReaderParams &p) {
     ss << "[gamma0: " << p.gamma0_ << ", gamma1: " << p.gamma1_;
     ss << ", 4-Color RGB: " << p.fourColorRGB_;
     ss << ", Fuji Rotate: " << p.useFujiRotate_;
+    ss << ", Half Size: " << p.halfSize_;
+    ss << ", Output Color: " << p.outputColor_;
     ss << ", User Quality (Demosaicing method): " << p.userQuality_;
     ss << ", Median Filter Passes: " << p.medPasses_;
     ss << ", WB Method: " << p.wbMethod_;
@@ -310,13 +324,15 @@ static void setParams(LibRaw &processor, const RAWReaderParams &params) {
     libraw_output_params_t &outParams = processor.imgdata.params;
 
     outParams.output_bps = 16;
-    outParams.output_color = 1;          // sRGB
+    outParams.output_color = params.outputColor_;
     outParams.gamm[0] = params.gamma0_;  // outParams.gamm[0] = 1/2.4;   //sRGB
     outParams.gamm[1] = params.gamma1_;  // outParams.gamm[1] = 12.92;   //sRGB
     // use 4-color demosaicing algorithm
     outParams.four_color_rgb = params.fourColorRGB_;
     // do not rotate or strech pixels on fuji cameras - default = 1 (rotate)
     outParams.use_fuji_rotate = params.useFujiRotate_;
+    // half-size output skips the demosaicing
+    outParams.half_size = params.halfSize_;
     // demosaicing parameters
     outParams.user_qual = params.userQuality_;
     outParams.med_passes = params.medPasses_;
@@ -336,12 +352,8 @@ static void setParams(LibRaw &processor, const RAWReaderParams &params) {
 
             RGB[1] = RGB[1] / params.wbGreen_;
 
-            bool identify = true;
-            if (processor.adjust_sizes_info_only() != LIBRAW_SUCCESS) {
-                identify = false;
-            }
-
-            if (identify && processor.imgdata.idata.colors >= 3) {
+            // open_file() has identified the camera already: pre_mul is set
+            if (processor.imgdata.idata.colors >= 3) {
                 RGB[0] = processor.imgdata.color.pre_mul[0] / RGB[0];
                 RGB[1] = processor.imgdata.color.pre_mul[1] / RGB[1];
                 RGB[2] = processor.imgdata.color.pre_mul[2] / RGB[2];
@@ -402,7 +414,21 @@ static void setParams(LibRaw &processor, const RAWReaderParams &params) {
 #define P2 m_processor.imgdata.other
 #define OUT m_processor.imgdata.params
 
-RAWReader::RAWReader(const std::string &filename) : FrameReader(filename) {
+//! \brief linear value of every 16 bit sample of the LibRaw output
+static const std::vector<float> &gammaTable() {
+    static const std::vector<float> table = []() {
+        std::vector<float> t(1 << 16);
+        const colorspace::Gamma<colorspace::Gamma1_8> gamma;
+        for (size_t i = 0; i < t.size(); ++i) {
+            t[i] = gamma.operator()<uint16_t, float>(uint16_t(i));
+        }
+        return t;
+    }();
+    return table;
+}
+
+RAWReader::RAWReader(const std::string &filename)
+    : FrameReader(filename), m_isOpen(false) {
     RAWReader::open();
 }
 
@@ -413,24 +439,32 @@ void RAWReader::open() {
     if (m_processor.open_file(filename().c_str()) != LIBRAW_SUCCESS) {
         throw pfs::io::InvalidFile("RAWReader: cannot open file " + filename());
     }
+    m_isOpen = true;
     setWidth(S.width);
     setHeight(S.height);
 }
 
-bool RAWReader::isOpen() const { return true; }
+bool RAWReader::isOpen() const { return m_isOpen; }
 
-void RAWReader::close() { m_processor.recycle(); }
+void RAWReader::close() {
+    m_processor.recycle();
+    m_isOpen = false;
+}
 
 void RAWReader::read(Frame &frame, const Params &params) {
     RAWReaderParams p;
     p.parse(params);
 
-    setParams(m_processor, p);
+    // the file has been identified by the constructor: only a reader that has
+    // been read already has to go through open_file() again
+    if (!isOpen()) {
+        open();
+    }
 
-    open();
+    setParams(m_processor, p);
 
     if (m_processor.unpack() != LIBRAW_SUCCESS) {
-        m_processor.recycle();
+        close();
         throw pfs::io::ReadException("Error Unpacking RAW File");
     }
 
@@ -446,7 +480,7 @@ void RAWReader::read(Frame &frame, const Params &params) {
 #endif
 
     if (m_processor.dcraw_process() != LIBRAW_SUCCESS) {
-        m_processor.recycle();
+        close();
         throw pfs::io::ReadException("Error Processing RAW File");
     }
 
@@ -455,7 +489,7 @@ void RAWReader::read(Frame &frame, const Params &params) {
     if (!image)  // ret != LIBRAW_SUCCESS ||
     {
         PRINT_DEBUG("Memory Error in processing RAW File");
-        m_processor.recycle();
+        close();
         throw pfs::io::ReadException("Memory Error in processing RAW File");
     }
 
@@ -469,26 +503,163 @@ void RAWReader::read(Frame &frame, const Params &params) {
     pfs::Channel *Xc, *Yc, *Zc;
     tempFrame.createXYZChannels(Xc, Yc, Zc);
 
+    // LibRaw's output curve depends on its histogram, so the mem image is
+    // kept; it is turned into linear values through a table instead of three
+    // pow() per pixel
     const uint16_t *raw_data = reinterpret_cast<const uint16_t *>(image->data);
-    utils::transform(
-        FixedStrideIterator<const uint16_t *, 3>(raw_data),
-        FixedStrideIterator<const uint16_t *, 3>(raw_data + H * W * 3),
-        FixedStrideIterator<const uint16_t *, 3>(raw_data + 1),
-        FixedStrideIterator<const uint16_t *, 3>(raw_data + 2), Xc->begin(),
-        Yc->begin(), Zc->begin(),
-        colorspace::Gamma<pfs::colorspace::Gamma1_8>());
+    const float *table = gammaTable().data();
+    float *x = Xc->data();
+    float *y = Yc->data();
+    float *z = Zc->data();
+    const long size = long(W) * H;
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (long i = 0; i < size; ++i) {
+        x[i] = table[raw_data[3 * i]];
+        y[i] = table[raw_data[3 * i + 1]];
+        z[i] = table[raw_data[3 * i + 2]];
+    }
 
     PRINT_DEBUG("Data size: " << image->data_size << " "
                               << W * H * 3 * sizeof(uint16_t));
     PRINT_DEBUG("W: " << W << " H: " << H);
 
     LibRaw::dcraw_clear_mem(image);
-    m_processor.recycle();
+    close();
 
     FrameReader::read(tempFrame, params);
     frame.swap(tempFrame);
 }
 
+void unpackBayer(const unsigned short *raw, size_t pitch, int left, int top,
+                 int width, int height, const int color[2][2],
+                 const float black[4], float maximum, BayerFrame &bayer) {
+    float rowBlack[2][2];
+    float scale[2][2];
+    for (int row = 0; row < 2; ++row) {
+        for (int col = 0; col < 2; ++col) {
+            const int c = color[row][col];
+            // the second green of 4-colour cameras
+            bayer.cfa[row][col] = (c == 3) ? 1 : c;
+            rowBlack[row][col] = black[c];
+            scale[row][col] = 1.f / std::max(1.f, maximum - black[c]);
+        }
+    }
+
+    // as LibRaw does, a white point well below the brightest photosite is
+    // taken from the data
+    unsigned dataMaximum = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(max : dataMaximum)
+#endif
+    for (int y = 0; y < height; ++y) {
+        const unsigned short *in = raw + (y + top) * pitch + left;
+        for (int x = 0; x < width; ++x) {
+            dataMaximum = std::max(dataMaximum, unsigned(in[x]));
+        }
+    }
+    const float white = (dataMaximum > 0.75f * maximum) ? dataMaximum : maximum;
+    // sensors lose linearity just before they clip: the lowest clipping
+    // level of the four photosites of a tile
+    bayer.saturation = (white - rowBlack[0][0]) * scale[0][0];
+    for (int row = 0; row < 2; ++row) {
+        for (int col = 0; col < 2; ++col) {
+            bayer.saturation =
+                std::min(bayer.saturation,
+                         (white - rowBlack[row][col]) * scale[row][col]);
+        }
+    }
+    bayer.saturation *= 0.97f;
+
+    bayer.data.resize(width, height);
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int y = 0; y < height; ++y) {
+        const unsigned short *in = raw + (y + top) * pitch + left;
+        float *out = bayer.data.data() + size_t(y) * width;
+        const float *b = rowBlack[y & 1];
+        const float *k = scale[y & 1];
+        for (int x = 0; x < width; ++x) {
+            out[x] = std::max(0.f, (in[x] - b[x & 1]) * k[x & 1]);
+        }
+    }
+}
+
+void RAWReader::readBayer(BayerFrame &bayer, const Params &params) {
+    RAWReaderParams p;
+    p.parse(params);
+
+    if (!isOpen()) {
+        open();
+    }
+
+    // X-Trans, Foveon and linear DNG have no 2x2 pattern
+    if (P1.filters < 1000 || P1.colors != 3) {
+        close();
+        throw pfs::io::ReadException("RAWReader: no Bayer filter in " +
+                                     filename());
+    }
+    // setParams() asks LibRaw for auto white balance unless the camera or a
+    // custom one is chosen, and LibRaw computes it on the demosaiced image:
+    // those files take the decoded-frame merge
+    if (p.wbMethod_ != 1 && p.wbMethod_ != 3) {
+        close();
+        throw pfs::io::ReadException(
+            "RAWReader: auto white balance needs the demosaiced image of " +
+            filename());
+    }
+
+    if (m_processor.unpack() != LIBRAW_SUCCESS) {
+        close();
+        throw pfs::io::ReadException("Error Unpacking RAW File");
+    }
+    if (!m_processor.imgdata.rawdata.raw_image) {
+        close();
+        throw pfs::io::ReadException("RAWReader: no Bayer data in " +
+                                     filename());
+    }
+
+    // the black level of a photosite follows its colour in LibRaw, where the
+    // second green has a level of its own
+    int color[2][2];
+    for (int row = 0; row < 2; ++row) {
+        for (int col = 0; col < 2; ++col) {
+            color[row][col] = m_processor.COLOR(row, col);
+        }
+    }
+    float black[4];
+    for (int c = 0; c < 4; ++c) {
+        black[c] = float(C.black + C.cblack[c]);
+    }
+    unpackBayer(m_processor.imgdata.rawdata.raw_image, S.raw_width,
+                S.left_margin, S.top_margin, S.width, S.height, color, black,
+                float(C.maximum), bayer);
+
+    // white balance as setParams() asks LibRaw for it
+    float mul[3] = {C.pre_mul[0], C.pre_mul[1], C.pre_mul[2]};
+    if (p.wbMethod_ == 1 && C.cam_mul[0] > 0.f && C.cam_mul[1] > 0.f) {
+        std::copy(C.cam_mul, C.cam_mul + 3, mul);
+    } else if (p.wbMethod_ == 3) {
+        double RGB[3];
+        temperatureToRGB(p.wbTemperature_, RGB);
+        RGB[1] = RGB[1] / p.wbGreen_;
+        for (int c = 0; c < 3; ++c) {
+            mul[c] = C.pre_mul[c] / RGB[c];
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        bayer.whiteBalance[c] = (mul[1] > 0.f) ? mul[c] / mul[1] : 1.f;
+        for (int k = 0; k < 3; ++k) {
+            bayer.rgbCam[c][k] =
+                (p.outputColor_ == 0) ? float(c == k) : C.rgb_cam[c][k];
+        }
+    }
+
+    close();
+}
+
 #undef P1
 #undef S
 #undef C
@@ -40,6 +40,8 @@
 //
 
 namespace pfs {
+struct BayerFrame;
+
 namespace io {
 
 class RAWReader : public FrameReader {
@@ -53,10 +55,29 @@ class RAWReader : public FrameReader {
 
     void read(Frame &frame, const Params &params);
 
+    //! \brief read the sensor data before demosaicing, white balance and
+    //! colour conversion, for the linear merge of RAW brackets
+    //! \throw ReadException if the sensor has no 2x2 Bayer filter, or if
+    //! \a params ask for auto white balance
+    void readBayer(BayerFrame &bayer, const Params &params);
+
    private:
     LibRaw m_processor;
+    //! \brief true between open_file() and the end of read()
+    bool m_isOpen;
 };
 
+//! \brief fill \a bayer with the \a width x \a height photosites of \a raw
+//! from (\a left, \a top), black subtracted and scaled to the white point
+//! \param pitch photosites per row of \a raw
+//! \param color LibRaw's colour of each photosite of the top-left 2x2 tile,
+//! 3 for the second green
+//! \param black black level of each colour
+//! \param maximum nominal white point
+void unpackBayer(const unsigned short *raw, size_t pitch, int left, int top,
+                 int width, int height, const int color[2][2],
+                 const float black[4], float maximum, BayerFrame &bayer);
+
 }  // io
 }  // pfs
 
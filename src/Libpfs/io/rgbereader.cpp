@@ -21,34 +21,81 @@
  * ----------------------------------------------------------------------
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <vector>
+
+#include <stdint.h>
 
 #include <Libpfs/array2d.h>
 #include <Libpfs/colorspace/colorspace.h>
 #include <Libpfs/frame.h>
 #include <Libpfs/io/rgbecommon.h>
 #include <Libpfs/io/rgbereader.h>
+#include "opthelper.h"
 
 using namespace std;
 
 namespace pfs {
 namespace io {
 
-void rgbe2rgb(const Trgbe_pixel &rgbe, float exposure, float &r, float &g,
-              float &b) {
-    if (rgbe.e != 0)  // a non-zero pixel
-    {
-        int e = rgbe.e - int(128 + 8);
-        double f = ldexp(1.0, e) /*WHITE_EFFICACY */ / exposure;
-
-        r = (float)(rgbe.r * f);
-        g = (float)(rgbe.g * f);
-        b = (float)(rgbe.b * f);
-    } else
-        r = g = b = 0.f;
+//! \brief 2^(e - 128) built from its bits, 0 for e == 0 (and for e == 1,
+//! whose 2^-127 is below the normal range)
+static inline float rgbeScale(Trgbe e) {
+    const uint32_t bits = (e > 0) ? (uint32_t(e) - 1) << 23 : 0;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+#ifdef __SSE2__
+//! \brief 4 bytes widened to 4 integers
+static inline vint loadBytes(const Trgbe *p) {
+    int32_t packed;
+    std::memcpy(&packed, p, sizeof(packed));
+    const vint zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(
+        _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+}
+#endif
+
+//! \brief convert one scanline, stored as 4 planes of \a width bytes
+//! (mantissas of R, G, B, then the exponents)
+static void convertScanline(const Trgbe *planes, int width, float exposure,
+                            float *r, float *g, float *b) {
+    const Trgbe *rIn = planes;
+    const Trgbe *gIn = planes + width;
+    const Trgbe *bIn = planes + 2 * width;
+    const Trgbe *eIn = planes + 3 * width;
+    const float factor = (1.f / 256.f) / exposure;
+
+    int x = 0;
+#ifdef __SSE2__
+    const vfloat factorv = F2V(factor);
+    const vint onev = _mm_set1_epi32(1);
+    const vint zerov = _mm_setzero_si128();
+    for (; x + 3 < width; x += 4) {
+        const vint e = loadBytes(eIn + x);
+        // the exponent bits of 2^(e - 128), cleared where e is 0
+        const vint bits = _mm_andnot_si128(
+            _mm_cmpeq_epi32(e, zerov),
+            _mm_slli_epi32(_mm_sub_epi32(e, onev), 23));
+        const vfloat scale = _mm_mul_ps(_mm_castsi128_ps(bits), factorv);
+
+        STVFU(r[x], _mm_mul_ps(_mm_cvtepi32_ps(loadBytes(rIn + x)), scale));
+        STVFU(g[x], _mm_mul_ps(_mm_cvtepi32_ps(loadBytes(gIn + x)), scale));
+        STVFU(b[x], _mm_mul_ps(_mm_cvtepi32_ps(loadBytes(bIn + x)), scale));
+    }
+#endif
+    for (; x < width; ++x) {
+        const float scale = rgbeScale(eIn[x]) * factor;
+        r[x] = rIn[x] * scale;
+        g[x] = gIn[x] * scale;
+        b[x] = bIn[x] * scale;
+    }
 }
 
 // Reading RGBE files
@@ -128,99 +175,140 @@ void readRadianceHeader(FILE *file, int &width, int &height, float &exposure,
     // DEBUG_STR << "RGBE: image size " << width << "x" << height << endl;
 }
 
-void RLERead(FILE *file, Trgbe *scanline, int size) {
-    int peek = 0;
-    while (peek < size) {
-        Trgbe p[2];
-        if (fread(p, sizeof(p), 1, file) == 0) {
-            throw pfs::io::ReadException("RGBE: Invalid data size");
-        }
-        if (p[0] > 128) {
-            // a run
-            int run_len = p[0] - 128;
+//! \brief read what is left of \a file in one block
+static void readRemaining(FILE *file, std::vector<Trgbe> &data) {
+    const long begin = ftell(file);
+    if (begin < 0 || fseek(file, 0, SEEK_END) != 0) {
+        throw pfs::io::ReadException("RGBE: cannot seek in the file");
+    }
+    const long end = ftell(file);
+    if (end < begin || fseek(file, begin, SEEK_SET) != 0) {
+        throw pfs::io::ReadException("RGBE: cannot seek in the file");
+    }
+
+    data.resize(end - begin);
+    if (!data.empty() &&
+        fread(data.data(), sizeof(Trgbe), data.size(), file) != data.size()) {
+        throw pfs::io::ReadException("RGBE: Invalid data size");
+    }
+}
+
+//! \brief is the scanline at \a p run length encoded?
+static bool isRLEScanline(const Trgbe *p, size_t available, int width) {
+    return available >= 4 && p[0] == 2 && p[1] == 2 &&
+           (p[2] << 8) + p[3] == width;
+}
 
-            while (run_len > 0) {
-                scanline[peek++] = p[1];
-                run_len--;
+//! \brief offset of every scanline in \a data, the last entry is the end of
+//! the image. The whole stream is validated here, so that the scanlines can
+//! then be decoded independently.
+static void indexScanlines(const std::vector<Trgbe> &data, int width,
+                           int height, std::vector<size_t> &offsets) {
+    offsets.resize(height + 1);
+
+    size_t pos = 0;
+    for (int y = 0; y < height; ++y) {
+        offsets[y] = pos;
+        if (!isRLEScanline(data.data() + pos, data.size() - pos, width)) {
+            //--- simple scanline (not rle)
+            pos += 4 * size_t(width);
+            if (pos > data.size()) {
+                throw pfs::Exception(
+                    "RGBE: not enough data to read "
+                    "in the simple format.");
             }
-        } else {
-            // a non-run
-            scanline[peek++] = p[1];
-
-            int nonrun_len = p[0] - 1;
-            if (nonrun_len > 0) {
-                if (fread(scanline + peek, sizeof(*scanline), nonrun_len,
-                          file) == 0) {
+            continue;
+        }
+
+        //--- rle scanline: each channel is encoded separately
+        pos += 4;
+        for (int ch = 0; ch < 4; ++ch) {
+            int peek = 0;
+            while (peek < width) {
+                if (pos + 2 > data.size()) {
                     throw pfs::io::ReadException("RGBE: Invalid data size");
+                }
+                if (data[pos] > 128) {
+                    // a run
+                    peek += data[pos] - 128;
+                    pos += 2;
                 } else {
+                    // a non-run
+                    const int nonrun_len = std::max<int>(data[pos], 1);
                     peek += nonrun_len;
+                    pos += 1 + nonrun_len;
+                    if (pos > data.size()) {
+                        throw pfs::io::ReadException(
+                            "RGBE: Invalid data size");
+                    }
                 }
             }
+            if (peek != width) {
+                throw pfs::io::ReadException(
+                    "RGBE: difference in size while reading RLE scanline");
+            }
+        }
+    }
+    offsets[height] = pos;
+}
+
+//! \brief decode the scanline at \a in into 4 planes of \a width bytes
+static void decodeScanline(const Trgbe *in, int width, Trgbe *planes) {
+    if (!isRLEScanline(in, 4, width)) {
+        for (int x = 0; x < width; ++x) {
+            for (int ch = 0; ch < 4; ++ch) {
+                planes[ch * width + x] = in[4 * x + ch];
+            }
         }
+        return;
     }
-    if (peek != size) {
-        throw pfs::io::ReadException(
-            "RGBE: difference in size while reading RLE scanline");
+
+    in += 4;
+    for (int ch = 0; ch < 4; ++ch) {
+        Trgbe *scanline = planes + ch * width;
+        int peek = 0;
+        while (peek < width) {
+            if (in[0] > 128) {
+                // a run
+                const int run_len = in[0] - 128;
+                std::memset(scanline + peek, in[1], run_len);
+                peek += run_len;
+                in += 2;
+            } else {
+                // a non-run
+                const int nonrun_len = std::max<int>(in[0], 1);
+                std::memcpy(scanline + peek, in + 1, nonrun_len);
+                peek += nonrun_len;
+                in += 1 + nonrun_len;
+            }
+        }
     }
 }
 
+//! \brief decode the pixel data, read in one block: a first pass finds where
+//! each scanline starts, then they are decoded in parallel
 void readRadiance(FILE *file, int width, int height, float exposure,
                   pfs::Array2Df &X, pfs::Array2Df &Y, pfs::Array2Df &Z) {
     // read image
-    // depending on format read either rle or normal (note: only rle supported)
-    std::vector<Trgbe> scanline(width * 4);
-
-    for (int y = 0; y < height; ++y) {
-        // read rle header
-        Trgbe header[4];
-        if (fread(header, sizeof(header), 1, file) == sizeof(header)) {
-            throw pfs::io::ReadException("RGBE: invalid data size");
-        }
-        if (header[0] != 2 || header[1] != 2 ||
-            (header[2] << 8) + header[3] != width) {
-            //--- simple scanline (not rle)
-            size_t rez =
-                fread(scanline.data() + 4, sizeof(Trgbe), 4 * width - 4, file);
-            if (rez != (size_t)4 * width - 4) {
-                //     DEBUG_STR << "RGBE: scanline " << y
-                //           << "(" << (int)rez << "/" << width << ")" <<endl;
-                throw pfs::Exception(
-                    "RGBE: not enough data to read "
-                    "in the simple format.");
-            }
-            //--- yes, we've read one pixel as a header
-            scanline[0] = header[0];
-            scanline[1] = header[1];
-            scanline[2] = header[2];
-            scanline[3] = header[3];
-
-            //--- write scanline to the image
-            for (int x = 0; x < width; ++x) {
-                Trgbe_pixel rgbe;
-                rgbe.r = scanline[4 * x + 0];
-                rgbe.g = scanline[4 * x + 1];
-                rgbe.b = scanline[4 * x + 2];
-                rgbe.e = scanline[4 * x + 3];
-
-                rgbe2rgb(rgbe, exposure, X(x, y), Y(x, y), Z(x, y));
-            }
-        } else {
-            //--- rle scanline
-            //--- each channel is encoded separately
-            for (int ch = 0; ch < 4; ++ch) {
-                RLERead(file, scanline.data() + width * ch, width);
-            }
+    // depending on format read either rle or normal
+    std::vector<Trgbe> data;
+    readRemaining(file, data);
 
-            //--- write scanline to the image
-            for (int x = 0; x < width; ++x) {
-                Trgbe_pixel rgbe;
-                rgbe.r = scanline[x + width * 0];
-                rgbe.g = scanline[x + width * 1];
-                rgbe.b = scanline[x + width * 2];
-                rgbe.e = scanline[x + width * 3];
+    std::vector<size_t> offsets;
+    indexScanlines(data, width, height, offsets);
 
-                rgbe2rgb(rgbe, exposure, X(x, y), Y(x, y), Z(x, y));
-            }
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<Trgbe> planes(4 * size_t(width));
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int y = 0; y < height; ++y) {
+            decodeScanline(data.data() + offsets[y], width, planes.data());
+            convertScanline(planes.data(), width, exposure, &X(0, y),
+                            &Y(0, y), &Z(0, y));
         }
     }
 }
@@ -21,24 +21,31 @@
  * ----------------------------------------------------------------------
  */
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <vector>
 
+#include <stdint.h>
+
 #include <Libpfs/channel.h>
 #include <Libpfs/frame.h>
 
 #include <Libpfs/io/rgbecommon.h>
 #include <Libpfs/io/rgbewriter.h>
 #include <Libpfs/utils/resourcehandlerstdio.h>
+#include "opthelper.h"
 
 using namespace std;
 
 namespace pfs {
 namespace io {
 
-int RLEWrite(FILE *file, Trgbe *scanline, int size) {
-    Trgbe *scanend = scanline + size;
+//! \brief append the run length encoding of \a size bytes to \a out, false
+//! when the runs do not add up to \a size
+bool RLEWrite(const Trgbe *scanline, int size, std::vector<Trgbe> &out) {
+    const Trgbe *scanend = scanline + size;
     while (scanline < scanend) {
         int run_start = 0;
         int peek = 0;
@@ -57,60 +64,127 @@ int RLEWrite(FILE *file, Trgbe *scanline, int size) {
         if (run_len > 4) {
             // write a non run: scanline[0] to scanline[run_start]
             if (run_start > 0) {
-                std::vector<Trgbe> buf(run_start + 1);
-
-                buf[0] = run_start;
-                for (int i = 0; i < run_start; i++) {
-                    buf[i + 1] = scanline[i];
-                }
-                fwrite(buf.data(), sizeof(Trgbe), run_start + 1, file);
+                out.push_back(run_start);
+                out.insert(out.end(), scanline, scanline + run_start);
             }
 
             // write a run: scanline[run_start], run_len
-            Trgbe buf[2];
-            buf[0] = 128 + run_len;
-            buf[1] = scanline[run_start];
-            fwrite(buf, sizeof(*buf), 2, file);
+            out.push_back(128 + run_len);
+            out.push_back(scanline[run_start]);
         } else {
             // write a non run: scanline[0] to scanline[peek]
-            std::vector<Trgbe> buf(peek + 1);
-
-            buf[0] = peek;
-            for (int i = 0; i < peek; i++) {
-                buf[i + 1] = scanline[i];
-            }
-            fwrite(buf.data(), sizeof(Trgbe), peek + 1, file);
+            out.push_back(peek);
+            out.insert(out.end(), scanline, scanline + peek);
         }
         scanline += peek;
     }
 
-    if (scanline != scanend) {
-        throw pfs::io::WriteException(
-            "RGBE: difference in size while writing RLE scanline");
+    return (scanline == scanend);
+}
+
+//! \brief smallest float that the original double test v < 1e-32 lets through
+static float zeroThreshold() {
+    float threshold = 1e-32f;
+    if (double(threshold) < 1e-32) {
+        threshold = std::nextafter(threshold, 1.f);
     }
+    return threshold;
+}
+
+static inline uint32_t floatBits(float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
 
-    return 0;
+static inline float bitsFloat(uint32_t bits) {
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
 }
 
+//! \brief mantissas truncated against the largest component: for v in
+//! [2^(k-1), 2^k), frexp() gives the exponent k and the scale 2^(8-k) is built
+//! from its bits. All products are exact, so the result matches frexp().
 void rgb2rgbe(float r, float g, float b, Trgbe_pixel &rgbe) {
+    static const float threshold = zeroThreshold();
+
     r /= WHITE_EFFICACY;
     g /= WHITE_EFFICACY;
     b /= WHITE_EFFICACY;
 
-    double v = r;  // max rgb value
+    float v = r;  // max rgb value
     if (v < g) v = g;
     if (v < b) v = b;
 
-    if (v < 1e-32) {
+    if (!(v >= threshold)) {
         rgbe.r = rgbe.g = rgbe.b = rgbe.e = 0;
     } else {
-        int e;  // exponent
+        const int exponent = (floatBits(v) >> 23) & 0xff;
+        const float scale = bitsFloat(uint32_t(261 - exponent) << 23);
 
-        v = frexp(v, &e) * 256.0 / v;
-        rgbe.r = Trgbe(v * r);
-        rgbe.g = Trgbe(v * g);
-        rgbe.b = Trgbe(v * b);
-        rgbe.e = Trgbe(e + 128);
+        rgbe.r = Trgbe(std::max(0.f, r * scale));
+        rgbe.g = Trgbe(std::max(0.f, g * scale));
+        rgbe.b = Trgbe(std::max(0.f, b * scale));
+        rgbe.e = Trgbe(exponent + 2);
+    }
+}
+
+//! \brief encode one scanline into 4 planes of \a width bytes
+static void encodeScanline(const float *r, const float *g, const float *b,
+                           int width, Trgbe *planes) {
+    Trgbe *rOut = planes;
+    Trgbe *gOut = planes + width;
+    Trgbe *bOut = planes + 2 * width;
+    Trgbe *eOut = planes + 3 * width;
+
+    int x = 0;
+#ifdef __SSE2__
+    static const float threshold = zeroThreshold();
+    const vfloat efficacyv = F2V(WHITE_EFFICACY);
+    const vfloat thresholdv = F2V(threshold);
+    const vint exponentMask = _mm_set1_epi32(0xff);
+    const vint biasv = _mm_set1_epi32(261);
+    const vint twov = _mm_set1_epi32(2);
+    for (; x + 3 < width; x += 4) {
+        const vfloat rv = _mm_div_ps(LVFU(r[x]), efficacyv);
+        const vfloat gv = _mm_div_ps(LVFU(g[x]), efficacyv);
+        const vfloat bv = _mm_div_ps(LVFU(b[x]), efficacyv);
+        const vfloat v = _mm_max_ps(_mm_max_ps(rv, gv), bv);
+        const vint keep = _mm_castps_si128(_mm_cmpge_ps(v, thresholdv));
+
+        const vint exponent = _mm_and_si128(
+            _mm_srli_epi32(_mm_castps_si128(v), 23), exponentMask);
+        const vfloat scale = _mm_castsi128_ps(
+            _mm_slli_epi32(_mm_sub_epi32(biasv, exponent), 23));
+
+        // saturating packs clamp the mantissas to [0, 255]
+        const vint rq =
+            _mm_and_si128(keep, _mm_cvttps_epi32(_mm_mul_ps(rv, scale)));
+        const vint gq =
+            _mm_and_si128(keep, _mm_cvttps_epi32(_mm_mul_ps(gv, scale)));
+        const vint bq =
+            _mm_and_si128(keep, _mm_cvttps_epi32(_mm_mul_ps(bv, scale)));
+        const vint eq = _mm_and_si128(keep, _mm_add_epi32(exponent, twov));
+
+        // R G B E, 4 bytes each
+        const vint rgbe = _mm_packus_epi16(_mm_packs_epi32(rq, gq),
+                                           _mm_packs_epi32(bq, eq));
+        int32_t packed[4];
+        _mm_storeu_si128(reinterpret_cast<vint *>(packed), rgbe);
+        std::memcpy(rOut + x, &packed[0], 4);
+        std::memcpy(gOut + x, &packed[1], 4);
+        std::memcpy(bOut + x, &packed[2], 4);
+        std::memcpy(eOut + x, &packed[3], 4);
+    }
+#endif
+    for (; x < width; x++) {
+        Trgbe_pixel p;
+        rgb2rgbe(r[x], g[x], b[x], p);
+        rOut[x] = p.r;
+        gOut[x] = p.g;
+        bOut[x] = p.b;
+        eOut[x] = p.e;
     }
 }
 
@@ -141,35 +215,68 @@ void writeRadiance(FILE *file, const pfs::Array2Df &X, const pfs::Array2Df &Y,
     // image size
     fprintf(file, "-Y %d +X %d\n", (int)height, (int)width);
 
-    // image run length encoded
-    std::vector<Trgbe> scanlineR(width);
-    std::vector<Trgbe> scanlineG(width);
-    std::vector<Trgbe> scanlineB(width);
-    std::vector<Trgbe> scanlineE(width);
-
-    for (size_t y = 0; y < height; ++y) {
-        // write rle header
-        unsigned char header[4];
-        header[0] = 2;
-        header[1] = 2;
-        header[2] = width >> 8;
-        ;
-        header[3] = width & 0xFF;
-        fwrite(header, sizeof(header), 1, file);
-
-        // each channel is encoded separately
-        for (size_t x = 0; x < width; x++) {
-            Trgbe_pixel p;
-            rgb2rgbe(X(x, y), Y(x, y), Z(x, y), p);
-            scanlineR[x] = p.r;
-            scanlineG[x] = p.g;
-            scanlineB[x] = p.b;
-            scanlineE[x] = p.e;
+    // run length encoding is only defined for these widths: outside of them
+    // scanlines are written flat
+    const bool rle = (width >= 8 && width <= 0x7fff);
+
+    // bands of scanlines are encoded in parallel, then written in order
+    const int bandRows = 64;
+    std::vector<std::vector<Trgbe>> encoded(bandRows);
+
+    for (size_t first = 0; first < height; first += bandRows) {
+        const int rows = (int)std::min<size_t>(bandRows, height - first);
+        int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel reduction(+ : failed)
+#endif
+        {
+            std::vector<Trgbe> planes(4 * width);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+            for (int i = 0; i < rows; ++i) {
+                const size_t y = first + i;
+                std::vector<Trgbe> &out = encoded[i];
+                out.clear();
+                encodeScanline(&X(0, y), &Y(0, y), &Z(0, y), (int)width,
+                               planes.data());
+
+                if (!rle) {
+                    out.resize(4 * width);
+                    for (size_t x = 0; x < width; ++x) {
+                        for (int ch = 0; ch < 4; ++ch) {
+                            out[4 * x + ch] = planes[ch * width + x];
+                        }
+                    }
+                    continue;
+                }
+
+                // rle header
+                out.push_back(2);
+                out.push_back(2);
+                out.push_back(width >> 8);
+                out.push_back(width & 0xFF);
+
+                // each channel is encoded separately
+                for (int ch = 0; ch < 4; ++ch) {
+                    if (!RLEWrite(planes.data() + ch * width, (int)width,
+                                  out)) {
+                        failed++;
+                    }
+                }
+            }
+        }
+        if (failed) {
+            throw pfs::io::WriteException(
+                "RGBE: difference in size while writing RLE scanline");
+        }
+
+        for (int i = 0; i < rows; ++i) {
+            if (fwrite(encoded[i].data(), sizeof(Trgbe), encoded[i].size(),
+                       file) != encoded[i].size()) {
+                throw pfs::io::WriteException("RGBE: cannot write scanline");
+            }
         }
-        RLEWrite(file, scanlineR.data(), width);
-        RLEWrite(file, scanlineG.data(), width);
-        RLEWrite(file, scanlineB.data(), width);
-        RLEWrite(file, scanlineE.data(), width);
     }
 }
 
@@ -35,6 +35,10 @@
 #include <Libpfs/io/tiffwriter.h>
 
 #include <tiffio.h>
+#include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 
 #include <stdint.h>
 #include <algorithm>
@@ -59,6 +63,7 @@
 #include <Libpfs/utils/chain.h>
 #include <Libpfs/utils/clamp.h>
 #include <Libpfs/utils/resourcehandlerlcms.h>
+#include <Libpfs/utils/transform.h>
 
 using namespace std;
 using namespace boost;
@@ -81,7 +86,8 @@ struct TiffWriterParams {
           luminanceMapping_(MAP_LINEAR),
           tiffWriterMode_(0)  // 8bit uint by default
           ,
-          deflateCompression_(true) {}
+          deflateCompression_(true),
+          deflateLevel_(-1) {}
 
     void parse(const Params &params) {
         for (Params::const_iterator it = params.begin(), itEnd = params.end();
@@ -109,6 +115,10 @@ struct TiffWriterParams {
             }
             if (it->first == "deflateCompression") {
                 deflateCompression_ = it->second.as<bool>(deflateCompression_);
+                continue;
+            }
+            if (it->first == "deflate_level") {
+                deflateLevel_ = it->second.as<int>(deflateLevel_);
                 // continue;
             }
         }
@@ -120,6 +130,8 @@ struct TiffWriterParams {
     RGBMappingType luminanceMapping_;
     int tiffWriterMode_;
     bool deflateCompression_;
+    //! zlib level, -1 (zlib default) to 9: 1 is the fast setting
+    int deflateLevel_;
 };
 
 ostream &operator<<(ostream &out, const TiffWriterParams &params) {
@@ -130,15 +142,17 @@ ostream &operator<<(ostream &out, const TiffWriterParams &params) {
     ss << "min_luminance: " << params.minLuminance_ << ", ";
     ss << "max_luminance: " << params.maxLuminance_ << ", ";
     ss << "mapping_method: " << params.luminanceMapping_ << "]";
-    ss << "deflateCompression: " << params.deflateCompression_ << "]";
+    ss << "deflateCompression: " << params.deflateCompression_ << ", ";
+    ss << "deflate_level: " << params.deflateLevel_ << "]";
 
     return (out << ss.str());
 }
 
-void writeCommonHeader(TIFF *tif, uint32_t width, uint32_t height) {
+void writeCommonHeader(TIFF *tif, uint32_t width, uint32_t height,
+                       uint32_t rowsPerStrip = 1) {
     TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)width);
     TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)height);
-    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)1);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
     TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 }
 
@@ -157,75 +171,178 @@ void writeSRGBProfile(TIFF *tif) {
                  reinterpret_cast<void *>(embedBuffer.data()));
 }
 
-// Info: if you want to write the alpha channel, please use this!
-//    uint16 extras[1] = { EXTRASAMPLE_ASSOCALPHA };
-//    TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)4);
-//    TIFFSetField (tif, TIFFTAG_EXTRASAMPLES, (uint16_t)1, &extras);
+//! \brief rows per strip for strips of about s_stripSize bytes
+static const size_t s_stripSize = 64 * 1024;
 
-bool writeUint8(TIFF *tif, const Frame &frame, const TiffWriterParams &params) {
-#ifndef NDEBUG
-    cout << BOOST_CURRENT_FUNCTION << endl;
+uint32_t stripRows(uint32_t width, size_t sampleSize) {
+    const size_t rowSize = size_t(width) * 3 * sampleSize;
+    return (uint32_t)std::max<size_t>(1, s_stripSize / rowSize);
+}
+
+//! \brief compresses strips into zlib streams, as libtiff does for
+//! COMPRESSION_DEFLATE. One instance per thread.
+class StripCompressor {
+   public:
+    explicit StripCompressor(int level)
+        : m_level(level)
+#ifdef HAVE_LIBDEFLATE
+          ,
+          m_compressor(NULL)
 #endif
+    {
+    }
 
-    assert(tif != NULL);
+#ifdef HAVE_LIBDEFLATE
+    ~StripCompressor() {
+        if (m_compressor) libdeflate_free_compressor(m_compressor);
+    }
 
-    uint32_t width = frame.getWidth();
-    uint32_t height = frame.getHeight();
+    bool operator()(const void *data, size_t size,
+                    std::vector<Bytef> &out) {
+        if (!m_compressor) {
+            m_compressor =
+                libdeflate_alloc_compressor((m_level < 0) ? 6 : m_level);
+            if (!m_compressor) return false;
+        }
+        out.resize(libdeflate_zlib_compress_bound(m_compressor, size));
+        size = libdeflate_zlib_compress(m_compressor, data, size, out.data(),
+                                        out.size());
+        out.resize(size);
+        return size > 0;
+    }
+#else
+    bool operator()(const void *data, size_t size,
+                    std::vector<Bytef> &out) {
+        uLongf outSize = compressBound((uLong)size);
+        out.resize(outSize);
+        const int status =
+            compress2(out.data(), &outSize,
+                      reinterpret_cast<const Bytef *>(data), (uLong)size,
+                      m_level);
+        out.resize(outSize);
+        return status == Z_OK;
+    }
+#endif
 
-    writeCommonHeader(tif, width, height);
-    writeSRGBProfile(tif);
+   private:
+    StripCompressor(const StripCompressor &);
+    StripCompressor &operator=(const StripCompressor &);
 
-    if (params.deflateCompression_)
-        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-    TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE,
-                 (uint16_t)8 * (uint16_t)sizeof(uint8_t));
-    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)3);
+    int m_level;
+#ifdef HAVE_LIBDEFLATE
+    libdeflate_compressor *m_compressor;
+#endif
+};
 
-    tsize_t stripSize = TIFFStripSize(tif);
-    assert(width * 3 == stripSize);
-    tstrip_t stripsNum = TIFFNumberOfStrips(tif);
+//! \brief convert the first \a height rows of the frame with \a remapper and
+//! write them as strips of \a rowsPerStrip rows, from strip \a firstStrip on
+//! \note libtiff encodes on the calling thread only: the strips of a band are
+//! converted and deflated in parallel here, then written in order as raw
+//! strips
+template <typename T, typename TiffRemapper>
+void writeStrips(TIFF *tif, const Frame &frame, uint32_t firstStrip,
+                 uint32_t height, uint32_t rowsPerStrip,
+                 const TiffWriterParams &params, const TiffRemapper &remapper) {
+    const uint32_t width = frame.getWidth();
+    const size_t rowSize = size_t(width) * 3;
+    const int stripsNum = (int)((height + rowsPerStrip - 1) / rowsPerStrip);
+    const int bandStrips = 32;
+    const int level = std::max(-1, std::min(params.deflateLevel_, 9));
 
     const Channel *rChannel;
     const Channel *gChannel;
     const Channel *bChannel;
     frame.getXYZChannels(rChannel, gChannel, bChannel);
 
-    std::vector<uint8_t> stripBuffer(stripSize);
-    for (tstrip_t s = 0; s < stripsNum; s++) {
-        utils::transform(
-            rChannel->row_begin(s), rChannel->row_end(s),
-            gChannel->row_begin(s), bChannel->row_begin(s),
-            FixedStrideIterator<uint8_t *, 3>(stripBuffer.data()),
-            FixedStrideIterator<uint8_t *, 3>(stripBuffer.data() + 1),
-            FixedStrideIterator<uint8_t *, 3>(stripBuffer.data() + 2),
-            utils::chain(colorspace::Normalizer(params.minLuminance_,
-                                                params.maxLuminance_),
-                         utils::CLAMP_F32,
-                         Remapper<uint8_t>(params.luminanceMapping_)));
+    std::vector<std::vector<T>> strips(bandStrips);
+    std::vector<std::vector<Bytef>> compressed(bandStrips);
 
-        if (TIFFWriteEncodedStrip(tif, s, stripBuffer.data(), stripSize) !=
-            stripSize) {
-            throw pfs::io::WriteException("TiffWriter: Error writing strip " +
-                                          boost::lexical_cast<std::string>(s));
-            return false;
+    for (int first = 0; first < stripsNum; first += bandStrips) {
+        const int count = std::min(bandStrips, stripsNum - first);
+        int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel reduction(+ : failed)
+#endif
+        {
+            StripCompressor compress(level);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+            for (int i = 0; i < count; i++) {
+                const uint32_t row0 = (first + i) * rowsPerStrip;
+                const uint32_t rows = std::min(rowsPerStrip, height - row0);
+                std::vector<T> &strip = strips[i];
+                strip.resize(rows * rowSize);
+
+                for (uint32_t r = 0; r < rows; r++) {
+                    T *out = strip.data() + r * rowSize;
+                    utils::transform(rChannel->row_begin(row0 + r),
+                                     rChannel->row_end(row0 + r),
+                                     gChannel->row_begin(row0 + r),
+                                     bChannel->row_begin(row0 + r),
+                                     FixedStrideIterator<T *, 3>(out),
+                                     FixedStrideIterator<T *, 3>(out + 1),
+                                     FixedStrideIterator<T *, 3>(out + 2),
+                                     remapper);
+                }
+
+                if (params.deflateCompression_ &&
+                    !compress(strip.data(), strip.size() * sizeof(T),
+                              compressed[i])) {
+                    failed++;
+                }
+            }
+        }
+        if (failed) {
+            throw pfs::io::WriteException(
+                "TiffWriter: Error compressing strips");
+        }
+
+        for (int i = 0; i < count; i++) {
+            void *data;
+            tsize_t size;
+            if (params.deflateCompression_) {
+                data = compressed[i].data();
+                size = compressed[i].size();
+            } else {
+                data = strips[i].data();
+                size = strips[i].size() * sizeof(T);
+            }
+            if (TIFFWriteRawStrip(tif, firstStrip + first + i, data, size) !=
+                size) {
+                throw pfs::io::WriteException(
+                    "TiffWriter: Error writing strip " +
+                    boost::lexical_cast<std::string>(firstStrip + first + i));
+            }
         }
     }
-    return true;
 }
 
-bool writeUint16(TIFF *tif, const Frame &frame,
-                 const TiffWriterParams &params) {
-#ifndef NDEBUG
-    cout << BOOST_CURRENT_FUNCTION << endl;
-#endif
+// Info: if you want to write the alpha channel, please use this!
+//    uint16 extras[1] = { EXTRASAMPLE_ASSOCALPHA };
+//    TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)4);
+//    TIFFSetField (tif, TIFFTAG_EXTRASAMPLES, (uint16_t)1, &extras);
+
+//! \brief RGB to the samples of the 8 and 16 bit modes
+template <typename T>
+utils::Chain<colorspace::Normalizer,
+             utils::Chain<utils::Clamp<float>, Remapper<T>>>
+uintRemapper(const TiffWriterParams &params) {
+    return utils::chain(
+        colorspace::Normalizer(params.minLuminance_, params.maxLuminance_),
+        utils::Clamp<float>(0.f, 1.f), Remapper<T>(params.luminanceMapping_));
+}
+
+//! \brief write the tags of the 8 and 16 bit modes
+//! \return the rows per strip
+template <typename T>
+uint32_t writeUintHeader(TIFF *tif, uint32_t width, uint32_t height,
+                         const TiffWriterParams &params) {
     assert(tif != NULL);
 
-    uint32_t width = frame.getWidth();
-    uint32_t height = frame.getHeight();
+    uint32_t rowsPerStrip = stripRows(width, sizeof(T));
 
-    writeCommonHeader(tif, width, height);
+    writeCommonHeader(tif, width, height, rowsPerStrip);
     writeSRGBProfile(tif);
 
     if (params.deflateCompression_) {
@@ -233,46 +350,22 @@ bool writeUint16(TIFF *tif, const Frame &frame,
     }
     TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
     TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE,
-                 (uint16_t)8 * (uint16_t)sizeof(uint16_t));
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)8 * (uint16_t)sizeof(T));
     TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)3);
 
-    tsize_t stripSize = TIFFStripSize(tif);
-    assert(width * 3 * 2 == stripSize);
-    tstrip_t stripsNum = TIFFNumberOfStrips(tif);
-
-    const Channel *rChannel;
-    const Channel *gChannel;
-    const Channel *bChannel;
-    frame.getXYZChannels(rChannel, gChannel, bChannel);
-
-    std::vector<uint16_t> stripBuffer(width * 3);
-
-    typedef utils::Chain<colorspace::Normalizer,
-                         utils::Chain<utils::Clamp<float>, Remapper<uint16_t>>>
-        TiffRemapper;
+    return rowsPerStrip;
+}
 
-    TiffRemapper remapper(
-        colorspace::Normalizer(params.minLuminance_, params.maxLuminance_),
-        utils::Chain<utils::Clamp<float>, Remapper<uint16_t>>(
-            utils::Clamp<float>(0.f, 1.f),
-            Remapper<uint16_t>(params.luminanceMapping_)));
-    for (tstrip_t s = 0; s < stripsNum; s++) {
-        utils::transform(
-            rChannel->row_begin(s), rChannel->row_end(s),
-            gChannel->row_begin(s), bChannel->row_begin(s),
-            FixedStrideIterator<uint16_t *, 3>(stripBuffer.data()),
-            FixedStrideIterator<uint16_t *, 3>(stripBuffer.data() + 1),
-            FixedStrideIterator<uint16_t *, 3>(stripBuffer.data() + 2),
-            remapper);
-        if (TIFFWriteEncodedStrip(tif, s, stripBuffer.data(), stripSize) !=
-            stripSize) {
-            throw pfs::io::WriteException("TiffWriter: Error writing strip " +
-                                          boost::lexical_cast<std::string>(s));
-            return false;
-        }
-    }
+template <typename T>
+bool writeUint(TIFF *tif, const Frame &frame, const TiffWriterParams &params) {
+#ifndef NDEBUG
+    cout << BOOST_CURRENT_FUNCTION << endl;
+#endif
+    uint32_t rowsPerStrip = writeUintHeader<T>(tif, frame.getWidth(),
+                                               frame.getHeight(), params);
 
+    writeStrips<T>(tif, frame, 0, frame.getHeight(), rowsPerStrip, params,
+                   uintRemapper<T>(params));
     return true;
 }
 
@@ -286,8 +379,9 @@ bool writeFloat32(TIFF *tif, const Frame &frame,
 
     uint32_t width = frame.getWidth();
     uint32_t height = frame.getHeight();
+    uint32_t rowsPerStrip = stripRows(width, sizeof(float));
 
-    writeCommonHeader(tif, width, height);
+    writeCommonHeader(tif, width, height, rowsPerStrip);
     // writeSRGBProfile(tif);
 
     if (params.deflateCompression_) {
@@ -299,40 +393,17 @@ bool writeFloat32(TIFF *tif, const Frame &frame,
                  (uint16_t)8 * (uint16_t)sizeof(float));
     TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)3);
 
-    tsize_t stripSize = TIFFStripSize(tif);
-    assert((tsize_t)sizeof(float) * width * 3 == stripSize);
-    tstrip_t stripsNum = TIFFNumberOfStrips(tif);
-
-    const Channel *rChannel;
-    const Channel *gChannel;
-    const Channel *bChannel;
-    frame.getXYZChannels(rChannel, gChannel, bChannel);
-
     PRINT_DEBUG(params.minLuminance_);
     PRINT_DEBUG(params.maxLuminance_);
 
-    std::vector<float> stripBuffer(width * 3);
     typedef utils::Chain<colorspace::Normalizer, utils::Clamp<float>>
         TiffRemapper;
     // Mapping is linear, so I avoid to call the Remapper class
     TiffRemapper remapper(
         colorspace::Normalizer(params.minLuminance_, params.maxLuminance_),
         utils::Clamp<float>(0.f, 1.f));
-    for (tstrip_t s = 0; s < stripsNum; s++) {
-        utils::transform(
-            rChannel->row_begin(s), rChannel->row_end(s),
-            gChannel->row_begin(s), bChannel->row_begin(s),
-            FixedStrideIterator<float *, 3>(stripBuffer.data()),
-            FixedStrideIterator<float *, 3>(stripBuffer.data() + 1),
-            FixedStrideIterator<float *, 3>(stripBuffer.data() + 2), remapper);
-        if (TIFFWriteEncodedStrip(tif, s, stripBuffer.data(), stripSize) == 0) {
-            throw pfs::io::WriteException("TiffWriter: Error writing strip " +
-                                          boost::lexical_cast<std::string>(s));
-
-            return -1;
-        }
-    }
 
+    writeStrips<float>(tif, frame, 0, height, rowsPerStrip, params, remapper);
     return true;
 }
 
@@ -420,7 +491,7 @@ bool TiffWriter::write(const pfs::Frame &frame, const pfs::Params &params) {
     bool status = true;
     switch (p.tiffWriterMode_) {
         case 1:
-            status = writeUint16(tif.data(), frame, p);
+            status = writeUint<uint16_t>(tif.data(), frame, p);
             break;
         case 2:
             status = writeFloat32(tif.data(), frame, p);
@@ -430,12 +501,120 @@ bool TiffWriter::write(const pfs::Frame &frame, const pfs::Params &params) {
             break;
         case 0:
         default:
-            status = writeUint8(tif.data(), frame, p);
+            status = writeUint<uint8_t>(tif.data(), frame, p);
             break;
     }
 
     return status;
 }
 
+struct TiffRowWriter::TiffRowWriterData {
+    TiffRowWriterData(TIFF *tif, size_t width, size_t height)
+        : tif_(tif),
+          width_(width),
+          height_(height),
+          rowsPerStrip_(1),
+          nextStrip_(0),
+          pending_(width, 0) {}
+
+    template <typename T>
+    void writeBand(const Frame &band, uint32_t rows) {
+        writeStrips<T>(tif_.data(), band, nextStrip_, rows, rowsPerStrip_,
+                       params_, uintRemapper<T>(params_));
+    }
+
+    ScopedTiffFile tif_;
+    TiffWriterParams params_;
+    size_t width_;
+    size_t height_;
+    uint32_t rowsPerStrip_;
+    uint32_t nextStrip_;
+    // rows not filling a strip yet
+    Frame pending_;
+};
+
+TiffRowWriter::TiffRowWriter(const std::string &filename, size_t width,
+                             size_t height, const pfs::Params &params) {
+    TiffWriterParams p;
+    p.parse(params);
+    if (p.tiffWriterMode_ != 0 && p.tiffWriterMode_ != 1) {
+        throw pfs::io::WriteException(
+            "TiffRowWriter: only 8 and 16 bit files can be written by rows");
+    }
+
+    TIFF *tif = TIFFOpen(filename.c_str(), "w");
+    if (!tif) {
+        throw pfs::io::InvalidFile("TiffRowWriter: cannot open " + filename);
+    }
+    m_data.reset(new TiffRowWriterData(tif, width, height));
+    m_data->params_ = p;
+    m_data->rowsPerStrip_ =
+        (p.tiffWriterMode_ == 1)
+            ? writeUintHeader<uint16_t>(tif, width, height, p)
+            : writeUintHeader<uint8_t>(tif, width, height, p);
+
+    Channel *X, *Y, *Z;
+    m_data->pending_.createXYZChannels(X, Y, Z);
+}
+
+TiffRowWriter::~TiffRowWriter() {}
+
+void TiffRowWriter::write(const pfs::Frame &rows) {
+    TiffRowWriterData &d = *m_data;
+    const size_t done = size_t(d.nextStrip_) * d.rowsPerStrip_;
+    const size_t count = d.pending_.getHeight() + rows.getHeight();
+    if (rows.getWidth() != d.width_ || done + count > d.height_) {
+        throw pfs::io::WriteException("TiffRowWriter: rows out of the image");
+    }
+
+    // the rows left over from the previous call, then the new ones
+    Frame band(d.width_, count);
+    Channel *bX, *bY, *bZ;
+    band.createXYZChannels(bX, bY, bZ);
+    Channel *bandChannels[] = {bX, bY, bZ};
+
+    const Channel *pX, *pY, *pZ;
+    d.pending_.getXYZChannels(pX, pY, pZ);
+    const Channel *pendingChannels[] = {pX, pY, pZ};
+
+    const Channel *rX, *rY, *rZ;
+    rows.getXYZChannels(rX, rY, rZ);
+    const Channel *rowsChannels[] = {rX, rY, rZ};
+
+    for (int c = 0; c < 3; c++) {
+        std::copy(rowsChannels[c]->begin(), rowsChannels[c]->end(),
+                  std::copy(pendingChannels[c]->begin(),
+                            pendingChannels[c]->end(), bandChannels[c]->begin()));
+    }
+
+    // only the last strip of the image may be shorter
+    const size_t ready = (done + count == d.height_)
+                             ? count
+                             : count / d.rowsPerStrip_ * d.rowsPerStrip_;
+    if (ready > 0) {
+        if (d.params_.tiffWriterMode_ == 1) {
+            d.writeBand<uint16_t>(band, uint32_t(ready));
+        } else {
+            d.writeBand<uint8_t>(band, uint32_t(ready));
+        }
+        d.nextStrip_ += uint32_t((ready + d.rowsPerStrip_ - 1) / d.rowsPerStrip_);
+    }
+
+    Frame pending(d.width_, count - ready);
+    Channel *nX, *nY, *nZ;
+    pending.createXYZChannels(nX, nY, nZ);
+    Channel *nextChannels[] = {nX, nY, nZ};
+    for (int c = 0; c < 3; c++) {
+        std::copy(bandChannels[c]->row_begin(ready), bandChannels[c]->end(),
+                  nextChannels[c]->begin());
+    }
+    d.pending_.swap(pending);
+}
+
+bool TiffRowWriter::complete() const {
+    return size_t(m_data->nextStrip_) * m_data->rowsPerStrip_ >=
+           m_data->height_;
+}
+
 }  // io
 }  // pfs
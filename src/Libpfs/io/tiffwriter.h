@@ -36,6 +36,7 @@
 
 #include <Libpfs/io/framewriter.h>
 #include <Libpfs/params.h>
+#include <memory>
 #include <string>
 
 namespace pfs {
@@ -58,6 +59,31 @@ class TiffWriter : public FrameWriter {
     bool write(const pfs::Frame &frame, const pfs::Params &params);
 };
 
+//! \brief Writer of an 8 or 16 bit TIFF file a band of rows at a time, top
+//! to bottom, for images too large to be held in memory
+class TiffRowWriter {
+   public:
+    //! \brief create \a filename, of \a width x \a height pixels
+    //! \c params as TiffWriter::write(), with tiff_mode 0 or 1
+    //! \throw InvalidFile if the file cannot be created
+    //! \throw WriteException if tiff_mode is not 0 or 1
+    TiffRowWriter(const std::string &filename, size_t width, size_t height,
+                  const pfs::Params &params);
+    ~TiffRowWriter();
+
+    //! \brief append the rows of \a rows, RGB in its XYZ channels, to the
+    //! image. Rows are written as soon as they fill a strip.
+    //! \throw WriteException if \a rows does not fit in the image
+    void write(const pfs::Frame &rows);
+
+    //! \brief true once every row of the image is written
+    bool complete() const;
+
+   private:
+    struct TiffRowWriterData;
+    std::unique_ptr<TiffRowWriterData> m_data;
+};
+
 }  // io
 }  // pfs
 
@@ -0,0 +1,131 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#include "demosaic.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Libpfs/frame.h"
+
+namespace pfs {
+
+BayerFrame::BayerFrame() : saturation(1.f) {
+    // RGGB, no white balance, camera space is sRGB
+    cfa[0][0] = 0;
+    cfa[0][1] = 1;
+    cfa[1][0] = 1;
+    cfa[1][1] = 2;
+    for (int i = 0; i < 3; ++i) {
+        whiteBalance[i] = 1.f;
+        for (int j = 0; j < 3; ++j) {
+            rgbCam[i][j] = (i == j) ? 1.f : 0.f;
+        }
+    }
+}
+
+namespace {
+inline float balance(float value, float wb, float saturation) {
+    return std::min(value * wb, saturation);
+}
+}
+
+void demosaic(const BayerFrame &in, Frame &out) {
+    const int W = in.data.getCols();
+    const int H = in.data.getRows();
+    assert(W >= 2 && H >= 2);
+
+    out.resize(W, H);
+    Channel *C[3];
+    out.createXYZChannels(C[0], C[1], C[2]);
+    float *outData[3] = {C[0]->data(), C[1]->data(), C[2]->data()};
+    const float *data = in.data.data();
+
+    // highlights as LibRaw's highlight mode 0: the photosites are white
+    // balanced with the lowest multiplier at 1, then clipped at the
+    // saturation level. Photosites clipped in every channel stay neutral
+    // instead of taking the tint of the multipliers.
+    float wbMin = std::min(in.whiteBalance[0],
+                           std::min(in.whiteBalance[1], in.whiteBalance[2]));
+    if (!(wbMin > 0.f)) {
+        wbMin = 1.f;
+    }
+    float wb[3];
+    float M[3][3];
+    for (int i = 0; i < 3; ++i) {
+        wb[i] = in.whiteBalance[i] / wbMin;
+        for (int j = 0; j < 3; ++j) {
+            M[i][j] = in.rgbCam[i][j] * wbMin;
+        }
+    }
+    const float saturation = in.saturation;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16)
+#endif
+    for (int y = 0; y < H; ++y) {
+        // neighbours outside the image are mirrored by two photosites, which
+        // keeps their colour
+        const float *rowN = data + size_t(y > 0 ? y - 1 : y + 1) * W;
+        const float *row = data + size_t(y) * W;
+        const float *rowS = data + size_t(y + 1 < H ? y + 1 : y - 1) * W;
+        const int py = y & 1;
+
+        for (int x = 0; x < W; ++x) {
+            const int xW = (x > 0) ? x - 1 : x + 1;
+            const int xE = (x + 1 < W) ? x + 1 : x - 1;
+            const int px = x & 1;
+
+            // in a 2x2 pattern the vertical, horizontal and diagonal
+            // neighbours have one colour each
+            float sum[3] = {0.f, 0.f, 0.f};
+            float count[3] = {0.f, 0.f, 0.f};
+            const int cV = in.cfa[py ^ 1][px];
+            const int cH = in.cfa[py][px ^ 1];
+            const int cD = in.cfa[py ^ 1][px ^ 1];
+            sum[cV] += balance(rowN[x], wb[cV], saturation) +
+                       balance(rowS[x], wb[cV], saturation);
+            count[cV] += 2.f;
+            sum[cH] += balance(row[xW], wb[cH], saturation) +
+                       balance(row[xE], wb[cH], saturation);
+            count[cH] += 2.f;
+            sum[cD] += balance(rowN[xW], wb[cD], saturation) +
+                       balance(rowN[xE], wb[cD], saturation) +
+                       balance(rowS[xW], wb[cD], saturation) +
+                       balance(rowS[xE], wb[cD], saturation);
+            count[cD] += 4.f;
+
+            float cam[3];
+            for (int c = 0; c < 3; ++c) {
+                cam[c] = (count[c] > 0.f) ? sum[c] / count[c] : 0.f;
+            }
+            const int c0 = in.cfa[py][px];
+            cam[c0] = balance(row[x], wb[c0], saturation);
+
+            const size_t k = size_t(y) * W + x;
+            for (int c = 0; c < 3; ++c) {
+                outData[c][k] =
+                    M[c][0] * cam[0] + M[c][1] * cam[1] + M[c][2] * cam[2];
+            }
+        }
+    }
+}
+}
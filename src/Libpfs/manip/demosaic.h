@@ -0,0 +1,58 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#ifndef PFS_DEMOSAIC_H
+#define PFS_DEMOSAIC_H
+
+#include <Libpfs/array2d.h>
+
+namespace pfs {
+class Frame;
+
+//! \brief Linear sensor data behind a 2x2 Bayer colour filter array, as
+//! stored in a RAW file before demosaicing
+struct BayerFrame {
+    BayerFrame();
+
+    //! \brief colour (0: red, 1: green, 2: blue) of the photosite at (x, y)
+    int color(size_t x, size_t y) const { return cfa[y & 1][x & 1]; }
+
+    //! \brief photosite values, black level subtracted and scaled so that
+    //! 1.f is the nominal white point of the sensor
+    Array2Df data;
+    //! \brief colour of the top-left 2x2 tile, cfa[row][column]
+    int cfa[2][2];
+    //! \brief values at or above this level are clipped
+    float saturation;
+    //! \brief white balance multipliers, green is 1
+    float whiteBalance[3];
+    //! \brief camera RGB to linear sRGB, rgbCam[output][input]
+    float rgbCam[3][3];
+};
+
+//! \brief Bilinear demosaicing of \a in into the XYZ (red, green, blue)
+//! channels of \a out, white balanced, clipped at \c in.saturation and
+//! converted with \c in.rgbCam
+//! \note \a in must be at least 2x2
+void demosaic(const BayerFrame &in, Frame &out);
+}
+
+#endif  // PFS_DEMOSAIC_H
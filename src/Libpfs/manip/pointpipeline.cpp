@@ -0,0 +1,280 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+//! \brief Fused per-pixel operations on the RGB channels of a frame
+
+#include "pointpipeline.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "Libpfs/colorspace/saturation.h"
+#include "Libpfs/frame.h"
+#include "Libpfs/manip/copy.h"
+#include "Libpfs/utils/msec_timer.h"
+#include "opthelper.h"
+#include "sleef.c"
+#define pow_F(a,b) (xexpf(b*xlogf(a)))
+
+namespace pfs {
+
+//! \brief one operation of the pipeline, run on a tile of pixels
+class PointPipeline::Stage {
+   public:
+    virtual ~Stage() {}
+    virtual void operator()(float *r, float *g, float *b, size_t size) const = 0;
+};
+
+namespace {
+
+//! \brief 3 x 2048 floats: 24KB, the working set of a tile fits in L1
+const size_t s_tileSize = 2048;
+
+class GammaStage : public PointPipeline::Stage {
+   public:
+    explicit GammaStage(float exponent) : m_exponent(exponent) {}
+
+    void operator()(float *r, float *g, float *b, size_t size) const {
+        apply(r, size);
+        apply(g, size);
+        apply(b, size);
+    }
+
+   private:
+    void apply(float *data, size_t size) const {
+        size_t i = 0;
+#ifdef __SSE2__
+        const vfloat exponentv = F2V(m_exponent);
+        for (; i + 3 < size; i += 4) {
+            const vfloat v = LVFU(data[i]);
+            STVFU(data[i], vselfzero(vmaskf_gt(v, ZEROV), pow_F(v, exponentv)));
+        }
+#endif
+        for (; i < size; ++i) {
+            data[i] = (data[i] > 0.0f) ? pow_F(data[i], m_exponent) : 0.0f;
+        }
+    }
+
+    float m_exponent;
+};
+
+class SaturationStage : public PointPipeline::Stage {
+   public:
+    explicit SaturationStage(float multiplier) : m_saturation(multiplier) {}
+
+    void operator()(float *r, float *g, float *b, size_t size) const {
+        for (size_t i = 0; i < size; ++i) {
+            m_saturation(r[i], g[i], b[i], r[i], g[i], b[i]);
+        }
+    }
+
+   private:
+    colorspace::ChangeSaturation m_saturation;
+};
+
+class LevelsStage : public PointPipeline::Stage {
+   public:
+    LevelsStage(float black_in, float white_in, float black_out,
+                float white_out, float gamma)
+        : m_blackIn(black_in),
+          m_scale((white_out - black_out) / (white_in - black_in)),
+          m_inverseRange(1.f / (white_in - black_in)),
+          m_blackOut(black_out),
+          m_rangeOut(white_out - black_out),
+          m_gamma(gamma) {}
+
+    void operator()(float *r, float *g, float *b, size_t size) const {
+        if (m_gamma == 1.0f) {
+            linear(r, size);
+            linear(g, size);
+            linear(b, size);
+            return;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            const float L = 0.2126f * r[i] + 0.7152f * g[i] + 0.0722f * b[i];
+            const float c = powf(L, m_gamma - 1.0f) * m_inverseRange;
+            r[i] = clamp(m_blackOut + (r[i] - m_blackIn) * c * m_rangeOut);
+            g[i] = clamp(m_blackOut + (g[i] - m_blackIn) * c * m_rangeOut);
+            b[i] = clamp(m_blackOut + (b[i] - m_blackIn) * c * m_rangeOut);
+        }
+    }
+
+   private:
+    static float clamp(float v) {
+        if (v <= 0.f) return 0.f;
+        if (v >= 1.f) return 1.f;
+        return v;
+    }
+
+    //! \brief gamma 1: the luminance term is 1, each channel is an affine map
+    void linear(float *data, size_t size) const {
+        size_t i = 0;
+#ifdef __SSE2__
+        const vfloat blackInv = F2V(m_blackIn);
+        const vfloat scalev = F2V(m_scale);
+        const vfloat blackOutv = F2V(m_blackOut);
+        const vfloat onev = F2V(1.f);
+        for (; i + 3 < size; i += 4) {
+            const vfloat v = blackOutv + (LVFU(data[i]) - blackInv) * scalev;
+            STVFU(data[i], vminf(vmaxf(v, ZEROV), onev));
+        }
+#endif
+        for (; i < size; ++i) {
+            data[i] = clamp(m_blackOut + (data[i] - m_blackIn) * m_scale);
+        }
+    }
+
+    float m_blackIn;
+    float m_scale;
+    float m_inverseRange;
+    float m_blackOut;
+    float m_rangeOut;
+    float m_gamma;
+};
+}
+
+PointPipeline::PointPipeline() {}
+
+PointPipeline::~PointPipeline() {}
+
+PointPipeline &PointPipeline::gamma(float exponent) {
+    if (exponent != 1.0f) {
+        m_stages.push_back(std::make_shared<GammaStage>(exponent));
+    }
+    return *this;
+}
+
+PointPipeline &PointPipeline::saturation(float multiplier) {
+    if (multiplier != 1.0f) {
+        m_stages.push_back(std::make_shared<SaturationStage>(multiplier));
+    }
+    return *this;
+}
+
+PointPipeline &PointPipeline::levels(float black_in, float white_in,
+                                     float black_out, float white_out,
+                                     float gamma) {
+    m_stages.push_back(std::make_shared<LevelsStage>(
+        black_in, white_in, black_out, white_out, gamma));
+    return *this;
+}
+
+void PointPipeline::process(float *r, float *g, float *b, size_t size) const {
+    for (size_t s = 0; s < m_stages.size(); ++s) {
+        (*m_stages[s])(r, g, b, size);
+    }
+}
+
+void PointPipeline::apply(Frame &frame) const {
+    if (empty()) return;
+
+#ifdef TIMER_PROFILING
+    msec_timer f_timer;
+    f_timer.start();
+#endif
+
+    Channel *X, *Y, *Z;
+    frame.getXYZChannels(X, Y, Z);
+    assert(X != NULL && Y != NULL && Z != NULL);
+
+    float *r = X->data();
+    float *g = Y->data();
+    float *b = Z->data();
+    const size_t size = X->size();
+    const int tiles = int((size + s_tileSize - 1) / s_tileSize);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int t = 0; t < tiles; ++t) {
+        const size_t begin = size_t(t) * s_tileSize;
+        const size_t length = std::min(s_tileSize, size - begin);
+        process(r + begin, g + begin, b + begin, length);
+    }
+
+#ifdef TIMER_PROFILING
+    f_timer.stop_and_update();
+    std::cout << "PointPipeline::apply() = " << f_timer.get_time() << " msec"
+              << std::endl;
+#endif
+}
+
+void PointPipeline::apply(const Frame &in, Frame &out) const {
+    assert(in.getWidth() == out.getWidth());
+    assert(in.getHeight() == out.getHeight());
+
+#ifdef TIMER_PROFILING
+    msec_timer f_timer;
+    f_timer.start();
+#endif
+
+    const Channel *inX, *inY, *inZ;
+    in.getXYZChannels(inX, inY, inZ);
+
+    const ChannelContainer &channels = in.getChannels();
+    for (ChannelContainer::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+        const Channel *inCh = *it;
+        Channel *outCh = out.createChannel(inCh->getName());
+        if (inCh != inX && inCh != inY && inCh != inZ) {
+            copy(inCh, outCh);
+        }
+    }
+    copyTags(&in, &out);
+
+    if (inX == NULL || inY == NULL || inZ == NULL) {
+        return;
+    }
+
+    Channel *outX, *outY, *outZ;
+    out.getXYZChannels(outX, outY, outZ);
+
+    const float *ri = inX->data();
+    const float *gi = inY->data();
+    const float *bi = inZ->data();
+    float *r = outX->data();
+    float *g = outY->data();
+    float *b = outZ->data();
+    const size_t size = inX->size();
+    const int tiles = int((size + s_tileSize - 1) / s_tileSize);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int t = 0; t < tiles; ++t) {
+        const size_t begin = size_t(t) * s_tileSize;
+        const size_t length = std::min(s_tileSize, size - begin);
+        std::memcpy(r + begin, ri + begin, length * sizeof(float));
+        std::memcpy(g + begin, gi + begin, length * sizeof(float));
+        std::memcpy(b + begin, bi + begin, length * sizeof(float));
+        process(r + begin, g + begin, b + begin, length);
+    }
+
+#ifdef TIMER_PROFILING
+    f_timer.stop_and_update();
+    std::cout << "PointPipeline::apply() = " << f_timer.get_time() << " msec"
+              << std::endl;
+#endif
+}
+}
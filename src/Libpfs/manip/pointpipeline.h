@@ -0,0 +1,80 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#ifndef PFS_POINTPIPELINE_H
+#define PFS_POINTPIPELINE_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+//! \brief Fused per-pixel operations on the RGB channels of a frame
+
+namespace pfs {
+class Frame;
+
+//! \brief Chain of per-pixel operations run in a single pass: the frame is
+//! walked in tiles small enough to stay in the L1 cache, and every stage runs
+//! on a tile before the next tile is loaded. Each stage gives the same result
+//! as the standalone function named in its description.
+//! \code
+//! pfs::PointPipeline post;
+//! post.saturation(1.2f).gamma(1.f / 2.2f);
+//! post.apply(*frame);
+//! \endcode
+class PointPipeline {
+   public:
+    PointPipeline();
+    ~PointPipeline();
+
+    //! \brief x^exponent, non positive values go to zero, as
+    //! applyGamma(Array2Df*, float). An exponent of 1 adds no stage
+    PointPipeline &gamma(float exponent);
+
+    //! \brief HSL saturation times \a multiplier, as applySaturation().
+    //! A multiplier of 1 adds no stage
+    PointPipeline &saturation(float multiplier);
+
+    //! \brief black/white points and gamma, output clamped to [0, 1], as
+    //! gammaAndLevels()
+    PointPipeline &levels(float black_in, float white_in, float black_out,
+                          float white_out, float gamma = 1.0f);
+
+    bool empty() const { return m_stages.empty(); }
+
+    //! \brief run the stages on \a size pixels, in place
+    void process(float *r, float *g, float *b, size_t size) const;
+
+    //! \brief run the stages on the XYZ channels of \a frame, in place
+    void apply(Frame &frame) const;
+
+    //! \brief fill \a out (same size as \a in, no channels yet) with a copy of
+    //! \a in, running the stages on the XYZ channels on the way
+    void apply(const Frame &in, Frame &out) const;
+
+    class Stage;
+
+   private:
+    std::vector<std::shared_ptr<const Stage>> m_stages;
+};
+}
+
+#endif  // PFS_POINTPIPELINE_H
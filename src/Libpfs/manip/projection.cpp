@@ -26,15 +26,22 @@
 
 #include <boost/math/constants/constants.hpp>
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
-// #include <stdio.h>
-// #include <stdlib.h>
+#include <mutex>
+#include <stdexcept>
 
 #include "Libpfs/array2d.h"
+#include "Libpfs/utils/resourcehandlerstdio.h"
 #include "arch/math.h"
+#include "opthelper.h"
+#include "sleef.c"
 
 using namespace std;
+using pfs::utils::ScopedStdIoFile;
 
 ProjectionFactory ProjectionFactory::singleton(true);
 
@@ -43,88 +50,273 @@ CylindricalProjection CylindricalProjection::singleton(true);
 AngularProjection AngularProjection::singleton(true);
 MirrorBallProjection MirrorBallProjection::singleton(true);
 
-const double EPSILON = 1e-7;
+namespace {
 
-class Vector3D {
-   public:
-    double x, y, z;
+const float EPSILON = 1e-7f;
+const float PI = boost::math::float_constants::pi;
+const float TWO_PI = boost::math::float_constants::two_pi;
+const float ONE_DIV_TWO_PI = boost::math::float_constants::one_div_two_pi;
 
-    Vector3D(double phi, double theta) {
-        x = cos(phi) * sin(theta);
-        y = sin(phi) * sin(theta);
-        z = cos(theta);
-    }
+// The kernels below convert one sample, or four with SSE2. The batched
+// conversions are templates over them, so that the per-sample code is inlined
+// in the loops.
+
+//! \brief longitude of the cylindrical and polar projections, in [0, 1)
+inline float longitude(float x, float z) {
+    // acos(-z / sin(lat)) for a unit vector
+    const float lon = xatan2f(std::fabs(x), -z) * ONE_DIV_TWO_PI;
+    const float u = (x < 0.f) ? lon : 1.f - lon;
+    return (u == 1.f) ? 0.f : u;
+}
+
+#ifdef __SSE2__
+inline vfloat longitude(vfloat x, vfloat z) {
+    const vfloat lon = vmulf(xatan2f(vabsf(x), vnegf(z)), F2V(ONE_DIV_TWO_PI));
+    const vfloat one = F2V(1.f);
+    const vfloat u = vself(vmaskf_lt(x, ZEROV), lon, vsubf(one, lon));
+    return vself(vmaskf_eq(u, one), ZEROV, u);
+}
 
-    Vector3D(double x, double y, double z) {
-        this->x = x;
-        this->y = y;
-        this->z = z;
+//! \brief v, and the longitude where the latitude is not too close to a pole
+inline void latitudeToUV(vfloat x, vfloat z, vfloat v, vfloat &uOut,
+                         vfloat &vOut) {
+    const vfloat one = F2V(1.f);
+    const vmask pole = vorm(vmaskf_lt(v, F2V(EPSILON)),
+                            vmaskf_lt(vabsf(vsubf(one, v)), F2V(EPSILON)));
+    uOut = vself(pole, ZEROV, longitude(x, z));
+    vOut = vself(vandnotm(pole, vmaskf_eq(v, one)), ZEROV, v);
+}
+#endif
 
-        normalize();
+inline void latitudeToUV(float x, float z, float v, float &uOut,
+                         float &vOut) {
+    if (v < EPSILON || std::fabs(1.f - v) < EPSILON) {
+        uOut = 0.f;
+        vOut = v;
+    } else {
+        uOut = longitude(x, z);
+        vOut = (v == 1.f) ? 0.f : v;
     }
+}
 
-    double magnitude(void) { return sqrt(x * x + y * y + z * z); }
+struct MirrorBallKernel {
+    void toDirection(float u, float v, float &x, float &y, float &z) const {
+        u = 2.f * u - 1.f;
+        v = 2.f * v - 1.f;
+        // theta = 2 asin(r): sin(theta) = 2 r sqrt(1 - r^2) and
+        // cos(theta) = 1 - 2 r^2
+        const float r2 = u * u + v * v;
+        const float s = 2.f * std::sqrt(std::max(1.f - r2, 0.f));
+        x = u * s;
+        y = -v * s;
+        z = std::max(1.f - 2.f * r2, -1.f);
+    }
 
-    void normalize(void) {
-        double len = magnitude();
+    void toUV(float x, float y, float z, float &u, float &v) const {
+        y = -y;
+        const float distance = std::sqrt(x * x + y * y);
+        if (distance > 0.f) {
+            // sin(acos(z) / 2) = sqrt((1 - z) / 2)
+            const float r =
+                0.5f * std::sqrt(std::max(0.5f * (1.f - z), 0.f)) / distance;
+            u = x * r + 0.5f;
+            v = y * r + 0.5f;
+        } else {
+            u = v = 0.5f;
+        }
+    }
 
-        x = x / len;
-        y = y / len;
-        z = z / len;
+#ifdef __SSE2__
+    void toDirection(vfloat u, vfloat v, vfloat &x, vfloat &y,
+                     vfloat &z) const {
+        const vfloat one = F2V(1.f);
+        const vfloat two = F2V(2.f);
+        u = vsubf(vmulf(two, u), one);
+        v = vsubf(vmulf(two, v), one);
+        const vfloat r2 = vmlaf(u, u, vmulf(v, v));
+        const vfloat s = vmulf(two, vsqrtf(vmaxf(vsubf(one, r2), ZEROV)));
+        x = vmulf(u, s);
+        y = vnegf(vmulf(v, s));
+        z = vmaxf(vsubf(one, vmulf(two, r2)), F2V(-1.f));
     }
 
-    double dot(Vector3D *v) { return x * v->x + y * v->y + z * v->z; }
+    void toUV(vfloat x, vfloat y, vfloat z, vfloat &u, vfloat &v) const {
+        const vfloat half = F2V(0.5f);
+        y = vnegf(y);
+        const vfloat distance = vsqrtf(vmlaf(x, x, vmulf(y, y)));
+        const vfloat r = vdivf(
+            vmulf(half,
+                  vsqrtf(vmaxf(vmulf(half, vsubf(F2V(1.f), z)), ZEROV))),
+            vmaxf(distance, F2V(1e-30f)));
+        const vmask centre = vmaskf_eq(distance, ZEROV);
+        u = vself(centre, half, vmlaf(x, r, half));
+        v = vself(centre, half, vmlaf(y, r, half));
+    }
+#endif
+};
 
-    // TODO: optimize rotations by precomputing sines and cosines
-    void rotateX(double angle) {
-        angle *= boost::math::double_constants::degree;
+struct AngularKernel {
+    explicit AngularKernel(float totalAngle) : scale(totalAngle / 360.f) {}
+
+    void toDirection(float u, float v, float &x, float &y, float &z) const {
+        u = (2.f * u - 1.f) * scale;
+        v = (2.f * v - 1.f) * scale;
+        // theta = pi r: the sine of theta over r tends to pi at the centre
+        const float r = std::max(std::sqrt(u * u + v * v), 1e-30f);
+        const float2 sc = xsincosf(PI * r);
+        const float k = sc.x / r;
+        x = u * k;
+        y = -v * k;
+        z = sc.y;
+    }
 
-        double c = cos(angle);
-        double s = sin(angle);
+    void toUV(float x, float y, float z, float &u, float &v) const {
+        y = -y;
+        const float distance = std::sqrt(x * x + y * y);
+        if (distance > 0.f) {
+            const float r = ONE_DIV_TWO_PI *
+                            xacosf(std::min(std::max(z, -1.f), 1.f)) /
+                            distance;
+            u = x * r + 0.5f;
+            v = y * r + 0.5f;
+        } else {
+            u = v = 0.5f;
+        }
+    }
 
-        double y2 = c * y + -s * z;
-        double z2 = s * y + c * z;
+#ifdef __SSE2__
+    void toDirection(vfloat u, vfloat v, vfloat &x, vfloat &y,
+                     vfloat &z) const {
+        const vfloat one = F2V(1.f);
+        const vfloat two = F2V(2.f);
+        const vfloat scalev = F2V(scale);
+        u = vmulf(vsubf(vmulf(two, u), one), scalev);
+        v = vmulf(vsubf(vmulf(two, v), one), scalev);
+        const vfloat r =
+            vmaxf(vsqrtf(vmlaf(u, u, vmulf(v, v))), F2V(1e-30f));
+        const vfloat2 sc = xsincosf(vmulf(F2V(PI), r));
+        const vfloat k = vdivf(sc.x, r);
+        x = vmulf(u, k);
+        y = vnegf(vmulf(v, k));
+        z = sc.y;
+    }
 
-        y = y2;
-        z = z2;
+    void toUV(vfloat x, vfloat y, vfloat z, vfloat &u, vfloat &v) const {
+        const vfloat half = F2V(0.5f);
+        y = vnegf(y);
+        const vfloat distance = vsqrtf(vmlaf(x, x, vmulf(y, y)));
+        const vfloat angle =
+            xacosf(vminf(vmaxf(z, F2V(-1.f)), F2V(1.f)));
+        const vfloat r = vdivf(vmulf(F2V(ONE_DIV_TWO_PI), angle),
+                               vmaxf(distance, F2V(1e-30f)));
+        const vmask centre = vmaskf_eq(distance, ZEROV);
+        u = vself(centre, half, vmlaf(x, r, half));
+        v = vself(centre, half, vmlaf(y, r, half));
     }
+#endif
 
-    void rotateY(double angle) {
-        angle *= boost::math::double_constants::degree;
+    float scale;
+};
 
-        double c = cos(angle);
-        double s = sin(angle);
+struct CylindricalKernel {
+    void toDirection(float u, float v, float &x, float &y, float &z) const {
+        const float2 phi = xsincosf((0.75f - u) * TWO_PI);
+        // theta = acos(1 - 2 v)
+        const float sinTheta = 2.f * std::sqrt(std::max(v * (1.f - v), 0.f));
+        x = phi.y * sinTheta;
+        y = 1.f - 2.f * v;
+        z = phi.x * sinTheta;
+    }
 
-        double x2 = c * x + s * z;
-        double z2 = -s * x + c * z;
+    void toUV(float x, float y, float z, float &u, float &v) const {
+        latitudeToUV(x, z, 0.5f * (1.f - y), u, v);
+    }
 
-        x = x2;
-        z = z2;
+#ifdef __SSE2__
+    void toDirection(vfloat u, vfloat v, vfloat &x, vfloat &y,
+                     vfloat &z) const {
+        const vfloat one = F2V(1.f);
+        const vfloat two = F2V(2.f);
+        const vfloat2 phi = xsincosf(vmulf(vsubf(F2V(0.75f), u), F2V(TWO_PI)));
+        const vfloat sinTheta =
+            vmulf(two, vsqrtf(vmaxf(vmulf(v, vsubf(one, v)), ZEROV)));
+        x = vmulf(phi.y, sinTheta);
+        y = vsubf(one, vmulf(two, v));
+        z = vmulf(phi.x, sinTheta);
     }
 
-    void rotateZ(double angle) {
-        angle *= boost::math::double_constants::degree;
+    void toUV(vfloat x, vfloat y, vfloat z, vfloat &u, vfloat &v) const {
+        latitudeToUV(x, z, vmulf(F2V(0.5f), vsubf(F2V(1.f), y)), u, v);
+    }
+#endif
+};
+
+struct PolarKernel {
+    void toDirection(float u, float v, float &x, float &y, float &z) const {
+        const float2 phi = xsincosf((0.75f - u) * TWO_PI);
+        const float2 theta = xsincosf(v * PI);
+        x = phi.y * theta.x;
+        y = theta.y;
+        z = phi.x * theta.x;
+    }
 
-        double c = cos(angle);
-        double s = sin(angle);
+    void toUV(float x, float y, float z, float &u, float &v) const {
+        const float lat = xacosf(std::min(std::max(y, -1.f), 1.f));
+        latitudeToUV(x, z, lat * (1.f / PI), u, v);
+    }
 
-        double x2 = c * x + -s * y;
-        double y2 = s * x + c * y;
+#ifdef __SSE2__
+    void toDirection(vfloat u, vfloat v, vfloat &x, vfloat &y,
+                     vfloat &z) const {
+        const vfloat2 phi = xsincosf(vmulf(vsubf(F2V(0.75f), u), F2V(TWO_PI)));
+        const vfloat2 theta = xsincosf(vmulf(v, F2V(PI)));
+        x = vmulf(phi.y, theta.x);
+        y = theta.y;
+        z = vmulf(phi.x, theta.x);
+    }
 
-        x = x2;
-        y = y2;
+    void toUV(vfloat x, vfloat y, vfloat z, vfloat &u, vfloat &v) const {
+        const vfloat lat = xacosf(vminf(vmaxf(y, F2V(-1.f)), F2V(1.f)));
+        latitudeToUV(x, z, vmulf(lat, F2V(1.f / PI)), u, v);
     }
+#endif
 };
 
-class Point2D {
-   public:
-    double x, y;
+template <typename Kernel>
+void uvToDirections(const Kernel &kernel, const float *u, const float *v,
+                    size_t n, float *x, float *y, float *z) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        vfloat xv, yv, zv;
+        kernel.toDirection(LVFU(u[i]), LVFU(v[i]), xv, yv, zv);
+        STVFU(x[i], xv);
+        STVFU(y[i], yv);
+        STVFU(z[i], zv);
+    }
+#endif
+    for (; i < n; ++i) {
+        kernel.toDirection(u[i], v[i], x[i], y[i], z[i]);
+    }
+}
 
-    Point2D(double x, double y) {
-        this->x = x;
-        this->y = y;
+template <typename Kernel>
+void directionsToUV(const Kernel &kernel, const float *x, const float *y,
+                    const float *z, size_t n, float *u, float *v) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        vfloat uv, vv;
+        kernel.toUV(LVFU(x[i]), LVFU(y[i]), LVFU(z[i]), uv, vv);
+        STVFU(u[i], uv);
+        STVFU(v[i], vv);
     }
-};
+#endif
+    for (; i < n; ++i) {
+        kernel.toUV(x[i], y[i], z[i], u[i], v[i]);
+    }
+}
+}
 
 /// PROJECTIONFACTORY
 ProjectionFactory::ProjectionFactory(bool) {}
@@ -191,39 +383,16 @@ bool MirrorBallProjection::isValidPixel(double u, double v) {
         return true;
 }
 
-Vector3D *MirrorBallProjection::uvToDirection(double u, double v) {
-    u = 2 * u - 1;
-    v = 2 * v - 1;
-
-    double phi = atan2(v, u);
-    double theta = 2 * asin(sqrt(u * u + v * v));
-
-    Vector3D *direction = new Vector3D(phi, theta);
-    //     double t;
-
-    direction->y = -direction->y;
-
-    return direction;
+void MirrorBallProjection::uvToDirection(const float *u, const float *v,
+                                         size_t n, float *x, float *y,
+                                         float *z) const {
+    uvToDirections(MirrorBallKernel(), u, v, n, x, y, z);
 }
 
-Point2D *MirrorBallProjection::directionToUV(Vector3D *direction) {
-    double u, v;
-
-    direction->y = -direction->y;
-
-    if (fabs(direction->x) > 0 || fabs(direction->y) > 0) {
-        double distance =
-            sqrt(direction->x * direction->x + direction->y * direction->y);
-
-        double r = 0.5 * (sin(acos(direction->z) / 2)) / distance;
-
-        u = direction->x * r + 0.5;
-        v = direction->y * r + 0.5;
-    } else {
-        u = v = 0.5;
-    }
-
-    return new Point2D(u, v);
+void MirrorBallProjection::directionToUV(const float *x, const float *y,
+                                         const float *z, size_t n, float *u,
+                                         float *v) const {
+    directionsToUV(MirrorBallKernel(), x, y, z, n, u, v);
 }
 /// END MIRRORBALL
 
@@ -267,6 +436,12 @@ void AngularProjection::setOptions(char *opts) {
     }
 }
 
+std::string AngularProjection::getOptions() const {
+    char options[32];
+    snprintf(options, sizeof(options), "angle=%.17g", totalAngle);
+    return options;
+}
+
 const char *AngularProjection::getName(void) { return name; }
 
 double AngularProjection::getSizeRatio(void) { return 1; }
@@ -279,44 +454,16 @@ bool AngularProjection::isValidPixel(double u, double v) {
         return true;
 }
 
-Vector3D *AngularProjection::uvToDirection(double u, double v) {
-    u = 2 * u - 1;
-    v = 2 * v - 1;
-
-    u *= totalAngle / 360;
-    v *= totalAngle / 360;
-
-    double phi = atan2(v, u);
-    double theta = boost::math::double_constants::pi * sqrt(u * u + v * v);
-
-    Vector3D *direction = new Vector3D(phi, theta);
-    //     double t;
-
-    direction->y = -direction->y;
-
-    return direction;
+void AngularProjection::uvToDirection(const float *u, const float *v,
+                                      size_t n, float *x, float *y,
+                                      float *z) const {
+    uvToDirections(AngularKernel(totalAngle), u, v, n, x, y, z);
 }
 
-Point2D *AngularProjection::directionToUV(Vector3D *direction) {
-    double u, v;
-
-    direction->y = -direction->y;
-
-    if (fabs(direction->x) > 0 || fabs(direction->y) > 0) {
-        double distance =
-            sqrt(direction->x * direction->x + direction->y * direction->y);
-
-        double r =
-            (boost::math::double_constants::one_div_two_pi)*acos(direction->z) /
-            distance;
-
-        u = direction->x * r + 0.5;
-        v = direction->y * r + 0.5;
-    } else {
-        u = v = 0.5;
-    }
-
-    return new Point2D(u, v);
+void AngularProjection::directionToUV(const float *x, const float *y,
+                                      const float *z, size_t n, float *u,
+                                      float *v) const {
+    directionsToUV(AngularKernel(totalAngle), x, y, z, n, u, v);
 }
 /// END ANGULAR
 
@@ -326,77 +473,28 @@ CylindricalProjection::CylindricalProjection(bool initialization) {
 
     if (initialization)
         ProjectionFactory::registerProjection(name, this->create);
-
-    pole = new Vector3D(0, 1, 0);
-    equator = new Vector3D(0, 0, -1);
-    cross = new Vector3D(1, 0, 0);
 }
 
 Projection *CylindricalProjection::create() {
     return new CylindricalProjection(false);
 }
 
-CylindricalProjection::~CylindricalProjection() {
-    delete pole;
-    delete equator;
-    delete cross;
-}
-
 double CylindricalProjection::getSizeRatio(void) { return 2; }
 
 bool CylindricalProjection::isValidPixel(double /*u*/, double /*v*/) {
     return true;
 }
 
-Vector3D *CylindricalProjection::uvToDirection(double u, double v) {
-    u = 0.75 - u;
-
-    u *= boost::math::double_constants::two_pi;
-
-    v = acos(1 - 2 * v);
-
-    Vector3D *direction = new Vector3D(u, v);
-
-    double temp = direction->z;
-    direction->z = direction->y;
-    direction->y = temp;
-
-    return direction;
+void CylindricalProjection::uvToDirection(const float *u, const float *v,
+                                          size_t n, float *x, float *y,
+                                          float *z) const {
+    uvToDirections(CylindricalKernel(), u, v, n, x, y, z);
 }
 
-Point2D *CylindricalProjection::directionToUV(Vector3D *direction) {
-    double u, v;
-    double lat = direction->dot(pole);
-
-    v = (1 - lat) / 2;
-
-    if (v < EPSILON || fabs(1 - v) < EPSILON)
-        u = 0;
-    else {
-        double ratio = equator->dot(direction) / sin(acos(lat));
-
-        if (ratio < -1)
-            ratio = -1;
-        else if (ratio > 1)
-            ratio = 1;
-
-        double lon = acos(ratio) / (boost::math::double_constants::two_pi);
-
-        if (cross->dot(direction) < 0)
-            u = lon;
-        else
-            u = 1 - lon;
-
-        if (u == 1) u = 0;
-
-        if (v == 1) v = 0;
-    }
-
-    //  if ( 0 > v || v >= 1 ) fprintf(stderr, "u: %f (%f,%f,%f)\n", v,
-    //  direction->x, direction->y, direction->z);
-    //  assert ( -0. <= u && u < 1 );
-    //  assert ( -0. <= v && v < 1 );
-    return new Point2D(u, v);
+void CylindricalProjection::directionToUV(const float *x, const float *y,
+                                          const float *z, size_t n, float *u,
+                                          float *v) const {
+    directionsToUV(CylindricalKernel(), x, y, z, n, u, v);
 }
 /// END CYLINDRICAL
 
@@ -406,162 +504,672 @@ PolarProjection::PolarProjection(bool initialization) {
 
     if (initialization)
         ProjectionFactory::registerProjection(name, this->create);
-
-    pole = new Vector3D(0, 1, 0);
-    equator = new Vector3D(0, 0, -1);
-    cross = new Vector3D(1, 0, 0);
 }
 
 Projection *PolarProjection::create() { return new PolarProjection(false); }
 
-PolarProjection::~PolarProjection() {
-    delete pole;
-    delete equator;
-    delete cross;
-}
-
 double PolarProjection::getSizeRatio(void) { return 2; }
 
 bool PolarProjection::isValidPixel(double /*u*/, double /*v*/) { return true; }
 
-Vector3D *PolarProjection::uvToDirection(double u, double v) {
-    u = 0.75 - u;
+void PolarProjection::uvToDirection(const float *u, const float *v, size_t n,
+                                    float *x, float *y, float *z) const {
+    uvToDirections(PolarKernel(), u, v, n, x, y, z);
+}
 
-    u *= boost::math::double_constants::two_pi;
-    v *= boost::math::double_constants::pi;
+void PolarProjection::directionToUV(const float *x, const float *y,
+                                    const float *z, size_t n, float *u,
+                                    float *v) const {
+    directionsToUV(PolarKernel(), x, y, z, n, u, v);
+}
+/// END POLAR
 
-    Vector3D *direction = new Vector3D(u, v);
+namespace {
 
-    double temp = direction->z;
-    direction->z = direction->y;
-    direction->y = temp;
+//! \brief the rotations of TransformInfo as one matrix. The angles are
+//! negated, because we want to rotate the environment around us, not us
+//! within the environment.
+class Rotation {
+   public:
+    explicit Rotation(const TransformInfo &info) {
+        const double degree = boost::math::double_constants::degree;
+        const double cx = cos(-info.xRotate * degree);
+        const double sx = sin(-info.xRotate * degree);
+        const double cy = cos(-info.yRotate * degree);
+        const double sy = sin(-info.yRotate * degree);
+        const double cz = cos(-info.zRotate * degree);
+        const double sz = sin(-info.zRotate * degree);
+
+        // Rz * Ry * Rx: about X first, then Y, then Z
+        const double m[3][3] = {
+            {cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx},
+            {sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx},
+            {-sy, cy * sx, cy * cx}};
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                m_matrix[r][c] = static_cast<float>(m[r][c]);
+            }
+        }
+        m_identity = info.xRotate == 0 && info.yRotate == 0 &&
+                     info.zRotate == 0;
+    }
 
-    return direction;
-}
+    void apply(float *x, float *y, float *z, size_t n) const {
+        if (m_identity) {
+            return;
+        }
+        const float(&m)[3][3] = m_matrix;
+        for (size_t i = 0; i < n; ++i) {
+            const float x0 = x[i];
+            const float y0 = y[i];
+            const float z0 = z[i];
+            x[i] = m[0][0] * x0 + m[0][1] * y0 + m[0][2] * z0;
+            y[i] = m[1][0] * x0 + m[1][1] * y0 + m[1][2] * z0;
+            z[i] = m[2][0] * x0 + m[2][1] * y0 + m[2][2] * z0;
+        }
+    }
 
-Point2D *PolarProjection::directionToUV(Vector3D *direction) {
-    double u, v;
-    double lat = acos(direction->dot(pole));
+   private:
+    float m_matrix[3][3];
+    bool m_identity;
+};
 
-    v = lat * (1 / boost::math::double_constants::pi);
+//! \brief add the value at (\a px, \a py) of every array of \a in to \a sums
+void accumulate(const std::vector<const pfs::Array2Df *> &in, float px,
+                float py, bool interpolate, float *sums) {
+    const int inCols = in[0]->getCols();
+    const int inRows = in[0]->getRows();
+
+    // the projections map the border of their domain on the last pixel
+    px = (px >= 0.f) ? std::min(px, float(inCols - 1)) : 0.f;
+    py = (py >= 0.f) ? std::min(py, float(inRows - 1)) : 0.f;
+
+    if (interpolate) {
+        const int ix = static_cast<int>(px);
+        const int iy = static_cast<int>(py);
+        const int dx = std::min(ix + 1, inCols - 1);
+        const int dy = std::min(iy + 1, inRows - 1);
+
+        const float i = px - ix;
+        const float j = py - iy;
+
+        // compute pixel weights for interpolation
+        const float w1 = i * j;
+        const float w2 = (1 - i) * j;
+        const float w3 = (1 - i) * (1 - j);
+        const float w4 = i * (1 - j);
+
+        for (size_t c = 0; c < in.size(); ++c) {
+            const pfs::Array2Df &a = *in[c];
+            sums[c] += w3 * a(ix, iy) + w4 * a(dx, iy) + w1 * a(dx, dy) +
+                       w2 * a(ix, dy);
+        }
+    } else {
+        const int ix = std::min(static_cast<int>(px + 0.5f), inCols - 1);
+        const int iy = std::min(static_cast<int>(py + 0.5f), inRows - 1);
 
-    if (v < EPSILON || fabs(1 - v) < EPSILON)
-        u = 0;
-    else {
-        double ratio = equator->dot(direction) / sin(lat);
+        for (size_t c = 0; c < in.size(); ++c) {
+            sums[c] += (*in[c])(ix, iy);
+        }
+    }
+}
 
-        if (ratio < -1)
-            ratio = -1;
-        else if (ratio > 1)
-            ratio = 1;
+//! \brief Source points of the samples of the output rows of a transform.
+//! Each thread uses its own sampler.
+class RowSampler {
+   public:
+    RowSampler(const TransformInfo &info, int outCols, int outRows)
+        : m_dstProjection(info.dstProjection),
+          m_srcProjection(info.srcProjection),
+          m_rotation(info),
+          m_oversample(info.oversampleFactor),
+          m_outCols(outCols),
+          m_outRows(outRows),
+          m_samples(size_t(outCols) * info.oversampleFactor),
+          m_u(m_samples),
+          m_v(m_samples),
+          m_x(m_samples),
+          m_y(m_samples),
+          m_z(m_samples),
+          m_valid(outCols) {}
+
+    //! \brief find the pixels of \a row inside the destination projection,
+    //! return false if there is none
+    bool validate(int row) {
+        bool anyValid = false;
+        for (int col = 0; col < m_outCols; col++) {
+            m_valid[col] = m_dstProjection->isValidPixel(
+                (col + 0.5) / m_outCols, (row + 0.5) / m_outRows);
+            anyValid = anyValid || m_valid[col];
+        }
+        return anyValid;
+    }
 
-        double lon = acos(ratio) / (boost::math::double_constants::two_pi);
+    bool valid(int col) const { return m_valid[col] != 0; }
 
-        if (cross->dot(direction) < 0)
-            u = lon;
-        else
-            u = 1 - lon;
+    //! \brief compute the source points, in [0, 1], of the samples of the
+    //! sub-row \a oy of \a row. Sample \a ox of column \a col is at index
+    //! col * oversample + ox of u() and v().
+    void sample(int row, int oy) {
+        const float delta = 1.f / m_oversample;
+        const float offset = 0.5f / m_oversample;
 
-        if (u == 1) u = 0;
+        const float sv = (row + offset + oy * delta) / m_outRows;
+        for (int col = 0; col < m_outCols; col++) {
+            for (int ox = 0; ox < m_oversample; ox++) {
+                m_u[col * m_oversample + ox] =
+                    (col + offset + ox * delta) / m_outCols;
+            }
+        }
+        std::fill(m_v.begin(), m_v.end(), sv);
 
-        if (v == 1) v = 0;
+        m_dstProjection->uvToDirection(m_u.data(), m_v.data(), m_samples,
+                                       m_x.data(), m_y.data(), m_z.data());
+        m_rotation.apply(m_x.data(), m_y.data(), m_z.data(), m_samples);
+        m_srcProjection->directionToUV(m_x.data(), m_y.data(), m_z.data(),
+                                       m_samples, m_u.data(), m_v.data());
     }
 
-    //  if ( 0 > v || v >= 1 ) fprintf(stderr, "u: %f (%f,%f,%f)\n", v,
-    //  direction->x, direction->y, direction->z);
-    //  assert ( -0. <= u && u < 1 );
-    //  assert ( -0. <= v && v < 1 );
-    return new Point2D(u, v);
+    const float *u() const { return m_u.data(); }
+    const float *v() const { return m_v.data(); }
+
+   private:
+    Projection *m_dstProjection;
+    const Projection *m_srcProjection;
+    const Rotation m_rotation;
+    const int m_oversample;
+    const int m_outCols;
+    const int m_outRows;
+    const size_t m_samples;
+
+    std::vector<float> m_u;
+    std::vector<float> m_v;
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<float> m_z;
+    std::vector<char> m_valid;
+};
 }
-/// END POLAR
 
 void transformArray(const pfs::Array2Df *in, pfs::Array2Df *out,
                     TransformInfo *transformInfo) {
-    const double delta = 1. / transformInfo->oversampleFactor;
-    const double offset = 0.5 / transformInfo->oversampleFactor;
-    const double scaler = 1. / (transformInfo->oversampleFactor *
-                                transformInfo->oversampleFactor);
+    transformArrays(std::vector<const pfs::Array2Df *>(1, in),
+                    std::vector<pfs::Array2Df *>(1, out), transformInfo);
+}
 
-    const int outRows = out->getRows();
-    const int outCols = out->getCols();
+void transformArrays(const std::vector<const pfs::Array2Df *> &in,
+                     const std::vector<pfs::Array2Df *> &out,
+                     TransformInfo *transformInfo) {
+    assert(in.size() == out.size());
+    if (in.empty()) {
+        return;
+    }
 
-    const int inRows = in->getRows();
-    const int inCols = in->getCols();
+    const int oversample = transformInfo->oversampleFactor;
+    const float scaler = 1.f / (oversample * oversample);
 
-    for (int y = 0; y < outRows; y++)
-        for (int x = 0; x < outCols; x++) {
-            double pixVal = 0;
+    const int outRows = out[0]->getRows();
+    const int outCols = out[0]->getCols();
 
-            if (transformInfo->dstProjection->isValidPixel(
-                    (x + 0.5) / outCols, (y + 0.5) / outCols) == true) {
-                for (double sy = 0, oy = 0;
-                     oy < transformInfo->oversampleFactor; sy += delta, oy++)
-                    for (double sx = 0, ox = 0;
-                         ox < transformInfo->oversampleFactor;
-                         sx += delta, ox++) {
-                        Vector3D *direction =
-                            transformInfo->dstProjection->uvToDirection(
-                                (x + offset + sx) / outCols,
-                                (y + offset + sy) / outRows);
+    const float inRows = in[0]->getRows();
+    const float inCols = in[0]->getCols();
 
-                        if (direction == NULL) continue;
+    const bool interpolate = transformInfo->interpolate;
+    const size_t channels = in.size();
 
-                        // angles below are negated, because we want to rotate
-                        // the environment around us, not us within the
-                        // environment.
-                        if (transformInfo->xRotate != 0)
-                            direction->rotateX(-transformInfo->xRotate);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        RowSampler sampler(*transformInfo, outCols, outRows);
+        std::vector<float> sums(size_t(outCols) * channels);
 
-                        if (transformInfo->yRotate != 0)
-                            direction->rotateY(-transformInfo->yRotate);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int row = 0; row < outRows; row++) {
+            if (!sampler.validate(row)) {
+                continue;
+            }
 
-                        if (transformInfo->zRotate != 0)
-                            direction->rotateZ(-transformInfo->zRotate);
+            std::fill(sums.begin(), sums.end(), 0.f);
+            for (int oy = 0; oy < oversample; oy++) {
+                sampler.sample(row, oy);
+                const float *u = sampler.u();
+                const float *v = sampler.v();
 
-                        Point2D *p =
-                            transformInfo->srcProjection->directionToUV(
-                                direction);
+                for (int col = 0; col < outCols; col++) {
+                    if (!sampler.valid(col)) {
+                        continue;
+                    }
+                    for (int ox = 0; ox < oversample; ox++) {
+                        const size_t s = col * oversample + ox;
+                        accumulate(in, u[s] * inCols, v[s] * inRows,
+                                   interpolate, &sums[col * channels]);
+                    }
+                }
+            }
 
-                        p->x *= inCols;
-                        p->y *= inRows;
+            for (int col = 0; col < outCols; col++) {
+                if (!sampler.valid(col)) {
+                    continue;
+                }
+                for (size_t c = 0; c < channels; c++) {
+                    (*out[c])(col, row) = sums[col * channels + c] * scaler;
+                }
+            }
+        }
+    }
+}
 
-                        if (transformInfo->interpolate == true) {
-                            int ix = (int)floor(p->x);
-                            int iy = (int)floor(p->y);
+namespace {
 
-                            double i = p->x - ix;
-                            double j = p->y - iy;
+const int32_t FIXED_ONE = 1 << RemapTable::s_fractionBits;
+const int32_t FIXED_MASK = FIXED_ONE - 1;
+const float FIXED_SCALE = 1.f / FIXED_ONE;
 
-                            // compute pixel weights for interpolation
-                            double w1 = i * j;
-                            double w2 = (1 - i) * j;
-                            double w3 = (1 - i) * (1 - j);
-                            double w4 = i * (1 - j);
+const char REMAP_MAGIC[] = "LHDRREMAP1";
 
-                            int dx = ix + 1;
-                            if (dx >= inCols) dx = inCols - 1;
+//! \brief projections, with their options, rotations and oversampling of
+//! \a info
+std::string describeTransform(const TransformInfo &info) {
+    std::string description = info.srcProjection->getName();
+    std::string options = info.srcProjection->getOptions();
+    if (!options.empty()) {
+        description += "/" + options;
+    }
+    description += " ";
+    description += info.dstProjection->getName();
+    options = info.dstProjection->getOptions();
+    if (!options.empty()) {
+        description += "/" + options;
+    }
 
-                            int dy = iy + 1;
-                            if (dy >= inRows) dy = inRows - 1;
+    char parameters[128];
+    snprintf(parameters, sizeof(parameters), " %.17g %.17g %.17g %d",
+             info.xRotate, info.yRotate, info.zRotate,
+             info.oversampleFactor);
+    return description + parameters;
+}
 
-                            pixVal += w3 * (*in)(ix, iy) + w4 * (*in)(dx, iy) +
-                                      w1 * (*in)(dx, dy) + w2 * (*in)(ix, dy);
-                        } else {
-                            int ix = (int)floor(p->x + 0.5);
-                            int iy = (int)floor(p->y + 0.5);
+//! \brief Catmull-Rom weights of the four taps around every fractional
+//! position
+class CubicWeights {
+   public:
+    CubicWeights() {
+        for (int phase = 0; phase < FIXED_ONE; phase++) {
+            const float t = phase * FIXED_SCALE;
+            const float t2 = t * t;
+            const float t3 = t2 * t;
+            m_weights[phase][0] = 0.5f * (-t3 + 2.f * t2 - t);
+            m_weights[phase][1] = 0.5f * (3.f * t3 - 5.f * t2 + 2.f);
+            m_weights[phase][2] = 0.5f * (-3.f * t3 + 4.f * t2 + t);
+            m_weights[phase][3] = 0.5f * (t3 - t2);
+        }
+    }
 
-                            if (ix >= inCols) ix = inCols - 1;
+    const float *operator[](int32_t phase) const { return m_weights[phase]; }
 
-                            if (iy >= inRows) iy = inRows - 1;
+   private:
+    float m_weights[FIXED_ONE][4];
+};
 
-                            pixVal += (*in)(ix, iy);
-                        }
+const CubicWeights CUBIC_WEIGHTS;
+
+//! \brief add the value at the fixed-point position (\a fx, \a fy) of every
+//! array of \a in to \a sums
+void gather(const std::vector<const pfs::Array2Df *> &in, int32_t fx,
+            int32_t fy, RemapTable::Filter filter, float *sums) {
+    const int inCols = in[0]->getCols();
+    const int inRows = in[0]->getRows();
+
+    switch (filter) {
+        case RemapTable::NEAREST: {
+            const int bits = RemapTable::s_fractionBits;
+            const int ix = std::min((fx + FIXED_ONE / 2) >> bits, inCols - 1);
+            const int iy = std::min((fy + FIXED_ONE / 2) >> bits, inRows - 1);
+            for (size_t c = 0; c < in.size(); ++c) {
+                sums[c] += (*in[c])(ix, iy);
+            }
+        } break;
+        case RemapTable::BILINEAR: {
+            const int ix = fx >> RemapTable::s_fractionBits;
+            const int iy = fy >> RemapTable::s_fractionBits;
+            const int dx = std::min(ix + 1, inCols - 1);
+            const int dy = std::min(iy + 1, inRows - 1);
+
+            const float i = (fx & FIXED_MASK) * FIXED_SCALE;
+            const float j = (fy & FIXED_MASK) * FIXED_SCALE;
+
+            for (size_t c = 0; c < in.size(); ++c) {
+                const pfs::Array2Df &a = *in[c];
+                const float top = a(ix, iy) + i * (a(dx, iy) - a(ix, iy));
+                const float bottom = a(ix, dy) + i * (a(dx, dy) - a(ix, dy));
+                sums[c] += top + j * (bottom - top);
+            }
+        } break;
+        case RemapTable::BICUBIC: {
+            const int ix = fx >> RemapTable::s_fractionBits;
+            const int iy = fy >> RemapTable::s_fractionBits;
+            const float *wx = CUBIC_WEIGHTS[fx & FIXED_MASK];
+            const float *wy = CUBIC_WEIGHTS[fy & FIXED_MASK];
+
+            // the taps outside the image repeat the border
+            int xs[4];
+            int ys[4];
+            for (int k = 0; k < 4; k++) {
+                xs[k] = std::max(0, std::min(ix + k - 1, inCols - 1));
+                ys[k] = std::max(0, std::min(iy + k - 1, inRows - 1));
+            }
 
-                        delete direction;
-                        delete p;
+            for (size_t c = 0; c < in.size(); ++c) {
+                const pfs::Array2Df &a = *in[c];
+                float sum = 0.f;
+                for (int k = 0; k < 4; k++) {
+                    sum += wy[k] * (wx[0] * a(xs[0], ys[k]) +
+                                    wx[1] * a(xs[1], ys[k]) +
+                                    wx[2] * a(xs[2], ys[k]) +
+                                    wx[3] * a(xs[3], ys[k]));
+                }
+                sums[c] += sum;
+            }
+        } break;
+    }
+}
+}
+
+RemapTable::RemapTable()
+    : m_inCols(0),
+      m_inRows(0),
+      m_outCols(0),
+      m_outRows(0),
+      m_oversample(1) {}
+
+RemapTable::RemapTable(const TransformInfo &transformInfo, size_t inCols,
+                       size_t inRows, size_t outCols, size_t outRows)
+    : m_transform(describeTransform(transformInfo)),
+      m_inCols(inCols),
+      m_inRows(inRows),
+      m_outCols(outCols),
+      m_outRows(outRows),
+      m_oversample(transformInfo.oversampleFactor) {
+    const int oversample = m_oversample;
+    const size_t samplesPerPixel = size_t(oversample) * oversample;
+    m_x.resize(outCols * outRows * samplesPerPixel);
+    m_y.resize(m_x.size());
+
+    // the projections map the border of their domain on the last pixel
+    const float maxX = float(inCols - 1);
+    const float maxY = float(inRows - 1);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        RowSampler sampler(transformInfo, int(outCols), int(outRows));
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int row = 0; row < int(outRows); row++) {
+            int32_t *x = &m_x[row * outCols * samplesPerPixel];
+            int32_t *y = &m_y[row * outCols * samplesPerPixel];
+
+            if (!sampler.validate(row)) {
+                std::fill(x, x + outCols * samplesPerPixel, -1);
+                continue;
+            }
 
-                        (*out)(x, y) = pixVal * scaler;
+            for (int oy = 0; oy < oversample; oy++) {
+                sampler.sample(row, oy);
+                const float *u = sampler.u();
+                const float *v = sampler.v();
+
+                for (size_t col = 0; col < outCols; col++) {
+                    for (int ox = 0; ox < oversample; ox++) {
+                        const size_t t =
+                            (col * oversample + oy) * oversample + ox;
+                        if (!sampler.valid(col)) {
+                            x[t] = -1;
+                            continue;
+                        }
+                        const size_t s = col * oversample + ox;
+                        float px = u[s] * inCols;
+                        float py = v[s] * inRows;
+                        px = (px >= 0.f) ? std::min(px, maxX) : 0.f;
+                        py = (py >= 0.f) ? std::min(py, maxY) : 0.f;
+                        x[t] = static_cast<int32_t>(px * FIXED_ONE + 0.5f);
+                        y[t] = static_cast<int32_t>(py * FIXED_ONE + 0.5f);
                     }
+                }
             }
         }
+    }
+}
+
+bool RemapTable::matches(const TransformInfo &transformInfo, size_t inCols,
+                         size_t inRows, size_t outCols,
+                         size_t outRows) const {
+    return m_inCols == inCols && m_inRows == inRows && m_outCols == outCols &&
+           m_outRows == outRows &&
+           m_transform == describeTransform(transformInfo);
+}
+
+size_t RemapTable::bytes(size_t outCols, size_t outRows, int oversample) {
+    return outCols * outRows * oversample * oversample * 2 * sizeof(int32_t);
+}
+
+void RemapTable::apply(const std::vector<const pfs::Array2Df *> &in,
+                       const std::vector<pfs::Array2Df *> &out,
+                       Filter filter) const {
+    assert(in.size() == out.size());
+    for (size_t c = 0; c < in.size(); c++) {
+        if (in[c]->getCols() != m_inCols || in[c]->getRows() != m_inRows ||
+            out[c]->getCols() != m_outCols ||
+            out[c]->getRows() != m_outRows) {
+            throw std::runtime_error("The sizes do not match the remap table");
+        }
+    }
+    if (in.empty()) {
+        return;
+    }
+
+    const size_t samplesPerPixel = size_t(m_oversample) * m_oversample;
+    const float scaler = 1.f / samplesPerPixel;
+    const size_t channels = in.size();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> sums(channels);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int row = 0; row < int(m_outRows); row++) {
+            for (size_t col = 0; col < m_outCols; col++) {
+                const size_t first =
+                    (row * m_outCols + col) * samplesPerPixel;
+                if (m_x[first] < 0) {
+                    continue;
+                }
+
+                std::fill(sums.begin(), sums.end(), 0.f);
+                for (size_t s = first; s < first + samplesPerPixel; s++) {
+                    gather(in, m_x[s], m_y[s], filter, sums.data());
+                }
+                for (size_t c = 0; c < channels; c++) {
+                    (*out[c])(col, row) = sums[c] * scaler;
+                }
+            }
+        }
+    }
+}
+
+void RemapTable::writeToFile(const std::string &fileName) const {
+    ScopedStdIoFile outputFile(fopen(fileName.c_str(), "wb"));
+    if (!outputFile) {
+        throw std::runtime_error("Cannot write remap table file " + fileName);
+    }
+
+    const uint32_t transformSize = uint32_t(m_transform.size());
+    const uint64_t sizes[] = {m_inCols, m_inRows, m_outCols, m_outRows};
+    const int32_t oversample = m_oversample;
+
+    FILE *fp = outputFile.data();
+    const bool ok =
+        fwrite(REMAP_MAGIC, sizeof(REMAP_MAGIC), 1, fp) == 1 &&
+        fwrite(&transformSize, sizeof(transformSize), 1, fp) == 1 &&
+        fwrite(m_transform.data(), 1, transformSize, fp) == transformSize &&
+        fwrite(sizes, sizeof(sizes), 1, fp) == 1 &&
+        fwrite(&oversample, sizeof(oversample), 1, fp) == 1 &&
+        fwrite(m_x.data(), sizeof(int32_t), m_x.size(), fp) == m_x.size() &&
+        fwrite(m_y.data(), sizeof(int32_t), m_y.size(), fp) == m_y.size();
+    if (!ok) {
+        throw std::runtime_error("Cannot write remap table file " + fileName);
+    }
+}
+
+void RemapTable::readFromFile(const std::string &fileName) {
+    ScopedStdIoFile inputFile(fopen(fileName.c_str(), "rb"));
+    if (!inputFile) {
+        throw std::runtime_error("Cannot open remap table file " + fileName);
+    }
+
+    FILE *fp = inputFile.data();
+    char magic[sizeof(REMAP_MAGIC)];
+    uint32_t transformSize;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 ||
+        memcmp(magic, REMAP_MAGIC, sizeof(magic)) != 0 ||
+        fread(&transformSize, sizeof(transformSize), 1, fp) != 1 ||
+        transformSize > 1024) {
+        throw std::runtime_error("Invalid remap table file");
+    }
+
+    std::string transform(transformSize, '\0');
+    uint64_t sizes[4];
+    int32_t oversample;
+    if (fread(&transform[0], 1, transformSize, fp) != transformSize ||
+        fread(sizes, sizeof(sizes), 1, fp) != 1 ||
+        fread(&oversample, sizeof(oversample), 1, fp) != 1 ||
+        oversample < 1 || oversample > 16) {
+        throw std::runtime_error("Invalid remap table file");
+    }
+    // fixed-point positions must fit in 31 bits
+    for (int k = 0; k < 4; k++) {
+        if (sizes[k] == 0 ||
+            sizes[k] > (uint64_t(1) << (30 - s_fractionBits))) {
+            throw std::runtime_error("Invalid remap table file");
+        }
+    }
+
+    // the sizes come from the file: check them against its length before
+    // allocating the table
+    const uint64_t samples = sizes[2] * sizes[3] * uint64_t(oversample) *
+                             uint64_t(oversample);
+    const long position = ftell(fp);
+    if (position < 0 || fseek(fp, 0, SEEK_END) != 0) {
+        throw std::runtime_error("Invalid remap table file");
+    }
+    const long length = ftell(fp);
+    if (length < position ||
+        uint64_t(length - position) != samples * 2 * sizeof(int32_t) ||
+        fseek(fp, position, SEEK_SET) != 0) {
+        throw std::runtime_error("Invalid remap table file");
+    }
+
+    const size_t samplesPerPixel = size_t(oversample) * oversample;
+    std::vector<int32_t> x(samples);
+    std::vector<int32_t> y(x.size());
+    if (fread(x.data(), sizeof(int32_t), x.size(), fp) != x.size() ||
+        fread(y.data(), sizeof(int32_t), y.size(), fp) != y.size()) {
+        throw std::runtime_error("Invalid remap table file");
+    }
+
+    // apply() reads the source at these positions: every sample of a valid
+    // pixel must lie inside the image
+    const int32_t maxX = int32_t(sizes[0] - 1) << s_fractionBits;
+    const int32_t maxY = int32_t(sizes[1] - 1) << s_fractionBits;
+    for (size_t first = 0; first < x.size(); first += samplesPerPixel) {
+        if (x[first] < 0) {
+            continue;
+        }
+        for (size_t s = first; s < first + samplesPerPixel; s++) {
+            if (x[s] < 0 || x[s] > maxX || y[s] < 0 || y[s] > maxY) {
+                throw std::runtime_error("Invalid remap table file");
+            }
+        }
+    }
+
+    m_transform.swap(transform);
+    m_inCols = sizes[0];
+    m_inRows = sizes[1];
+    m_outCols = sizes[2];
+    m_outRows = sizes[3];
+    m_oversample = oversample;
+    m_x.swap(x);
+    m_y.swap(y);
+}
+
+namespace {
+//! \brief parameters of the last conversion, and their table once it is
+//! used a second time
+struct RemapTableCache {
+    RemapTableCache() : m_inCols(0), m_inRows(0), m_outCols(0), m_outRows(0) {}
+
+    bool matches(const std::string &transform, size_t inCols, size_t inRows,
+                 size_t outCols, size_t outRows) const {
+        return m_inCols == inCols && m_inRows == inRows &&
+               m_outCols == outCols && m_outRows == outRows &&
+               m_transform == transform;
+    }
+
+    std::mutex m_mutex;
+    std::string m_transform;
+    size_t m_inCols;
+    size_t m_inRows;
+    size_t m_outCols;
+    size_t m_outRows;
+    std::shared_ptr<const RemapTable> m_table;
+};
+
+RemapTableCache &remapTableCache() {
+    static RemapTableCache cache;
+    return cache;
+}
+}
+
+std::shared_ptr<const RemapTable> getRemapTable(
+    const TransformInfo &transformInfo, size_t inCols, size_t inRows,
+    size_t outCols, size_t outRows) {
+    const std::string transform = describeTransform(transformInfo);
+    RemapTableCache &cache = remapTableCache();
+
+    std::lock_guard<std::mutex> lock(cache.m_mutex);
+    if (!cache.matches(transform, inCols, inRows, outCols, outRows)) {
+        // building the table costs about as much as transformArrays(): a
+        // single conversion is done without it, keeping only its parameters
+        cache.m_table.reset();
+        cache.m_transform = transform;
+        cache.m_inCols = inCols;
+        cache.m_inRows = inRows;
+        cache.m_outCols = outCols;
+        cache.m_outRows = outRows;
+        return std::shared_ptr<const RemapTable>();
+    }
+    if (!cache.m_table) {
+        cache.m_table = std::make_shared<RemapTable>(transformInfo, inCols,
+                                                     inRows, outCols, outRows);
+    }
+    return cache.m_table;
+}
+
+void releaseRemapTable() {
+    RemapTableCache &cache = remapTableCache();
+
+    std::lock_guard<std::mutex> lock(cache.m_mutex);
+    cache.m_table.reset();
+    cache.m_transform.clear();
+    cache.m_inCols = cache.m_inRows = cache.m_outCols = cache.m_outRows = 0;
 }
@@ -29,26 +29,39 @@
 //! \author Giuseppe Rota <grota@users.sourceforge.net>
 //! \author Miloslaw Smyk, <thorgal@wfmh.org.pl>
 
+#include <cstddef>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "Libpfs/array2d_fwd.h"
 
-class Vector3D;
-class Point2D;
-
+//! \brief Mapping between the directions of the sphere and the points of an
+//! image
+//!
+//! Directions are unit vectors, points are (u, v) coordinates in [0, 1]. Both
+//! are converted in batches, one array per coordinate, so that the virtual
+//! call is paid once per batch rather than once per sample.
 class Projection {
    protected:
     const char *name;
 
    public:
-    virtual Vector3D *uvToDirection(double u, double v) = 0;
-    virtual Point2D *directionToUV(Vector3D *direction) = 0;
+    //! \brief directions of the \a n points (\a u[i], \a v[i])
+    virtual void uvToDirection(const float *u, const float *v, size_t n,
+                               float *x, float *y, float *z) const = 0;
+    //! \brief points of the \a n directions (\a x[i], \a y[i], \a z[i])
+    virtual void directionToUV(const float *x, const float *y, const float *z,
+                               size_t n, float *u, float *v) const = 0;
     virtual bool isValidPixel(double u, double v) = 0;
     virtual double getSizeRatio(void) = 0;
     virtual ~Projection() {}
 
     virtual void setOptions(char *) {}
+    //! \brief options in the syntax of setOptions(), empty if none
+    virtual std::string getOptions() const { return std::string(); }
 
     virtual const char *getName(void) { return name; }
 };
@@ -74,8 +87,10 @@ class MirrorBallProjection : public Projection {
     const char *getName(void);
     double getSizeRatio(void);
     bool isValidPixel(double u, double v);
-    Vector3D *uvToDirection(double u, double v);
-    Point2D *directionToUV(Vector3D *direction);
+    void uvToDirection(const float *u, const float *v, size_t n, float *x,
+                       float *y, float *z) const;
+    void directionToUV(const float *x, const float *y, const float *z,
+                       size_t n, float *u, float *v) const;
 };
 
 class AngularProjection : public Projection {
@@ -86,44 +101,43 @@ class AngularProjection : public Projection {
     static AngularProjection singleton;
     static Projection *create();
     void setOptions(char *opts);
+    std::string getOptions() const;
     const char *getName(void);
     double getSizeRatio(void);
     bool isValidPixel(double u, double v);
-    Vector3D *uvToDirection(double u, double v);
-    Point2D *directionToUV(Vector3D *direction);
+    void uvToDirection(const float *u, const float *v, size_t n, float *x,
+                       float *y, float *z) const;
+    void directionToUV(const float *x, const float *y, const float *z,
+                       size_t n, float *u, float *v) const;
     void setAngle(double v) { totalAngle = v; }
 };
 
 class CylindricalProjection : public Projection {
-    Vector3D *pole;
-    Vector3D *equator;
-    Vector3D *cross;
     explicit CylindricalProjection(bool initialization);
 
    public:
     static CylindricalProjection singleton;
     static Projection *create();
-    ~CylindricalProjection();
     double getSizeRatio(void);
     bool isValidPixel(double /*u*/, double /*v*/);
-    Vector3D *uvToDirection(double u, double v);
-    Point2D *directionToUV(Vector3D *direction);
+    void uvToDirection(const float *u, const float *v, size_t n, float *x,
+                       float *y, float *z) const;
+    void directionToUV(const float *x, const float *y, const float *z,
+                       size_t n, float *u, float *v) const;
 };
 
 class PolarProjection : public Projection {
-    Vector3D *pole;
-    Vector3D *equator;
-    Vector3D *cross;
     explicit PolarProjection(bool initialization);
 
    public:
     static PolarProjection singleton;
     static Projection *create();
-    ~PolarProjection();
     double getSizeRatio(void);
     bool isValidPixel(double /*u*/, double /*v*/);
-    Vector3D *uvToDirection(double u, double v);
-    Point2D *directionToUV(Vector3D *direction);
+    void uvToDirection(const float *u, const float *v, size_t n, float *x,
+                       float *y, float *z) const;
+    void directionToUV(const float *x, const float *y, const float *z,
+                       size_t n, float *u, float *v) const;
 };
 
 class TransformInfo {
@@ -147,4 +161,75 @@ class TransformInfo {
 void transformArray(const pfs::Array2Df *in, pfs::Array2Df *out,
                     TransformInfo *transformInfo);
 
+//! \brief transform each array of \a in into the array of \a out with the
+//! same index, computing the geometry once for all of them
+void transformArrays(const std::vector<const pfs::Array2Df *> &in,
+                     const std::vector<pfs::Array2Df *> &out,
+                     TransformInfo *transformInfo);
+
+//! \brief Source position of every sample of a transform between two image
+//! sizes, computed once and applied to any number of arrays
+//!
+//! An output pixel has oversampleFactor^2 samples. Each sample is stored as a
+//! source position in fixed point, with s_fractionBits fractional bits: the
+//! filter weights are looked up from the fractional part, so applying the
+//! table is a pure gather. The table takes 8 bytes per sample. Pixels outside
+//! the destination projection are left untouched, as by transformArrays().
+class RemapTable {
+   public:
+    enum Filter { NEAREST, BILINEAR, BICUBIC };
+
+    static const int s_fractionBits = 8;
+
+    //! \brief empty table, to be filled by readFromFile()
+    RemapTable();
+    //! \brief table of \a transformInfo from an \a inCols x \a inRows image to
+    //! an \a outCols x \a outRows image
+    RemapTable(const TransformInfo &transformInfo, size_t inCols,
+               size_t inRows, size_t outCols, size_t outRows);
+
+    //! \brief true if the table was built for these parameters
+    bool matches(const TransformInfo &transformInfo, size_t inCols,
+                 size_t inRows, size_t outCols, size_t outRows) const;
+
+    //! \brief resample each array of \a in into the array of \a out with the
+    //! same index. The arrays must have the sizes of the table.
+    void apply(const std::vector<const pfs::Array2Df *> &in,
+               const std::vector<pfs::Array2Df *> &out, Filter filter) const;
+
+    //! \brief memory needed by a table, in bytes
+    static size_t bytes(size_t outCols, size_t outRows, int oversample);
+
+    //! \brief save the table, in the byte order of this machine, together
+    //! with the transform and the sizes it was built for
+    void writeToFile(const std::string &fileName) const;
+    //! \brief load a table saved by writeToFile()
+    void readFromFile(const std::string &fileName);
+
+   private:
+    //! \brief projections, rotations and oversampling of the transform
+    std::string m_transform;
+    size_t m_inCols;
+    size_t m_inRows;
+    size_t m_outCols;
+    size_t m_outRows;
+    int m_oversample;
+    //! \brief source positions, oversample^2 per output pixel in row-major
+    //! order. A negative x marks the samples of an invalid pixel.
+    std::vector<int32_t> m_x;
+    std::vector<int32_t> m_y;
+};
+
+//! \brief remap table of \a transformInfo, for a conversion with the
+//! transform and the sizes of the previous call
+//! \return an empty pointer when the parameters differ from those of the previous call:
+//! the table pays off from the second conversion on. Otherwise the table,
+//! built once and kept until the parameters change or releaseRemapTable()
+std::shared_ptr<const RemapTable> getRemapTable(
+    const TransformInfo &transformInfo, size_t inCols, size_t inRows,
+    size_t outCols, size_t outRows);
+
+//! \brief free the table kept by getRemapTable(), and forget its parameters
+void releaseRemapTable();
+
 #endif  // PFS_PROJECTION_H
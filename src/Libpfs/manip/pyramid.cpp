@@ -0,0 +1,225 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#include "pyramid.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "Libpfs/exception.h"
+#include "Libpfs/frame.h"
+#include "Libpfs/utils/msec_timer.h"
+#include "resize.h"
+
+namespace pfs {
+
+namespace {
+//! \brief no level is built below this size: resampling from the level
+//! above is already cheap
+const size_t s_minimumSize = 16;
+
+//! \brief number of taps of the Lanczos (a = 3) kernel for a 2:1 decimation
+const int s_taps = 12;
+
+//! \brief output pixel i is centred on input i * 2 + 0.5: the taps sit at
+//! +/- 0.5, 1.5, ... 5.5 input pixels
+void decimationKernel(float *w) {
+    float sum = 0.f;
+    for (int k = 0; k < s_taps; k++) {
+        w[k] = detail::Lanc(0.5f * (k - 5.5f), 3.f);
+        sum += w[k];
+    }
+    for (int k = 0; k < s_taps; k++) {
+        w[k] /= sum;
+    }
+}
+
+inline int clampIndex(int i, int size) {
+    return (i < 0) ? 0 : ((i >= size) ? size - 1 : i);
+}
+
+//! \brief separable 2:1 Lanczos decimation, borders replicated. Unlike
+//! pfs::resize() the kernel is fixed, so both passes are plain
+//! multiply-accumulate loops over contiguous data, which the compiler
+//! vectorises: the vertical pass runs on full rows, the horizontal one on the
+//! even and odd samples of each row, split apart.
+void decimate(const Array2Df &in, Array2Df &out) {
+    float w[s_taps];
+    decimationKernel(w);
+
+    const int W = in.getCols();
+    const int H = in.getRows();
+    const int W2 = out.getCols();
+    const int H2 = out.getRows();
+
+    // padded row: sample i of the input row is at i + pad
+    const int pad = s_taps / 2;
+    const int halfPadded = W2 + pad;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> row(W);
+        std::vector<float> even(halfPadded);
+        std::vector<float> odd(halfPadded);
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int y = 0; y < H2; y++) {
+            // vertical pass, W wide
+            const float *rows[s_taps];
+            for (int k = 0; k < s_taps; k++) {
+                rows[k] = in.data() + size_t(clampIndex(2 * y - 5 + k, H)) * W;
+            }
+            std::fill(row.begin(), row.end(), 0.f);
+            // four taps at a time: fewer passes over the row
+            for (int k = 0; k < s_taps; k += 4) {
+                const float *r0 = rows[k];
+                const float *r1 = rows[k + 1];
+                const float *r2 = rows[k + 2];
+                const float *r3 = rows[k + 3];
+                const float w0 = w[k], w1 = w[k + 1], w2 = w[k + 2],
+                            w3 = w[k + 3];
+                for (int x = 0; x < W; x++) {
+                    row[x] += w0 * r0[x] + w1 * r1[x] + w2 * r2[x] + w3 * r3[x];
+                }
+            }
+
+            // horizontal pass: input 2 * x - 5 + k is even[x + (k + 1) / 2]
+            // for odd k, odd[x + k / 2] for even k
+            for (int m = 0; m < halfPadded; m++) {
+                even[m] = row[clampIndex(2 * m - pad, W)];
+                odd[m] = row[clampIndex(2 * m + 1 - pad, W)];
+            }
+            float *dst = out.data() + size_t(y) * W2;
+            for (int x = 0; x < W2; x++) {
+                float acc = 0.f;
+                for (int k = 0; k < s_taps; k += 2) {
+                    acc += w[k] * odd[x + k / 2] +
+                           w[k + 1] * even[x + (k + 2) / 2];
+                }
+                // like pfs::resize(), do not let the ringing go negative
+                dst[x] = std::max(acc, 0.f);
+            }
+        }
+    }
+}
+
+//! \brief half-size copy of \a frame
+Frame *downsampleOctave(const Frame &frame) {
+    const size_t width = (frame.getWidth() + 1) / 2;
+    const size_t height = (frame.getHeight() + 1) / 2;
+
+    Frame *level = new Frame(width, height);
+
+    const ChannelContainer &channels = frame.getChannels();
+    for (ChannelContainer::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+        Channel *newCh = level->createChannel((*it)->getName());
+        decimate(**it, *newCh);
+    }
+    copyTags(&frame, level);
+
+    return level;
+}
+}
+
+FramePyramid::FramePyramid(const Frame &base)
+    : m_base(&base), m_width(base.getWidth()), m_height(base.getHeight()) {}
+
+FramePyramid::~FramePyramid() {}
+
+std::shared_ptr<const Frame> FramePyramid::levelFor(size_t width) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_base == NULL) {
+        throw pfs::Exception("FramePyramid: the frame has changed");
+    }
+
+    // level 0 is not owned by the pyramid
+    std::shared_ptr<const Frame> level(m_base, [](const Frame *) {});
+    size_t next = 0;
+    while (true) {
+        const size_t nextWidth = (level->getWidth() + 1) / 2;
+        const size_t nextHeight = (level->getHeight() + 1) / 2;
+        if (nextWidth < width || nextWidth < s_minimumSize ||
+            nextHeight < s_minimumSize) {
+            return level;
+        }
+        if (next == m_levels.size()) {
+#ifdef TIMER_PROFILING
+            msec_timer f_timer;
+            f_timer.start();
+#endif
+            m_levels.push_back(
+                std::shared_ptr<const Frame>(downsampleOctave(*level)));
+#ifdef TIMER_PROFILING
+            f_timer.stop_and_update();
+            std::cout << "FramePyramid: level " << next + 1 << " ("
+                      << nextWidth << "x" << nextHeight
+                      << ") = " << f_timer.get_time() << " msec" << std::endl;
+#endif
+        }
+        level = m_levels[next++];
+    }
+}
+
+size_t FramePyramid::builtLevels() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_levels.size() + 1;
+}
+
+bool FramePyramid::detached() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_base == NULL;
+}
+
+void FramePyramid::detach() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_base = NULL;
+}
+
+Frame *FramePyramid::resize(int xSize, InterpolationMethod m) {
+    std::shared_ptr<const Frame> levelPtr(levelFor(xSize));
+    const Frame &level = *levelPtr;
+
+    const int new_x = xSize;
+    const int new_y =
+        (int)((float)m_height * (float)xSize / (float)m_width);
+
+    Frame *resizedFrame = new Frame(new_x, new_y);
+
+    std::vector<const Array2Df *> in;
+    std::vector<Array2Df *> out;
+    const ChannelContainer &channels = level.getChannels();
+    for (ChannelContainer::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+        in.push_back(*it);
+        out.push_back(resizedFrame->createChannel((*it)->getName()));
+    }
+    pfs::resize(in, out, m);
+    copyTags(&level, resizedFrame);
+
+    return resizedFrame;
+}
+}
@@ -0,0 +1,88 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#ifndef PFS_PYRAMID_H
+#define PFS_PYRAMID_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Common/global.h"
+
+//! \brief Memoised octave pyramid of a frame, shared by everything that needs
+//! a smaller copy of it (previews, resized tonemapping, ...)
+
+namespace pfs {
+class Frame;
+
+//! \brief Level 0 is the frame itself, every following level is half the size
+//! of the previous one, downsampled with a Lanczos filter. Levels are built on
+//! demand and kept until the pyramid is destroyed.
+//! All the member functions are thread safe.
+//! \note Get one through Frame::pyramid(). The frame detaches the pyramid
+//! when it is destroyed or its content changes (see
+//! Frame::invalidateCaches()): from then on the pyramid never reads the frame
+//! again, and every request for a level throws.
+class FramePyramid {
+   public:
+    explicit FramePyramid(const Frame &base);
+    ~FramePyramid();
+
+    //! \brief smallest level at least \a width pixels wide, or the frame
+    //! itself if \a width is larger than the frame. The pointer owns the
+    //! levels below the frame, which stay valid after the pyramid is
+    //! detached; it does not own level 0, valid as long as the frame is.
+    //! \throw pfs::Exception if the pyramid is detached
+    std::shared_ptr<const Frame> levelFor(size_t width);
+
+    //! \brief number of levels built so far, including level 0
+    size_t builtLevels() const;
+
+    //! \brief replacement for pfs::resize(): a copy of the frame \a xSize
+    //! pixels wide, resampled from levelFor(xSize). The height follows the
+    //! aspect ratio of the frame, exactly as in pfs::resize()
+    //! \throw pfs::Exception if the pyramid is detached
+    Frame *resize(int xSize, InterpolationMethod m);
+
+    //! \brief true once the frame was destroyed or changed
+    bool detached() const;
+
+   private:
+    friend class Frame;
+
+    FramePyramid(const FramePyramid &);
+    FramePyramid &operator=(const FramePyramid &);
+
+    //! \brief forget the frame: called by the frame before its channels
+    //! change or are deleted. Waits for the level being built, if any
+    void detach();
+
+    const Frame *m_base;  // NULL once detached
+    size_t m_width;
+    size_t m_height;
+    std::vector<std::shared_ptr<const Frame>> m_levels;  // levels 1 to n
+    mutable std::mutex m_mutex;
+};
+}
+
+#endif  // PFS_PYRAMID_H
@@ -28,6 +28,8 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <list>
+#include <mutex>
 #include <numeric>
 
 #include "resize.h"
@@ -35,10 +37,186 @@
 #include "Libpfs/utils/msec_timer.h"
 
 #include "Libpfs/frame.h"
+#include "opthelper.h"
 
 namespace pfs {
+namespace detail {
 
-Frame *resize(Frame *frame, int xSize, InterpolationMethod m) {
+ResizeKernel::ResizeKernel(size_t srcSize, size_t dstSize,
+                           InterpolationMethod m)
+    : m_srcSize(srcSize),
+      m_dstSize(dstSize),
+      m_method(m),
+      m_first(dstSize) {
+    const double delta = static_cast<double>(srcSize) / dstSize;
+    const float a = 3.0f;
+    const float sc = std::min(static_cast<float>(1.0 / delta), 1.0f);
+
+    // source samples [begin, end) under every output sample
+    std::vector<int> begin(dstSize);
+    std::vector<int> end(dstSize);
+    int width = 1;
+    // position of output sample j for BilinearInterp
+    const double ratio = static_cast<double>(srcSize - 1) / dstSize;
+    for (size_t j = 0; j < dstSize; j++) {
+        if (m == AreaInterp) {
+            begin[j] = static_cast<int>(std::floor(j * delta));
+            end[j] = std::min(static_cast<int>(std::ceil((j + 1) * delta)),
+                              static_cast<int>(srcSize));
+        } else if (m == BilinearInterp) {
+            begin[j] = static_cast<int>(ratio * j);
+            end[j] = std::min(begin[j] + 2, static_cast<int>(srcSize));
+        } else {
+            // x coord of the center of pixel on src image
+            const float x0 = static_cast<float>((j + 0.5) * delta - 0.5);
+            begin[j] = std::max(0, static_cast<int>(floorf(x0 - a / sc)) + 1);
+            end[j] = std::min(static_cast<int>(srcSize),
+                              static_cast<int>(floorf(x0 + a / sc)) + 1);
+        }
+        width = std::max(width, end[j] - begin[j]);
+    }
+
+    m_taps = (width + 3) & ~3;
+    m_weights.assign(dstSize * m_taps, 0.f);
+
+    const int limit = std::max(static_cast<int>(srcSize), m_taps);
+    for (size_t j = 0; j < dstSize; j++) {
+        m_first[j] = std::min(begin[j], limit - m_taps);
+        float *w = &m_weights[j * m_taps];
+
+        // sum of weights used for normalization
+        double ws = 0.0;
+        for (int jj = begin[j]; jj < end[j]; jj++) {
+            double weight;
+            if (m == AreaInterp) {
+                // overlap of source sample jj with the output sample
+                weight = std::min(jj + 1.0, (j + 1) * delta) -
+                         std::max(static_cast<double>(jj), j * delta);
+            } else if (m == BilinearInterp) {
+                const double diff = ratio * j - begin[j];
+                weight = (jj == begin[j]) ? 1.0 - diff : diff;
+            } else {
+                const float x0 = static_cast<float>((j + 0.5) * delta - 0.5);
+                weight = Lanc(sc * (x0 - static_cast<float>(jj)), a);
+            }
+            w[jj - m_first[j]] = static_cast<float>(weight);
+            ws += weight;
+        }
+
+        // normalize weights
+        if (ws != 0.0) {
+            for (int k = 0; k < m_taps; k++) {
+                w[k] = static_cast<float>(w[k] / ws);
+            }
+        }
+    }
+}
+
+std::shared_ptr<const ResizeKernel> ResizeKernel::get(size_t srcSize,
+                                                      size_t dstSize,
+                                                      InterpolationMethod m) {
+    // previews resize the same frames to the same few sizes over and over:
+    // keep the most recently used kernels
+    static const size_t s_cacheSize = 8;
+    static std::mutex mutex;
+    static std::list<std::shared_ptr<const ResizeKernel>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::list<std::shared_ptr<const ResizeKernel>>::iterator it =
+             cache.begin();
+         it != cache.end(); ++it) {
+        const ResizeKernel &kernel = **it;
+        if (kernel.m_srcSize == srcSize && kernel.m_dstSize == dstSize &&
+            kernel.m_method == m) {
+            cache.splice(cache.begin(), cache, it);
+            return cache.front();
+        }
+    }
+
+    cache.push_front(std::make_shared<ResizeKernel>(srcSize, dstSize, m));
+    if (cache.size() > s_cacheSize) {
+        cache.pop_back();
+    }
+    return cache.front();
+}
+
+void filterRows(const float *const *rows, const float *w, int taps,
+                size_t size, float *out) {
+    size_t x = 0;
+#ifdef __SSE2__
+    for (; x + 3 < size; x += 4) {
+        vfloat acc = ZEROV;
+        for (int k = 0; k < taps; k++) {
+            acc += F2V(w[k]) * LVFU(rows[k][x]);
+        }
+        STVFU(out[x], acc);
+    }
+#endif
+    for (; x < size; x++) {
+        float acc = 0.f;
+        for (int k = 0; k < taps; k++) {
+            acc += w[k] * rows[k][x];
+        }
+        out[x] = acc;
+    }
+}
+
+void filterRow(const float *in, const ResizeKernel &kernel, float *out) {
+    const int taps = kernel.taps();
+    for (size_t j = 0; j < kernel.dstSize(); j++) {
+        const float *src = in + kernel.first(j);
+        const float *w = kernel.weights(j);
+#ifdef __SSE2__
+        vfloat acc = ZEROV;
+        for (int k = 0; k < taps; k += 4) {
+            acc += LVFU(w[k]) * LVFU(src[k]);
+        }
+        out[j] = vhadd(acc);
+#else
+        float acc = 0.f;
+        for (int k = 0; k < taps; k++) {
+            acc += w[k] * src[k];
+        }
+        out[j] = acc;
+#endif
+    }
+}
+}
+
+void resize(const std::vector<const Array2Df *> &in,
+            const std::vector<Array2Df *> &out, InterpolationMethod m) {
+    assert(in.size() == out.size());
+    if (in.empty()) {
+        return;
+    }
+
+    const size_t W = in[0]->getCols();
+    const size_t H = in[0]->getRows();
+    const size_t W2 = out[0]->getCols();
+    const size_t H2 = out[0]->getRows();
+
+    if ((W == W2 && H == H2) ||
+        (m == BilinearInterp && !detail::shrinksMoreThanTwice(W, H, W2, H2))) {
+        for (size_t c = 0; c < in.size(); c++) {
+            resize(in[c], out[c], m);
+        }
+        return;
+    }
+
+    std::vector<const float *> src;
+    std::vector<float *> dst;
+    for (size_t c = 0; c < in.size(); c++) {
+        assert(in[c]->getCols() == W && in[c]->getRows() == H);
+        assert(out[c]->getCols() == W2 && out[c]->getRows() == H2);
+        src.push_back(in[c]->data());
+        dst.push_back(out[c]->data());
+    }
+    detail::resampleSeparable(src, dst, W, H, W2, H2,
+                              detail::axisMethod(W, W2, m),
+                              detail::axisMethod(H, H2, m));
+}
+
+Frame *resize(const Frame *frame, int xSize, InterpolationMethod m) {
 #ifdef TIMER_PROFILING
     msec_timer f_timer;
     f_timer.start();
@@ -50,13 +228,15 @@ Frame *resize(Frame *frame, int xSize, InterpolationMethod m) {
 
     pfs::Frame *resizedFrame = new pfs::Frame(new_x, new_y);
 
+    std::vector<const Array2Df *> in;
+    std::vector<Array2Df *> out;
     const ChannelContainer &channels = frame->getChannels();
     for (ChannelContainer::const_iterator it = channels.begin();
          it != channels.end(); ++it) {
-        pfs::Channel *newCh = resizedFrame->createChannel((*it)->getName());
-
-        resize(*it, newCh, m);
+        in.push_back(*it);
+        out.push_back(resizedFrame->createChannel((*it)->getName()));
     }
+    resize(in, out, m);
     pfs::copyTags(frame, resizedFrame);
 
 #ifdef TIMER_PROFILING
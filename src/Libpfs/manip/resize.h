@@ -27,6 +27,10 @@
 //! \author Rafal Mantiuk, <mantiuk@mpi-sb.mpg.de>
 //! \author Davide Anastasia <davideanastasia@users.sourceforge.net>
 
+#include <cstddef>
+#include <memory>
+#include <vector>
+
 //#include "Libpfs/array2d_fwd.h"
 #include "Common/global.h"
 #include "Libpfs/array2d.h"
@@ -35,7 +39,13 @@ namespace pfs {
 // forward declaration
 class Frame;
 
-Frame *resize(Frame *frame, int xSize, InterpolationMethod m);
+Frame *resize(const Frame *frame, int xSize, InterpolationMethod m);
+
+//! \brief resize each array of \a in into the array of \a out with the same
+//! index. The arrays are resampled together, one output row at a time, and
+//! share the filter weights.
+void resize(const std::vector<const Array2Df *> &in,
+            const std::vector<Array2Df *> &out, InterpolationMethod m);
 
 template <typename Type>
 void resize(const Array2D<Type> *from, Array2D<Type> *to,
@@ -46,6 +56,52 @@ void resize(const Array2D<Type> &from, Array2D<Type> &to,
             InterpolationMethod m) {
     resize(&from, &to, m);
 }
+
+namespace detail {
+
+//! \brief Normalised weights of a one-dimensional resampling filter
+//!
+//! Every output sample has the same number of taps, a multiple of 4, over
+//! consecutive source samples: taps falling outside the filter support have a
+//! zero weight. The first tap is chosen so that the taps stay inside
+//! [0, max(srcSize, taps())).
+class ResizeKernel {
+   public:
+    //! \brief filter resampling \a srcSize samples into \a dstSize with
+    //! \a m. BilinearInterp samples the positions of resizeBilinearGray().
+    ResizeKernel(size_t srcSize, size_t dstSize, InterpolationMethod m);
+
+    //! \brief kernel shared with the previous calls with the same arguments
+    static std::shared_ptr<const ResizeKernel> get(size_t srcSize,
+                                                   size_t dstSize,
+                                                   InterpolationMethod m);
+
+    size_t srcSize() const { return m_srcSize; }
+    size_t dstSize() const { return m_dstSize; }
+    int taps() const { return m_taps; }
+    //! \brief first source sample of output sample \a i
+    int first(size_t i) const { return m_first[i]; }
+    //! \brief taps() weights of output sample \a i
+    const float *weights(size_t i) const { return &m_weights[i * m_taps]; }
+
+   private:
+    size_t m_srcSize;
+    size_t m_dstSize;
+    InterpolationMethod m_method;
+    int m_taps;
+    std::vector<int> m_first;
+    std::vector<float> m_weights;
+};
+
+//! \brief \a out[x] = sum over k of \a w[k] * \a rows[k][x], for x < \a size
+void filterRows(const float *const *rows, const float *w, int taps,
+                size_t size, float *out);
+
+//! \brief apply \a kernel to \a in, which holds at least
+//! max(kernel.srcSize(), kernel.taps()) samples, into kernel.dstSize()
+//! samples of \a out
+void filterRow(const float *in, const ResizeKernel &kernel, float *out);
+}
 }
 
 #include "resize.hxx"
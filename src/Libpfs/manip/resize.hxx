@@ -22,7 +22,11 @@
 #ifndef PFS_RESIZE_HXX
 #define PFS_RESIZE_HXX
 
+#include <algorithm>
+#include <vector>
+
 #include <boost/math/constants/constants.hpp>
+#include <boost/numeric/conversion/bounds.hpp>
 #include "copy.h"
 #include "resize.h"
 #include "../../sleef.c"
@@ -45,120 +49,72 @@ static inline float Lanc(float x, float a) {
     }
 }
 
-template <typename Type>
-void Lanczos(const Type *src, Type *dst, int W, int H, int W2, int H2)
+inline const float *floatRow(const float *row, size_t /*size*/,
+                             std::vector<float> & /*buffer*/) {
+    return row;
+}
 
-{
-    const float scale = static_cast<float>(W2) / static_cast<float>(W);
-    const float delta = 1.0f / scale;
-    const float a = 3.0f;
-    const float sc = std::min(scale, 1.0f);
-    const int support = static_cast<int>(2.0f * a / sc) + 1;
+template <typename Type>
+const float *floatRow(const Type *row, size_t size,
+                      std::vector<float> &buffer) {
+    buffer.assign(row, row + size);
+    return buffer.data();
+}
 
-    const Type zero = static_cast<Type>(0);
+//! \brief store \a size samples, clamped to [0, highest value of Type]: the
+//! Lanczos filter rings below zero near sharp edges
+template <typename Type>
+void storeRow(const float *in, size_t size, Type *out) {
+    const float highest =
+        static_cast<float>(boost::numeric::bounds<Type>::highest());
+    for (size_t j = 0; j < size; j++) {
+        out[j] = static_cast<Type>(std::max(0.f, std::min(in[j], highest)));
+    }
+}
 
+//! \brief separable resampling of the W x H arrays of \a in into the W2 x H2
+//! arrays of \a out with the same index, with \a mx along the rows and \a my
+//! along the columns. The filter weights come from the kernel cache; every
+//! output row is computed for all the arrays before moving to the next one.
+template <typename Type>
+void resampleSeparable(const std::vector<const Type *> &in,
+                       const std::vector<Type *> &out, int W, int H, int W2,
+                       int H2, InterpolationMethod mx, InterpolationMethod my) {
+    const std::shared_ptr<const ResizeKernel> kx =
+        ResizeKernel::get(W, W2, mx);
+    const std::shared_ptr<const ResizeKernel> ky =
+        ResizeKernel::get(H, H2, my);
+    const int taps = ky->taps();
+    // the horizontal filter may read past the row when it is shorter than
+    // the kernel: those samples stay zero
+    const size_t rowSize = std::max(W, kx->taps());
+
+#ifdef _OPENMP
 #pragma omp parallel
+#endif
     {
-        // storage for precomputed parameters for horisontal interpolation
-        float *wwh = new float[support * W2];
-        int *jj0 = new int[W2];
-        int *jj1 = new int[W2];
-
-        // temporal storage for vertically-interpolated row of pixels
-        float *l = new float[W];
-
-        // Phase 1: precompute coefficients for horisontal interpolation
-
-        for (int j = 0; j < W2; j++) {
-            // x coord of the center of pixel on src image
-            float x0 = (static_cast<float>(j) + 0.5f) * delta - 0.5f;
-
-            // weights for interpolation in horisontal direction
-            float *w = wwh + j * support;
-
-            // sum of weights used for normalization
-            float ws = 0.0f;
-
-            jj0[j] = std::max(0, static_cast<int>(floorf(x0 - a / sc)) + 1);
-            jj1[j] = std::min(W, static_cast<int>(floorf(x0 + a / sc)) + 1);
-
-            // calculate weights
-            for (int jj = jj0[j]; jj < jj1[j]; jj++) {
-                int k = jj - jj0[j];
-                float z = sc * (x0 - static_cast<float>(jj));
-                w[k] = Lanc(z, a);
-                ws += w[k];
-            }
-
-            // normalize weights
-            for (int k = 0; k < support; k++) {
-                w[k] /= ws;
-            }
-        }
-
-        // Phase 2: do actual interpolation
-        // weights for interpolation in y direction
-        float *w = new float[support];
-#pragma omp for
+        std::vector<float> column(rowSize, 0.f);
+        std::vector<float> result(W2);
+        std::vector<const float *> rows(taps);
+        std::vector<std::vector<float>> buffers(taps);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
         for (int i = 0; i < H2; i++) {
-            // y coord of the center of pixel on src image
-            float y0 = (static_cast<float>(i) + 0.5f) * delta - 0.5f;
-
-            // sum of weights used for normalization
-            float ws = 0.0f;
-
-            int ii0 = std::max(0, static_cast<int>(floorf(y0 - a / sc)) + 1);
-            int ii1 = std::min(H, static_cast<int>(floorf(y0 + a / sc)) + 1);
-
-            // calculate weights for vertical interpolation
-            for (int ii = ii0; ii < ii1; ii++) {
-                int k = ii - ii0;
-                float z = sc * (y0 - static_cast<float>(ii));
-                w[k] = Lanc(z, a);
-                ws += w[k];
-            }
-
-            // normalize weights
-            for (int k = 0; k < support; k++) {
-                w[k] /= ws;
-            }
-
-            // Do vertical interpolation. Store results.
-            for (int j = 0; j < W; j++) {
-                float o = 0.0f;
-
-                for (int ii = ii0; ii < ii1; ii++) {
-                    int k = ii - ii0;
-
-                    o += w[k] * static_cast<float>(src[ii * W + j]);
-                }
-
-                l[j] = o;
-            }
-
-            // Do horizontal interpolation
-            for (int j = 0; j < W2; j++) {
-                float *wh = wwh + support * j;
-
-                float o = 0.0f;
-
-                for (int jj = jj0[j]; jj < jj1[j]; jj++) {
-                    int k = jj - jj0[j];
-
-                    o += wh[k] * l[jj];
+            const int first = ky->first(i);
+            for (size_t c = 0; c < in.size(); c++) {
+                // vertical pass, then horizontal pass
+                for (int k = 0; k < taps; k++) {
+                    const int ii = std::min(first + k, H - 1);
+                    rows[k] = floatRow(in[c] + size_t(ii) * W, W, buffers[k]);
                 }
-
-                dst[i * W2 + j] =
-                    max(zero, min(static_cast<Type>(o),
-                                  boost::numeric::bounds<Type>::highest()));
+                filterRows(rows.data(), ky->weights(i), taps, W,
+                           column.data());
+                filterRow(column.data(), *kx, result.data());
+                storeRow(result.data(), W2, out[c] + size_t(i) * W2);
             }
         }
-
-        delete[] w;
-        delete[] wwh;
-        delete[] jj0;
-        delete[] jj1;
-        delete[] l;
     }
 }
 
@@ -221,18 +177,34 @@ void resizeBilinearGray(const Type *pixels, Type *output, size_t w, size_t h,
     }  // end parallel region
 }
 
+//! \brief true if bilinear interpolation would skip source pixels, and
+//! alias: it only reads the four pixels around each output pixel
+inline bool shrinksMoreThanTwice(size_t W, size_t H, size_t W2, size_t H2) {
+    return 2 * W2 < W || 2 * H2 < H;
+}
+
+//! \brief filter of \a m along an axis of \a size samples resized to
+//! \a size2: bilinear interpolation averages the areas of the axes it would
+//! alias on only
+inline InterpolationMethod axisMethod(size_t size, size_t size2,
+                                      InterpolationMethod m) {
+    return (m == BilinearInterp && 2 * size2 < size) ? AreaInterp : m;
+}
+
 template <typename Type>
 void resample(const ::pfs::Array2D<Type> *in, ::pfs::Array2D<Type> *out,
               InterpolationMethod m) {
-    switch (m) {
-        case LanczosInterp:
-            Lanczos(in->data(), out->data(), in->getCols(), in->getRows(),
-                    out->getCols(), out->getRows());
-            break;
-        case BilinearInterp:
-            resizeBilinearGray(in->data(), out->data(), in->getCols(),
-                               in->getRows(), out->getCols(), out->getRows());
-            break;
+    const size_t W = in->getCols();
+    const size_t H = in->getRows();
+    const size_t W2 = out->getCols();
+    const size_t H2 = out->getRows();
+
+    if (m == BilinearInterp && !shrinksMoreThanTwice(W, H, W2, H2)) {
+        resizeBilinearGray(in->data(), out->data(), W, H, W2, H2);
+    } else {
+        resampleSeparable(std::vector<const Type *>(1, in->data()),
+                          std::vector<Type *>(1, out->data()), W, H, W2, H2,
+                          axisMethod(W, W2, m), axisMethod(H, H2, m));
     }
 }
 
@@ -0,0 +1,371 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+//! \brief Memoised statistics of a frame
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Libpfs/colorspace/xyz.h"
+#include "Libpfs/exception.h"
+#include "Libpfs/frame.h"
+#include "Libpfs/manip/pyramid.h"
+#include "opthelper.h"
+#include "sleef.c"
+
+namespace pfs {
+
+//! \brief what has been computed so far on the content of a frame
+class FrameStatisticsCache {
+   public:
+    explicit FrameStatisticsCache(const Frame &frame)
+        : hasMoments(false), m_frame(&frame) {}
+
+    //! \brief the frame the statistics are computed on. Call with the mutex
+    //! held
+    //! \throw pfs::Exception once the frame has changed or is gone
+    const Frame &frame() const {
+        if (m_frame == NULL) {
+            throw pfs::Exception("FrameStatistics: the frame has changed");
+        }
+        return *m_frame;
+    }
+
+    //! \brief forget the frame, see Frame::invalidateCaches()
+    void detach() {
+        std::lock_guard<std::mutex> lock(mutex);
+        m_frame = NULL;
+    }
+
+    std::mutex mutex;
+
+    bool hasMoments;
+    float minimum[4];
+    float maximum[4];
+    float minimumPositive[4];
+    float mean[4];
+
+    std::map<std::pair<int, float>, float> meanLogs;
+    std::shared_ptr<const std::vector<size_t> > histograms[4];
+
+   private:
+    const Frame *m_frame;  // NULL once detached
+};
+
+namespace {
+
+//! \brief run \a reduce(row, signals) on every row of \a frame, in parallel.
+//! signals[s] points to the row of signal s, luminance included
+template <typename Reduce>
+void forEachRow(const Frame &frame, Reduce &reduce) {
+    const Channel *R, *G, *B;
+    frame.getXYZChannels(R, G, B);
+    if (!R || !G || !B) {
+        throw pfs::Exception("Missing X, Y, Z channels in the PFS stream");
+    }
+
+    const int height = frame.getHeight();
+    const size_t width = frame.getWidth();
+    const float kr = colorspace::rgb2xyzD65Mat[1][0];
+    const float kg = colorspace::rgb2xyzD65Mat[1][1];
+    const float kb = colorspace::rgb2xyzD65Mat[1][2];
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        std::vector<float> luminance(width);
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (int y = 0; y < height; y++) {
+            const float *signals[4] = {R->data() + y * width,
+                                       G->data() + y * width,
+                                       B->data() + y * width,
+                                       luminance.data()};
+            for (size_t x = 0; x < width; x++) {
+                luminance[x] = kr * signals[0][x] + kg * signals[1][x] +
+                               kb * signals[2][x];
+            }
+            reduce(y, signals);
+        }
+    }
+}
+
+//! \brief extrema and sums of the four signals
+struct Moments {
+    explicit Moments(size_t width) : m_width(width) {
+        for (int s = 0; s < 4; s++) {
+            minimum[s] = std::numeric_limits<float>::max();
+            maximum[s] = -std::numeric_limits<float>::max();
+            minimumPositive[s] = std::numeric_limits<float>::max();
+            sum[s] = 0.;
+        }
+    }
+
+    void operator()(int, const float *const *signals) {
+        float rowMin[4], rowMax[4], rowMinPositive[4], rowSum[4];
+        for (int s = 0; s < 4; s++) {
+            rowMin[s] = std::numeric_limits<float>::max();
+            rowMax[s] = -std::numeric_limits<float>::max();
+            rowMinPositive[s] = std::numeric_limits<float>::max();
+            rowSum[s] = 0.f;
+            const float *row = signals[s];
+            for (size_t x = 0; x < m_width; x++) {
+                const float v = row[x];
+                rowMin[s] = std::min(rowMin[s], v);
+                rowMax[s] = std::max(rowMax[s], v);
+                rowMinPositive[s] = (v > 0.f) ? std::min(rowMinPositive[s], v)
+                                              : rowMinPositive[s];
+                rowSum[s] += v;
+            }
+        }
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        for (int s = 0; s < 4; s++) {
+            minimum[s] = std::min(minimum[s], rowMin[s]);
+            maximum[s] = std::max(maximum[s], rowMax[s]);
+            minimumPositive[s] = std::min(minimumPositive[s], rowMinPositive[s]);
+            sum[s] += rowSum[s];
+        }
+    }
+
+    size_t m_width;
+    float minimum[4];
+    float maximum[4];
+    float minimumPositive[4];
+    double sum[4];
+};
+
+struct MeanLog {
+    MeanLog(size_t width, int signal, float offset)
+        : m_width(width), m_signal(signal), m_offset(offset), sum(0.) {}
+
+    void operator()(int, const float *const *signals) {
+        const float *row = signals[m_signal];
+        float rowSum = 0.f;
+        size_t x = 0;
+#ifdef __SSE2__
+        const vfloat offsetv = F2V(m_offset);
+        vfloat rowSumv = ZEROV;
+        for (; x + 3 < m_width; x += 4) {
+            rowSumv += xlogf(LVFU(row[x]) + offsetv);
+        }
+        rowSum += vhadd(rowSumv);
+#endif
+        for (; x < m_width; x++) {
+            rowSum += xlogf(row[x] + m_offset);
+        }
+#ifdef _OPENMP
+        #pragma omp atomic
+#endif
+        sum += rowSum;
+    }
+
+    size_t m_width;
+    int m_signal;
+    float m_offset;
+    double sum;
+};
+
+//! \brief one histogram per thread, summed by total()
+struct LogHistogram {
+    LogHistogram(int signal, float minimum, float maximum, size_t width)
+        : m_width(width),
+          m_signal(signal),
+          m_logMin(std::log10(std::max(minimum, 1e-30f))),
+          m_scale(float(FrameStatistics::s_histogramBins) /
+                  std::max(std::log10(std::max(maximum, 1e-30f)) - m_logMin,
+                           1e-6f)),
+#ifdef _OPENMP
+          m_counts(omp_get_max_threads(),
+#else
+          m_counts(1,
+#endif
+                   std::vector<size_t>(FrameStatistics::s_histogramBins, 0)) {
+    }
+
+    void operator()(int, const float *const *signals) {
+#ifdef _OPENMP
+        std::vector<size_t> &counts = m_counts[omp_get_thread_num()];
+#else
+        std::vector<size_t> &counts = m_counts[0];
+#endif
+        const int bins = int(counts.size());
+        const float *row = signals[m_signal];
+        for (size_t x = 0; x < m_width; x++) {
+            if (row[x] > 0.f) {
+                const int bin = int((std::log10(row[x]) - m_logMin) * m_scale);
+                counts[std::min(std::max(bin, 0), bins - 1)]++;
+            }
+        }
+    }
+
+    std::vector<size_t> total() const {
+        std::vector<size_t> counts(m_counts[0]);
+        for (size_t t = 1; t < m_counts.size(); t++) {
+            for (size_t b = 0; b < counts.size(); b++) {
+                counts[b] += m_counts[t][b];
+            }
+        }
+        return counts;
+    }
+
+    size_t m_width;
+    int m_signal;
+    float m_logMin;
+    float m_scale;
+    std::vector<std::vector<size_t> > m_counts;
+};
+
+//! \brief compute the moments if they are missing. Call with the mutex held
+void updateMoments(FrameStatisticsCache &cache) {
+    const Frame &frame = cache.frame();
+    if (cache.hasMoments) return;
+
+    Moments moments(frame.getWidth());
+    forEachRow(frame, moments);
+
+    const double size = std::max(frame.size(), size_t(1));
+    for (int s = 0; s < 4; s++) {
+        cache.minimum[s] = moments.minimum[s];
+        cache.maximum[s] = moments.maximum[s];
+        cache.minimumPositive[s] =
+            (moments.minimumPositive[s] < std::numeric_limits<float>::max())
+                ? moments.minimumPositive[s]
+                : 0.f;
+        cache.mean[s] = float(moments.sum[s] / size);
+    }
+    cache.hasMoments = true;
+}
+}
+
+const size_t FrameStatistics::s_histogramBins;
+
+FrameStatistics::FrameStatistics(
+    const std::shared_ptr<FrameStatisticsCache> &cache)
+    : m_cache(cache) {}
+
+float FrameStatistics::minimum(Signal s) const {
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    updateMoments(*m_cache);
+    return m_cache->minimum[s];
+}
+
+float FrameStatistics::maximum(Signal s) const {
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    updateMoments(*m_cache);
+    return m_cache->maximum[s];
+}
+
+float FrameStatistics::mean(Signal s) const {
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    updateMoments(*m_cache);
+    return m_cache->mean[s];
+}
+
+float FrameStatistics::minimumPositive(Signal s) const {
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    updateMoments(*m_cache);
+    return m_cache->minimumPositive[s];
+}
+
+float FrameStatistics::meanLog(Signal s, float offset) const {
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    const Frame &frame = m_cache->frame();
+
+    const std::pair<int, float> key(s, offset);
+    std::map<std::pair<int, float>, float>::const_iterator it =
+        m_cache->meanLogs.find(key);
+    if (it != m_cache->meanLogs.end()) {
+        return it->second;
+    }
+
+    MeanLog meanLog(frame.getWidth(), s, offset);
+    forEachRow(frame, meanLog);
+
+    const float value =
+        float(meanLog.sum / std::max(frame.size(), size_t(1)));
+    m_cache->meanLogs[key] = value;
+    return value;
+}
+
+std::shared_ptr<const std::vector<size_t> > FrameStatistics::logHistogram(
+    Signal s) const {
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    const Frame &frame = m_cache->frame();
+    if (!m_cache->histograms[s]) {
+        updateMoments(*m_cache);
+
+        LogHistogram histogram(s, m_cache->minimumPositive[s],
+                               m_cache->maximum[s], frame.getWidth());
+        if (m_cache->minimumPositive[s] > 0.f) {
+            forEachRow(frame, histogram);
+        }
+        m_cache->histograms[s] =
+            std::make_shared<const std::vector<size_t> >(histogram.total());
+    }
+    return m_cache->histograms[s];
+}
+
+// Frame members that need the definition of FrameStatisticsCache
+
+FrameStatistics Frame::statistics() const {
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    if (!m_statistics) {
+        m_statistics = std::make_shared<FrameStatisticsCache>(*this);
+    }
+    return FrameStatistics(m_statistics);
+}
+
+std::shared_ptr<const void> Frame::contentKey() const {
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    if (!m_statistics) {
+        m_statistics = std::make_shared<FrameStatisticsCache>(*this);
+    }
+    return m_statistics;
+}
+
+void Frame::invalidateCaches() {
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    // both may be kept by someone else: they must not read this frame any
+    // longer
+    if (m_pyramid) {
+        m_pyramid->detach();
+    }
+    m_pyramid.reset();
+    if (m_statistics) {
+        m_statistics->detach();
+    }
+    m_statistics.reset();
+}
+}
@@ -0,0 +1,77 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#ifndef PFS_STATISTICS_H
+#define PFS_STATISTICS_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+//! \brief Memoised statistics of a frame, shared by the tonemapping operators,
+//! the histograms and the luminance range widget
+
+namespace pfs {
+class Frame;
+class FrameStatisticsCache;
+
+//! \brief Reductions over the RGB channels of a frame and over their
+//! luminance. Each one is computed on the first request, in a single parallel
+//! pass, and kept until the frame is written: extrema and means of the four
+//! signals come from the same pass.
+//! All the member functions are thread safe.
+//! \note Get one through Frame::statistics(). It is tied to the content of
+//! the frame at that time: once the frame is written (see
+//! Frame::invalidateCaches()) or destroyed, every member function throws
+//! pfs::Exception.
+class FrameStatistics {
+   public:
+    enum Signal { RED = 0, GREEN = 1, BLUE = 2, LUMINANCE = 3 };
+
+    //! \brief resolution of logHistogram()
+    static const size_t s_histogramBins = 4096;
+
+    float minimum(Signal s) const;
+    float maximum(Signal s) const;
+    float mean(Signal s) const;
+
+    //! \brief smallest value above zero, or zero if there is none
+    float minimumPositive(Signal s) const;
+
+    //! \brief mean of log(s + \a offset), as in the log-average luminance of
+    //! most operators
+    float meanLog(Signal s, float offset) const;
+
+    //! \brief number of samples in each of s_histogramBins bins evenly
+    //! spaced in log10(s), over [log10(minimumPositive(s)),
+    //! log10(maximum(s))]. Samples not above zero are not counted.
+    std::shared_ptr<const std::vector<size_t> > logHistogram(Signal s) const;
+
+   private:
+    friend class Frame;
+    explicit FrameStatistics(
+        const std::shared_ptr<FrameStatisticsCache> &cache);
+
+    std::shared_ptr<FrameStatisticsCache> m_cache;
+};
+}
+
+#endif  // PFS_STATISTICS_H
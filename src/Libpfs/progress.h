@@ -25,6 +25,8 @@
 #ifndef LIBPFS_PROGRESS_H
 #define LIBPFS_PROGRESS_H
 
+#include <atomic>
+
 namespace pfs {
 
 //! \brief This class is a virtual interface for a status callback. It allows
@@ -65,7 +67,8 @@ class Progress {
 
     int m_value;
 
-    bool m_canceled;
+    //! \brief set from the GUI thread while the operator polls it
+    std::atomic<bool> m_canceled;
 };
 }
 
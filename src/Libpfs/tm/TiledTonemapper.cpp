@@ -0,0 +1,339 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#include "TiledTonemapper.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+#include "Libpfs/frame.h"
+#include "Libpfs/io/framereader.h"
+#include "Libpfs/manip/cut.h"
+#include "Libpfs/manip/pointpipeline.h"
+#include "Libpfs/params.h"
+#include "Libpfs/progress.h"
+#include "Libpfs/tm/TonemapOperator.h"
+
+//! \brief Image read a band of rows at a time
+class TiledTonemapper::RowSource {
+   public:
+    virtual ~RowSource() {}
+
+    virtual size_t width() const = 0;
+    virtual size_t height() const = 0;
+
+    //! \brief read \a rows rows, starting at row \a y, into \a frame
+    virtual void read(pfs::Frame &frame, size_t y, size_t rows) = 0;
+};
+
+namespace {
+
+class ReaderRowSource : public TiledTonemapper::RowSource {
+   public:
+    explicit ReaderRowSource(pfs::io::FrameReader &reader) : m_reader(reader) {}
+
+    size_t width() const { return m_reader.width(); }
+    size_t height() const { return m_reader.height(); }
+
+    void read(pfs::Frame &frame, size_t y, size_t rows) {
+        m_reader.readRows(frame, y, rows, pfs::Params());
+    }
+
+   private:
+    pfs::io::FrameReader &m_reader;
+};
+
+class FrameRowSource : public TiledTonemapper::RowSource {
+   public:
+    explicit FrameRowSource(const pfs::Frame &frame) : m_frame(frame) {}
+
+    size_t width() const { return m_frame.getWidth(); }
+    size_t height() const { return m_frame.getHeight(); }
+
+    void read(pfs::Frame &frame, size_t y, size_t rows) {
+        std::unique_ptr<pfs::Frame> band(
+            pfs::cut(&m_frame, 0, y, m_frame.getWidth(), y + rows));
+        frame.swap(*band);
+    }
+
+   private:
+    const pfs::Frame &m_frame;
+};
+
+//! \brief weight of a tile whose core spans [c0, c1) of [0, n), at \a x.
+//! The weights of neighbouring tiles ramp linearly over the 2 * overlap
+//! pixels around their common border and sum to one.
+inline float blendWeight(size_t x, size_t c0, size_t c1, size_t n,
+                         size_t overlap) {
+    if (overlap == 0) return 1.f;
+
+    float w = 1.f;
+    if (c0 > 0) {
+        w = std::min(w, (float(x) - float(c0) + overlap + 0.5f) / (2 * overlap));
+    }
+    if (c1 < n) {
+        w = std::min(w, (float(c1) - float(x) + overlap - 0.5f) / (2 * overlap));
+    }
+    return std::max(w, 0.f);
+}
+
+//! \brief reduced copy of the image \a source streams, averaging blocks of
+//! \a factor x \a factor pixels
+void buildProxy(TiledTonemapper::RowSource &source, size_t factor,
+                size_t bandRows, pfs::Frame &proxy) {
+    const size_t width = source.width();
+    const size_t height = source.height();
+
+    pfs::Channel *pX, *pY, *pZ;
+    proxy.createXYZChannels(pX, pY, pZ);
+    pfs::Channel *proxyChannels[] = {pX, pY, pZ};
+
+    for (size_t y = 0; y < height; y += bandRows) {
+        const size_t rows = std::min(bandRows, height - y);
+        pfs::Frame band;
+        source.read(band, y, rows);
+
+        const pfs::Channel *bX, *bY, *bZ;
+        band.getXYZChannels(bX, bY, bZ);
+        const pfs::Channel *bandChannels[] = {bX, bY, bZ};
+
+        const int proxyRows = int((rows + factor - 1) / factor);
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int py = 0; py < proxyRows; py++) {
+            const size_t y0 = py * factor;
+            const size_t y1 = std::min(y0 + factor, rows);
+            for (size_t px = 0; px < proxy.getWidth(); px++) {
+                const size_t x0 = px * factor;
+                const size_t x1 = std::min(x0 + factor, width);
+                const float norm = 1.f / ((y1 - y0) * (x1 - x0));
+                for (int c = 0; c < 3; c++) {
+                    float sum = 0.f;
+                    for (size_t j = y0; j < y1; j++) {
+                        const float *row = bandChannels[c]->data() + j * width;
+                        for (size_t i = x0; i < x1; i++) {
+                            sum += row[i];
+                        }
+                    }
+                    (*proxyChannels[c])(px, y / factor + py) = sum * norm;
+                }
+            }
+        }
+    }
+}
+}
+
+TiledTonemapper::Sink::~Sink() {}
+
+TiledTonemapper::FrameSink::FrameSink(pfs::Frame &frame) : m_frame(frame) {}
+
+void TiledTonemapper::FrameSink::write(const pfs::Frame &rows, size_t y) {
+    pfs::Channel *X, *Y, *Z;
+    m_frame.createXYZChannels(X, Y, Z);
+    pfs::Channel *channels[] = {X, Y, Z};
+
+    const pfs::Channel *rX, *rY, *rZ;
+    rows.getXYZChannels(rX, rY, rZ);
+    const pfs::Channel *rowsChannels[] = {rX, rY, rZ};
+
+    for (int c = 0; c < 3; c++) {
+        std::copy(rowsChannels[c]->begin(), rowsChannels[c]->end(),
+                  channels[c]->row_begin(y));
+    }
+}
+
+TiledTonemapper::TiledTonemapper(size_t tileSize, size_t overlap)
+    : m_tileSize(std::max(tileSize, size_t(1))), m_overlap(overlap) {}
+
+bool TiledTonemapper::supports(TMOperator tmo) {
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(tmo));
+    return tmEngine->tonemapsRegions();
+}
+
+void TiledTonemapper::tonemap(pfs::io::FrameReader &reader,
+                              TonemappingOptions *opts, Sink &sink,
+                              pfs::Progress &ph) const {
+    if (!reader.readsRows()) {
+        throw std::runtime_error("TiledTonemapper: " + reader.filename() +
+                                 " cannot be read a band at a time");
+    }
+    ReaderRowSource source(reader);
+    run(source, opts, sink, ph);
+}
+
+void TiledTonemapper::tonemap(const pfs::Frame &frame,
+                              TonemappingOptions *opts, Sink &sink,
+                              pfs::Progress &ph) const {
+    FrameRowSource source(frame);
+    run(source, opts, sink, ph);
+}
+
+void TiledTonemapper::run(RowSource &source, TonemappingOptions *opts,
+                          Sink &sink, pfs::Progress &ph) const {
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(opts->tmoperator));
+    if (!tmEngine->tonemapsRegions()) {
+        throw std::runtime_error(
+            "TiledTonemapper: this operator cannot be run in tiles");
+    }
+
+    const size_t width = source.width();
+    const size_t height = source.height();
+    if (width == 0 || height == 0) return;
+
+    pfs::PointPipeline pregamma;
+    pregamma.gamma(1.0f / opts->pregamma);
+    pfs::PointPipeline post;
+    post.saturation(opts->postsaturation).gamma(1.0f / opts->postgamma);
+
+    const size_t bands = (height + m_tileSize - 1) / m_tileSize;
+    ph.setRange(0, int(bands + 1));
+    ph.setValue(0);
+
+    // first pass: statistics of the whole image, on a reduced copy
+    std::unique_ptr<TonemapStatistics> statistics;
+    {
+        const size_t factor = (width + s_proxyWidth - 1) / s_proxyWidth;
+        pfs::Frame proxy((width + factor - 1) / factor,
+                         (height + factor - 1) / factor);
+        buildProxy(source, factor,
+                   std::max(factor, m_tileSize / factor * factor), proxy);
+        pregamma.apply(proxy);
+
+        pfs::Progress progress;
+        statistics.reset(tmEngine->computeStatistics(proxy, opts, progress));
+    }
+    ph.setValue(1);
+
+    // second pass: bands of tiles. Operators with no halo are per-pixel
+    // given the statistics, and their tiles need no blending
+    const size_t halo = tmEngine->regionHalo(opts);
+    const size_t overlap = (halo > 0) ? std::min(m_overlap, m_tileSize / 2) : 0;
+    const size_t tiles = (width + m_tileSize - 1) / m_tileSize;
+
+    // weighted sum of the tiles, from row accY of the image on
+    const size_t accRows = std::min(m_tileSize + 2 * overlap, height);
+    pfs::Frame acc(width, accRows);
+    pfs::Channel *aX, *aY, *aZ;
+    acc.createXYZChannels(aX, aY, aZ);
+    pfs::Channel *accChannels[] = {aX, aY, aZ};
+    for (int c = 0; c < 3; c++) {
+        accChannels[c]->fill(0.f);
+    }
+    size_t accY = 0;
+
+    for (size_t y0 = 0; y0 < height; y0 += m_tileSize) {
+        if (ph.canceled()) return;
+
+        const size_t y1 = std::min(y0 + m_tileSize, height);
+        const size_t by0 = (y0 > overlap) ? y0 - overlap : 0;
+        const size_t by1 = std::min(y1 + overlap, height);
+        const size_t ry0 = (by0 > halo) ? by0 - halo : 0;
+        const size_t ry1 = std::min(by1 + halo, height);
+
+        pfs::Frame band;
+        source.read(band, ry0, ry1 - ry0);
+        pregamma.apply(band);
+
+        // neighbouring tiles overlap: even and odd tiles are summed in turn
+        std::exception_ptr failure;
+        for (size_t parity = 0; parity < 2; parity++) {
+            const int count = int((tiles - parity + 1) / 2);
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(dynamic) if (count > 1)
+#endif
+            for (int k = 0; k < count; k++) {
+                try {
+                    const size_t t = 2 * k + parity;
+                    const size_t x0 = t * m_tileSize;
+                    const size_t x1 = std::min(x0 + m_tileSize, width);
+                    const size_t bx0 = (x0 > overlap) ? x0 - overlap : 0;
+                    const size_t bx1 = std::min(x1 + overlap, width);
+                    const size_t rx0 = (bx0 > halo) ? bx0 - halo : 0;
+                    const size_t rx1 = std::min(bx1 + halo, width);
+
+                    std::unique_ptr<pfs::Frame> region(
+                        pfs::cut(&band, rx0, 0, rx1, ry1 - ry0));
+                    std::unique_ptr<TonemapOperator> regionEngine(
+                        TonemapOperator::getTonemapOperator(opts->tmoperator));
+                    pfs::Progress progress;
+                    regionEngine->tonemapRegion(*region, opts, *statistics,
+                                                progress);
+
+                    const pfs::Channel *tX, *tY, *tZ;
+                    region->getXYZChannels(tX, tY, tZ);
+                    const pfs::Channel *tileChannels[] = {tX, tY, tZ};
+
+                    for (size_t y = by0; y < by1; y++) {
+                        const float wy =
+                            blendWeight(y, y0, y1, height, overlap);
+                        for (int c = 0; c < 3; c++) {
+                            const float *in = tileChannels[c]->data() +
+                                              (y - ry0) * (rx1 - rx0);
+                            float *out =
+                                accChannels[c]->data() + (y - accY) * width;
+                            for (size_t x = bx0; x < bx1; x++) {
+                                out[x] += wy *
+                                          blendWeight(x, x0, x1, width,
+                                                      overlap) *
+                                          in[x - rx0];
+                            }
+                        }
+                    }
+                } catch (...) {
+#ifdef _OPENMP
+                    #pragma omp critical
+#endif
+                    failure = std::current_exception();
+                }
+            }
+            if (failure) std::rethrow_exception(failure);
+        }
+
+        // rows above the overlap with the next band are complete
+        const size_t done = (y1 == height) ? height : y1 - overlap;
+        pfs::Frame rows(width, done - accY);
+        pfs::Channel *oX, *oY, *oZ;
+        rows.createXYZChannels(oX, oY, oZ);
+        pfs::Channel *rowsChannels[] = {oX, oY, oZ};
+        for (int c = 0; c < 3; c++) {
+            float *data = accChannels[c]->data();
+            std::copy(data, data + rowsChannels[c]->size(),
+                      rowsChannels[c]->data());
+
+            // keep the rows still to be blended, at the top
+            const size_t kept = (by1 - done) * width;
+            std::memmove(data, data + (done - accY) * width,
+                         kept * sizeof(float));
+            std::fill(data + kept, data + accChannels[c]->size(), 0.f);
+        }
+        post.apply(rows);
+        sink.write(rows, accY);
+        accY = done;
+
+        ph.setValue(int(y0 / m_tileSize + 2));
+    }
+}
@@ -0,0 +1,110 @@
+/**
+ * This file is a part of Luminance HDR package.
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ *
+ */
+
+#ifndef TILEDTONEMAPPER_H
+#define TILEDTONEMAPPER_H
+
+#include <cstddef>
+
+#include "Core/TonemappingOptions.h"
+
+// Forward declaration
+namespace pfs {
+class Progress;
+class Frame;
+namespace io {
+class FrameReader;
+}
+}
+
+//!
+//! \brief Tonemap images too large to be held in memory, in two passes:
+//! the statistics of the whole image are computed on a reduced copy of it,
+//! then the image is tonemapped in overlapping tiles, a band of tiles at a
+//! time, with the tiles of a band in parallel. Seams are blended linearly
+//! over the overlap of neighbouring tiles.
+//!
+//! Memory is bounded by a few bands of rows: about
+//! width * (tileSize + 2 * (overlap + halo)) pixels, halo being the margin
+//! the operator needs around a region (TonemapOperator::regionHalo()).
+//! Only operators that tonemapsRegions() can be run.
+//! Pre-gamma, post-saturation and post-gamma of the options are applied;
+//! resizing and selections are not.
+//!
+class TiledTonemapper {
+   public:
+    //!
+    //! \brief Receives the tonemapped image, top to bottom
+    //!
+    class Sink {
+       public:
+        virtual ~Sink();
+
+        //! \brief \a rows holds RGB in its XYZ channels. Its first row is row
+        //! \a y of the image.
+        virtual void write(const pfs::Frame &rows, size_t y) = 0;
+    };
+
+    //!
+    //! \brief Sink assembling the image into a frame as large as the input
+    //!
+    class FrameSink : public Sink {
+       public:
+        explicit FrameSink(pfs::Frame &frame);
+
+        void write(const pfs::Frame &rows, size_t y);
+
+       private:
+        pfs::Frame &m_frame;
+    };
+
+    //! \brief width of the reduced copy the statistics are computed on
+    static const size_t s_proxyWidth = 2048;
+
+    explicit TiledTonemapper(size_t tileSize = 1024, size_t overlap = 32);
+
+    //! \return true if \a tmo can be run in tiles
+    static bool supports(TMOperator tmo);
+
+    //!
+    //! Tonemap the image \a reader streams, which must readsRows()
+    //! \throw std::runtime_error if the operator cannot be run in tiles
+    //!
+    void tonemap(pfs::io::FrameReader &reader, TonemappingOptions *opts,
+                 Sink &sink, pfs::Progress &ph) const;
+
+    //!
+    //! Tonemap \a frame, tile by tile
+    //!
+    void tonemap(const pfs::Frame &frame, TonemappingOptions *opts,
+                 Sink &sink, pfs::Progress &ph) const;
+
+    class RowSource;
+
+   private:
+    void run(RowSource &source, TonemappingOptions *opts, Sink &sink,
+             pfs::Progress &ph) const;
+
+    size_t m_tileSize;
+    size_t m_overlap;
+};
+
+#endif  // TILEDTONEMAPPER_H
@@ -32,7 +32,9 @@
 
 #include <boost/assign.hpp>
 #include <boost/thread/mutex.hpp>
+#include <cmath>
 #include <map>
+#include <memory>
 
 #include "TonemappingOperators/pfstmo.h"
 
@@ -51,6 +53,51 @@ struct TonemapOperatorRegister : public TonemapOperator {
     TMOperator getType() const { return Key; }
 };
 
+//! \brief TonemapStatistics holding the statistics of one operator
+template <typename Statistics>
+struct TonemapStatisticsOf : public TonemapStatistics {
+    Statistics value;
+};
+
+//! \brief Operators that can tonemap a region with the statistics of the whole
+//! image. ConcreteClass runs the operator in
+//! run(pfs::Frame &, TonemappingOptions *, Statistics *, pfs::Progress &),
+//! where the statistics are used, filled in or NULL (see pfstmo.h)
+template <TMOperator Key, typename ConcreteClass, typename Statistics>
+struct TonemapOperatorRegionRegister
+    : public TonemapOperatorRegister<Key, ConcreteClass> {
+    void tonemapFrame(pfs::Frame &workingframe, TonemappingOptions *opts,
+                      pfs::Progress &ph) {
+        concrete()->run(workingframe, opts, NULL, ph);
+    }
+
+    bool tonemapsRegions() const { return true; }
+
+    TonemapStatistics *computeStatistics(pfs::Frame &frame,
+                                         TonemappingOptions *opts,
+                                         pfs::Progress &ph) {
+        std::unique_ptr<TonemapStatisticsOf<Statistics> > statistics(
+            new TonemapStatisticsOf<Statistics>);
+        concrete()->run(frame, opts, &statistics->value, ph);
+        return statistics.release();
+    }
+
+    void tonemapRegion(pfs::Frame &workingframe, TonemappingOptions *opts,
+                       const TonemapStatistics &statistics,
+                       pfs::Progress &ph) {
+        const TonemapStatisticsOf<Statistics> *s =
+            dynamic_cast<const TonemapStatisticsOf<Statistics> *>(&statistics);
+        if (s == NULL || !s->value.valid) {
+            throw std::runtime_error("Invalid statistics for this operator");
+        }
+        Statistics value(s->value);
+        concrete()->run(workingframe, opts, &value, ph);
+    }
+
+   private:
+    ConcreteClass *concrete() { return static_cast<ConcreteClass *>(this); }
+};
+
 class TonemapOperatorMantiuk06
     : public TonemapOperatorRegister<mantiuk06, TonemapOperatorMantiuk06> {
    public:
@@ -65,7 +112,7 @@ class TonemapOperatorMantiuk06
                 opts->operator_options.mantiuk06options.saturationfactor,
                 opts->operator_options.mantiuk06options.detailfactor,
                 opts->operator_options.mantiuk06options.contrastequalization,
-                ph);
+                ph, takeCache());
         } catch (...) {
             throw std::runtime_error("Mantiuk06: Tonemap Failed");
         }
@@ -79,9 +126,7 @@ struct TonemapOperatorMantiuk08
         ph.setMaximum(100);
 
         // Convert to CS_XYZ: tm operator now use this colorspace
-        pfs::Channel *X, *Y, *Z;
-        workingframe.getXYZChannels(X, Y, Z);
-        pfs::transformColorSpace(pfs::CS_RGB, X, Y, Z, pfs::CS_XYZ, X, Y, Z);
+        pfs::transformColorSpace(pfs::CS_RGB, pfs::CS_XYZ, workingframe);
 
         try {
             pfstmo_mantiuk08(
@@ -89,12 +134,13 @@ struct TonemapOperatorMantiuk08
                 opts->operator_options.mantiuk08options.colorsaturation,
                 opts->operator_options.mantiuk08options.contrastenhancement,
                 opts->operator_options.mantiuk08options.luminancelevel,
-                opts->operator_options.mantiuk08options.setluminance, ph);
+                opts->operator_options.mantiuk08options.setluminance, ph,
+                takeCache());
         } catch (...) {
             throw std::runtime_error("Mantiuk08: Tonemap Failed");
         }
 
-        pfs::transformColorSpace(pfs::CS_XYZ, X, Y, Z, pfs::CS_RGB, X, Y, Z);
+        pfs::transformColorSpace(pfs::CS_XYZ, pfs::CS_RGB, workingframe);
     }
 };
 
@@ -126,7 +172,7 @@ struct TonemapOperatorFattal02
                             opts->operator_options.fattaloptions.noiseredux,
                             opts->operator_options.fattaloptions.newfattal,
                             opts->operator_options.fattaloptions.fftsolver,
-                            detail_level, ph);
+                            detail_level, ph, takeCache());
         } catch (...) {
             throw std::runtime_error("Fattal: Tonemap Failed");
         }
@@ -164,31 +210,41 @@ struct TonemapOperatorMai11
 };
 
 struct TonemapOperatorDrago03
-    : public TonemapOperatorRegister<drago, TonemapOperatorDrago03> {
-    void tonemapFrame(pfs::Frame &workingframe, TonemappingOptions *opts,
-                      pfs::Progress &ph) {
+    : public TonemapOperatorRegionRegister<drago, TonemapOperatorDrago03,
+                                           Drago03Statistics> {
+    void run(pfs::Frame &workingframe, TonemappingOptions *opts,
+             Drago03Statistics *stats, pfs::Progress &ph) {
         ph.setMaximum(100);  // this guy should not be here!
 
         try {
             pfstmo_drago03(workingframe,
-                           opts->operator_options.dragooptions.bias, ph);
+                           opts->operator_options.dragooptions.bias, ph,
+                           stats);
         } catch (...) {
             throw std::runtime_error("Drago: Tonemap Failed");
         }
     }
 };
 
-class TonemapOperatorDurand02
-    : public TonemapOperatorRegister<durand, TonemapOperatorDurand02> {
-    void tonemapFrame(pfs::Frame &workingframe, TonemappingOptions *opts,
-                      pfs::Progress &ph) {
+struct TonemapOperatorDurand02
+    : public TonemapOperatorRegionRegister<durand, TonemapOperatorDurand02,
+                                           Durand02Statistics> {
+    // the spatial kernel of the bilateral filter is a gaussian: past 5 sigma
+    // its tail weighs less than 1e-6
+    int regionHalo(const TonemappingOptions *opts) const {
+        return int(std::ceil(5.f * opts->operator_options.durandoptions.spatial));
+    }
+
+    void run(pfs::Frame &workingframe, TonemappingOptions *opts,
+             Durand02Statistics *stats, pfs::Progress &ph) {
         ph.setMaximum(100);
 
         try {
             pfstmo_durand02(workingframe,
                             opts->operator_options.durandoptions.spatial,
                             opts->operator_options.durandoptions.range,
-                            opts->operator_options.durandoptions.base, ph);
+                            opts->operator_options.durandoptions.base, ph,
+                            stats);
         } catch (...) {
             throw std::runtime_error("Durand: Tonemap Failed");
         }
@@ -202,9 +258,7 @@ struct TonemapOperatorReinhard02
         ph.setMaximum(100);
 
         // Convert to CS_XYZ: tm operator now use this colorspace
-        pfs::Channel *X, *Y, *Z;
-        workingframe.getXYZChannels(X, Y, Z);
-        pfs::transformColorSpace(pfs::CS_RGB, X, Y, Z, pfs::CS_XYZ, X, Y, Z);
+        pfs::transformColorSpace(pfs::CS_RGB, pfs::CS_XYZ, workingframe);
 
         try {
             pfstmo_reinhard02(
@@ -213,19 +267,22 @@ struct TonemapOperatorReinhard02
                 opts->operator_options.reinhard02options.range,
                 opts->operator_options.reinhard02options.lower,
                 opts->operator_options.reinhard02options.upper,
-                opts->operator_options.reinhard02options.scales, ph);
+                opts->operator_options.reinhard02options.scales, ph,
+                takeCache());
         } catch (...) {
             throw std::runtime_error("Reinhard02: Tonemap Failed");
         }
 
-        pfs::transformColorSpace(pfs::CS_XYZ, X, Y, Z, pfs::CS_RGB, X, Y, Z);
+        pfs::transformColorSpace(pfs::CS_XYZ, pfs::CS_RGB, workingframe);
     }
 };
 
 struct TonemapOperatorReinhard05
-    : public TonemapOperatorRegister<reinhard05, TonemapOperatorReinhard05> {
-    void tonemapFrame(pfs::Frame &workingframe, TonemappingOptions *opts,
-                      pfs::Progress &ph) {
+    : public TonemapOperatorRegionRegister<reinhard05,
+                                           TonemapOperatorReinhard05,
+                                           Reinhard05Statistics> {
+    void run(pfs::Frame &workingframe, TonemappingOptions *opts,
+             Reinhard05Statistics *stats, pfs::Progress &ph) {
         ph.setMaximum(100);
 
         try {
@@ -233,13 +290,16 @@ struct TonemapOperatorReinhard05
                 workingframe,
                 opts->operator_options.reinhard05options.brightness,
                 opts->operator_options.reinhard05options.chromaticAdaptation,
-                opts->operator_options.reinhard05options.lightAdaptation, ph);
+                opts->operator_options.reinhard05options.lightAdaptation, ph,
+                stats);
         } catch (...) {
             throw std::runtime_error("Reinhard05: Tonemap Failed");
         }
     }
 };
 
+// the local adaptation comes from pyramid levels whose sampling grid depends
+// on the size of the frame: a region does not come out as in the whole image
 struct TonemapOperatorAshikhmin02
     : public TonemapOperatorRegister<ashikhmin, TonemapOperatorAshikhmin02> {
     void tonemapFrame(pfs::Frame &workingframe, TonemappingOptions *opts,
@@ -264,9 +324,7 @@ struct TonemapOperatorPattanaik00
         ph.setMaximum(100);
 
         // Convert to CS_XYZ: tm operator now use this colorspace
-        pfs::Channel *X, *Y, *Z;
-        workingframe.getXYZChannels(X, Y, Z);
-        pfs::transformColorSpace(pfs::CS_RGB, X, Y, Z, pfs::CS_XYZ, X, Y, Z);
+        pfs::transformColorSpace(pfs::CS_RGB, pfs::CS_XYZ, workingframe);
 
         try {
             pfstmo_pattanaik00(
@@ -279,21 +337,22 @@ struct TonemapOperatorPattanaik00
             throw std::runtime_error("Pattanaik: Tonemap Failed");
         }
 
-        pfs::transformColorSpace(pfs::CS_XYZ, X, Y, Z, pfs::CS_RGB, X, Y, Z);
+        pfs::transformColorSpace(pfs::CS_XYZ, pfs::CS_RGB, workingframe);
     }
 };
 
 struct TonemapOperatorFerwerda96
-    : public TonemapOperatorRegister<ferwerda, TonemapOperatorFerwerda96> {
-    void tonemapFrame(pfs::Frame &workingframe, TonemappingOptions *opts,
-                      pfs::Progress &ph) {
+    : public TonemapOperatorRegionRegister<ferwerda, TonemapOperatorFerwerda96,
+                                           Ferwerda96Statistics> {
+    void run(pfs::Frame &workingframe, TonemappingOptions *opts,
+             Ferwerda96Statistics *stats, pfs::Progress &ph) {
         ph.setMaximum(100);
 
         try {
             pfstmo_ferwerda96(
                 workingframe, opts->operator_options.ferwerdaoptions.multiplier,
                 opts->operator_options.ferwerdaoptions.adaptationluminance,
-                ph);
+                ph, stats);
         } catch (...) {
             throw std::runtime_error("Ferwerda: Tonemap Failed");
         }
@@ -301,9 +360,10 @@ struct TonemapOperatorFerwerda96
 };
 
 struct TonemapOperatorKimKautz08
-    : public TonemapOperatorRegister<kimkautz, TonemapOperatorKimKautz08> {
-    void tonemapFrame(pfs::Frame &workingframe, TonemappingOptions *opts,
-                      pfs::Progress &ph) {
+    : public TonemapOperatorRegionRegister<kimkautz, TonemapOperatorKimKautz08,
+                                           KimKautz08Statistics> {
+    void run(pfs::Frame &workingframe, TonemappingOptions *opts,
+             KimKautz08Statistics *stats, pfs::Progress &ph) {
         ph.setMaximum(100);
 
         try {
@@ -311,7 +371,7 @@ struct TonemapOperatorKimKautz08
                 workingframe,
                 opts->operator_options.kimkautzoptions.c1,
                 opts->operator_options.kimkautzoptions.c2,
-                ph);
+                ph, stats);
         } catch (...) {
             throw std::runtime_error("KimKautz: Tonemap Failed");
         }
@@ -344,7 +404,7 @@ struct TonemapOperatorLischinski06
         try {
             pfstmo_lischinski06(
                 workingframe, opts->operator_options.lischinskioptions.alpha,
-                ph);
+                ph, opts->operator_options.lischinskioptions.solve_width);
         } catch (...) {
             throw std::runtime_error("Lischinski: Tonemap Failed");
         }
@@ -375,10 +435,99 @@ inline const TonemapOperatorCreatorMap &registry() {
     return reg;
 }
 
-TonemapOperator::TonemapOperator() {}
+TonemapStatistics::~TonemapStatistics() {}
+
+TonemapInput::TonemapInput()
+    : width(0),
+      height(0),
+      left(0),
+      top(0),
+      pregamma(1.f),
+      interpolation(0) {}
+
+bool TonemapInput::operator==(const TonemapInput &other) const {
+    std::shared_ptr<const void> a = content.lock();
+    return a && a == other.content.lock() && width == other.width &&
+           height == other.height && left == other.left && top == other.top &&
+           pregamma == other.pregamma && interpolation == other.interpolation;
+}
+
+TonemapOperator::TonemapOperator() : m_current(NULL) {}
 
 TonemapOperator::~TonemapOperator() {}
 
+void TonemapOperator::setInput(const TonemapInput &input) {
+    CacheList::iterator it = m_cache.begin();
+    while (it != m_cache.end() && !(it->first == input)) {
+        ++it;
+    }
+    if (it == m_cache.end()) {
+        m_cache.push_front(std::make_pair(
+            input,
+            std::unique_ptr<TonemapOperatorCache>(new TonemapOperatorCache)));
+    } else {
+        m_cache.splice(m_cache.begin(), m_cache, it);
+    }
+    m_current = m_cache.front().second.get();
+
+    trimCache();
+}
+
+void TonemapOperator::trimCache() {
+    // least recently used last
+    size_t count = 0;
+    size_t bytes = 0;
+    for (CacheList::iterator it = m_cache.begin(); it != m_cache.end();) {
+        const size_t entryBytes = it->second->bytes();
+        if (it->second.get() == m_current ||
+            (!it->first.content.expired() && count < s_cachedInputs &&
+             bytes + entryBytes <= s_cacheBytes)) {
+            ++count;
+            bytes += entryBytes;
+            ++it;
+        } else {
+            it = m_cache.erase(it);
+        }
+    }
+}
+
+size_t TonemapOperator::cachedBytes() const {
+    size_t bytes = 0;
+    for (CacheList::const_iterator it = m_cache.begin(); it != m_cache.end();
+         ++it) {
+        bytes += it->second->bytes();
+    }
+    return bytes;
+}
+
+void TonemapOperator::clearCache() {
+    m_cache.clear();
+    m_current = NULL;
+}
+
+TonemapOperatorCache *TonemapOperator::takeCache() {
+    TonemapOperatorCache *cache = m_current;
+    m_current = NULL;
+    return cache;
+}
+
+TonemapStatistics *TonemapOperator::computeStatistics(pfs::Frame &,
+                                                      TonemappingOptions *,
+                                                      pfs::Progress &) {
+    return NULL;
+}
+
+bool TonemapOperator::tonemapsRegions() const { return false; }
+
+int TonemapOperator::regionHalo(const TonemappingOptions *) const { return 0; }
+
+void TonemapOperator::tonemapRegion(pfs::Frame &workingframe,
+                                    TonemappingOptions *opts,
+                                    const TonemapStatistics &,
+                                    pfs::Progress &ph) {
+    tonemapFrame(workingframe, opts, ph);
+}
+
 TonemapOperator *TonemapOperator::getTonemapOperator(const TMOperator tmo) {
     TonemapOperatorCreatorMap::const_iterator it = registry().find(tmo);
     if (it != registry().end()) {
@@ -32,7 +32,10 @@
 #ifndef TONEMAPOPERATOR_H
 #define TONEMAPOPERATOR_H
 
+#include <list>
+#include <memory>
 #include <stdexcept>
+#include <utility>
 
 #include "Core/TonemappingOptions.h"
 
@@ -42,6 +45,36 @@ class Progress;
 class Frame;
 }
 
+//!
+//! \brief Quantities an operator derives from the whole image (averages,
+//! extrema, percentiles...), computed once and reused to tonemap regions of it
+//!
+class TonemapStatistics {
+   public:
+    virtual ~TonemapStatistics();
+};
+
+class TonemapOperatorCache;
+
+//!
+//! \brief Identifies the frame an operator is given: the image it is taken
+//! from (see pfs::Frame::contentKey()) and how it is taken from it
+//!
+struct TonemapInput {
+    TonemapInput();
+
+    std::weak_ptr<const void> content;
+    int width;
+    int height;
+    int left;
+    int top;
+    float pregamma;
+    int interpolation;
+
+    //! \brief false as soon as the image either refers to is gone
+    bool operator==(const TonemapInput &other) const;
+};
+
 class TonemapOperator {
    public:
     static TonemapOperator *getTonemapOperator(const TMOperator tmo);
@@ -60,8 +93,81 @@ class TonemapOperator {
     virtual void tonemapFrame(pfs::Frame &, TonemappingOptions *,
                               pfs::Progress &ph) = 0;
 
+    //!
+    //! \return false when the result of the operator depends on every pixel
+    //! of the image: a region can then only be tonemapped on its own
+    //!
+    virtual bool tonemapsRegions() const;
+
+    //!
+    //! Compute the statistics of the whole image the operator depends on,
+    //! by tonemapping \a frame: the image, or a reduced copy of it.
+    //! \note \a frame is MODIFIED
+    //! \return NULL if !tonemapsRegions()
+    //!
+    virtual TonemapStatistics *computeStatistics(pfs::Frame &frame,
+                                                 TonemappingOptions *,
+                                                 pfs::Progress &ph);
+
+    //!
+    //! \return margin, in pixels, the operator needs around a region so that
+    //! the region comes out as in a tonemap of the whole image
+    //!
+    virtual int regionHalo(const TonemappingOptions *) const;
+
+    //!
+    //! Tonemap a region of an image, halo included, with the \a statistics
+    //! computeStatistics() returned for the whole image
+    //! \note input frame is MODIFIED
+    //!
+    virtual void tonemapRegion(pfs::Frame &, TonemappingOptions *,
+                               const TonemapStatistics &statistics,
+                               pfs::Progress &ph);
+
+    //!
+    //! Tell the operator which input the next tonemapFrame() is given. What
+    //! the operator derives from the input alone is kept for the last
+    //! s_cachedInputs inputs and reused when one of them comes back, so that
+    //! tonemapping again with other parameters is faster.
+    //! \note an operator is not thread safe: use one instance per thread
+    //!
+    void setInput(const TonemapInput &input);
+
+    //!
+    //! Drop the data of the inputs whose image is gone, then the least
+    //! recently used data past s_cachedInputs inputs or s_cacheBytes. Only
+    //! the input given to setInput() for a tonemapFrame() still to come is
+    //! kept whatever its size. Called by setInput(); call it after a run too,
+    //! so that nothing is kept past the budget until the next one.
+    //!
+    void trimCache();
+
+    //! \brief drop everything kept by setInput()
+    void clearCache();
+
+    //! \brief memory kept by setInput() for all the inputs
+    size_t cachedBytes() const;
+
+    //! \brief number of inputs setInput() keeps data for
+    static const size_t s_cachedInputs = 3;
+
+    //! \brief memory kept by setInput() for all the inputs, once trimmed
+    static const size_t s_cacheBytes = size_t(512) << 20;
+
    protected:
     TonemapOperator();
+
+    //! \return the cache of the input given to setInput() for this call
+    //! of tonemapFrame(), or NULL
+    TonemapOperatorCache *takeCache();
+
+   private:
+    typedef std::list<
+        std::pair<TonemapInput, std::unique_ptr<TonemapOperatorCache> > >
+        CacheList;
+
+    CacheList m_cache;
+    TonemapOperatorCache *m_current;
 };
 
 #endif  // TONEMAPOPERATOR_H
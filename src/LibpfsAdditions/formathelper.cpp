@@ -153,8 +153,13 @@ void FormatHelper::buttonPressed() {
             if (!m_params.get("tiff_mode", tiffMode)) tiffMode = -1;
 
             TiffModeDialog t(format == 2, tiffMode, m_settingsButton);
+            int deflateLevel;
+            if (m_params.get("deflate_level", deflateLevel)) {
+                t.setDeflateLevel(deflateLevel);
+            }
             if (t.exec() == QDialog::Accepted) {
                 m_params.set("tiff_mode", t.getTiffWriterMode());
+                m_params.set("deflate_level", t.getDeflateLevel());
             }
         } break;
         case 21:
@@ -163,11 +168,21 @@ void FormatHelper::buttonPressed() {
             int qual = -1;
             if (m_params.get("quality", quality)) qual = quality;
 
-            ImageQualityDialog d(NULL, format == 21 ? "png" : "jpg", qual,
+            ImageQualityDialog d(NULL, format == 21 ? "jpg" : "png", qual,
                                  m_settingsButton);
+            bool progressive;
+            bool optimizeCoding;
+            if (m_params.get("progressive", progressive) &&
+                m_params.get("optimize_coding", optimizeCoding)) {
+                d.setJpegOptions(progressive, optimizeCoding);
+            }
             if (d.exec() == QDialog::Accepted) {
                 size_t quality = d.getQuality();
                 m_params.set("quality", quality);
+                if (format == 21) {
+                    m_params.set("progressive", d.getProgressive());
+                    m_params.set("optimize_coding", d.getOptimizeCoding());
+                }
             }
 
         } break;
@@ -210,6 +225,21 @@ void FormatHelper::writeSettings(const QString prefix) {
         int qual = quality;
         LuminanceOptions().setValue(prefix + "/" + KEY_EXPORT_QUALITY, qual);
     }
+    int deflateLevel;
+    if (m_params.get("deflate_level", deflateLevel)) {
+        LuminanceOptions().setValue(prefix + "/" + KEY_EXPORT_DEFLATE_LEVEL,
+                                    deflateLevel);
+    }
+    bool progressive;
+    if (m_params.get("progressive", progressive)) {
+        LuminanceOptions().setValue(prefix + "/" + KEY_EXPORT_JPEG_PROGRESSIVE,
+                                    progressive);
+    }
+    bool optimizeCoding;
+    if (m_params.get("optimize_coding", optimizeCoding)) {
+        LuminanceOptions().setValue(
+            prefix + "/" + KEY_EXPORT_JPEG_OPTIMIZE_CODING, optimizeCoding);
+    }
 }
 
 pfs::Params FormatHelper::getParamsFromSettings(const QString prefix,
@@ -229,6 +259,19 @@ pfs::Params FormatHelper::getParamsFromSettings(const QString prefix,
         size_t qual = quality;
         params.set("quality", qual);
     }
+    // the writers of the other formats ignore them
+    int deflateLevel = LuminanceOptions()
+                           .value(prefix + "/" + KEY_EXPORT_DEFLATE_LEVEL, -1)
+                           .toInt();
+    params.set("deflate_level", deflateLevel);
+    params.set("progressive",
+               LuminanceOptions()
+                   .value(prefix + "/" + KEY_EXPORT_JPEG_PROGRESSIVE, false)
+                   .toBool());
+    params.set("optimize_coding",
+               LuminanceOptions()
+                   .value(prefix + "/" + KEY_EXPORT_JPEG_OPTIMIZE_CODING, false)
+                   .toBool());
     return params;
 }
 }
@@ -26,6 +26,7 @@
  */
 
 #include <QDebug>
+#include <QFile>
 #include <QTimer>
 #include <boost/program_options.hpp>
 #include <iostream>
@@ -39,7 +40,11 @@
 #include <Exif/ExifOperations.h>
 #include <Fileformat/pfsoutldrimage.h>
 #include <HdrHTML/pfsouthdrhtml.h>
+#include <Common/ProgressHelper.h>
+#include <Libpfs/io/framereaderfactory.h>
+#include <Libpfs/io/tiffwriter.h>
 #include <Libpfs/manip/gamma_levels.h>
+#include <Libpfs/tm/TiledTonemapper.h>
 #include <Libpfs/tm/TonemapOperator.h>
 #include "commandline.h"
 
@@ -78,6 +83,17 @@ float toFloatWithErrMsg(const QString &str) {
     }
     return ret;
 }
+
+//! \brief writes the tonemapped rows to the output file as they come
+class TiffRowSink : public TiledTonemapper::Sink {
+   public:
+    explicit TiffRowSink(pfs::io::TiffRowWriter &writer) : m_writer(writer) {}
+
+    void write(const pfs::Frame &rows, size_t /*y*/) { m_writer.write(rows); }
+
+   private:
+    pfs::io::TiffRowWriter &m_writer;
+};
 }
 
 CommandLineInterfaceManager::CommandLineInterfaceManager(const int argc,
@@ -101,7 +117,8 @@ CommandLineInterfaceManager::CommandLineInterfaceManager(const int argc,
       isProposedHdrName(false),
       pageName(),
       imagesDir(),
-      saveAlignedImagesPrefix(QLatin1String("")) {
+      saveAlignedImagesPrefix(QLatin1String("")),
+      tileSize(0) {
     hdrcreationconfig.weightFunction = WEIGHT_TRIANGULAR;
     hdrcreationconfig.responseCurve = RESPONSE_LINEAR;
     hdrcreationconfig.fusionOperator = DEBEVEC;
@@ -166,7 +183,11 @@ int CommandLineInterfaceManager::execCommandLineParams() {
             tr("FILE_EXTENSION   Save LDR file with a name of the form "
             "first-last_tmparameters.extension.").toUtf8().constData())
         ("proposedhdrname,z", po::value<std::string>(&hdrExtension), tr("FILE_EXTENSION   Save HDR file with a name of the form "
-            "first-last_HdrCreationModel.extension.").toUtf8().constData());
+            "first-last_HdrCreationModel.extension.").toUtf8().constData())
+        ("tiled", po::value<int>(&tileSize), tr("TILE_SIZE   Tonemap the HDR loaded with -l in tiles of TILE_SIZE pixels, "
+            "reading and writing it a band of rows at a time, for images too large to be held in memory. "
+            "EXR input, 8 or 16 bit TIFF output, with drago, durand, ferwerda, kimkautz or reinhard05 only, "
+            "no resizing nor autolevels.").toUtf8().constData());
 
     po::options_description hdr_desc(
         tr("HDR creation parameters  - you must either load an existing HDR "
@@ -185,7 +206,8 @@ int CommandLineInterfaceManager::execCommandLineParams() {
                               .toUtf8()
                               .constData())(
         "hdrModel", po::value<std::string>(),
-        tr("model: robertson|robertsonauto|debevec (Default is debevec)")
+        tr("model: robertson|robertsonauto|debevec|linear (Default is "
+           "debevec)")
             .toUtf8()
             .constData())(
         "hdrCurveFilename", po::value<std::string>(),
@@ -204,6 +226,21 @@ int CommandLineInterfaceManager::execCommandLineParams() {
             .constData())(
         "ldrTiffDeflate", po::value<bool>(),
         tr("Tiff deflate compression. true|false (Default is true)")
+            .toUtf8()
+            .constData())(
+        "ldrTiffDeflateLevel", po::value<int>(),
+        tr("VALUE      Tiff deflate level, from the fastest (1) to the "
+           "smallest files (9), 0 stores the data. (Default is the zlib "
+           "default)")
+            .toUtf8()
+            .constData())(
+        "ldrJpegProgressive", po::value<bool>(),
+        tr("Progressive Jpeg. true|false (Default is false)")
+            .toUtf8()
+            .constData())(
+        "ldrJpegOptimize", po::value<bool>(),
+        tr("Jpeg Huffman tables computed for the image. true|false (Default "
+           "is false)")
             .toUtf8()
             .constData());
 
@@ -425,7 +462,15 @@ reinhard02|\nreinhard05|mai|mantiuk06|mantiuk08|\nvanhateren|lischinski] (Defaul
         (
         "tmoLischinskiAlpha",
         po::value<float>(&tmopts->operator_options.lischinskioptions.alpha),
-        tr("alpha FLOAT").toUtf8().constData());
+        tr("alpha FLOAT").toUtf8().constData())
+        (
+        "tmoLischinskiSolveWidth",
+        po::value<int>(&tmopts->operator_options.lischinskioptions.solve_width),
+        tr("width INT of the grid the exposure map is solved on, smaller is "
+           "faster, up to 512 only the coarse solve is done. 0 for the width "
+           "of the image (Default is 0)")
+            .toUtf8()
+            .constData());
 
     tmo_desc.add(tmo_fattal);
     tmo_desc.add(tmo_ferradans);
@@ -579,6 +624,8 @@ reinhard02|\nreinhard05|mai|mantiuk06|mantiuk08|\nvanhateren|lischinski] (Defaul
                 hdrcreationconfig.fusionOperator = ROBERTSON_AUTO;
             else if (strcmp(value, "debevec") == 0)
                 hdrcreationconfig.fusionOperator = DEBEVEC;
+            else if (strcmp(value, "linear") == 0)
+                hdrcreationconfig.fusionOperator = LINEAR;
             else
                 printErrorAndExit(
                     tr("Error: Unknown HDR creation model specified."));
@@ -675,6 +722,21 @@ reinhard02|\nreinhard05|mai|mantiuk06|mantiuk08|\nvanhateren|lischinski] (Defaul
         if (vm.count("ldrTiffDeflate"))
             tmofileparams->set("deflateCompression",
                                vm["ldrTiffDeflate"].as<bool>());
+        if (vm.count("ldrTiffDeflateLevel")) {
+            int level = vm["ldrTiffDeflateLevel"].as<int>();
+            if (level < 0 || level > 9)
+                printErrorAndExit(
+                    tr("Error: Tiff deflate level must be in the range "
+                       "[0..9]."));
+            else
+                tmofileparams->set("deflate_level", level);
+        }
+        if (vm.count("ldrJpegProgressive"))
+            tmofileparams->set("progressive",
+                               vm["ldrJpegProgressive"].as<bool>());
+        if (vm.count("ldrJpegOptimize"))
+            tmofileparams->set("optimize_coding",
+                               vm["ldrJpegOptimize"].as<bool>());
 
         if (vm.count("load"))
             loadHdrFilename =
@@ -705,6 +767,19 @@ reinhard02|\nreinhard05|mai|mantiuk06|mantiuk08|\nvanhateren|lischinski] (Defaul
         if (threshold < 0.0f || threshold > 1.0f)
             printErrorAndExit(
                 tr("Error: Threshold must be in the range [0..1]."));
+        if (vm.count("tiled")) {
+            if (tileSize < 1)
+                printErrorAndExit(tr("Error: TILE_SIZE must be positive."));
+            if (!vm.count("load") || !vm.count("output"))
+                printErrorAndExit(
+                    tr("Error: --tiled needs an HDR file loaded with -l and an "
+                       "output file given with -o."));
+            if (vm.count("save") || isHtml || isAutolevels ||
+                vm.count("resize"))
+                printErrorAndExit(
+                    tr("Error: --tiled cannot be combined with -s, -w, -b "
+                       "nor -r."));
+        }
 
     } catch (boost::program_options::required_option &e) {
         std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
@@ -788,6 +863,8 @@ void CommandLineInterfaceManager::execCommandLineParamsSlot() {
         } catch (...) {
             printErrorAndExit(QStringLiteral("Catched unhandled exception"));
         }
+    } else if (tileSize > 0) {
+        startTiledTonemap();
     } else {
         printIfVerbose(QObject::tr("Loading file %1").arg(loadHdrFilename),
                        verbose);
@@ -1019,9 +1096,7 @@ void CommandLineInterfaceManager::startTonemap() {
         // Autolevels
         if (isAutolevels) {
             float minL, maxL, gammaL;
-            QScopedPointer<QImage> temp_qimage(
-                fromLDRPFStoQImage(tm_frame.data()));
-            computeAutolevels(temp_qimage.data(), 0.985f, minL, maxL, gammaL);
+            computeAutolevels(tm_frame.data(), 0.985f, minL, maxL, gammaL);
             pfs::gammaAndLevels(tm_frame.data(), minL, maxL, 0.f, 1.f, gammaL);
         }
         if (tmopts->postsaturation != 1)
@@ -1059,6 +1134,62 @@ void CommandLineInterfaceManager::startTonemap() {
     }
 }
 
+void CommandLineInterfaceManager::startTiledTonemap() {
+    if (!TiledTonemapper::supports(tmopts->tmoperator)) {
+        printErrorAndExit(
+            tr("Error: This tone mapping operator cannot be run in tiles."));
+    }
+    QString fileExtension = QFileInfo(saveLdrFilename).suffix();
+    if (fileExtension.compare(QLatin1String("tif"), Qt::CaseInsensitive) != 0 &&
+        fileExtension.compare(QLatin1String("tiff"), Qt::CaseInsensitive) != 0) {
+        printErrorAndExit(tr("Error: --tiled writes TIFF files only."));
+    }
+
+    printIfVerbose(tr("Tonemapping %1 in tiles of %2 pixels, saving to file %3.")
+                       .arg(loadHdrFilename)
+                       .arg(tileSize)
+                       .arg(saveLdrFilename),
+                   verbose);
+
+    try {
+        pfs::io::FrameReaderPtr reader = pfs::io::FrameReaderFactory::open(
+            QFile::encodeName(loadHdrFilename).constData());
+        reader->open();
+        if (!reader->readsRows()) {
+            printErrorAndExit(
+                tr("Error: %1 cannot be read a band of rows at a time, --tiled "
+                   "reads EXR files only.")
+                    .arg(loadHdrFilename));
+        }
+        tmopts->origxsize = reader->width();
+        tmopts->xsize = reader->width();
+
+        pfs::io::TiffRowWriter writer(
+            QFile::encodeName(saveLdrFilename).constData(), reader->width(),
+            reader->height(), *tmofileparams);
+        TiffRowSink sink(writer);
+
+        ProgressHelper ph;
+        connect(&ph, &ProgressHelper::qtSetRange, this,
+                [this](int, int max) { setProgressBar(max); });
+        connect(&ph, &ProgressHelper::qtSetValue, this,
+                &CommandLineInterfaceManager::updateProgressBar);
+
+        TiledTonemapper tiledTonemapper(tileSize);
+        tiledTonemapper.tonemap(*reader, tmopts.data(), sink, ph);
+        if (!writer.complete()) {
+            printErrorAndExit(
+                tr("\nERROR: Cannot save to file: %1").arg(saveLdrFilename));
+        }
+    } catch (std::exception &e) {
+        printErrorAndExit(tr("\nERROR: %1").arg(QString::fromLocal8Bit(e.what())));
+    }
+
+    printIfVerbose(tr("\nImage %1 successfully saved").arg(saveLdrFilename),
+                   verbose);
+    emit finishedParsing();
+}
+
 void CommandLineInterfaceManager::errorWhileLoading(
     const QString &errormessage) {
     printErrorAndExit(tr("Failed loading images: %1").arg(errormessage));
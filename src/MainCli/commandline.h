@@ -89,9 +89,11 @@ class CommandLineInterfaceManager : public QObject {
     QString saveAlignedImagesPrefix;
     QStringList validLdrExtensions;
     QStringList validHdrExtensions;
+    int tileSize;
 
     void generateHTML();
     void startTonemap();
+    void startTiledTonemap();
 
    private slots:
     void finishedLoadingInputFiles();
@@ -32,6 +32,8 @@
  *
  */
 
+#include <algorithm>
+
 #ifdef QT_DEBUG
 #include <QDebug>
 #endif
@@ -63,6 +65,7 @@
 #include <Libpfs/manip/copy.h>
 #include <Libpfs/manip/cut.h>
 #include <Libpfs/manip/gamma_levels.h>
+#include <Libpfs/manip/projection.h>
 #include <Libpfs/manip/rotate.h>
 #include <Libpfs/params.h>
 
@@ -213,6 +216,8 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
       m_Ui(new Ui::MainWindow),
       m_isFullscreenViewer(false),
+      m_pendingTonemaps(0),
+      m_refiningViewerIsNew(false),
       m_exportQueueSize(0),
       m_interpolationMethod(BilinearInterp),
       m_firstWindow(0),
@@ -226,6 +231,8 @@ MainWindow::MainWindow(pfs::Frame *curr_frame, const QString &new_file,
     : QMainWindow(parent),
       m_Ui(new Ui::MainWindow),
       m_isFullscreenViewer(false),
+      m_pendingTonemaps(0),
+      m_refiningViewerIsNew(false),
       m_exportQueueSize(0),
       m_interpolationMethod(BilinearInterp),
       m_firstWindow(0),
@@ -628,7 +635,7 @@ void MainWindow::on_fileSaveAllAction_triggered() {
             QWidget *wgt = m_tabwidget->widget(i);
             GenericViewer *g_v = qobject_cast<GenericViewer *>(wgt);
 
-            if (!g_v->isHDR()) {
+            if (!g_v->isHDR() && !g_v->isPreview()) {
                 LdrViewer *l_v = qobject_cast<LdrViewer *>(g_v);
 
                 QString ldr_name = QFileInfo(getCurrentHDRName()).baseName();
@@ -679,6 +686,7 @@ void MainWindow::on_fileSaveAsAction_triggered() {
             if (t.exec() == QDialog::Rejected) return;
 
             p.set("tiff_mode", t.getTiffWriterMode());
+            p.set("deflate_level", t.getDeflateLevel());
         }
 
         // CALL m_IOWorker->write_hdr_frame(qobject_cast<HdrViewer*>(g_v),
@@ -694,6 +702,15 @@ void MainWindow::on_fileSaveAsAction_triggered() {
 
         if (l_v == nullptr) return;
 
+        if (l_v->isPreview()) {
+            QMessageBox::warning(
+                this, tr("Luminance HDR"),
+                tr("This image is only a preview of a tonemapping that did "
+                   "not complete, please tonemap it again before saving."),
+                QMessageBox::Ok, QMessageBox::NoButton);
+            return;
+        }
+
         QString ldr_name = QFileInfo(getCurrentHDRName()).baseName();
 
         QString proposedFileName =
@@ -723,6 +740,8 @@ void MainWindow::on_fileSaveAsAction_triggered() {
             if (savedFileQuality.exec() == QDialog::Rejected) return;
 
             p.set("quality", (size_t)savedFileQuality.getQuality());
+            p.set("progressive", savedFileQuality.getProgressive());
+            p.set("optimize_coding", savedFileQuality.getOptimizeCoding());
         }
 
         if (format == QLatin1String("tif") || format == QLatin1String("tiff")) {
@@ -730,6 +749,7 @@ void MainWindow::on_fileSaveAsAction_triggered() {
             if (t.exec() == QDialog::Rejected) return;
 
             p.set("tiff_mode", t.getTiffWriterMode());
+            p.set("deflate_level", t.getDeflateLevel());
         }
 
         QString inputfname;
@@ -1587,6 +1607,8 @@ void MainWindow::setupTM() {
     // get back result!
     connect(m_TMWorker, &TMWorker::tonemapSuccess, this,
             &MainWindow::addLdrFrame);
+    connect(m_TMWorker, &TMWorker::tonemapRefined, this,
+            &MainWindow::refineLdrFrame);
     connect(m_TMWorker, SIGNAL(tonemapFailed(QString)), this,
             SLOT(tonemapFailed(QString)));
 
@@ -1725,10 +1747,18 @@ void MainWindow::tonemapImage(TonemappingOptions *opts) {
 #ifdef QT_DEBUG
         qDebug() << "MainWindow(): emit getTonemappedFrame()";
 #endif
+        // a new request supersedes the one in flight: stop it, its passes
+        // still to run would be thrown away
+        if (m_pendingTonemaps > 0) {
+            emit m_TMWorker->tonemapRequestTermination(true);
+        }
+        ++m_pendingTonemaps;
+        m_TMWorker->announceJob();
+
         // CALL m_TMWorker->getTonemappedFrame(hdr_viewer->getHDRPfsFrame(),
         // opts);
         QMetaObject::invokeMethod(
-            m_TMWorker, "computeTonemap", Qt::QueuedConnection,
+            m_TMWorker, "computeTonemapProgressive", Qt::QueuedConnection,
             Q_ARG(pfs::Frame *, hdr_viewer->getFrame()),
             Q_ARG(TonemappingOptions *, opts),
             Q_ARG(InterpolationMethod, m_interpolationMethod));
@@ -1749,6 +1779,7 @@ void MainWindow::exportImage(TonemappingOptions *opts) {
 
         m_tonemapPanel->setExportQueueSize(++m_exportQueueSize);
 
+        m_QueueWorker->announceJob();
         QMetaObject::invokeMethod(
             m_QueueWorker, "computeTonemapAndExport", Qt::QueuedConnection,
             Q_ARG(pfs::Frame *, hdr_viewer->getFrame()),
@@ -1761,17 +1792,44 @@ void MainWindow::exportImage(TonemappingOptions *opts) {
 
 void MainWindow::addLdrFrame(pfs::Frame *frame,
                              TonemappingOptions *tm_options) {
+    m_pendingTonemaps = std::max(0, m_pendingTonemaps - 1);
+
+    GenericViewer *n = showLdrFrame(frame, tm_options);
+    n->setPreview(false);
+    m_refiningViewer = nullptr;
+    m_refiningViewerIsNew = false;
+
+    m_PreviewPanel->setEnabled(true);
+}
+
+void MainWindow::refineLdrFrame(pfs::Frame *frame,
+                                TonemappingOptions *tm_options) {
+    if (!m_refiningViewer) {
+        const int tabs = m_tabwidget->count();
+        m_refiningViewer = showLdrFrame(frame, tm_options);
+        m_refiningViewerIsNew = m_tabwidget->count() > tabs;
+    } else {
+        showLdrFrame(frame, tm_options);
+    }
+    m_refiningViewer->setPreview(true);
+}
+
+GenericViewer *MainWindow::showLdrFrame(pfs::Frame *frame,
+                                        TonemappingOptions *tm_options) {
     if (m_tonemapPanel->doAutoLevels()) {
         float threshold, minL, maxL, gammaL;
         threshold = m_tonemapPanel->getAutoLevelsThreshold();
-        QScopedPointer<QImage> temp_qimage(fromLDRPFStoQImage(frame));
-        computeAutolevels(temp_qimage.data(), threshold, minL, maxL, gammaL);
+        computeAutolevels(frame, threshold, minL, maxL, gammaL);
         pfs::gammaAndLevels(frame, minL, maxL, 0.f, 1.f, gammaL);
     }
 
     GenericViewer *n =
         static_cast<GenericViewer *>(m_tabwidget->currentWidget());
-    if (m_tonemapPanel->replaceLdr() && n != nullptr && !n->isHDR()) {
+    if (m_refiningViewer) {
+        // replace the coarser pass
+        n = m_refiningViewer;
+        n->setFrame(frame, tm_options);
+    } else if (m_tonemapPanel->replaceLdr() && n != nullptr && !n->isHDR()) {
         n->setFrame(frame, tm_options);
     } else {
         curr_num_ldr_open++;
@@ -1798,8 +1856,6 @@ void MainWindow::addLdrFrame(pfs::Frame *frame,
     }
     m_tabwidget->setCurrentWidget(n);
 
-    m_PreviewPanel->setEnabled(true);
-
     if (m_Ui->actionSoft_Proofing->isChecked()) {
         LdrViewer *viewer = static_cast<LdrViewer *>(n);
         viewer->doSoftProofing(false);
@@ -1807,9 +1863,22 @@ void MainWindow::addLdrFrame(pfs::Frame *frame,
         LdrViewer *viewer = static_cast<LdrViewer *>(n);
         viewer->doSoftProofing(true);
     }
+    return n;
 }
 
 void MainWindow::tonemapFailed(const QString &error_msg) {
+    m_pendingTonemaps = std::max(0, m_pendingTonemaps - 1);
+    // the next request, if any, refines the same viewer. Otherwise a tab
+    // opened by the coarse passes is closed, and one they overwrote stays
+    // marked as a preview, which cannot be saved
+    if (m_pendingTonemaps == 0) {
+        if (m_refiningViewer && m_refiningViewerIsNew) {
+            removeTab(m_tabwidget->indexOf(m_refiningViewer));
+        }
+        m_refiningViewer = nullptr;
+        m_refiningViewerIsNew = false;
+    }
+
     if (error_msg != QLatin1String("Canceled")) {
         QMessageBox::critical(this, tr("Luminance HDR"),
                               tr("Error: %1").arg(error_msg), QMessageBox::Ok,
@@ -1948,6 +2017,8 @@ void MainWindow::removeTab(int t) {
         if (doClose) {
             m_tabwidget->removeTab(t);
             w->deleteLater();  // delete yourself whenever you want
+            // the table of the last projective transformation
+            releaseRemapTable();
 
             showPreviewPanel(false);
             setWindowModified(false);
@@ -2112,6 +2183,9 @@ void MainWindow::whiteBalanceDone() {
     m_viewerToProcess->setEnabled(true);
     m_tabwidget->setTabEnabled(m_tabwidget->indexOf(m_viewerToProcess), true);
     m_tabwidget->setCurrentWidget(m_viewerToProcess);
+    // the channels have been balanced in place by another thread, while the
+    // viewer could still read the statistics
+    m_viewerToProcess->getFrame()->invalidateCaches();
     m_viewerToProcess->updatePixmap();
     if (m_viewerToProcess->isHDR()) {
         m_viewerToProcess->setNeedsSaving(true);
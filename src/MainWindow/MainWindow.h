@@ -38,6 +38,7 @@
 #include <QFutureWatcher>
 #include <QMainWindow>
 #include <QMap>
+#include <QPointer>
 #include <QProgressBar>
 #include <QScopedPointer>
 #include <QScrollArea>
@@ -192,6 +193,7 @@ class MainWindow : public QMainWindow {
     void tonemapImage(TonemappingOptions *opts);
     void exportImage(TonemappingOptions *opts);
     void addLdrFrame(pfs::Frame *, TonemappingOptions *);
+    void refineLdrFrame(pfs::Frame *, TonemappingOptions *);
     // void addLDRResult(QImage*, quint16*);
     void tonemapFailed(const QString &);
 
@@ -308,6 +310,10 @@ class MainWindow : public QMainWindow {
 
     bool maybeSave();
 
+    //! \brief show a tonemapped frame, in the viewer of the progressive
+    //! tonemapping in flight, if any
+    GenericViewer *showLdrFrame(pfs::Frame *, TonemappingOptions *);
+
     void setRealtimePreviewsActive(bool);
     void setPreviewPanelActive(bool b);
 
@@ -337,6 +343,11 @@ class MainWindow : public QMainWindow {
     QThread *m_TMThread;
     TMWorker *m_TMWorker;
     TMOProgressIndicator *m_TMProgressBar;
+    int m_pendingTonemaps;
+    // viewer showing the coarse passes of a progressive tonemapping
+    QPointer<GenericViewer> m_refiningViewer;
+    // true if m_refiningViewer was opened by the coarse passes themselves
+    bool m_refiningViewerIsNew;
 
     // Export queue
     QThread *m_QueueThread;
@@ -218,6 +218,7 @@ void PreferencesDialog::on_okButton_clicked() {
     luminance_options.setRawFourColorRGB(m_Ui->four_color_rgb_CB->isChecked());
     luminance_options.setRawDoNotUseFujiRotate(
         m_Ui->do_not_use_fuji_rotate_CB->isChecked());
+    luminance_options.setRawHalfSize(m_Ui->half_size_CB->isChecked());
     QString user_qual = m_Ui->user_qual_comboBox->itemText(
         m_Ui->user_qual_comboBox->currentIndex());
     if (user_qual == QLatin1String("Bilinear") ||
@@ -600,6 +601,7 @@ void PreferencesDialog::from_options_to_gui() {
     m_Ui->four_color_rgb_CB->setChecked(luminance_options.isRawFourColorRGB());
     m_Ui->do_not_use_fuji_rotate_CB->setChecked(
         luminance_options.isRawDoNotUseFujiRotate());
+    m_Ui->half_size_CB->setChecked(luminance_options.getRawHalfSize() != 0);
 
 #ifdef DEMOSAICING_GPL2
     bool GPL2 = true;
@@ -22,14 +22,23 @@
  */
 
 #include <QDebug>
+#include <QMutex>
+#include <QRunnable>
+#include <QSet>
 #include <QSharedPointer>
-#include <QtConcurrentMap>
+#include <QThread>
+#include <QThreadPool>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "PreviewPanel.h"
 
 #include "Libpfs/frame.h"
 #include "Libpfs/manip/copy.h"
 #include "Libpfs/manip/gamma_levels.h"
+#include "Libpfs/manip/pyramid.h"
 #include "Libpfs/manip/resize.h"
 
 #include "Core/TMWorker.h"
@@ -42,6 +51,66 @@
 #include "Common/LuminanceOptions.h"
 #include "UI/FlowLayout.h"
 
+//! \brief Bookkeeping of the preview jobs in flight
+//!
+//! Every label has a generation counter: a new request for a label bumps it,
+//! which turns all the jobs queued or running for the old generation stale.
+//! Running jobs are asked to terminate through their TMWorker, queued jobs
+//! notice it when they are picked up by the pool. Images are only delivered
+//! by jobs of the current generation, so a label never goes back to an old
+//! preview.
+class PreviewRenderQueue {
+   public:
+    explicit PreviewRenderQueue(int labels)
+        : m_generation(labels, 0), m_running(labels) {}
+
+    //! \brief invalidate the jobs of label \a index, return the new generation
+    quint64 advance(int index) {
+        QMutexLocker locker(&m_mutex);
+        foreach (TMWorker *worker, m_running[index]) {
+            emit worker->tonemapRequestTermination(true);
+        }
+        return ++m_generation[index];
+    }
+
+    bool isCurrent(int index, quint64 generation) {
+        QMutexLocker locker(&m_mutex);
+        return m_generation[index] == generation;
+    }
+
+    //! \brief register \a worker as running for \a index, unless the job is
+    //! already stale
+    bool start(int index, quint64 generation, TMWorker *worker) {
+        QMutexLocker locker(&m_mutex);
+        if (m_generation[index] != generation) return false;
+        m_running[index].insert(worker);
+        return true;
+    }
+
+    void finish(int index, TMWorker *worker) {
+        QMutexLocker locker(&m_mutex);
+        m_running[index].remove(worker);
+    }
+
+    //! \brief queue \a qimage on \a label if the job is still current. It
+    //! runs under the lock, so it is ordered with respect to advance()
+    void deliver(int index, quint64 generation, PreviewLabel *label,
+                 QSharedPointer<QImage> qimage) {
+        QMutexLocker locker(&m_mutex);
+        if (m_generation[index] != generation) return;
+        //! \note setPixmap must run in the GUI thread, so I queue a SLOT
+        //! request on the label
+        QMetaObject::invokeMethod(label, "assignNewQImage",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(QSharedPointer<QImage>, qimage));
+    }
+
+   private:
+    QMutex m_mutex;
+    QVector<quint64> m_generation;
+    QVector<QSet<TMWorker *>> m_running;
+};
+
 namespace  // anoymous namespace
 {
 const int PREVIEW_WIDTH = 120;
@@ -57,117 +126,97 @@ void resetTonemappingOptions(TonemappingOptions *tm_options,
     tm_options->tonemapSelection = false;
 }
 
-class PreviewLabelUpdater {
+class PreviewLabelUpdater : public QRunnable {
    public:
-    explicit PreviewLabelUpdater(QSharedPointer<pfs::Frame> reference_frame)
+    //! \brief must be built in the GUI thread: it takes a snapshot of the
+    //! label's tonemapping options
+    PreviewLabelUpdater(QSharedPointer<pfs::Frame> reference_frame,
+                        PreviewLabel *to_update, int index, quint64 generation,
+                        QSharedPointer<PreviewRenderQueue> queue)
         : m_doAutolevels(false),
           m_autolevelThreshold(0.985f),
-          m_ReferenceFrame(reference_frame) {}
+          m_ReferenceFrame(reference_frame),
+          m_PreviewLabel(to_update),
+          m_index(index),
+          m_generation(generation),
+          m_Queue(queue) {
+        // retrieve TM parameters
+        TonemappingOptions *tm_options = to_update->getTonemappingOptions();
+        resetTonemappingOptions(tm_options, m_ReferenceFrame.data());
+        m_TMOptions = *tm_options;
+    }
 
     void setAutolevels(bool al, float th) {
         m_doAutolevels = al;
         m_autolevelThreshold = th;
     }
+
     //! \brief QRunnable::run() definition
     //! \caption I use shared pointer in this function, so I don't have to worry
     //! about memory allocation
     //! in case something wrong happens, it shouldn't leak
-    void operator()(PreviewLabel *to_update) {
-#ifdef QT_DEBUG
-// qDebug() << QThread::currentThread() << "running...";
-#endif
-
-        // retrieve TM parameters
-        TonemappingOptions *tm_options = to_update->getTonemappingOptions();
-        resetTonemappingOptions(tm_options, m_ReferenceFrame.data());
+    void run() {
+        if (!m_Queue->isCurrent(m_index, m_generation)) return;
 
-        if (m_ReferenceFrame.isNull()) {
-#ifdef QT_DEBUG
-            qDebug() << "operator()() for TM"
-                     << static_cast<int>(tm_options->tmoperator)
-                     << " received a NULL pointer";
-            return;
+#ifdef _OPENMP
+        // the pool already keeps every core busy: one thread per preview
+        omp_set_num_threads(1);
 #endif
-        }
 
         // Copy Reference Frame
         QSharedPointer<pfs::Frame> temp_frame(
             pfs::copy(m_ReferenceFrame.data()));
 
-        // Tone Mapping
-        // QScopedPointer<TonemapOperator> tm_operator(
-        // TonemapOperator::getTonemapOperator(tm_options->tmoperator));
-        // tm_operator->tonemapFrame(temp_frame.data(), tm_options,
-        // fake_progress_helper);
+        // announced before it can be reached by advance(), so that a
+        // termination request cancels it even before the operator runs
+        TMWorker tmWorker;
+        tmWorker.announceJob();
+        if (!m_Queue->start(m_index, m_generation, &tmWorker)) return;
+        QSharedPointer<pfs::Frame> frame(tmWorker.computeTonemap(
+            temp_frame.data(), &m_TMOptions, BilinearInterp));
+        m_Queue->finish(m_index, &tmWorker);
 
-        // try { //Since nothing here actually throws this isn't useful, i need
-        // to
-        // check if returned frame != NULL
-        QScopedPointer<TMWorker> tmWorker(new TMWorker);
-        QSharedPointer<pfs::Frame> frame(tmWorker->computeTonemap(
-            temp_frame.data(), tm_options, BilinearInterp));
+        if (!m_Queue->isCurrent(m_index, m_generation)) return;
 
+        QSharedPointer<QImage> qimage;
         if (!frame.isNull()) {
-            // Create QImage from pfs::Frame into QSharedPointer, and I give it
-            // to the
-            // preview panel
-            // QSharedPointer<QImage>
-            // qimage(fromLDRPFStoQImage(temp_frame.data()));
             if (m_doAutolevels) {
-                QSharedPointer<QImage> temp_qimage(
-                    fromLDRPFStoQImage(frame.data()));
                 float minL, maxL, gammaL;
-                computeAutolevels(temp_qimage.data(), m_autolevelThreshold,
-                                  minL, maxL, gammaL);
+                computeAutolevels(frame.data(), m_autolevelThreshold, minL,
+                                  maxL, gammaL);
                 pfs::gammaAndLevels(frame.data(), minL, maxL, 0.f, 1.f, gammaL);
             }
 
-            QSharedPointer<QImage> qimage(fromLDRPFStoQImage(frame.data()));
-
-            //! \note I cannot use these 2 functions, because setPixmap must run
-            //! in
-            //! the GUI thread
-            // m_PreviewLabel->setPixmap( QPixmap::fromImage(*qimage) );
-            // m_PreviewLabel->adjustSize();
-            //! \note So I queue a SLOT request on the m_PreviewPanel
-            QMetaObject::invokeMethod(to_update, "assignNewQImage",
-                                      Qt::QueuedConnection,
-                                      Q_ARG(QSharedPointer<QImage>, qimage));
+            qimage = QSharedPointer<QImage>(fromLDRPFStoQImage(frame.data()));
         } else {
-            QSharedPointer<QImage> qimage(
+            qimage = QSharedPointer<QImage>(
                 new QImage(PREVIEW_WIDTH, PREVIEW_HEIGHT,
                            QImage::Format_ARGB32_Premultiplied));
             qimage->fill(QColor(
                 255, 0,
                 0));  // TODO Tonemapping failed, let's show a RED preview...
-            QMetaObject::invokeMethod(to_update, "assignNewQImage",
-                                      Qt::QueuedConnection,
-                                      Q_ARG(QSharedPointer<QImage>, qimage));
         }
-/*
-}
-catch (...) {
-    qDebug() << "PreviewLabelUpdater: caught exception";
-    QSharedPointer<QImage> qimage(new QImage);
-    QMetaObject::invokeMethod(to_update, "assignNewQImage",
-Qt::QueuedConnection,
-                              Q_ARG(QSharedPointer<QImage>, qimage));
-}
-*/
-#ifdef QT_DEBUG
-// qDebug() << QThread::currentThread() << "done!";
-#endif
+        m_Queue->deliver(m_index, m_generation, m_PreviewLabel, qimage);
     }
 
    private:
     bool m_doAutolevels;
     float m_autolevelThreshold;
     QSharedPointer<pfs::Frame> m_ReferenceFrame;
+    TonemappingOptions m_TMOptions;
+    PreviewLabel *m_PreviewLabel;
+    int m_index;
+    quint64 m_generation;
+    QSharedPointer<PreviewRenderQueue> m_Queue;
 };
 }
 
 PreviewPanel::PreviewPanel(QWidget *parent)
-    : QWidget(parent), m_original_width_frame(0), m_doAutolevels(false) {
+    : QWidget(parent),
+      m_original_width_frame(0),
+      m_doAutolevels(false),
+      m_autolevelThreshold(0.985f),
+      m_threadPool(new QThreadPool(this)) {
     //! \note I need to register the new object to pass this class as parameter
     //! inside invokeMethod()
     //! see run() inside PreviewLabelUpdater
@@ -341,12 +390,22 @@ PreviewPanel::PreviewPanel(QWidget *parent)
     flowLayout->addWidget(labelLischinski);
 
     setLayout(flowLayout);
+
+    m_threadPool->setMaxThreadCount(QThread::idealThreadCount());
+    m_renderQueue = QSharedPointer<PreviewRenderQueue>(
+        new PreviewRenderQueue(m_ListPreviewLabel.size()));
 }
 
 PreviewPanel::~PreviewPanel() {
 #ifdef QT_DEBUG
     qDebug() << "PreviewPanel::~PreviewPanel()";
 #endif
+    // the labels must outlive the jobs that refer to them
+    for (int idx = 0; idx < m_ListPreviewLabel.size(); ++idx) {
+        m_renderQueue->advance(idx);
+    }
+    m_threadPool->clear();
+    m_threadPool->waitForDone();
 }
 
 void PreviewPanel::updatePreviews(pfs::Frame *frame, int index) {
@@ -362,27 +421,21 @@ void PreviewPanel::updatePreviews(pfs::Frame *frame, int index) {
         float ratio = ((float)frame_width) / frame_height;
         resized_width = PREVIEW_HEIGHT * ratio;
     }
-    // 1. make a resized copy
+    // 1. make a resized copy, starting from the nearest level of the pyramid
     QSharedPointer<pfs::Frame> current_frame(
-        pfs::resize(frame, resized_width, BilinearInterp));
-
-    // 2. (non concurrent) for each PreviewLabel, call
-    // PreviewLabelUpdater::operator()
-    if (index == -1) {
-        foreach (PreviewLabel *current_label, m_ListPreviewLabel) {
-            PreviewLabelUpdater updater(current_frame);
-            updater.setAutolevels(m_doAutolevels, m_autolevelThreshold);
-            updater(current_label);
-        }
-    } else {
-        PreviewLabelUpdater updater(current_frame);
-        updater.setAutolevels(m_doAutolevels, m_autolevelThreshold);
-        updater(m_ListPreviewLabel.at(index));
+        frame->pyramid()->resize(resized_width, BilinearInterp));
+
+    // 2. for each PreviewLabel, cancel the previous job and queue a new one:
+    // each preview reaches its label as soon as it is ready
+    int first = (index == -1) ? 0 : index;
+    int last = (index == -1) ? m_ListPreviewLabel.size() - 1 : index;
+    for (int idx = first; idx <= last; ++idx) {
+        PreviewLabelUpdater *updater = new PreviewLabelUpdater(
+            current_frame, m_ListPreviewLabel.at(idx), idx,
+            m_renderQueue->advance(idx), m_renderQueue);
+        updater->setAutolevels(m_doAutolevels, m_autolevelThreshold);
+        m_threadPool->start(updater);
     }
-    // 2. (concurrent) for each PreviewLabel, call
-    // PreviewLabelUpdater::operator()
-    // QtConcurrent::map (m_ListPreviewLabel, PreviewLabelUpdater(current_frame)
-    // );
 }
 
 void PreviewPanel::tonemapPreview(TonemappingOptions *opts) {
@@ -24,6 +24,7 @@
 #ifndef PREVIEWPANEL_IMPL_H
 #define PREVIEWPANEL_IMPL_H
 
+#include <QSharedPointer>
 #include <QWidget>
 
 // forward declaration
@@ -37,6 +38,8 @@ class PreviewPanel;
 
 class TonemappingOptions;  // #include "Core/TonemappingOptions.h"
 class PreviewLabel;        // #include "PreviewPanel/PreviewLabel.h"
+class PreviewRenderQueue;  // defined in PreviewPanel.cpp
+class QThreadPool;
 
 class PreviewPanel : public QWidget {
     Q_OBJECT
@@ -62,5 +65,9 @@ class PreviewPanel : public QWidget {
     bool m_doAutolevels;
     float m_autolevelThreshold;
     QVector<PreviewLabel *> m_ListPreviewLabel;
+
+    //! \brief previews are tonemapped concurrently on this pool
+    QThreadPool *m_threadPool;
+    QSharedPointer<PreviewRenderQueue> m_renderQueue;
 };
 #endif
@@ -31,6 +31,7 @@
 #include "Libpfs/frame.h"
 #include "Libpfs/manip/copy.h"
 #include "Libpfs/manip/cut.h"
+#include "Libpfs/manip/pyramid.h"
 #include "Libpfs/manip/resize.h"
 #include "Libpfs/progress.h"
 #include "Libpfs/tm/TonemapOperator.h"
@@ -157,9 +158,9 @@ void PreviewSettings::updatePreviews(pfs::Frame *frame) {
         float ratio = ((float)frame_width) / frame_height;
         resized_width = PREVIEW_HEIGHT * ratio;
     }
-    // 1. make a resized copy
+    // 1. make a resized copy, starting from the nearest level of the pyramid
     QSharedPointer<pfs::Frame> current_frame(
-        pfs::resize(frame, resized_width, BilinearInterp));
+        frame->pyramid()->resize(resized_width, BilinearInterp));
 
     // 2. (non concurrent) for each PreviewLabel, call
     // PreviewLabelUpdater::operator()
@@ -30,15 +30,36 @@
 #include "Libpfs/frame.h"
 #include "Libpfs/manip/projection.h"
 
-static void worker(pfs::Frame *original, pfs::Frame *transformed, int xSize,
-                   int ySize, TransformInfo *transforminfo) {
+//! \brief largest remap table kept between two conversions: above it, the
+//! geometry is computed on the fly
+static const size_t s_maxRemapTableBytes = size_t(512) << 20;
+
+static void worker(const pfs::Frame *original, pfs::Frame *transformed,
+                   int xSize, int ySize, TransformInfo *transforminfo) {
     const pfs::ChannelContainer &channels = original->getChannels();
 
+    std::vector<const pfs::Array2Df *> in;
+    std::vector<pfs::Array2Df *> out;
     for (pfs::ChannelContainer::const_iterator it = channels.begin();
          it != channels.end(); ++it) {
-        pfs::Channel *newCh = transformed->createChannel((*it)->getName());
-
-        transformArray(*it, newCh, transforminfo);
+        in.push_back(*it);
+        out.push_back(transformed->createChannel((*it)->getName()));
+    }
+    // the channels share the geometry of the transform, and so do the
+    // images of a shoot converted one after the other: the table is built
+    // when the same conversion comes again
+    std::shared_ptr<const RemapTable> table;
+    if (RemapTable::bytes(xSize, ySize, transforminfo->oversampleFactor) <=
+        s_maxRemapTableBytes) {
+        table = getRemapTable(*transforminfo, original->getWidth(),
+                              original->getHeight(), xSize, ySize);
+    }
+    if (table) {
+        table->apply(in, out, transforminfo->interpolate
+                                  ? RemapTable::BILINEAR
+                                  : RemapTable::NEAREST);
+    } else {
+        transformArrays(in, out, transforminfo);
     }
 
     pfs::copyTags(original, transformed);
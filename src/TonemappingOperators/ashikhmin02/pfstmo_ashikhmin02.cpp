@@ -29,76 +29,17 @@
  */
 
 #include <stdlib.h>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iostream>
 
 #include "Libpfs/colorspace/colorspace.h"
 #include "Libpfs/frame.h"
+#include "Libpfs/manip/statistics.h"
 #include "Libpfs/progress.h"
 
 #include "tmo_ashikhmin02.h"
-#include "../../sleef.c"
-#include "../../opthelper.h"
-
-namespace {
-void calculateLuminance(pfs::Array2Df *Y, float &avLum, float &maxLum,
-                        float &minLum) {
-
-    avLum = 0.0f;
-    maxLum = 0.0f;
-    minLum = 0.0f;
-
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-{
-    float maxLumThr = 0.f;
-    float minLumThr = 0.f;
-    float avLumThr = 0.f;
-
-#ifdef __SSE2__
-    vfloat maxLumThrv = ZEROV;
-    vfloat minLumThrv = ZEROV;
-    vfloat avLumThrv = ZEROV;
-    vfloat c1v = F2V(1e-4f);
-#endif
-#ifdef _OPENMP
-    #pragma omp for nowait
-#endif
-    for (size_t y = 0; y < Y->getRows(); ++y) {
-        size_t x = 0;
-#ifdef __SSE2__
-        for (; x < Y->getCols() - 3; x+=4) {
-            vfloat Yv = LVFU((*Y)(x, y));
-            avLumThrv += xlogf(Yv + c1v);
-            maxLumThrv = vmaxf(Yv, maxLumThrv);
-            minLumThrv = vminf(Yv, minLumThrv);
-        }
-#endif
-        for (; x < Y->getCols(); ++x) {
-            avLumThr += xlogf((*Y)(x, y) + 1e-4f);
-            maxLumThr = std::max((*Y)(x, y), maxLumThr);
-            minLumThr = std::min((*Y)(x, y), minLumThr);
-        }
-    }
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-{
-    avLum += avLumThr;
-    maxLum = std::max(maxLum, maxLumThr);
-    minLum = std::max(minLum, minLumThr);
-#ifdef __SSE2__
-    avLum += vhadd(avLumThrv);
-    maxLum = std::max(maxLum, vhmax(maxLumThrv));
-    minLum = std::max(minLum, vhmin(minLumThrv));
-#endif
-}
-}
-    avLum = exp(avLum / (Y->getRows() * Y->getCols()));
-}
-}
 
 void pfstmo_ashikhmin02(pfs::Frame &frame, bool simple_flag, float lc_value,
                         int eq, pfs::Progress &ph) {
@@ -113,6 +54,15 @@ void pfstmo_ashikhmin02(pfs::Frame &frame, bool simple_flag, float lc_value,
 
     ph.setValue(0);
 
+    // the luminance of the frame is the Y channel after the transform
+    // below. The minimum is clamped to zero, as it always was. Read before
+    // the channels are taken for writing, which drops the statistics
+    const float maxLum = std::max(
+        frame.statistics().maximum(pfs::FrameStatistics::LUMINANCE), 0.f);
+    const float minLum = 0.f;
+    // the log-average is unused by tmo_ashikhmin02()
+    const float avLum = 0.f;
+
     pfs::Channel *Xr, *Yr, *Zr;
     frame.getXYZChannels(Xr, Yr, Zr);
     assert(Xr != NULL);
@@ -123,8 +73,6 @@ void pfstmo_ashikhmin02(pfs::Frame &frame, bool simple_flag, float lc_value,
     }
 
     pfs::transformColorSpace(pfs::CS_RGB, Xr, Yr, Zr, pfs::CS_XYZ, Xr, Yr, Zr);
-    float maxLum, avLum, minLum;
-    calculateLuminance(Yr, avLum, maxLum, minLum);
 
     int w = Yr->getCols();
     int h = Yr->getRows();
@@ -28,268 +28,209 @@
 #ifndef PYRAMID_ASHIKHMIN_H
 #define PYRAMID_ASHIKHMIN_H
 
-#include <stdio.h>
+#include <algorithm>
+#include <vector>
 
 #include <Libpfs/array2d.h>
-#include <Libpfs/array2d_fwd.h>
-
-using namespace pfs;
-
-class Pyramid {  // each level of a Gaussian pyramid
-   public:
-    Pyramid() : width(0), height(0), size(0), kernel_size(0), lambda(0.), GP(NULL), flag(0) {
-    };
-
-    ~Pyramid(){
-        //    delete GP;
-    };
-
-    int width;
-    int height;
-    int size;
-    int kernel_size;
-
-    double lambda;
-
-    pfs::Array2Df *GP;
-    int flag;
-
-    inline double getPixel(int x, int y) { return (*GP)(x, y); }
-
-    inline void setPixel(int x, int y, double val) { (*GP)(x, y) = val; }
-};
-
-////////////////////////////////////////////////////////
 
+//! \brief Gaussian pyramid of the luminance, in single precision
+//!
+//! Levels are indexed by kernel size - 1: levels 0, 4, 9 and 19 are built by
+//! successive 5-tap filtering and decimation, the levels in between are
+//! interpolated from their two neighbours. All the levels live in one
+//! contiguous buffer owned by the pyramid.
 class GaussianPyramid {
    public:
-    GaussianPyramid() {}
+    static const int PYRAMID = 20;
 
-    GaussianPyramid(pfs::Array2Df *lum_map, int im_height, int im_width) {
-        // set a=0.4 (considered by Burt and Adelson, 1983).
-        // obtained by Outer((0.05, 0.25, 0.4, 0.25, 0.05),(0.05, 0.25, 0.4,
-        // 0.25,
-        // 0.05))
-        g_weights[0][0] = g_weights[0][4] = 0.0025;
-        g_weights[0][1] = g_weights[0][3] = 0.0125;
-        g_weights[0][2] = 0.0200;
+    //! \brief geometry of one level and its position in the pyramid buffer
+    struct Level {
+        int width;
+        int height;
+        int kernel_size;
+        float lambda;
+        size_t offset;
+    };
 
-        g_weights[1][0] = g_weights[1][4] = 0.0125;
-        g_weights[1][1] = g_weights[1][3] = 0.0625;
-        g_weights[1][2] = 0.1000;
+    explicit GaussianPyramid(const pfs::Array2Df &lum_map) {
+        computeGeometry(lum_map.getCols(), lum_map.getRows());
+        std::copy(lum_map.begin(), lum_map.end(), m_data.begin());
 
-        g_weights[2][0] = g_weights[2][4] = 0.0200;
-        g_weights[2][1] = g_weights[2][3] = 0.1000;
-        g_weights[2][2] = 0.1600;
+        int current_index = 0;
+        while (m_levels[current_index].kernel_size < PYRAMID) {
+            const int next_index = nextIndex(current_index);
+            constructNext(current_index, next_index);
+            current_index = next_index;
+        }
 
-        g_weights[3][0] = g_weights[3][4] = 0.0125;
-        g_weights[3][1] = g_weights[3][3] = 0.0625;
-        g_weights[3][2] = 0.1000;
+        int bottom = 0;
+        while (bottom < PYRAMID - 1) {
+            const int top = nextIndex(bottom);
+            for (int i = bottom + 1; i < top; i++) {
+                interpolate(bottom, top, i);
+            }
+            bottom = top;
+        }
+    }
 
-        g_weights[4][0] = g_weights[4][4] = 0.0025;
-        g_weights[4][1] = g_weights[4][3] = 0.0125;
-        g_weights[4][2] = 0.0200;
+    const Level &level(int index) const { return m_levels[index]; }
 
-        constructPyramid(lum_map, im_width, im_height);
+    const float *data(int index) const {
+        return m_data.data() + m_levels[index].offset;
     }
 
-    ~GaussianPyramid() {
-        for (int i = 0; i < PYRAMID; i++) delete p[i].GP;
+    //! \brief Bilinear samples of level \a index at the \a cols pixels of the
+    //! image row \a y, written to \a out. Coordinates past the last pixel of
+    //! the level are clamped to it.
+    void interpolateRow(int index, int y, int cols, float *out) const {
+        const Level &l = m_levels[index];
+        const float *d = data(index);
+
+        const float newY = y * l.lambda;
+        const int Y0 = std::min(int(newY), l.height - 1);
+        const int Y1 = std::min(Y0 + 1, l.height - 1);
+        const float dy = newY - int(newY);
+        const float *row0 = d + size_t(Y0) * l.width;
+        const float *row1 = d + size_t(Y1) * l.width;
+
+        for (int x = 0; x < cols; x++) {
+            const float newX = x * l.lambda;
+            const int X0 = std::min(int(newX), l.width - 1);
+            const int X1 = std::min(X0 + 1, l.width - 1);
+            const float dx = newX - int(newX);
+
+            const float top = row0[X0] + dx * (row0[X1] - row0[X0]);
+            const float bottom = row1[X0] + dx * (row1[X1] - row1[X0]);
+            out[x] = top + dy * (bottom - top);
+        }
     }
 
-    double NoInterpolateLum(int newX, int newY, Pyramid *pl) {
-
-        double lum;
-
-        if (newX < pl->width - 1 && newY < pl->height - 1)
-            lum = pl->getPixel(newX, newY);
-        else if (newX < pl->width - 1 && newY >= pl->height) {
-            lum = pl->getPixel(newX, pl->height - 1);
-        } else if (newX >= pl->width && newY < pl->height - 1) {
-            lum = pl->getPixel(pl->width - 1, newY);
-        } else
-            lum = pl->getPixel(pl->width - 1, pl->height - 1);
-
-        return lum;
+   private:
+    static int nextIndex(int index) {
+        return (index == 0) ? 4 : 2 * (index + 1) - 1;
     }
 
-    double InterpolateLum(double newX, double newY, Pyramid *pl) {
-        int X_int = (int)newX;
-        int Y_int = (int)newY;
-
-        double dx, omdx, dy, omdy;
-        dx = newX - (double)X_int;
-        omdx = 1.0 - dx;
-        dy = newY - (double)Y_int;
-        omdy = 1.0 - dy;
-        double lum;
+    //! \brief size of every level, then a single allocation for all of them
+    void computeGeometry(int im_width, int im_height) {
+        size_t offset = 0;
+        auto setLevel = [&](int index, int w, int h, int k_size, float lambda) {
+            Level &l = m_levels[index];
+            l.width = std::max(w, 1);
+            l.height = std::max(h, 1);
+            l.kernel_size = k_size;
+            l.lambda = lambda;
+            l.offset = offset;
+            offset += size_t(l.width) * l.height;
+        };
+
+        setLevel(0, im_width, im_height, 1, 1.f);
+        int bottom = 0;
+        while (bottom < PYRAMID - 1) {
+            const Level &b = m_levels[bottom];
+            const int top = nextIndex(bottom);
+            setLevel(top, b.width / 2, b.height / 2, top + 1, b.lambda * 0.5f);
+
+            const Level &t = m_levels[top];
+            for (int i = bottom + 1; i < top; i++) {
+                const float lambda = interpolationLambda(b, t, i);
+                setLevel(i, int(b.width * lambda), int(b.height * lambda), i + 1,
+                         lambda * b.lambda);
+            }
+            bottom = top;
+        }
 
-        if (X_int < pl->width - 1 && Y_int < pl->height - 1)
-            lum = omdx * omdy * pl->getPixel(X_int, Y_int) +
-                  dx * omdy * pl->getPixel(X_int + 1, Y_int) +
-                  omdx * dy * pl->getPixel(X_int, Y_int + 1) +
-                  dx * dy * pl->getPixel(X_int + 1, Y_int + 1);
-        else if (X_int < pl->width - 1 && Y_int >= pl->height) {
-            Y_int = pl->height - 1;
-            lum = omdx * pl->getPixel(X_int, Y_int) +
-                  dx * pl->getPixel(X_int + 1, Y_int);
-        } else if (X_int >= pl->width && Y_int < pl->height - 1) {
-            X_int = pl->width - 1;
-            lum = omdy * pl->getPixel(X_int, Y_int) +
-                  dy * pl->getPixel(X_int, Y_int + 1);
-        } else
-            lum = pl->getPixel(pl->width - 1, pl->height - 1);
+        m_data.resize(offset);
+    }
 
-        return lum;
+    static float interpolationLambda(const Level &bottom, const Level &top,
+                                     int index) {
+        return 1.f - float(bottom.kernel_size - (index + 1)) /
+                         float(bottom.kernel_size - top.kernel_size) * 0.5f;
     }
 
-    void Interpolate(int bottom, int top) {
-        //         fprintf(stderr, "Interpolating kernel_size=%2d and
-        //         kernel_size=%2d\n", p[bottom].kernel_size,
-        //         p[top].kernel_size);
-        for (int i = bottom + 1; i < top && i < PYRAMID; i++) {
-            //      fprintf(stderr, "into %2d\n", i+1);
+    //! \brief 5-tap binomial filter (a = 0.4, Burt and Adelson 1983) followed
+    //! by decimation, done separately along the columns and the rows
+    void constructNext(int current_index, int next_index) {
+        static const float g_weights[5] = {0.05f, 0.25f, 0.4f, 0.25f, 0.05f};
 
-            int new_kernel_size = i + 1;
-            double lambda =
-                1.0 -
-                (double)(p[bottom].kernel_size - new_kernel_size) /
-                    (double)(p[bottom].kernel_size - p[top].kernel_size) * 0.5;
-            int new_w = (int)((double)p[bottom].width * lambda);
-            int new_h = (int)((double)p[bottom].height * lambda);
-            initializeNewLevel(i, new_w, new_h, new_kernel_size, lambda * p[bottom].lambda);
+        const Level &c = m_levels[current_index];
+        const Level &n = m_levels[next_index];
+        const float *src = data(current_index);
+        float *dst = m_data.data() + n.offset;
 
+        // vertical filter on the decimated rows: n.height x c.width
+        std::vector<float> tmp(size_t(n.height) * c.width);
 #ifdef _OPENMP
-            #pragma omp parallel for schedule(dynamic,16)
+        #pragma omp parallel for
 #endif
-            for (int y = 0; y < p[i].height; y++) {
-                for (int x = 0; x < p[i].width; x++) {
-                    // top
-                    int newX = x / (lambda + lambda);
-                    int newY = y / (lambda + lambda);
-                    double top_lum = NoInterpolateLum(newX, newY, &p[top]);
-
-                    // bottom
-                    newX = (int)((double)x / lambda);
-                    newY = (int)((double)y / lambda);
-                    double bottom_lum = NoInterpolateLum(newX, newY, &p[bottom]);
-
-/* old implementation. It casts the values to int and calls InterPolateLum, where no interpolation is made because the values are int => nonsense
-                    int newX = (int)((double)x / (lambda + lambda));
-                    int newY = (int)((double)y / (lambda + lambda));
-                    double top_lum = InterpolateLum(newX, newY, &p[top]);
+        for (int y = 0; y < n.height; y++) {
+            const float *rows[5];
+            for (int k = 0; k < 5; k++) {
+                const int Y = std::min(std::max(2 * y + k - 2, 0), c.height - 1);
+                rows[k] = src + size_t(Y) * c.width;
+            }
+            float *out = tmp.data() + size_t(y) * c.width;
+            for (int x = 0; x < c.width; x++) {
+                out[x] = g_weights[0] * rows[0][x] + g_weights[1] * rows[1][x] +
+                         g_weights[2] * rows[2][x] + g_weights[3] * rows[3][x] +
+                         g_weights[4] * rows[4][x];
+            }
+        }
 
-                    // bottom
-                    newX = (int)((double)x / lambda);
-                    newY = (int)((double)y / lambda);
-                    double bottom_lum = InterpolateLum(newX, newY, &p[bottom]);
-*/
-                    (*p[i].GP)(x, y) = (1.0 - lambda) * top_lum + lambda * bottom_lum;
+        // horizontal filter and decimation
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int y = 0; y < n.height; y++) {
+            const float *in = tmp.data() + size_t(y) * c.width;
+            float *out = dst + size_t(y) * n.width;
+            for (int x = 0; x < n.width; x++) {
+                float sum = 0.f;
+                for (int k = 0; k < 5; k++) {
+                    const int X = std::min(std::max(2 * x + k - 2, 0), c.width - 1);
+                    sum += g_weights[k] * in[X];
                 }
+                out[x] = sum;
             }
         }
     }
 
-    void InterpolatePyramid() {
-        int bottom = 0, top = bottom + 1;
-        while (bottom < PYRAMID - 1) {
-            while (p[top].flag == 0) top++;
-
-            Interpolate(bottom, top);
-
-            bottom = top;
-            top++;
+    //! \brief level \a index as a blend of the nearest pixels of the levels
+    //! \a bottom and \a top
+    void interpolate(int bottom, int top, int index) {
+        const Level &b = m_levels[bottom];
+        const Level &t = m_levels[top];
+        const Level &l = m_levels[index];
+        const float lambda = interpolationLambda(b, t, index);
+
+        const float *bottomData = data(bottom);
+        const float *topData = data(top);
+        float *dst = m_data.data() + l.offset;
+
+        std::vector<int> topX(l.width);
+        std::vector<int> bottomX(l.width);
+        for (int x = 0; x < l.width; x++) {
+            topX[x] = std::min(int(x / (lambda + lambda)), t.width - 1);
+            bottomX[x] = std::min(int(x / lambda), b.width - 1);
         }
-    }
-
-    int constructNext(int current_index) {
-        int w = (int)(p[current_index].width / 2);
-        int h = (int)(p[current_index].height / 2);
-
-        int k_size;
-        if (p[current_index].kernel_size == 1)
-            k_size = 5;
-        else
-            k_size = 2 * p[current_index].kernel_size;
-
-        int next_index = k_size - 1;
-        double new_lambda = p[current_index].lambda * 0.5;
-        initializeNewLevel(next_index, w, h, k_size, new_lambda);
 
-        // apply 5*5 kernel
-        int X, Y;
 #ifdef _OPENMP
-        #pragma omp parallel for private(X,Y)
+        #pragma omp parallel for
 #endif
-        for (int y = 0; y < h; y++) {
-            for (int x = 0; x < w; x++) {
-                double sum = 0.0;
-                for (int n = -2; n < 3; n++) {
-                    for (int m = -2; m < 3; m++) {
-                        if (2 * x + m >= 0 &&
-                            2 * x + m < p[current_index].width)
-                            X = 2 * x + m;
-                        else if (2 * x + m < 0)
-                            X = 0;
-                        else
-                            X = p[current_index].width - 1;
-
-                        if (2 * y + n >= 0 &&
-                            2 * y + n < p[current_index].height)
-                            Y = 2 * y + n;
-                        else if (2 * y + n < 0)
-                            Y = 0;
-                        else
-                            Y = p[current_index].height - 1;
-
-                        sum += g_weights[m + 2][n + 2] *
-                               p[current_index].getPixel(X, Y);
-                    }
-                }
-
-                p[next_index].setPixel(x, y, sum);
+        for (int y = 0; y < l.height; y++) {
+            const float *topRow =
+                topData + size_t(std::min(int(y / (lambda + lambda)), t.height - 1)) * t.width;
+            const float *bottomRow =
+                bottomData + size_t(std::min(int(y / lambda), b.height - 1)) * b.width;
+            float *out = dst + size_t(y) * l.width;
+            for (int x = 0; x < l.width; x++) {
+                out[x] = (1.f - lambda) * topRow[topX[x]] + lambda * bottomRow[bottomX[x]];
             }
         }
-        return next_index;
-    }
-
-    void showPyramid() {
-        fprintf(stderr, "showPyramid()...\n");
-        for (int i = 0; i < PYRAMID; i++)
-            fprintf(stderr,
-                    "index=%2d: kernel_size=%2d, w h=%4d %4d, lambda=%f\n", i,
-                    p[i].kernel_size, p[i].width, p[i].height, p[i].lambda);
-    }
-
-    void initializeNewLevel(int index, int w, int h, int k_size,
-                            double lambda) {
-        p[index].width = w;
-        p[index].height = h;
-        p[index].size = w * h;
-        p[index].kernel_size = k_size;
-        p[index].lambda = lambda;
-        p[index].GP = new pfs::Array2Df(w, h);
-        p[index].flag = 1;
     }
 
-    void constructPyramid(pfs::Array2Df *lum_map, int im_width, int im_height) {
-        initializeNewLevel(0, im_width, im_height, 1, 1.0);
-        for (int y = 0; y < im_height; y++)
-            for (int x = 0; x < im_width; x++)
-                p[0].setPixel(x, y, (*lum_map)(x, y));
-
-        int current_index = 0;
-        while (p[current_index].kernel_size < PYRAMID)
-            current_index = constructNext(current_index);
-
-        InterpolatePyramid();
-
-        // showPyramid();
-    }
-
-    static const int PYRAMID = 20;
-    Pyramid p[PYRAMID];
-    double g_weights[5][5];
+    Level m_levels[PYRAMID];
+    std::vector<float> m_data;
 };
 
 #endif
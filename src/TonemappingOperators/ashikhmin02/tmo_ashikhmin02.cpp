@@ -29,6 +29,7 @@
 #include <assert.h>
 #include <math.h>
 #include <iostream>
+#include <vector>
 
 #include "Libpfs/array2d.h"
 #include "Libpfs/frame.h"
@@ -44,73 +45,44 @@
 
 //-------------------------------------------
 
-float calc_LAL_interpolated(GaussianPyramid *myPyramid, size_t x, size_t y, int s) {
-    float ratio = myPyramid->p[s - 1].lambda;
-
-    float newX = (float)x * ratio;
-    float newY = (float)y * ratio;
-    size_t X_int = (size_t)newX;
-    size_t Y_int = (size_t)newY;
-
-    float dx, dy, omdx, omdy;
-    dx = newX - (float)X_int;
-    omdx = 1.f - dx;
-    dy = newY - (float)Y_int;
-    omdy = 1.f - dy;
-
-    size_t w = myPyramid->p[s - 1].GP->getCols();
-    size_t h = myPyramid->p[s - 1].GP->getRows();
-
-    float g;
-    if (X_int < w - 1 && Y_int < h - 1) {
-        g = omdx * omdy * myPyramid->p[s - 1].getPixel(X_int, Y_int) +
-            dx * omdy * myPyramid->p[s - 1].getPixel(X_int + 1, Y_int) +
-            omdx * dy * myPyramid->p[s - 1].getPixel(X_int, Y_int + 1) +
-            dx * dy * myPyramid->p[s - 1].getPixel(X_int + 1, Y_int + 1);
-    } else if (X_int < w - 1 && Y_int >= h - 1) {
-        Y_int = h - 1;
-        g = omdx * myPyramid->p[s - 1].getPixel(X_int, Y_int) +
-            dx * myPyramid->p[s - 1].getPixel(X_int + 1, Y_int);
-    } else if (X_int >= w - 1 && Y_int < h - 1) {
-        X_int = w - 1;
-        g = omdy * myPyramid->p[s - 1].getPixel(X_int, Y_int) +
-            dy * myPyramid->p[s - 1].getPixel(X_int, Y_int + 1);
-    } else
-        g = myPyramid->p[s - 1].getPixel(w - 1, h - 1);
-
-    return g;
-}
-
-float calc_LAL(GaussianPyramid *myPyramid, int x, int y, int s) {
-    float ratio = myPyramid->p[s - 1].lambda;
-
-    float newX = (float)x * ratio;
-    float newY = (float)y * ratio;
-    unsigned int X_int = (unsigned int)newX;
-    unsigned int Y_int = (unsigned int)newY;
-
-    if (X_int >= myPyramid->p[s - 1].GP->getCols())
-        X_int = myPyramid->p[s - 1].GP->getCols() - 1;
-    if (Y_int >= myPyramid->p[s - 1].GP->getRows())
-        Y_int = myPyramid->p[s - 1].GP->getRows() - 1;
-
-    return myPyramid->p[s - 1].getPixel(X_int, Y_int);
-}
-
-float LAL(GaussianPyramid *myPyramid, int x, int y, float LOCAL_CONTRAST) {
-    float g, gg;
-    for (int s = 1; s <= SMAX; s++) {
-        // with interpolation
-        g = calc_LAL_interpolated(myPyramid, x, y, s);
-        gg = calc_LAL_interpolated(myPyramid, x, y, 2 * s);
-
-        // w/o interpolation
-        //    g = calc_LAL(myPyramid, x, y, s);
-        //     gg = calc_LAL(myPyramid, x, y, 2*s);
-
-        if (fabs((g - gg) / g) >= LOCAL_CONTRAST) return g;
+//! \brief Local adaptation luminance of one image row: for every pixel, the
+//! first pyramid scale s whose local contrast against scale 2s exceeds
+//! \a LOCAL_CONTRAST. The pyramid levels are upsampled a whole row at a time,
+//! and only while some pixel of the row is still unresolved.
+void LALRow(const GaussianPyramid &myPyramid, int y, int ncols,
+            float LOCAL_CONTRAST, std::vector<float> &levelRows,
+            std::vector<int> &active, float *la) {
+    const int numLevels = GaussianPyramid::PYRAMID;
+    bool computed[numLevels] = {false};
+    levelRows.resize(size_t(numLevels) * ncols);
+
+    auto levelRow = [&](int index) {
+        float *row = levelRows.data() + size_t(index) * ncols;
+        if (!computed[index]) {
+            myPyramid.interpolateRow(index, y, ncols, row);
+            computed[index] = true;
+        }
+        return row;
+    };
+
+    active.resize(ncols);
+    for (int x = 0; x < ncols; x++) active[x] = x;
+    size_t numActive = ncols;
+
+    for (int s = 1; s <= SMAX && numActive > 0; s++) {
+        const float *g = levelRow(s - 1);
+        const float *gg = levelRow(2 * s - 1);
+
+        size_t stillActive = 0;
+        for (size_t i = 0; i < numActive; i++) {
+            const int x = active[i];
+            la[x] = g[x];
+            if (!(fabs((g[x] - gg[x]) / g[x]) >= LOCAL_CONTRAST)) {
+                active[stillActive++] = x;
+            }
+        }
+        numActive = stillActive;
     }
-    return g;
 }
 
 ////////////////////////////////////////////////////////
@@ -202,7 +174,7 @@ int tmo_ashikhmin02(pfs::Array2Df *Y, pfs::Array2Df *L, float maxLum,
     }
 
     // applying the full functions....
-    GaussianPyramid *myPyramid = new GaussianPyramid(Y, nrows, ncols);
+    GaussianPyramid myPyramid(*Y);
 
     // LAL calculation
     pfs::Array2Df la(ncols, nrows);
@@ -212,27 +184,33 @@ int tmo_ashikhmin02(pfs::Array2Df *Y, pfs::Array2Df *L, float maxLum,
     ph.setValue(phVal);
 
 #ifdef _OPENMP
-    #pragma omp parallel for schedule(dynamic,16)
+    #pragma omp parallel
 #endif
-    for (unsigned int y = 0; y < nrows; y++) {
-        for (unsigned int x = 0; x < ncols; x++) {
-            float lal = LAL(myPyramid, x, y, lc_value);
-            la(x, y) = lal == 0 ? EPSILON : lal;
-        }
+    {
+        std::vector<float> levelRows;
+        std::vector<int> active;
 #ifdef _OPENMP
-        #pragma omp critical
+        #pragma omp for schedule(dynamic,16)
 #endif
-        {
-            progress += 1;
-            if((progress % progressSteps) == 0) {
-                phVal ++;
-                ph.setValue(std::min(phVal,80));
+        for (unsigned int y = 0; y < nrows; y++) {
+            float *laRow = &la(0, y);
+            LALRow(myPyramid, y, ncols, lc_value, levelRows, active, laRow);
+            for (unsigned int x = 0; x < ncols; x++) {
+                laRow[x] = laRow[x] == 0 ? EPSILON : laRow[x];
+            }
+#ifdef _OPENMP
+            #pragma omp critical
+#endif
+            {
+                progress += 1;
+                if((progress % progressSteps) == 0) {
+                    phVal ++;
+                    ph.setValue(std::min(phVal,80));
+                }
             }
         }
     }
 
-    delete myPyramid;
-
     ph.setValue(66);
 
     // TM function
@@ -29,12 +29,23 @@
 #ifndef TMO_ASHIKHMIN02_H
 #define TMO_ASHIKHMIN02_H
 
+#include <vector>
+
 #include <Libpfs/array2d_fwd.h>
 
 namespace pfs {
 class Frame;
 class Progress;
 }
+class GaussianPyramid;
+
+//! \brief Local adaptation luminance of the \a ncols pixels of row \a y:
+//! for each pixel, the first pyramid scale s whose local contrast against
+//! scale 2s exceeds \a LOCAL_CONTRAST. \a levelRows and \a active are
+//! scratch buffers, reused across calls.
+void LALRow(const GaussianPyramid &myPyramid, int y, int ncols,
+            float LOCAL_CONTRAST, std::vector<float> &levelRows,
+            std::vector<int> &active, float *la);
 
 //! \brief Michael Ashikhmin tone mapping operator
 //!
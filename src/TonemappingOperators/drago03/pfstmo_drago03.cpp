@@ -29,6 +29,7 @@
  * $Id: pfstmo_drago03.cpp,v 1.3 2008/09/04 12:46:48 julians37 Exp $
  */
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -36,11 +37,14 @@
 
 #include "Libpfs/exception.h"
 #include "Libpfs/frame.h"
+#include "Libpfs/manip/statistics.h"
 #include "Libpfs/progress.h"
 #include "tmo_drago03.h"
+#include "TonemappingOperators/pfstmo.h"
 #include "../../opthelper.h"
 
-void pfstmo_drago03(pfs::Frame &frame, float opt_biasValue, pfs::Progress &ph) {
+void pfstmo_drago03(pfs::Frame &frame, float opt_biasValue, pfs::Progress &ph,
+                    Drago03Statistics *stats) {
 #ifndef NDEBUG
     std::stringstream ss;
     ss << "pfstmo_drago03 (";
@@ -51,6 +55,27 @@ void pfstmo_drago03(pfs::Frame &frame, float opt_biasValue, pfs::Progress &ph) {
 
     ph.setValue(0);
 
+    // read before the channels are taken for writing, which drops the
+    // statistics of the frame
+    float maxLum;
+    float avLum;
+    if (stats && stats->valid) {
+        avLum = stats->avLum;
+        maxLum = stats->maxLum;
+    } else {
+        // the Y channel holds green: the luminance of the original operator
+        const pfs::FrameStatistics frameStatistics = frame.statistics();
+        avLum = std::exp(
+            frameStatistics.meanLog(pfs::FrameStatistics::GREEN, 1e-4f));
+        maxLum = std::max(
+            frameStatistics.maximum(pfs::FrameStatistics::GREEN), 0.f);
+        if (stats) {
+            stats->avLum = avLum;
+            stats->maxLum = maxLum;
+            stats->valid = true;
+        }
+    }
+
     pfs::Channel *X, *Y, *Z;
     frame.getXYZChannels(X, Y, Z);
 
@@ -67,10 +92,6 @@ void pfstmo_drago03(pfs::Frame &frame, float opt_biasValue, pfs::Progress &ph) {
     int w = Yr.getCols();
     int h = Yr.getRows();
 
-    float maxLum;
-    float avLum;
-    calculateLuminance(w, h, Yr.data(), avLum, maxLum);
-
     pfs::Array2Df L(w, h);
     try {
         tmo_drago03(Yr, L, maxLum, avLum, opt_biasValue, ph);
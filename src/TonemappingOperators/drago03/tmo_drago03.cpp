@@ -40,6 +40,7 @@
 #include "Libpfs/frame.h"
 #include "Libpfs/progress.h"
 #include "TonemappingOperators/pfstmo.h"
+#include "TonemappingOperators/tonecurve.h"
 #include "../../opthelper.h"
 #include "../../sleef.c"
 
@@ -53,61 +54,6 @@ inline float biasFunc(float b, float x) {
 const float LOG05 = -0.693147f;  // log(0.5)
 }
 
-void calculateLuminance(unsigned int width, unsigned int height, const float *Y,
-                        float &avLum, float &maxLum) {
-    avLum = 0.0f;
-    maxLum = 0.0f;
-
-    int size = width * height;
-
-#ifdef __SSE2__
-    vfloat maxLumv = ZEROV;
-    vfloat avLumv = ZEROV;
-#endif // __SSE2__
-
-#pragma omp parallel
-{
-    float eps = 1e-4f;
-    float avLumThr = 0.f;
-    float maxLumThr = 0.f;
-#ifdef __SSE2__
-    vfloat epsv = F2V(eps);
-    vfloat maxLumThrv = ZEROV;
-    vfloat avLumThrv = ZEROV;
-#endif // __SSE2__
-    #pragma omp for nowait
-    for(size_t i = 0; i < height; ++i) {
-        size_t j = 0;
-#ifdef __SSE2__
-        for (; j < width - 3; j+=4) {
-            vfloat Ywv = LVFU(Y[i * width + j]);
-            avLumThrv += xlogf(Ywv + epsv);
-            maxLumThrv = vmaxf(Ywv, maxLumThrv);
-        }
-#endif
-        for (; j < width; j++) {
-            float Yw = Y[i * width + j];
-            avLumThr += xlogf(Yw + eps);
-            maxLumThr = std::max(Yw, maxLumThr);
-        }
-    }
-#pragma omp critical
-{
-#ifdef __SSE2__
-    avLumv += avLumThrv;
-    maxLumv = vmaxf(maxLumv, maxLumThrv);
-#endif
-    avLum += avLumThr;
-    maxLum = std::max(maxLum, maxLumThr);
-}
-}
-#ifdef __SSE2__
-    avLum += vhadd(avLumv);
-    maxLum = std::max(maxLum, vhmax(maxLumv));
-#endif
-    avLum = exp(avLum / size);
-}
-
 void tmo_drago03(const pfs::Array2Df &Y, pfs::Array2Df &L, float maxLum,
                  float avLum, float bias, pfs::Progress &ph) {
     assert(Y.getRows() == L.getRows());
@@ -124,6 +70,33 @@ void tmo_drago03(const pfs::Array2Df &Y, pfs::Array2Df &L, float maxLum,
     float biasP = (log(bias) / LOG05);
     float logmaxLum = log(maxLum);
 
+    auto curve = [=](float Y) {
+        float Yw = Y / avLum;
+        float interpol = xlogf( 2.f + 8.f * xexpf(biasP * (xlogf(Yw) - logmaxLum)));
+        return xlogf(Yw + 1.f) / (interpol * divider);  // avoid loss of precision
+    };
+
+    // large images: the curve is compiled into a lookup table. Below 1e-6 of
+    // the average the curve is linear and smaller than 1e-5
+    if (ToneCurveLUT::worthwhile(Y.size())) {
+        const ToneCurveLUT lut(curve, 1e-6f * avLum, maxLum * avLum, 0.f, 1e-5f);
+        if (lut.valid()) {
+            const float* in = Y.data();
+            float* out = L.data();
+            const int size = Y.size();
+            #pragma omp parallel for
+            for (int i = 0; i < size; i++) {
+                out[i] = lut(in[i]);
+            }
+#ifdef TIMER_PROFILING
+            stop_watch.stop_and_update();
+            cout << endl;
+            cout << "tmo_drago03 (lut) = " << stop_watch.get_time() << " msec" << endl;
+#endif
+            return;
+        }
+    }
+
     // Normal tone mapping of every pixel
     #pragma omp parallel
     {
@@ -149,9 +122,7 @@ void tmo_drago03(const pfs::Array2Df &Y, pfs::Array2Df &L, float maxLum,
         }
 #endif
         for (; x < xEnd; x++) {
-            float Yw = Y(x, y) / avLum;
-            float interpol = xlogf( 2.f + 8.f * xexpf(biasP * (xlogf(Yw) - logmaxLum)));
-            L(x, y) = xlogf(Yw + 1.f) / (interpol * divider);  // avoid loss of precision
+            L(x, y) = curve(Y(x, y));
 
             assert(!boost::math::isnan(L(x, y)));
         }
@@ -50,13 +50,4 @@ class Progress;
 void tmo_drago03(const pfs::Array2Df &Y, pfs::Array2Df &L, float maxLum,
                  float avLum, float bias, pfs::Progress &ph);
 
-//! \brief Find average and maximum luminance in an image
-//!
-//! \param Y [in] image luminance values
-//! \param avLum [out] average luminance
-//! \param maxLum [out] maximum luminance
-//!
-void calculateLuminance(unsigned int width, unsigned int height, const float *Y,
-                        float &avLum, float &maxLum);
-
 #endif
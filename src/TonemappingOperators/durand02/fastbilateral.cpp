@@ -27,6 +27,7 @@
  * $Id: fastbilateral.cpp,v 1.5 2008/09/09 18:10:49 rafm Exp $
  */
 
+#include <algorithm>
 #include <cmath>
 
 #include <Libpfs/array2d.h>
@@ -158,9 +159,7 @@ PiecewiseBilateral (Image I, spatial kernel fs , intensity influence gr )
 void fastBilateralFilter(const pfs::Array2Df &I, pfs::Array2Df &J,
                          float sigma_s, float sigma_r, int /*downsample*/,
                          pfs::Progress &ph) {
-    int w = I.getCols();
-    int h = I.getRows();
-    int size = w * h;
+    int size = I.getCols() * I.getRows();
 
     // find range of values in the input array
     float maxI = I(0);
@@ -172,9 +171,20 @@ void fastBilateralFilter(const pfs::Array2Df &I, pfs::Array2Df &J,
         float v = I(i);
         maxI = std::max(maxI, v);
         minI = std::min(minI, v);
-        J(i) = 0.0f;  // zero output
     }
 
+    fastBilateralFilter(I, J, sigma_s, sigma_r, minI, maxI, ph);
+}
+
+void fastBilateralFilter(const pfs::Array2Df &I, pfs::Array2Df &J,
+                         float sigma_s, float sigma_r, float minI, float maxI,
+                         pfs::Progress &ph) {
+    int w = I.getCols();
+    int h = I.getRows();
+    int size = w * h;
+
+    std::fill(J.begin(), J.end(), 0.0f);  // zero output
+
     pfs::Array2Df jJ(w, h);
     pfs::Array2Df jG(w, h);
     pfs::Array2Df jH(w, h);
@@ -50,4 +50,13 @@ void fastBilateralFilter(const pfs::Array2Df &I, pfs::Array2Df &J,
                          float sigma_s, float sigma_r, int downsample,
                          pfs::Progress &ph);
 
+//!
+//! @brief As above, with the range kernel segments spread over
+//! [\a minI, \a maxI] instead of the range of \a I: values of \a I outside
+//! fall into the first or the last segment
+//!
+void fastBilateralFilter(const pfs::Array2Df &I, pfs::Array2Df &J,
+                         float sigma_s, float sigma_r, float minI, float maxI,
+                         pfs::Progress &ph);
+
 #endif /* #ifndef FASTBILATERAL_H */
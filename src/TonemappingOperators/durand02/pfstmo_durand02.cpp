@@ -40,6 +40,7 @@
 #include "Libpfs/frame.h"
 #include "Libpfs/progress.h"
 #include "tmo_durand02.h"
+#include "TonemappingOperators/pfstmo.h"
 
 namespace {
 const int downsample = 1;
@@ -56,7 +57,8 @@ const bool original_algorithm = false;
 // float baseContrast = 5.0f;
 
 void pfstmo_durand02(pfs::Frame &frame, float sigma_s, float sigma_r,
-                     float baseContrast, pfs::Progress &ph) {
+                     float baseContrast, pfs::Progress &ph,
+                     Durand02Statistics *stats) {
 #ifndef NDEBUG
     std::stringstream ss;
 
@@ -87,7 +89,7 @@ void pfstmo_durand02(pfs::Frame &frame, float sigma_s, float sigma_r,
 
     try {
         tmo_durand02(*X, *Y, *Z, sigma_s, sigma_r, baseContrast, downsample,
-                     !original_algorithm, ph);
+                     !original_algorithm, ph, stats);
     } catch (...) {
         throw pfs::Exception("Tonemapping Failed!");
     }
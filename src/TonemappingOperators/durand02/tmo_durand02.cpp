@@ -99,7 +99,8 @@ R output = r*exp(log(output intensity)), etc.
 
 void tmo_durand02(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B,
                   float sigma_s, float sigma_r, float baseContrast,
-                  int downsample, bool color_correction, pfs::Progress &ph) {
+                  int downsample, bool color_correction, pfs::Progress &ph,
+                  Durand02Statistics *stats) {
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
     stop_watch.start();
@@ -164,6 +165,9 @@ void tmo_durand02(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B,
 #ifdef __SSE2__
     min_pos = std::min(min_pos, vhmin(min_posv));
 #endif
+    if (stats && stats->valid) {
+        min_pos = stats->minPositive;
+    }
 
 #ifdef _OPENMP
 #pragma omp parallel
@@ -202,12 +206,42 @@ void tmo_durand02(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B,
     }
 }
 
-    fastBilateralFilter(I, BASE, sigma_s, sigma_r, downsample, ph);
+    float minI;
+    float maxI;
+    if (stats && stats->valid) {
+        minI = stats->logMin;
+        maxI = stats->logMax;
+    } else {
+        minI = I(0);
+        maxI = I(0);
+#ifdef _OPENMP
+        #pragma omp parallel for reduction(min:minI) reduction(max:maxI)
+#endif
+        for (int i = 0; i < size; i++) {
+            minI = std::min(minI, I(i));
+            maxI = std::max(maxI, I(i));
+        }
+    }
+
+    fastBilateralFilter(I, BASE, sigma_s, sigma_r, minI, maxI, ph);
 
     //!! FIX: find minimum and maximum luminance, but skip 1% of outliers
     float maxB;
     float minB;
-    lhdrengine::findMinMaxPercentile(BASE.data(), w * h, 0.01f, minB, 0.99f, maxB, true);
+    if (stats && stats->valid) {
+        minB = stats->baseMin;
+        maxB = stats->baseMax;
+    } else {
+        lhdrengine::findMinMaxPercentile(BASE.data(), w * h, 0.01f, minB, 0.99f, maxB, true);
+        if (stats) {
+            stats->minPositive = min_pos;
+            stats->logMin = minI;
+            stats->logMax = maxI;
+            stats->baseMin = minB;
+            stats->baseMax = maxB;
+            stats->valid = true;
+        }
+    }
 
     float compressionfactor = baseContrast / (maxB - minB);
     float compressionfactorm1 = compressionfactor - 1.f;
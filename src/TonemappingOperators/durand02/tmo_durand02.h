@@ -35,11 +35,14 @@
 #ifndef TMO_DURAND02_H
 #define TMO_DURAND02_H
 
+#include <cstddef>
+
 #include <Libpfs/array2d_fwd.h>
 
 namespace pfs {
 class Progress;
 }
+struct Durand02Statistics;
 
 //!
 //! \brief Fast bilateral filtering
@@ -55,10 +58,11 @@ class Progress;
 //! \param color_correction enable automatic color correction
 //! \param downsample down sampling factor for speeding up fast-bilateral
 //! (1..20)
+//! \param stats statistics of the whole image, see TonemapOperatorStatistics
 //!
 void tmo_durand02(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B,
                   float sigma_s, float sigma_r, float baseContrast,
                   int downsample, bool color_correction /*= true*/,
-                  pfs::Progress &ph);
+                  pfs::Progress &ph, Durand02Statistics *stats = NULL);
 
 #endif  // TMO_DURAND02_H
@@ -52,7 +52,8 @@ const float epsilon = 1e-4f;
 
 void pfstmo_fattal02(pfs::Frame &frame, float opt_alpha, float opt_beta,
                      float opt_saturation, float opt_noise, bool newfattal,
-                     bool fftsolver, int detail_level, pfs::Progress &ph) {
+                     bool fftsolver, int detail_level, pfs::Progress &ph,
+                     TonemapOperatorCache *cache) {
 
     if (fftsolver) {
         // opt_alpha = 1.f;
@@ -96,7 +97,7 @@ void pfstmo_fattal02(pfs::Frame &frame, float opt_alpha, float opt_beta,
 
     try {
         tmo_fattal02(w, h, Yr, L, opt_alpha, opt_beta, opt_noise, newfattal,
-                     fftsolver, detail_level, ph);
+                     fftsolver, detail_level, ph, cache);
     } catch (...) {
         throw pfs::Exception("Tonemapping Failed!");
     }
@@ -34,6 +34,7 @@
 #include <cstdio>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <vector>
 
 #include <assert.h>
@@ -282,46 +283,29 @@ void calculateFiMatrix(pfs::Array2Df &FI, pfs::Array2Df *gradients[],
     delete[] fi;
 }
 
-void tmo_fattal02(size_t width, size_t height, const pfs::Array2Df &Y,
-                  pfs::Array2Df &L, float alfa, float beta, float noise,
-                  bool newfattal, bool fftsolver, int detail_level,
-                  pfs::Progress &ph) {
-#ifdef TIMER_PROFILING
-    msec_timer stop_watch;
-    stop_watch.start();
-#endif
-    static const float black_point = 0.1f;
-    static const float white_point = 0.5f;
-    static const float gamma = 1.0f;  // 0.8f;
-    // static const int   detail_level = 3;
-    if (detail_level < 0) detail_level = 0;
-    if (detail_level > 3) detail_level = 3;
-
-    ph.setValue(2);
-    if (ph.canceled()) return;
+Fattal02Cache::Fattal02Cache(size_t width, size_t height, int msize)
+    : msize(msize), H(width, height) {}
 
-    int MSIZE = 32;  // minimum size of gaussian pyramid
-    // I believe a smaller value than 32 results in slightly better overall
-    // quality but I'm only applying this if the newly implemented fft solver
-    // is used in order not to change behaviour of the old version
-    // TODO: best let the user decide this value
-    if (fftsolver) {
-        MSIZE = 8;
+size_t Fattal02Cache::bytes() const {
+    size_t size = H.size();
+    for (size_t k = 0; k < gradients.size(); k++) {
+        size += gradients[k].size();
     }
+    return size * sizeof(float);
+}
 
-    size_t size = width * height;
+void Fattal02Cache::compute(const pfs::Array2Df &Y, pfs::Progress &ph) {
+    const size_t width = H.getCols();
+    const size_t height = H.getRows();
+    const size_t size = width * height;
 
-    // find max & min values, normalize to range 0..100 and take logarithm
-    float minLum = Y(0, 0);
+    // find max value, normalize to range 0..100 and take logarithm
     float maxLum = Y(0, 0);
 
     for (size_t i = 0; i < size; i++) {
-        minLum = (Y(i) < minLum) ? Y(i) : minLum;
         maxLum = (Y(i) > maxLum) ? Y(i) : maxLum;
     }
 
-    pfs::Array2Df H(width, height);
-
 #ifdef __SSE2__
     const vfloat maxLumv = F2V(maxLum);
     const vfloat c100v = F2V(100.f);
@@ -345,7 +329,7 @@ void tmo_fattal02(size_t width, size_t height, const pfs::Array2Df &Y,
     // create gaussian pyramids
     int mins = (width < height) ? width : height;  // smaller dimension
     int nlevels = 0;
-    while (mins >= MSIZE) {
+    while (mins >= msize) {
         nlevels++;
         mins /= 2;
     }
@@ -359,26 +343,67 @@ void tmo_fattal02(size_t width, size_t height, const pfs::Array2Df &Y,
     ph.setValue(8);
 
     // calculate gradients and its average values on pyramid levels
-    pfs::Array2Df **gradients = new pfs::Array2Df *[nlevels];
-    float avgGrad[nlevels];
+    gradients.resize(nlevels);
+    avgGrad.resize(nlevels);
     for (int k = 0; k < nlevels; k++) {
-        gradients[k] = new pfs::Array2Df(pyramids[k]->getCols(), pyramids[k]->getRows());
-        avgGrad[k] = calculateGradients(*pyramids[k], *gradients[k], k);
+        gradients[k].resize(pyramids[k]->getCols(), pyramids[k]->getRows());
+        avgGrad[k] = calculateGradients(*pyramids[k], gradients[k], k);
+        if (k != 0) // pyramids[0] is H
+            delete pyramids[k];
+    }
+    delete[] pyramids;
+}
+
+void tmo_fattal02(size_t width, size_t height, const pfs::Array2Df &Y,
+                  pfs::Array2Df &L, float alfa, float beta, float noise,
+                  bool newfattal, bool fftsolver, int detail_level,
+                  pfs::Progress &ph, TonemapOperatorCache *cache) {
+#ifdef TIMER_PROFILING
+    msec_timer stop_watch;
+    stop_watch.start();
+#endif
+    static const float black_point = 0.1f;
+    static const float white_point = 0.5f;
+    static const float gamma = 1.0f;  // 0.8f;
+    // static const int   detail_level = 3;
+    if (detail_level < 0) detail_level = 0;
+    if (detail_level > 3) detail_level = 3;
+
+    ph.setValue(2);
+    if (ph.canceled()) return;
+
+    int MSIZE = 32;  // minimum size of gaussian pyramid
+    // I believe a smaller value than 32 results in slightly better overall
+    // quality but I'm only applying this if the newly implemented fft solver
+    // is used in order not to change behaviour of the old version
+    // TODO: best let the user decide this value
+    if (fftsolver) {
+        MSIZE = 8;
+    }
+
+    // the log-luminance and its gradients depend on the input alone
+    std::unique_ptr<Fattal02Cache> local;
+    Fattal02Cache *derived = cache ? cache->get<Fattal02Cache>() : NULL;
+    if (derived == NULL || derived->msize != MSIZE) {
+        local.reset(new Fattal02Cache(width, height, MSIZE));
+        local->compute(Y, ph);
+        derived = local.get();
+        if (cache) cache->set(local.release());
     }
     ph.setValue(12);
+    if (ph.canceled()) return;
+
+    const pfs::Array2Df &H = derived->H;
+    const int nlevels = derived->gradients.size();
+    std::vector<pfs::Array2Df *> gradients(nlevels);
+    for (int k = 0; k < nlevels; k++) {
+        gradients[k] = &derived->gradients[k];
+    }
 
     // calculate fi matrix
     pfs::Array2Df FI(width, height);
-    calculateFiMatrix(FI, gradients, avgGrad, nlevels, detail_level, alfa, beta,
-                      noise, newfattal);
-
-    for (int i = 0; i < nlevels; i++) {
-        if(i != 0) // pyramids[0] is H. Will be deleted later
-            delete pyramids[i];
-        delete gradients[i];
-    }
-    delete[] pyramids;
-    delete[] gradients;
+    calculateFiMatrix(FI, gradients.data(), derived->avgGrad.data(), nlevels,
+                      detail_level, alfa, beta, noise, newfattal);
     ph.setValue(16);
     if (ph.canceled()) {
         return;
@@ -481,6 +506,7 @@ void tmo_fattal02(size_t width, size_t height, const pfs::Array2Df &Y,
     float cut_min = 0.01f * black_point;
     float cut_max = 1.0f - 0.01f * white_point;
     assert(cut_min >= 0.0f && (cut_max <= 1.0f) && (cut_min < cut_max));
+    float minLum, maxLum;
     lhdrengine::findMinMaxPercentile(L.data(), width * height, cut_min, minLum, cut_max, maxLum, true);
 
     for (size_t idx = 0; idx < height * width; ++idx) {
@@ -33,13 +33,34 @@
 #ifndef TMO_FATTAL02_H
 #define TMO_FATTAL02_H
 
-#include <Libpfs/array2d_fwd.h>
+#include <Libpfs/array2d.h>
 #include <cstddef>
+#include <vector>
+
+#include "TonemappingOperators/pfstmo.h"
 
 namespace pfs {
 class Progress;
 }
 
+//! \brief What tmo_fattal02() derives from the luminance alone: its
+//! logarithm and the gradient magnitudes of its gaussian pyramid
+struct Fattal02Cache : public TonemapOperatorCache::Entry {
+    Fattal02Cache(size_t width, size_t height, int msize);
+
+    size_t bytes() const;
+
+    //! \brief fill in from the luminance \a Y
+    void compute(const pfs::Array2Df &Y, pfs::Progress &ph);
+
+    //! \brief minimum size of the pyramid levels
+    int msize;
+    //! \brief log-luminance, normalized to 0..100
+    pfs::Array2Df H;
+    std::vector<pfs::Array2Df> gradients;
+    std::vector<float> avgGrad;
+};
+
 //! \brief Gradient Domain High Dynamic Range Compression
 //!
 //! Implementation of Gradient Domain High Dynamic Range Compression
@@ -52,11 +73,13 @@ class Progress;
 //! \param alfa parameter alfa (refer to the paper)
 //! \param beta parameter beta (refer to the paper)
 //! \param noise gradient level of noise (extra parameter)
+//! \param cache see TonemapOperatorCache
 //!
 void tmo_fattal02(size_t width, size_t height,
                   // const float* Y, float* L,
                   const pfs::Array2Df &Y, pfs::Array2Df &L, float alfa,
                   float beta, float noise, bool newfattal, bool fftsolver,
-                  int detail_level, pfs::Progress &ph);
+                  int detail_level, pfs::Progress &ph,
+                  TonemapOperatorCache *cache = NULL);
 
 #endif
@@ -36,6 +36,12 @@
 #include "Libpfs/progress.h"
 #include "tmo_ferradans11.h"
 
+namespace {
+// above this number of pixels the powers of the channels are convolved one at
+// a time, which needs about 28 instead of 49 bytes per pixel of working memory
+const size_t s_lowMemoryPixels = 24 * 1000 * 1000;
+}
+
 void pfstmo_ferradans11(pfs::Frame &frame, float opt_rho, float opt_inv_alpha,
                         pfs::Progress &ph) {
 //--- default tone mapping parameters;
@@ -64,7 +70,8 @@ void pfstmo_ferradans11(pfs::Frame &frame, float opt_rho, float opt_inv_alpha,
 
     // tone mapping
     try {
-        tmo_ferradans11(*inR, *inG, *inB, opt_rho, opt_inv_alpha, ph);
+        tmo_ferradans11(*inR, *inG, *inB, opt_rho, opt_inv_alpha, ph,
+                        inR->size() > s_lowMemoryPixels);
     } catch (...) {
         throw pfs::Exception("Tonemapping Failed!");
     }
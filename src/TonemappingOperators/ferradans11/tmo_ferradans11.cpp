@@ -41,6 +41,7 @@
 #include <math.h>
 
 #include <cstring>
+#include <vector>
 
 #include <stdlib.h>
 #ifdef _OPENMP
@@ -206,25 +207,81 @@ float medval(const float* a, int length, bool multiThread = true) {
     return lhdrengine::accumulate(a, length, multiThread) / length;
 }
 
-float MSE(const float Im1[], const float Im2[], int largo) {
-
-    double res = 0.0; // use double precision for summations
-#pragma omp parallel for reduction(+:res)
-    for (int i = 0; i < largo; i++) {
-        res += fabs(Im1[i] - Im2[i]);
+//! \brief weight of the convolved k-th power of the channel in the contrast
+//! term: apply_arctg_slope10 is a sum of convolutions of (Ip - u)^n, so it can
+//! be accumulated one power at a time as sum_k weight_k(Ip) * I_k, with I_0 = 1.
+//! The terms of even degree, whose coefficients are below 1e-14, are dropped.
+inline float contrastWeight(int k, float Ip) {
+    static const float coeff[8] = {0.f, 3.7891e+00f, 0.f, -1.1013e+01f,
+                                   0.f, 1.5836e+01f, 0.f, -7.7456e+00f};
+    static const float binomial[8][8] = {
+        {1, 0, 0, 0, 0, 0, 0, 0},      {1, 1, 0, 0, 0, 0, 0, 0},
+        {1, 2, 1, 0, 0, 0, 0, 0},      {1, 3, 3, 1, 0, 0, 0, 0},
+        {1, 4, 6, 4, 1, 0, 0, 0},      {1, 5, 10, 10, 5, 1, 0, 0},
+        {1, 6, 15, 20, 15, 6, 1, 0},   {1, 7, 21, 35, 35, 21, 7, 1}};
+
+    float weight = 0.f;
+    float Ipn = 1.f;
+    for (int n = k; n < 8; n++) {
+        weight += coeff[n] * binomial[n][k] * Ipn;
+        Ipn *= Ip;
     }
-    return res / largo;
+    return (k & 1) ? -weight : weight;
 }
 
-void producto(fftwf_complex *A, const fftwf_complex *B, int fil, int col) {
+//! \brief Plan \a howmany in-place 2D real-to-complex (or complex-to-real)
+//! transforms of size \a fil x \a col, stored one after the other in \a data
+//! with rows padded to 2 * (col / 2 + 1) floats. Wisdom is loaded from disk or
+//! measured and saved when not available.
+//! The caller must hold FFTW_MUTEX::fftw_mutex_plan.
+fftwf_plan planInPlace(int fil, int col, int howmany, float *data,
+                       bool forward) {
+    const int n[2] = {fil, col};
+    const int realEmbed[2] = {fil, 2 * (col / 2 + 1)};
+    const int complexEmbed[2] = {fil, col / 2 + 1};
+    const int dist = fil * (col / 2 + 1);
+    fftwf_complex *spectrum = reinterpret_cast<fftwf_complex *>(data);
+
+    auto plan = [&](unsigned flags) {
+        return forward ? fftwf_plan_many_dft_r2c(2, n, howmany, data, realEmbed,
+                                                 1, 2 * dist, spectrum,
+                                                 complexEmbed, 1, dist, flags)
+                       : fftwf_plan_many_dft_c2r(2, n, howmany, spectrum,
+                                                 complexEmbed, 1, dist, data,
+                                                 realEmbed, 1, 2 * dist, flags);
+    };
 
-    int length = fil * col;
+    // test for available wisdom
+    fftwf_plan p = plan(FFTW_WISDOM_ONLY);
+    if (!p) {
+        // no wisdom available, load wisdom from file
+        fftwf_import_wisdom_from_filename(LuminanceOptions().getFftwWisdomFileName().toStdString().c_str());
+        // test again for wisdom
+        p = plan(FFTW_WISDOM_ONLY);
+        if (!p) {
+            // build plan with FFTW_MEASURE
+            p = plan(FFTW_MEASURE);
+            // save the wisdom
+            fftwf_export_wisdom_to_filename(LuminanceOptions().getFftwWisdomFileName().toStdString().c_str());
+        }
+    }
+    return p;
+}
 
+//! \brief Multiply \a howmany spectra, stored \a dist elements apart, by \a G
+//! in a single pass
+void producto(fftwf_complex *A, const fftwf_complex *G, int dist,
+              int howmany) {
 #pragma omp parallel for
-    for (int i = 0; i < length; i++) {
-        float a1 = (A[i][0] * B[i][1] + A[i][1] * B[i][0]);
-        A[i][0] = (A[i][0] * B[i][0] - A[i][1] * B[i][1]);
-        A[i][1] = a1;
+    for (int i = 0; i < dist; i++) {
+        const float g0 = G[i][0];
+        const float g1 = G[i][1];
+        for (int k = 0; k < howmany; k++) {
+            fftwf_complex &a = A[size_t(k) * dist + i];
+            const float a1 = (a[0] * g1 + a[1] * g0);
+            a[0] = (a[0] * g0 - a[1] * g1);
+            a[1] = a1;
+        }
     }
 }
 
@@ -276,7 +333,8 @@ void fftshift(float a[], int fil, int col) {
 }
 
 void tmo_ferradans11(pfs::Array2Df &imR, pfs::Array2Df &imG, pfs::Array2Df &imB,
-                     float rho, float invalpha, pfs::Progress &ph) {
+                     float rho, float invalpha, pfs::Progress &ph,
+                     bool lowMemory) {
 
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
@@ -285,60 +343,42 @@ void tmo_ferradans11(pfs::Array2Df &imR, pfs::Array2Df &imG, pfs::Array2Df &imB,
 
     init_fftw();
 
-    int fil = imR.getRows();
-    int col = imR.getCols();
-    int length = fil * col;
-    int colors = 3;
+    const int fil = imR.getRows();
+    const int col = imR.getCols();
+    const int length = fil * col;
+    const int colors = 3;
     float dt = 0.2;                    // 1e-1;//
     float threshold_diff = dt / 20.0;  // 1e-5;//
 
-    float *RGBorig[3];
-    RGBorig[0] = new float[length];
-    RGBorig[1] = new float[length];
-    RGBorig[2] = new float[length];
-
-#pragma omp parallel for
-    for (int i = 0; i < length; i++) {
-        RGBorig[0][i] = (float)max(imR(i), 0.f);
-        RGBorig[1][i] = (float)max(imG(i), 0.f);
-        RGBorig[2][i] = (float)max(imB(i), 0.f);
-    }
-
-    ///////////////////////////////////////////
-
-    ph.setValue(10);
-
-    float *RGB[3];
-    RGB[0] = new float[length];
-    RGB[1] = new float[length];
-    RGB[2] = new float[length];
-
-    int iteration = 0;
-    float difference = 1000.0f;
+    // RGBorig is the response to which the evolution is attached, RGB the
+    // current estimate. The estimate is evolved in the channels themselves,
+    // which are left untouched until the evolution starts: a cancel before
+    // that point returns the input as it was.
+    float *RGB[3] = {imR.data(), imG.data(), imB.data()};
+    vector<float> RGBorig[3];
 
     float med[3];
-    float *aux = new float[length];
-    float median, mu[3];
-
-    for (int k = 0; k < 3; k++) {
-        vsadd(RGBorig[k], 1e-6f, RGBorig[k], length);
-        copy(RGBorig[k], RGBorig[k] + length, aux);
-        median = quick_select(aux, length);
-        float mdval = medval(aux, length);
-        mu[k] = pow(mdval, 0.5) * pow(median, 0.5);
-        copy(RGBorig[k], RGBorig[k] + length, RGB[k]);
+    float mu[3];
+
+    {
+        vector<float> aux(length);
+        for (int k = 0; k < 3; k++) {
+            RGBorig[k].resize(length);
+            float *orig = RGBorig[k].data();
+            const float *in = RGB[k];
+#pragma omp parallel for
+            for (int i = 0; i < length; i++) {
+                orig[i] = max(in[i], 0.f) + 1e-6f;
+            }
+            copy(orig, orig + length, aux.begin());
+            float median = quick_select(aux.data(), length);
+            float mdval = medval(aux.data(), length);
+            mu[k] = pow(mdval, 0.5) * pow(median, 0.5);
+        }
     }
 
-    delete[] aux;
-
     ph.setValue(15);
     if (ph.canceled()) {
-        delete[] RGBorig[0];
-        delete[] RGBorig[1];
-        delete[] RGBorig[2];
-        delete[] RGB[0];
-        delete[] RGB[1];
-        delete[] RGB[2];
         return;
     }
 
@@ -375,183 +415,99 @@ void tmo_ferradans11(pfs::Array2Df &imR, pfs::Array2Df &imG, pfs::Array2Df &imB,
 // mix W-F and N-R
 
         float ln10 = log(10.f);
+        float *orig = RGBorig[k].data();
 #pragma omp parallel for
         for (int i = 0; i < length; i++) {
-            if (RGBorig[k][i] <= Ir) {
-                RGB[k][i] = K_ * xlogf(RGBorig[k][i] + I0) / ln10 + mKlogc;
+            if (orig[i] <= Ir) {
+                orig[i] = K_ * xlogf(orig[i] + I0) / ln10 + mKlogc;
             } else {
-                float In = pow_F(RGBorig[k][i], n);
-                RGB[k][i] = In / (In + sigma_n);
+                float In = pow_F(orig[i], n);
+                orig[i] = In / (In + sigma_n);
             }
         }
 
-        float minmez = *min_element(RGB[k], RGB[k] + length);
-        vsadd(RGB[k], -minmez, RGB[k], length);
+        float minmez = *min_element(orig, orig + length);
+        vsadd(orig, -minmez, orig, length);
 
-        float escalamez = 1.f / (*max_element(RGB[k], RGB[k] + length) + 1e-12);
-        vsmul(RGB[k], escalamez, RGB[k], length);
+        float escalamez = 1.f / (*max_element(orig, orig + length) + 1e-12);
+        vsmul(orig, escalamez, orig, length);
     }
 
     ph.setValue(20);
     if (ph.canceled()) {
-        delete[] RGBorig[0];
-        delete[] RGBorig[1];
-        delete[] RGBorig[2];
-        delete[] RGB[0];
-        delete[] RGB[1];
-        delete[] RGB[2];
         return;
     }
 
-#pragma omp parallel for
     for (int color = 0; color < colors; color++) {
-        copy(RGB[color], RGB[color] + length, RGBorig[color]);
-        med[color] = medval(RGB[color], length, false);
+        med[color] = medval(RGBorig[color].data(), length);
     }
 
+    // The seven powers of a channel are convolved with the kernel in place, in
+    // a row-padded layout: each transform needs 2 * dist floats. In low memory
+    // mode the powers are transformed one at a time and the contrast term is
+    // accumulated in a separate buffer.
+    const int powers = 7;
+    const int batch = lowMemory ? 1 : powers;
+    const size_t stride = 2 * (col / 2 + 1);
+    const size_t dist = size_t(fil) * (col / 2 + 1);
+
     FFTW_MUTEX::fftw_mutex_alloc.lock();
-    float *RGB0 = fftwf_alloc_real(length);
-    float *u0 = fftwf_alloc_real(length);
-    float *u2 = fftwf_alloc_real(length);
-    float *u3 = fftwf_alloc_real(length);
-    float *u4 = fftwf_alloc_real(length);
-    float *u5 = fftwf_alloc_real(length);
-    float *u6 = fftwf_alloc_real(length);
-    float *u7 = fftwf_alloc_real(length);
+    float *work = fftwf_alloc_real(batch * 2 * dist);
+    float *g = fftwf_alloc_real(2 * dist);
     FFTW_MUTEX::fftw_mutex_alloc.unlock();
+    vector<float> contrast(lowMemory ? length : 0);
 
     FFTW_MUTEX::fftw_mutex_plan.lock();
-    fftwf_complex *U = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
+    fftwf_plan pU = planInPlace(fil, col, batch, work, true);
+    fftwf_plan pinvU = planInPlace(fil, col, batch, work, false);
+    fftwf_plan pG = planInPlace(fil, col, 1, g, true);
+    FFTW_MUTEX::fftw_mutex_plan.unlock();
 
-    // test for available wisdom
-    fftwf_plan pU = fftwf_plan_dft_r2c_2d(fil, col, u0, U, FFTW_WISDOM_ONLY);
-    if(!pU) {
-        // no wisdom available, load wisdom from file
-        fftwf_import_wisdom_from_filename(LuminanceOptions().getFftwWisdomFileName().toStdString().c_str());
-        // test again for wisdom
-        pU = fftwf_plan_dft_r2c_2d(fil, col, u0, U, FFTW_WISDOM_ONLY);
-        if(!pU) {
-            // build plan with FFTW_MEASURE
-            pU = fftwf_plan_dft_r2c_2d(fil, col, u0, U, FFTW_MEASURE);
-            // save the wisdom
-            fftwf_export_wisdom_to_filename(LuminanceOptions().getFftwWisdomFileName().toStdString().c_str());
+    float alpha = min(col, fil) / invalpha;
+    {
+        vector<float> kernel(length);
+        nucleo_gaussiano(kernel.data(), fil, col, alpha);
+        escala(kernel.data(), length, 1.f, 0.f);
+        fftshift(kernel.data(), fil, col);
+
+        // normalize the kernel, and fold the scaling of the inverse transform
+        float suma = lhdrengine::accumulate(kernel.data(), length);
+        float w = (1.0f / suma) / length;
+#pragma omp parallel for
+        for (int i = 0; i < fil; i++) {
+            for (int j = 0; j < col; j++) {
+                g[i * stride + j] = w * kernel[size_t(i) * col + j];
+            }
         }
     }
-
-    fftwf_complex *U2 = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
-    fftwf_plan pU2 = fftwf_plan_dft_r2c_2d(fil, col, u2, U2, FFTW_WISDOM_ONLY);
-
-    fftwf_complex *U3 = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
-    fftwf_plan pU3 = fftwf_plan_dft_r2c_2d(fil, col, u3, U3, FFTW_WISDOM_ONLY);
-
-    fftwf_complex *U4 = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
-    fftwf_plan pU4 = fftwf_plan_dft_r2c_2d(fil, col, u4, U4, FFTW_WISDOM_ONLY);
-
-    fftwf_complex *U5 = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
-    fftwf_plan pU5 = fftwf_plan_dft_r2c_2d(fil, col, u5, U5, FFTW_WISDOM_ONLY);
-
-    fftwf_complex *U6 = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
-    fftwf_plan pU6 = fftwf_plan_dft_r2c_2d(fil, col, u6, U6, FFTW_WISDOM_ONLY);
-
-    fftwf_complex *U7 = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
-    fftwf_plan pU7 = fftwf_plan_dft_r2c_2d(fil, col, u7, U7, FFTW_WISDOM_ONLY);
-
-
-    float *iu = fftwf_alloc_real(length);
-    fftwf_plan pinvU = fftwf_plan_dft_c2r_2d(fil, col, U, iu, FFTW_WISDOM_ONLY);
-    if(!pinvU) {
-        // no wisdom available. Makes no sense to load wisdom from file because we just did that a few lines above.
-        // build plan with FFTW_MEASURE
-        pinvU = fftwf_plan_dft_c2r_2d(fil, col, U, iu, FFTW_MEASURE);
-        // save the wisdom
-        fftwf_export_wisdom_to_filename(LuminanceOptions().getFftwWisdomFileName().toStdString().c_str());
-    }
-
-    fftwf_plan pinvU2 = fftwf_plan_dft_c2r_2d(fil, col, U2, u2, FFTW_WISDOM_ONLY);
-
-    fftwf_plan pinvU3 = fftwf_plan_dft_c2r_2d(fil, col, U3, u3, FFTW_WISDOM_ONLY);
-
-    fftwf_plan pinvU4 = fftwf_plan_dft_c2r_2d(fil, col, U4, u4, FFTW_WISDOM_ONLY);
-
-    fftwf_plan pinvU5 = fftwf_plan_dft_c2r_2d(fil, col, U5, u5, FFTW_WISDOM_ONLY);
-
-    fftwf_plan pinvU6 = fftwf_plan_dft_c2r_2d(fil, col, U6, u6, FFTW_WISDOM_ONLY);
-
-    fftwf_plan pinvU7 = fftwf_plan_dft_c2r_2d(fil, col, U7, u7, FFTW_WISDOM_ONLY);
-
-    float alpha = min(col, fil) / invalpha;
-    float *g = fftwf_alloc_real(length);
-    FFTW_MUTEX::fftw_mutex_plan.unlock();
-
-    nucleo_gaussiano(g, fil, col, alpha);
-    escala(g, length, 1.f, 0.f);
-    fftshift(g, fil, col);
-
-    float suma, norm = 1.f / length;
-    suma = lhdrengine::accumulate(g, length);
-
-    float w = (1.0f / suma);
-    vsmul(g, w, g, length);
-
-    FFTW_MUTEX::fftw_mutex_plan.lock();
-    fftwf_complex *G =
-        (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * length);
-    fftwf_plan pG = fftwf_plan_dft_r2c_2d(fil, col, g, G, FFTW_WISDOM_ONLY);
-    FFTW_MUTEX::fftw_mutex_plan.unlock();
     fftwf_execute(pG);
-    FFTW_MUTEX::fftw_mutex_destroy_plan.lock();
-    fftwf_destroy_plan(pG);
+    const fftwf_complex *G = reinterpret_cast<const fftwf_complex *>(g);
+    fftwf_complex *U = reinterpret_cast<fftwf_complex *>(work);
 
-    fftwf_free(g);
-    FFTW_MUTEX::fftw_mutex_destroy_plan.unlock();
-
-    ph.setValue(30);
-    if (ph.canceled()) {
-        delete[] RGBorig[0];
-        delete[] RGBorig[1];
-        delete[] RGBorig[2];
-        delete[] RGB[0];
-        delete[] RGB[1];
-        delete[] RGB[2];
+    auto release = [&]() {
         FFTW_MUTEX::fftw_mutex_destroy_plan.lock();
         fftwf_destroy_plan(pU);
-        fftwf_destroy_plan(pU2);
-        fftwf_destroy_plan(pU3);
-        fftwf_destroy_plan(pU4);
-        fftwf_destroy_plan(pU5);
-        fftwf_destroy_plan(pU6);
-        fftwf_destroy_plan(pU7);
-
         fftwf_destroy_plan(pinvU);
-        fftwf_destroy_plan(pinvU2);
-        fftwf_destroy_plan(pinvU3);
-        fftwf_destroy_plan(pinvU4);
-        fftwf_destroy_plan(pinvU5);
-        fftwf_destroy_plan(pinvU6);
-        fftwf_destroy_plan(pinvU7);
-
-        fftwf_free(RGB0);
-        fftwf_free(u0);
-        fftwf_free(u2);
-        fftwf_free(u3);
-        fftwf_free(u4);
-        fftwf_free(u5);
-        fftwf_free(u6);
-        fftwf_free(u7);
-
-        fftwf_free(iu);
-
-        fftwf_free(U);
-        fftwf_free(U2);
-        fftwf_free(U3);
-        fftwf_free(U4);
-        fftwf_free(U5);
-        fftwf_free(U6);
-        fftwf_free(U7);
+        fftwf_destroy_plan(pG);
 
+        fftwf_free(work);
+        fftwf_free(g);
         FFTW_MUTEX::fftw_mutex_destroy_plan.unlock();
+    };
+
+    ph.setValue(30);
+    if (ph.canceled()) {
+        release();
         return;
     }
+
+    // the evolution starts from the response
+    for (int color = 0; color < colors; color++) {
+        copy(RGBorig[color].begin(), RGBorig[color].end(), RGB[color]);
+    }
+
+    int iteration = 0;
+    float difference = 1000.0f;
     float delta = 0.f, oldDifference = 0.f;
     int steps;
 
@@ -564,71 +520,109 @@ void tmo_ferradans11(pfs::Array2Df &imR, pfs::Array2Df &imG, pfs::Array2Df &imB,
         difference = 0.0;
 
         for (int color = 0; color < colors; color++) {
-            copy(RGB[color], RGB[color] + length, u0);
-            copy(RGB[color], RGB[color] + length, RGB0);
-
-            transform(u0, u0 + length, u0, u2, multiplies<float>());
-            transform(u2, u2 + length, u0, u3, multiplies<float>());
-            transform(u3, u3 + length, u0, u4, multiplies<float>());
-            transform(u4, u4 + length, u0, u5, multiplies<float>());
-            transform(u5, u5 + length, u0, u6, multiplies<float>());
-            transform(u6, u6 + length, u0, u7, multiplies<float>());
-
-            fftwf_execute(pU);
-            producto(U, G, fil, col);
-            fftwf_execute(pinvU);
-
-            fftwf_execute(pU2);
-            producto(U2, G, fil, col);
-            fftwf_execute(pinvU2);
-
-            fftwf_execute(pU3);
-            producto(U3, G, fil, col);
-            fftwf_execute(pinvU3);
-
-            fftwf_execute(pU4);
-            producto(U4, G, fil, col);
-            fftwf_execute(pinvU4);
+            float *u0 = RGB[color];
+            float mabsv = 0.f;
 
-            fftwf_execute(pU5);
-            producto(U5, G, fil, col);
-            fftwf_execute(pinvU5);
-
-            fftwf_execute(pU6);
-            producto(U6, G, fil, col);
-            fftwf_execute(pinvU6);
-
-            fftwf_execute(pU7);
-            producto(U7, G, fil, col);
-            fftwf_execute(pinvU7);
+            if (!lowMemory) {
+#pragma omp parallel for
+                for (int i = 0; i < fil; i++) {
+                    for (int j = 0; j < col; j++) {
+                        const float u = u0[i * col + j];
+                        float uk = u;
+                        for (int k = 0; k < powers; k++) {
+                            work[k * 2 * dist + i * stride + j] = uk;
+                            uk *= u;
+                        }
+                    }
+                }
+
+                fftwf_execute(pU);
+                producto(U, G, int(dist), powers);
+                fftwf_execute(pinvU);
+
+#pragma omp parallel for reduction(max:mabsv)
+                for (int i = 0; i < fil; i++) {
+                    for (int j = 0; j < col; j++) {
+                        float *I = work + i * stride + j;
+                        // compute contrast component
+                        float R = apply_arctg_slope10(
+                            u0[i * col + j], I[0], I[2 * dist], I[4 * dist],
+                            I[6 * dist], I[8 * dist], I[10 * dist],
+                            I[12 * dist]);
+
+                        // project onto the interval [-1,1]
+                        R = max(min(R, 1.f), -1.f);
+                        I[0] = R;
+                        mabsv = max(mabsv, fabs(R));
+                    }
+                }
+            } else {
+#pragma omp parallel for
+                for (int i = 0; i < length; i++) {
+                    contrast[i] = contrastWeight(0, u0[i]);
+                }
 
+                for (int k = 1; k <= powers; k++) {
 #pragma omp parallel for
-            for (int i = 0; i < length; i++) {
-                // compute contrast component
-                u0[i] = apply_arctg_slope10(u0[i], norm * iu[i], norm * u2[i], norm * u3[i],
-                                            norm * u4[i], norm * u5[i], norm * u6[i], norm * u7[i]);
+                    for (int i = 0; i < fil; i++) {
+                        for (int j = 0; j < col; j++) {
+                            const float u = u0[i * col + j];
+                            float uk = u;
+                            for (int p = 1; p < k; p++) {
+                                uk *= u;
+                            }
+                            work[i * stride + j] = uk;
+                        }
+                    }
+
+                    fftwf_execute(pU);
+                    producto(U, G, int(dist), 1);
+                    fftwf_execute(pinvU);
 
-                // project onto the interval [-1,1]
-                u0[i] = max(min(u0[i], 1.f), -1.f);
+#pragma omp parallel for
+                    for (int i = 0; i < fil; i++) {
+                        for (int j = 0; j < col; j++) {
+                            contrast[i * col + j] +=
+                                contrastWeight(k, u0[i * col + j]) *
+                                work[i * stride + j];
+                        }
+                    }
+                }
+
+#pragma omp parallel for reduction(max:mabsv)
+                for (int i = 0; i < fil; i++) {
+                    for (int j = 0; j < col; j++) {
+                        // project onto the interval [-1,1]
+                        const float R =
+                            max(min(contrast[i * col + j], 1.f), -1.f);
+                        work[i * stride + j] = R;
+                        mabsv = max(mabsv, fabs(R));
+                    }
+                }
             }
 
             // normalizing R term to estandarize results
             //
-            float mabsv = fabs(*max_element(u0, u0 + length, abs_compare));
-
             float multiplier = 0.5f / mabsv;
 
             float norm1 = (1.0 + dt * (1.0 + 255.0 / 253.0));  // assuming alpha=255/253,beta=1
 
-#pragma omp parallel for
-            for (int i = 0; i < length; i++) {
-                RGB[color][i] = (RGB[color][i] + dt * (RGBorig[color][i] + multiplier * u0[i] + 255.f / 253.f * med[color])) / norm1;
-                // project onto the interval [0,1]
-                RGB[color][i] = max(min(RGB[color][i], 1.f), 0.f);
+            double mse = 0.0; // use double precision for summations
+            const float *orig = RGBorig[color].data();
+#pragma omp parallel for reduction(+:mse)
+            for (int i = 0; i < fil; i++) {
+                for (int j = 0; j < col; j++) {
+                    const int idx = i * col + j;
+                    const float previous = u0[idx];
+                    float next = (previous + dt * (orig[idx] + multiplier * work[i * stride + j] + 255.f / 253.f * med[color])) / norm1;
+                    // project onto the interval [0,1]
+                    next = max(min(next, 1.f), 0.f);
+                    u0[idx] = next;
+                    mse += fabs(previous - next);
+                }
             }
 
-            float mse = MSE(RGB0, RGB[color], length);
-            difference += mse;
+            difference += mse / length;
         }
         delta = fabs(oldDifference - difference);
         steps = (difference - threshold_diff) / delta;
@@ -636,63 +630,14 @@ void tmo_ferradans11(pfs::Array2Df &imR, pfs::Array2Df &imG, pfs::Array2Df &imB,
         if (iteration > 1) ph.setValue(30 + 69 / (steps + 1));
     }
 
-    FFTW_MUTEX::fftw_mutex_destroy_plan.lock();
-    fftwf_destroy_plan(pU);
-    fftwf_destroy_plan(pU2);
-    fftwf_destroy_plan(pU3);
-    fftwf_destroy_plan(pU4);
-    fftwf_destroy_plan(pU5);
-    fftwf_destroy_plan(pU6);
-    fftwf_destroy_plan(pU7);
-
-    fftwf_destroy_plan(pinvU);
-    fftwf_destroy_plan(pinvU2);
-    fftwf_destroy_plan(pinvU3);
-    fftwf_destroy_plan(pinvU4);
-    fftwf_destroy_plan(pinvU5);
-    fftwf_destroy_plan(pinvU6);
-    fftwf_destroy_plan(pinvU7);
-
-    fftwf_free(RGB0);
-    fftwf_free(u0);
-    fftwf_free(u2);
-    fftwf_free(u3);
-    fftwf_free(u4);
-    fftwf_free(u5);
-    fftwf_free(u6);
-    fftwf_free(u7);
-
-    fftwf_free(iu);
-
-    fftwf_free(U);
-    fftwf_free(U2);
-    fftwf_free(U3);
-    fftwf_free(U4);
-    fftwf_free(U5);
-    fftwf_free(U6);
-    fftwf_free(U7);
-
-    FFTW_MUTEX::fftw_mutex_destroy_plan.unlock();
+    release();
 
     ph.setValue(90);
 
+    // range between (0,1)
     for (int c = 0; c < 3; c++)
         escala(RGB[c], length, 1.f, 0.f);
 
-    // range between (0,1)
-    copy(RGB[0], RGB[0] + length, imR.begin());
-    copy(RGB[1], RGB[1] + length, imG.begin());
-    copy(RGB[2], RGB[2] + length, imB.begin());
-
-    delete[] RGBorig[0];
-    delete[] RGBorig[1];
-    delete[] RGBorig[2];
-    delete[] RGB[0];
-    delete[] RGB[1];
-    delete[] RGB[2];
-    FFTW_MUTEX::fftw_mutex_free.lock();
-    fftwf_free(G);
-    FFTW_MUTEX::fftw_mutex_free.unlock();
 #ifdef TIMER_PROFILING
     stop_watch.stop_and_update();
     cout << endl;
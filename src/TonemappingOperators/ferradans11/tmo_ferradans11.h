@@ -53,8 +53,15 @@ class Progress;
 //! \param imB [In/Out] Blue  Channel
 //! \param rho parameter rho (refer to the paper)
 //! \param inv_alpha parameter inv_alpha (refer to the paper)
+//! \param lowMemory convolve the powers of each channel one at a time instead
+//! of in a single batch: about 7 instead of 12 floats per pixel of working
+//! memory, at the price of more passes over the image
+//! \note The channels are left untouched if \a ph is canceled before the
+//! evolution starts; a cancel during the evolution returns the current
+//! estimate.
 //!
 void tmo_ferradans11(pfs::Array2Df &imR, pfs::Array2Df &imG, pfs::Array2Df &imB,
-                     float rho, float invalpha, pfs::Progress &ph);
+                     float rho, float invalpha, pfs::Progress &ph,
+                     bool lowMemory = false);
 
 #endif
@@ -37,11 +37,13 @@
 #include "Libpfs/progress.h"
 
 #include "tmo_ferwerda96.h"
+#include "TonemappingOperators/pfstmo.h"
 #include "../../sleef.c"
 #include "../../opthelper.h"
 
 void pfstmo_ferwerda96(pfs::Frame &frame, float Ld_Max,
-                        float L_da, pfs::Progress &ph) {
+                        float L_da, pfs::Progress &ph,
+                        Ferwerda96Statistics *stats) {
 
 #ifndef NDEBUG
     //--- default tone mapping parameters;
@@ -70,7 +72,7 @@ void pfstmo_ferwerda96(pfs::Frame &frame, float Ld_Max,
     try {
             tmo_ferwerda96(inX, inY, inZ, &L,
                            Ld_Max, L_da,
-                           ph);
+                           ph, stats);
     } catch (...) {
         throw pfs::Exception("Tonemapping Failed!");
     }
@@ -36,6 +36,7 @@
 #include "Libpfs/progress.h"
 #include "Libpfs/utils/msec_timer.h"
 #include "tmo_ferwerda96.h"
+#include "TonemappingOperators/pfstmo.h"
 
 namespace {
     float TpFerwerda(float x)
@@ -85,7 +86,7 @@ using namespace std;
 
 int tmo_ferwerda96(Array2Df *X, Array2Df *Y, Array2Df *Z, Array2Df *L,
                     float mul1, float mul2,
-                    Progress &ph) {
+                    Progress &ph, Ferwerda96Statistics *stats) {
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
     stop_watch.start();
@@ -99,7 +100,25 @@ int tmo_ferwerda96(Array2Df *X, Array2Df *Y, Array2Df *Z, Array2Df *L,
     mul2 /= 1000.f;
 
     float Ld_Max = 100.f * mul1;
-    float L_wa = *max_element(L->begin(), L->end()) * 0.5f * mul1;
+    float maxL;
+    float maxC;
+    if (stats && stats->valid) {
+        maxL = stats->maxLum;
+        maxC = stats->maxChannel;
+    } else {
+        maxL = *max_element(L->begin(), L->end());
+        float maxX = *max_element(X->begin(), X->end());
+        float maxY = *max_element(Y->begin(), Y->end());
+        float maxZ = *max_element(Z->begin(), Z->end());
+        maxC = max(maxX, max(maxY, maxZ));
+        if (stats) {
+            stats->maxLum = maxL;
+            stats->maxChannel = maxC;
+            stats->valid = true;
+        }
+    }
+
+    float L_wa = maxL * 0.5f * mul1;
 
     float L_da = mul2 * Ld_Max;
 
@@ -112,10 +131,6 @@ int tmo_ferwerda96(Array2Df *X, Array2Df *Y, Array2Df *Z, Array2Df *L,
     if (ph.canceled()) return 0;
 
     float vec[3] = {1.05f, 0.97f, 1.27f};
-    float maxX = *max_element(X->begin(), X->end());
-    float maxY = *max_element(Y->begin(), Y->end());
-    float maxZ = *max_element(Z->begin(), Z->end());
-    float maxC = max(maxX, max(maxY, maxZ));
     float scale = 1.0f / maxC;
 
     ph.setValue(10);
@@ -30,12 +30,15 @@
 #ifndef TMO_FERWERDA_H
 #define TMO_FERWERDA_H
 
+#include <cstddef>
+
 #include <Libpfs/array2d_fwd.h>
 
 namespace pfs {
 class Frame;
 class Progress;
 }
+struct Ferwerda96Statistics;
 
 //! \brief A. Ferwerda tone mapping operator
 //!
@@ -43,9 +46,10 @@ class Progress;
 //! \param X, Y, Z [out] tone mapped values
 //! \param Ld_Max: maximum luminance of the display in cd/m^2
 //! \param L_da: adaptation luminance in cd/m^2
+//! \param stats: statistics of the whole image, see TonemapOperatorStatistics
 //!
 int tmo_ferwerda96(pfs::Array2Df *X, pfs::Array2Df *Y, pfs::Array2Df *Z, pfs::Array2Df *L,
                     float Ld_Max, float L_da,
-                    pfs::Progress &ph);
+                    pfs::Progress &ph, Ferwerda96Statistics *stats = NULL);
 
 #endif  // TMO_FERWERDA_H
@@ -40,13 +40,14 @@
 #include "Libpfs/progress.h"
 
 #include "tmo_kimkautz08.h"
+#include "TonemappingOperators/pfstmo.h"
 #include "../../opthelper.h"
 #include "../../sleef.c"
 
 using namespace pfs;
 
 void pfstmo_kimkautz08(Frame &frame, float KK_c1, float KK_c2,
-                        Progress &ph) {
+                        Progress &ph, KimKautz08Statistics *stats) {
 
 #ifndef NDEBUG
     //--- default tone mapping parameters;
@@ -75,7 +76,7 @@ void pfstmo_kimkautz08(Frame &frame, float KK_c1, float KK_c2,
     copy(L.begin(), L.end(), Lold.begin());
 
     try {
-            tmo_kimkautz08(L, KK_c1, KK_c2, ph);
+            tmo_kimkautz08(L, KK_c1, KK_c2, ph, stats);
     } catch (...) {
         throw Exception("Tonemapping Failed!");
     }
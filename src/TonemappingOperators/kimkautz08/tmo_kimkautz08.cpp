@@ -42,6 +42,8 @@
 #include <Libpfs/colorspace/normalizer.h>
 #include "Libpfs/utils/msec_timer.h"
 #include "tmo_kimkautz08.h"
+#include "TonemappingOperators/pfstmo.h"
+#include "TonemappingOperators/tonecurve.h"
 #include "sleef.c"
 #include "opthelper.h"
 
@@ -51,7 +53,7 @@ using namespace pfs::colorspace;
 
 int tmo_kimkautz08(Array2Df &L,
                     float KK_c1, float KK_c2,
-                    Progress &ph) {
+                    Progress &ph, KimKautz08Statistics *stats) {
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
     stop_watch.start();
@@ -120,6 +122,16 @@ int tmo_kimkautz08(Array2Df &L,
     ph.setValue(25);
     if (ph.canceled()) return 0;
 
+    if (stats && stats->valid) {
+        sum = stats->logMean * (w * h);
+        minVal = stats->logMin;
+        maxVal = stats->logMax;
+    } else if (stats) {
+        stats->logMean = sum / (w * h);
+        stats->logMin = minVal;
+        stats->logMax = maxVal;
+    }
+
     const float mu = sum / (w * h);
 
     const float maxLd = logf(300.f);
@@ -130,57 +142,82 @@ int tmo_kimkautz08(Array2Df &L,
     const float sigma = d0 / KK_c1;
     const float sigma_sq_2 = sigma*sigma * 2;
 
+    // large images: both steps below only depend on the luminance, compile
+    // them into one lookup table
+    bool tabulated = false;
+    if (ToneCurveLUT::worthwhile(w * h)) {
+        const ToneCurveLUT lut(
+            [=](float Lv) {
+                const float weight = (1 - k1) * xexpf(-(Lv - mu)*(Lv - mu) / sigma_sq_2) + k1;
+                return xexpf(KK_c2 * weight * (xlogf(Lv + 1e-6f) - mu) + mu);
+            },
+            0.999f * (xexpf(minVal) - 1e-6f), 1.001f * (xexpf(maxVal) - 1e-6f), 1e-5f);
+        if (lut.valid()) {
 #ifdef _OPENMP
-    #pragma omp parallel
+            #pragma omp parallel for schedule(dynamic, 16)
 #endif
-    {
+            for (int i = 0; i < h; i++) {
+                for (int j = 0; j < w; ++j) {
+                    L(j, i) = lut(L(j, i));
+                }
+            }
+            tabulated = true;
+        }
+    }
+
+    if (!tabulated) {
+#ifdef _OPENMP
+        #pragma omp parallel
+#endif
+        {
 #ifdef __SSE2__
-        const vfloat sigma_sq_2v = F2V(sigma_sq_2);
-        const vfloat muv = F2V(mu);
-        const vfloat k1v = F2V(k1);
-        const vfloat onevmk1v = F2V(1.f - k1);
+            const vfloat sigma_sq_2v = F2V(sigma_sq_2);
+            const vfloat muv = F2V(mu);
+            const vfloat k1v = F2V(k1);
+            const vfloat onevmk1v = F2V(1.f - k1);
 
 #endif
 #ifdef _OPENMP
-        #pragma omp for schedule(dynamic, 16)
+            #pragma omp for schedule(dynamic, 16)
 #endif
-        for (int i = 0; i < h; i++) {
-            int j = 0;
+            for (int i = 0; i < h; i++) {
+                int j = 0;
 #ifdef __SSE2__
-            for (; j < w - 3; j += 4) {
-                const vfloat Lv = LVFU(L(j, i));
-                STVFU(L(j, i), onevmk1v * xexpf(-SQRV(Lv - muv) / sigma_sq_2v) + k1v);
-            }
+                for (; j < w - 3; j += 4) {
+                    const vfloat Lv = LVFU(L(j, i));
+                    STVFU(L(j, i), onevmk1v * xexpf(-SQRV(Lv - muv) / sigma_sq_2v) + k1v);
+                }
 #endif
-            for (; j < w; ++j) {
-                L(j, i) = (1 - k1) * xexpf(-(L(j, i) - mu)*(L(j, i) - mu) / sigma_sq_2) + k1;
+                for (; j < w; ++j) {
+                    L(j, i) = (1 - k1) * xexpf(-(L(j, i) - mu)*(L(j, i) - mu) / sigma_sq_2) + k1;
+                }
             }
         }
-    }
 
-    ph.setValue(50);
-    if (ph.canceled()) return 0;
+        ph.setValue(50);
+        if (ph.canceled()) return 0;
 
 #ifdef _OPENMP
-    #pragma omp parallel
+        #pragma omp parallel
 #endif
-    {
+        {
 #ifdef __SSE2__
-        const vfloat KK_c2v = F2V(KK_c2);
-        const vfloat muv = F2V(mu);
+            const vfloat KK_c2v = F2V(KK_c2);
+            const vfloat muv = F2V(mu);
 #endif
 #ifdef _OPENMP
-        #pragma omp for schedule(dynamic, 16)
+            #pragma omp for schedule(dynamic, 16)
 #endif
-        for (int i = 0; i < h; i++) {
-            int j = 0;
+            for (int i = 0; i < h; i++) {
+                int j = 0;
 #ifdef __SSE2__
-            for (; j < w - 3; j += 4) {
-                STVFU(L(j, i), xexpf(KK_c2v * LVFU(L(j, i)) * (LVFU(L_log(j, i)) - muv) + muv));
-            }
+                for (; j < w - 3; j += 4) {
+                    STVFU(L(j, i), xexpf(KK_c2v * LVFU(L(j, i)) * (LVFU(L_log(j, i)) - muv) + muv));
+                }
 #endif
-            for (; j < w; ++j) {
-                L(j, i) = xexpf(KK_c2 * L(j, i) * (L_log(j, i) - mu) + mu);
+                for (; j < w; ++j) {
+                    L(j, i) = xexpf(KK_c2 * L(j, i) * (L_log(j, i) - mu) + mu);
+                }
             }
         }
     }
@@ -189,7 +226,17 @@ int tmo_kimkautz08(Array2Df &L,
     if (ph.canceled()) return 0;
 
     //Percentile clamping
-    lhdrengine::findMinMaxPercentile(L.data(), L.getCols() * L.getRows(), 0.01f, minVal, 0.99f, maxVal, true);
+    if (stats && stats->valid) {
+        minVal = stats->outputMin;
+        maxVal = stats->outputMax;
+    } else {
+        lhdrengine::findMinMaxPercentile(L.data(), L.getCols() * L.getRows(), 0.01f, minVal, 0.99f, maxVal, true);
+        if (stats) {
+            stats->outputMin = minVal;
+            stats->outputMax = maxVal;
+            stats->valid = true;
+        }
+    }
 
     const float range = maxVal - minVal;
 #ifdef _OPENMP
@@ -32,12 +32,15 @@
 #ifndef TMO_KIMKAUTZ_H
 #define TMO_KIMKAUTZ_H
 
+#include <cstddef>
+
 #include <Libpfs/array2d_fwd.h>
 
 namespace pfs {
 class Frame;
 class Progress;
 }
+struct KimKautz08Statistics;
 
 //! \brief Min H. Kim, Jan Kautz tone mapping operator
 //!
@@ -50,9 +53,11 @@ class Progress;
 //!         KK_c2  the ratio between the dynamic range (in log10) of an
 //!                8-bit imag (2.4) and the dynamic range (in log10) of the
 //!                LDR monitor for visualization
+//!         stats  statistics of the whole image, see
+//!                TonemapOperatorStatistics
 //!
 int tmo_kimkautz08(pfs::Array2Df &L,
                     float KK_c1, float KK_c2,
-                    pfs::Progress &ph);
+                    pfs::Progress &ph, KimKautz08Statistics *stats = NULL);
 
 #endif  // TMO_KIMKAUTZ_H
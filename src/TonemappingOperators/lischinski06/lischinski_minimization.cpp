@@ -37,6 +37,12 @@
  *
  */
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
 #include <Eigen/Sparse>
 #include <Eigen/src/SparseCore/SparseMatrix.h>
 
@@ -54,32 +60,22 @@ inline float LischinskiFunction(float Lcur, float Lref, float param[2],
     return -param[1] / (powf(fabsf(Lcur - Lref), param[0]) + LISCHINSKI_EPSILON);
 }
 
-void LischinskiMinimization(Array2Df &L_orig, Array2Df &g_orig, Array2Df &F,
-                            float alpha, float lambda, float LISCHINSKI_EPSILON, float omega) {
-
-    const int orig_width = L_orig.getCols();
-    const int orig_height = L_orig.getRows();
-
-    int xSize = 512;
-
-    if (orig_width < 2*xSize)
-        xSize = 256;
-
-    const int width = xSize;
-    const int height = (int)(orig_height * (float)xSize /
-                      (float)orig_width);
+namespace {
 
+//! \brief Direct (sparse Cholesky) solve of the Lischinski system on the
+//! whole grid of \a L. Only suitable for small grids.
+void LischinskiDirectSolve(const Array2Df &L, const Array2Df &g, Array2Df &F,
+                           float alpha, float lambda, float LISCHINSKI_EPSILON,
+                           float omega) {
+    const int width = L.getCols();
+    const int height = L.getRows();
     const int size = height * width;
-    Array2Df L(width, height);
-    Array2Df g(width, height);
-
-    resize(&L_orig, &L, BilinearInterp);
-    resize(&g_orig, &g, BilinearInterp);
 
     Eigen::VectorXf b, x;
     b = Eigen::VectorXf::Zero(size);
 
     std::vector< Eigen::Triplet< float > > tL;
+    tL.reserve(5 * size);
 
     float param[2];
     param[0] = alpha;
@@ -144,8 +140,6 @@ void LischinskiMinimization(Array2Df &L_orig, Array2Df &g_orig, Array2Df &F,
         throw pfs::Exception("SOLVER FAILED");
     }
 
-    Array2Df F_res(width, height);
-
 #ifdef _OPENMP
     #pragma omp parallel for
 #endif
@@ -154,13 +148,441 @@ void LischinskiMinimization(Array2Df &L_orig, Array2Df &g_orig, Array2Df &F,
         int counter = i * width;
 #ifdef __SSE2__
         for (; j < width - 3; j += 4) {
-             STVFU(F_res(j, i), LVFU(x(counter + j)));
+             STVFU(F(j, i), LVFU(x(counter + j)));
         }
 #endif
         for (; j < width; ++j) {
-            F_res(j, i) =  x(counter + j);
+            F(j, i) =  x(counter + j);
+        }
+    }
+}
+
+//! \brief One level of the matrix-free Lischinski system
+//! A = diag(mass) + weighted graph Laplacian of the 4-connected grid.
+//! Only the two forward edge weights of each node are stored: \c wE couples
+//! (x, y) with (x + 1, y), \c wS couples (x, y) with (x, y + 1). The diagonal is
+//! rebuilt on the fly from \c mass and the four incident edges.
+struct LischinskiStencil {
+    LischinskiStencil(int width, int height)
+        : width(width), height(height),
+          wE(width, height), wS(width, height), mass(width, height) {}
+
+    inline float diagonal(int j, int i) const {
+        float d = mass(j, i) + wE(j, i) + wS(j, i);
+        if (j > 0) d += wE(j - 1, i);
+        if (i > 0) d += wS(j, i - 1);
+        return d;
+    }
+
+    inline float neighbours(const Array2Df &x, int j, int i) const {
+        float v = 0.f;
+        if (j > 0) v += wE(j - 1, i) * x(j - 1, i);
+        if (j + 1 < width) v += wE(j, i) * x(j + 1, i);
+        if (i > 0) v += wS(j, i - 1) * x(j, i - 1);
+        if (i + 1 < height) v += wS(j, i) * x(j, i + 1);
+        return v;
+    }
+
+    //! \brief out = A * in
+    void apply(const Array2Df &in, Array2Df &out) const {
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < height; ++i) {
+            for (int j = 0; j < width; ++j) {
+                out(j, i) = diagonal(j, i) * in(j, i) - neighbours(in, j, i);
+            }
+        }
+    }
+
+    //! \brief r = b - A * x
+    void residual(const Array2Df &x, const Array2Df &b, Array2Df &r) const {
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < height; ++i) {
+            for (int j = 0; j < width; ++j) {
+                r(j, i) = b(j, i) - diagonal(j, i) * x(j, i) + neighbours(x, j, i);
+            }
+        }
+    }
+
+    //! \brief Red-black Gauss-Seidel sweep. The backward sweep visits the
+    //! colours in reverse order, so that a forward/backward pair is symmetric
+    void smooth(Array2Df &x, const Array2Df &b, bool forward) const {
+        for (int c = 0; c < 2; ++c) {
+            const int colour = forward ? c : 1 - c;
+#ifdef _OPENMP
+            #pragma omp parallel for
+#endif
+            for (int i = 0; i < height; ++i) {
+                for (int j = (i + colour) & 1; j < width; j += 2) {
+                    x(j, i) = (b(j, i) + neighbours(x, j, i)) / diagonal(j, i);
+                }
+            }
+        }
+    }
+
+    const int width;
+    const int height;
+    Array2Df wE;
+    Array2Df wS;
+    Array2Df mass;
+};
+
+//! \brief Aggregation multigrid hierarchy of the Lischinski system
+//!
+//! Coarse levels are the Galerkin products P^T A P, with P the piecewise
+//! constant interpolation over 2x2 aggregates: they keep the 5-point structure,
+//! the edge weights of an aggregate being the sum of the fine edges that cross
+//! its border. Edges across strong luminance discontinuities stay weak on
+//! every level, so the hierarchy follows the image edges.
+class LischinskiMultigrid {
+   public:
+    LischinskiMultigrid(const Array2Df &L, float alpha, float lambda,
+                        float LISCHINSKI_EPSILON, float omega) {
+        const int width = L.getCols();
+        const int height = L.getRows();
+
+        m_levels.push_back(LevelPtr(new Level(width, height)));
+        LischinskiStencil &A = m_levels.back()->A;
+
+        float param[2];
+        param[0] = alpha;
+        param[1] = lambda;
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < height; ++i) {
+            for (int j = 0; j < width; ++j) {
+                const float Lref = L(j, i);
+                A.wE(j, i) = (j + 1 < width)
+                    ? -LischinskiFunction(L(j + 1, i), Lref, param, LISCHINSKI_EPSILON)
+                    : 0.f;
+                A.wS(j, i) = (i + 1 < height)
+                    ? -LischinskiFunction(L(j, i + 1), Lref, param, LISCHINSKI_EPSILON)
+                    : 0.f;
+                A.mass(j, i) = omega;
+            }
+        }
+
+        while (m_levels.back()->A.width * m_levels.back()->A.height > s_coarsestSize &&
+               m_levels.back()->A.width > 1 && m_levels.back()->A.height > 1) {
+            coarsen();
+        }
+        factorizeCoarsest();
+    }
+
+    const LischinskiStencil &fine() const { return m_levels.front()->A; }
+
+    //! \brief z = M^-1 * r, one symmetric V-cycle started from zero
+    void precondition(const Array2Df &r, Array2Df &z) {
+        Level &top = *m_levels.front();
+        std::copy(r.begin(), r.end(), top.b.begin());
+        vcycle(0);
+        std::copy(top.x.begin(), top.x.end(), z.begin());
+    }
+
+   private:
+    struct Level {
+        Level(int width, int height)
+            : A(width, height), x(width, height),
+              b(width, height), r(width, height) {}
+
+        LischinskiStencil A;
+        Array2Df x;
+        Array2Df b;
+        Array2Df r;
+    };
+    typedef std::unique_ptr<Level> LevelPtr;
+
+    static const int s_coarsestSize = 4096;
+    static const int s_smoothingSteps = 2;
+
+    void coarsen() {
+        const LischinskiStencil &F = m_levels.back()->A;
+        const int width = (F.width + 1) / 2;
+        const int height = (F.height + 1) / 2;
+
+        LevelPtr coarse(new Level(width, height));
+        LischinskiStencil &C = coarse->A;
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < height; ++i) {
+            const int i0 = 2 * i;
+            const int i1 = std::min(i0 + 1, F.height - 1);
+            for (int j = 0; j < width; ++j) {
+                const int j0 = 2 * j;
+                const int j1 = std::min(j0 + 1, F.width - 1);
+
+                float mass = F.mass(j0, i0);
+                if (j1 != j0) mass += F.mass(j1, i0);
+                if (i1 != i0) mass += F.mass(j0, i1);
+                if (j1 != j0 && i1 != i0) mass += F.mass(j1, i1);
+                C.mass(j, i) = mass;
+
+                // edges leaving the aggregate to the east and to the south
+                float we = 0.f;
+                if (j + 1 < width) {
+                    we = F.wE(j1, i0);
+                    if (i1 != i0) we += F.wE(j1, i1);
+                }
+                C.wE(j, i) = we;
+
+                float ws = 0.f;
+                if (i + 1 < height) {
+                    ws = F.wS(j0, i1);
+                    if (j1 != j0) ws += F.wS(j1, i1);
+                }
+                C.wS(j, i) = ws;
+            }
+        }
+
+        m_levels.push_back(std::move(coarse));
+    }
+
+    void factorizeCoarsest() {
+        const LischinskiStencil &C = m_levels.back()->A;
+        const int width = C.width;
+        const int size = C.width * C.height;
+
+        std::vector< Eigen::Triplet< float > > tL;
+        tL.reserve(5 * size);
+        for (int i = 0; i < C.height; ++i) {
+            for (int j = 0; j < width; ++j) {
+                const int indI = i * width + j;
+                tL.push_back(Eigen::Triplet< float >(indI, indI, C.diagonal(j, i)));
+                if (j > 0) tL.push_back(Eigen::Triplet< float >(indI, indI - 1, -C.wE(j - 1, i)));
+                if (j + 1 < width) tL.push_back(Eigen::Triplet< float >(indI, indI + 1, -C.wE(j, i)));
+                if (i > 0) tL.push_back(Eigen::Triplet< float >(indI, indI - width, -C.wS(j, i - 1)));
+                if (i + 1 < C.height) tL.push_back(Eigen::Triplet< float >(indI, indI + width, -C.wS(j, i)));
+            }
+        }
+
+        Eigen::SparseMatrix<float> A(size, size);
+        A.setFromTriplets(tL.begin(), tL.end());
+        m_coarseSolver.compute(A);
+
+        if (m_coarseSolver.info() != Eigen::Success) {
+            throw pfs::Exception("SOLVER FAILED");
+        }
+    }
+
+    void vcycle(size_t l) {
+        Level &level = *m_levels[l];
+        const LischinskiStencil &A = level.A;
+
+        if (l + 1 == m_levels.size()) {
+            const Eigen::Map<const Eigen::VectorXf> b(level.b.data(), level.b.size());
+            Eigen::Map<Eigen::VectorXf> x(level.x.data(), level.x.size());
+            x = m_coarseSolver.solve(b);
+            return;
+        }
+
+        level.x.fill(0.f);
+        for (int s = 0; s < s_smoothingSteps; ++s) {
+            A.smooth(level.x, level.b, true);
+        }
+        A.residual(level.x, level.b, level.r);
+
+        // restriction: sum of the residual over each aggregate
+        Level &coarse = *m_levels[l + 1];
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < coarse.A.height; ++i) {
+            const int i0 = 2 * i;
+            const int i1 = std::min(i0 + 1, A.height - 1);
+            for (int j = 0; j < coarse.A.width; ++j) {
+                const int j0 = 2 * j;
+                const int j1 = std::min(j0 + 1, A.width - 1);
+                float v = level.r(j0, i0);
+                if (j1 != j0) v += level.r(j1, i0);
+                if (i1 != i0) v += level.r(j0, i1);
+                if (j1 != j0 && i1 != i0) v += level.r(j1, i1);
+                coarse.b(j, i) = v;
+            }
+        }
+
+        vcycle(l + 1);
+
+        // prolongation: piecewise constant over each aggregate
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < A.height; ++i) {
+            for (int j = 0; j < A.width; ++j) {
+                level.x(j, i) += coarse.x(j / 2, i / 2);
+            }
+        }
+
+        for (int s = 0; s < s_smoothingSteps; ++s) {
+            A.smooth(level.x, level.b, false);
+        }
+    }
+
+    std::vector<LevelPtr> m_levels;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<float> > m_coarseSolver;
+};
+
+double dotProduct(const Array2Df &a, const Array2Df &b) {
+    const int size = a.size();
+    double sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:sum)
+#endif
+    for (int i = 0; i < size; ++i) {
+        sum += double(a(i)) * double(b(i));
+    }
+    return sum;
+}
+
+//! \brief Multigrid preconditioned conjugate gradient on the matrix-free
+//! stencil. \a x holds the initial guess on entry and the solution on exit.
+//! Returns the relative residual |b - Ax| / |b|, and warns on std::cerr when
+//! it is still above \a tolerance, as the other iterative solvers do.
+float LischinskiPCGSolve(LischinskiMultigrid &M, const Array2Df &g,
+                        Array2Df &x, float omega, float tolerance,
+                        int maxIterations) {
+    const LischinskiStencil &A = M.fine();
+    const int size = A.width * A.height;
+
+    Array2Df b(A.width, A.height);
+    Array2Df r(A.width, A.height);
+    Array2Df z(A.width, A.height);
+    Array2Df p(A.width, A.height);
+    Array2Df q(A.width, A.height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < size; ++i) {
+        b(i) = omega * g(i);
+    }
+
+    const double bb = dotProduct(b, b);
+    if (bb == 0.0) {
+        x.fill(0.f);
+        return 0.f;
+    }
+    const double threshold = double(tolerance) * tolerance * bb;
+
+    A.residual(x, b, r);
+    double rr = dotProduct(r, r);
+    if (rr <= threshold) return float(std::sqrt(rr / bb));
+
+    M.precondition(r, z);
+    std::copy(z.begin(), z.end(), p.begin());
+    double rz = dotProduct(r, z);
+
+    int it = 0;
+    bool unstable = false;
+    for (; it < maxIterations; ++it) {
+        A.apply(p, q);
+        const double pq = dotProduct(p, q);
+        if (pq <= 0.0) {
+            unstable = true;
+            break;
         }
+        const float a = float(rz / pq);
+
+        rr = 0.0;
+#ifdef _OPENMP
+        #pragma omp parallel for reduction(+:rr)
+#endif
+        for (int i = 0; i < size; ++i) {
+            x(i) += a * p(i);
+            r(i) -= a * q(i);
+            rr += double(r(i)) * r(i);
+        }
+
+        if (rr <= threshold) break;
+
+        M.precondition(r, z);
+        const double rz_new = dotProduct(r, z);
+        const float beta = float(rz_new / rz);
+        rz = rz_new;
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < size; ++i) {
+            p(i) = z(i) + beta * p(i);
+        }
+    }
+
+    const float error = float(std::sqrt(rr / bb));
+    if (rr > threshold) {
+        std::cerr << std::endl
+                  << "lischinski06: Warning: Not converged "
+                  << (unstable ? "(going unstable)"
+                               : "(hit maximum iterations)")
+                  << ", error = " << error << " (should be below "
+                  << tolerance << ")" << std::endl;
+    }
+    return error;
+}
+
+}  // namespace
+
+void LischinskiMinimization(Array2Df &L_orig, Array2Df &g_orig, Array2Df &F,
+                            float alpha, float lambda, float LISCHINSKI_EPSILON, float omega,
+                            int solveWidth) {
+
+    const int orig_width = L_orig.getCols();
+    const int orig_height = L_orig.getRows();
+
+    int xSize = 512;
+
+    if (orig_width < 2*xSize)
+        xSize = 256;
+
+    // coarse direct solve: on its own it is the legacy result, otherwise
+    // it is the warm start for the iterative refinement
+    const int width = xSize;
+    const int height = std::max(1, (int)(orig_height * (float)xSize /
+                      (float)orig_width));
+
+    Array2Df L(width, height);
+    Array2Df g(width, height);
+
+    resize(&L_orig, &L, BilinearInterp);
+    resize(&g_orig, &g, BilinearInterp);
+
+    Array2Df F_res(width, height);
+    LischinskiDirectSolve(L, g, F_res, alpha, lambda, LISCHINSKI_EPSILON, omega);
+
+    const int targetWidth = (solveWidth > 0) ? std::min(solveWidth, orig_width)
+                                             : orig_width;
+    if (targetWidth <= xSize) {
+        resize(&F_res, &F, BilinearInterp);
+        return;
     }
 
-    resize(&F_res, &F, BilinearInterp);
+    // matrix-free refinement at the requested resolution
+    const int targetHeight = std::max(1, (int)(orig_height * (float)targetWidth /
+                                      (float)orig_width));
+    const bool fullResolution = (targetWidth == orig_width);
+
+    Array2Df x(targetWidth, targetHeight);
+    resize(&F_res, &x, BilinearInterp);
+
+    if (fullResolution) {
+        // F may alias L_orig: the stencil is built before F is written
+        LischinskiMultigrid M(L_orig, alpha, lambda, LISCHINSKI_EPSILON, omega);
+        LischinskiPCGSolve(M, g_orig, x, omega, 1e-3f, 200);
+        F.swap(x);
+    } else {
+        Array2Df Lt(targetWidth, targetHeight);
+        Array2Df gt(targetWidth, targetHeight);
+        resize(&L_orig, &Lt, BilinearInterp);
+        resize(&g_orig, &gt, BilinearInterp);
+
+        LischinskiMultigrid M(Lt, alpha, lambda, LISCHINSKI_EPSILON, omega);
+        LischinskiPCGSolve(M, gt, x, omega, 1e-3f, 200);
+        resize(&x, &F, BilinearInterp);
+    }
 }
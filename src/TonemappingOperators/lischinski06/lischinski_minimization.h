@@ -42,12 +42,21 @@
 
 #include "Libpfs/array2d_fwd.h"
 
+//! \brief Solve the Lischinski minimization for the exposure map \a F
+//!
+//! The system is first solved directly on a 256/512 pixels wide grid. When a
+//! larger \a solveWidth is requested (0 means the width of \a L) the coarse
+//! solution is used as warm start of a matrix-free conjugate gradient over
+//! the 5-point stencil at that resolution, preconditioned by a multigrid
+//! V-cycle. A warning is printed if it does not converge.
+//! \note \a F may be the same array as \a L
 void LischinskiMinimization(pfs::Array2Df &L,
                             pfs::Array2Df &g,
                             pfs::Array2Df &F,
                             float alpha = 1.0f,
                             float lambda = 0.4f,
                             float LISCHINSKI_EPSILON = 1e-4f,
-                            float omega = 0.07f);
+                            float omega = 0.07f,
+                            int solveWidth = 0);
 
 #endif // LISCHINSKI_MINIMIZATION_H
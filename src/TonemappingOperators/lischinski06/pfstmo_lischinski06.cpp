@@ -45,6 +45,7 @@
 
 #include "Libpfs/colorspace/colorspace.h"
 #include "Libpfs/frame.h"
+#include "Libpfs/manip/statistics.h"
 #include "Libpfs/progress.h"
 
 #include "tmo_lischinski06.h"
@@ -52,16 +53,22 @@
 using namespace pfs;
 
 void pfstmo_lischinski06(Frame &frame, float alpha_mul,
-                         Progress &ph) {
+                         Progress &ph, int solveWidth) {
 
 #ifndef NDEBUG
     //--- default tone mapping parameters;
     std::cout << "pfstmo_lischinski06 (";
-    std::cout << "alpha_mul: " << alpha_mul << ")" << std::endl;
+    std::cout << "alpha_mul: " << alpha_mul;
+    std::cout << ", solveWidth: " << solveWidth << ")" << std::endl;
 #endif
 
     ph.setValue(0);
 
+    // read before the channels are taken for writing, which drops the
+    // statistics of the frame
+    const float Lav = std::exp(
+        frame.statistics().meanLog(FrameStatistics::LUMINANCE, 1e-6f));
+
     Channel *inX, *inY, *inZ;
     frame.getXYZChannels(inX, inY, inZ);
     assert(inX != NULL);
@@ -79,7 +86,8 @@ void pfstmo_lischinski06(Frame &frame, float alpha_mul,
     transformRGB2Y(inX, inY, inZ, &L);
 
     try {
-            tmo_lischinski06(L, *inX, *inY, *inZ, alpha_mul, ph);
+            tmo_lischinski06(L, *inX, *inY, *inZ, alpha_mul, Lav, ph,
+                             solveWidth);
     } catch (...) {
         throw Exception("Tonemapping Failed!");
     }
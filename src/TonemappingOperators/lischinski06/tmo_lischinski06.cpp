@@ -58,54 +58,9 @@
 using namespace std;
 using namespace pfs;
 
-float LogMeanVal(const Array2Df &L) {
-    const size_t height = L.getRows();
-    const size_t width = L.getCols();
-    const size_t size = width*height;
-    constexpr float eps = 1e-6f;
-
-    float avg_loglum = 0.f;
-
-#ifdef _OPENMP
-    #pragma omp parallel
-#endif
-    {
-#ifdef __SSE2__
-        vfloat avg_loglumv = ZEROV;
-        vfloat epsv = F2V(eps);
-#endif
-#ifdef _OPENMP
-        #pragma omp for reduction(+:avg_loglum) nowait
-#endif
-        for (size_t j = 0; j < height; ++j) {
-            size_t i = 0;
-#ifdef __SSE2__
-            for (; i < width - 3; i += 4) {
-                vfloat value = xlogf(LVFU(L(i,j)) + epsv);
-                avg_loglumv += value;
-            }
-#endif
-            for (; i < width; ++i) {
-                float value = xlogf(L(i,j) + eps);
-                avg_loglum += value;
-            }
-        }
-
-#ifdef _OPENMP
-        #pragma omp critical
-#endif
-        {
-#ifdef __SSE2__
-            avg_loglum += vhadd(avg_loglumv);
-#endif
-        }
-    }
-    return xexpf(avg_loglum / size);
-}
-
 int tmo_lischinski06(Array2Df &L,Array2Df &inX, Array2Df &inY, Array2Df &inZ,
-                     const float alpha_mul,
-                     Progress &ph) {
+                     const float alpha_mul, const float Lav,
+                     Progress &ph, const int solveWidth) {
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
     stop_watch.start();
@@ -122,7 +77,6 @@ int tmo_lischinski06(Array2Df &L,Array2Df &inX, Array2Df &inY, Array2Df &inZ,
     lhdrengine::findMinMaxPercentile(L.data(), L.getCols() * L.getRows(), 0.01f, minL, 0.99f, maxL, true);
 
     const float invLOG2 = 1.0f/xlogf(2.0f);
-    const float Lav = LogMeanVal(L);
     const float maxL_log = xlogf(maxL + eps) * invLOG2;
     const float minL_log = xlogf(minL + eps) * invLOG2;
 
@@ -240,7 +194,8 @@ int tmo_lischinski06(Array2Df &L,Array2Df &inX, Array2Df &inY, Array2Df &inZ,
     if (ph.canceled()) return 0;
 
     //Lischinski minimization
-    LischinskiMinimization(L, fstopMap, L);
+    LischinskiMinimization(L, fstopMap, L, 1.0f, 0.4f, 1e-4f, 0.07f,
+                           solveWidth);
 
     ph.setValue(85);
     if (ph.canceled()) return 0;
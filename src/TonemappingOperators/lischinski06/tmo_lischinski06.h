@@ -54,9 +54,12 @@ class Progress;
 //!        inY           [out] image green channel
 //!        inZ           [out] image blue channel
 //!        alpha_mul     multiplier value of exposure of the image
+//!        Lav           logarithmic average of \a L, exp(mean(log(L + 1e-6)))
+//!        solveWidth    width of the grid the exposure map is solved on, 0
+//!                      for the width of \a L, see LischinskiMinimization
 //!
 int tmo_lischinski06(pfs::Array2Df &L, pfs::Array2Df &inX, pfs::Array2Df &inY, pfs::Array2Df &inZ,
-                     float alpha_mul,
-                     pfs::Progress &ph);
+                     float alpha_mul, float Lav,
+                     pfs::Progress &ph, int solveWidth = 0);
 
 #endif  // TMO_LISCHINSKI_H
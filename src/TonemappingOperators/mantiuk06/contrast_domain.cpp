@@ -344,6 +344,24 @@ namespace {
 const float CUT_MARGIN = 0.1f;
 const float DISP_DYN_RANGE = 2.3f;
 
+//! \brief What tmo_mantiuk06_contmap() derives from the input alone: the
+//! gradient pyramid of the log-luminance. The solver always starts from the
+//! input, so a run gives the same result whether the pyramid is reused or not.
+struct Mantiuk06Cache : public TonemapOperatorCache::Entry {
+    explicit Mantiuk06Cache(const PyramidT &gradients) : gradients(gradients) {}
+
+    size_t bytes() const {
+        size_t size = 0;
+        for (PyramidT::const_iterator it = gradients.begin();
+             it != gradients.end(); ++it) {
+            size += 2 * it->size();
+        }
+        return size * sizeof(float);
+    }
+
+    PyramidT gradients;
+};
+
 void normalizeLuminanceAndRGB(Array2Df &R, Array2Df &G, Array2Df &B,
                               Array2Df &Y) {
     const float Ymax = utils::maxElement(Y.data(), Y.size());
@@ -439,7 +457,8 @@ void denormalizeRGB(Array2Df &R, Array2Df &G, Array2Df &B, const Array2Df &Y,
 int tmo_mantiuk06_contmap(Array2Df &R, Array2Df &G, Array2Df &B, Array2Df &Y,
                           const float contrastFactor,
                           const float saturationFactor, float detailfactor,
-                          const int itmax, const float tol, Progress &ph) {
+                          const int itmax, const float tol, Progress &ph,
+                          TonemapOperatorCache *cache) {
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
     stop_watch.start();
@@ -463,7 +482,13 @@ int tmo_mantiuk06_contmap(Array2Df &R, Array2Df &G, Array2Df &B, Array2Df &Y,
     ph.setValue(6);
 
     // calculate gradients for pyramid (Y won't be changed)
-    pp.computeGradients(Y);
+    Mantiuk06Cache *derived = cache ? cache->get<Mantiuk06Cache>() : NULL;
+    if (derived) {
+        pp = derived->gradients;
+    } else {
+        pp.computeGradients(Y);
+        if (cache) cache->set(new Mantiuk06Cache(pp));
+    }
 
     // transform gradients to R
     pp.transformToR(detailfactor);
@@ -163,6 +163,17 @@ static inline vfloat safe_log10(vfloat x, const float min_x = MIN_PHVAL, const f
     return xlogfNoCheck(x) * F2V(LOGE_10__1);
 }
 
+//! \brief round_int((x - offset) / delta) of four floats, computed in double
+//! as the scalar code does: a pixel lands in the same bin either way
+static inline vint round_bin(vfloat x, vdouble offset, vdouble delta) {
+    const vdouble half = vcast_vd_d(0.5);
+    const vint low = vtruncate_vi_vd(
+        vadd(vdiv(vsub(_mm_cvtps_pd(x), offset), delta), half));
+    const vint high = vtruncate_vi_vd(vadd(
+        vdiv(vsub(_mm_cvtps_pd(_mm_movehl_ps(x, x)), offset), delta), half));
+    return _mm_unpacklo_epi64(low, high);
+}
+
 #endif
 
 /**
@@ -176,14 +187,6 @@ static float min_positive(const float *x, size_t len) {
     return min_val;
 }
 
-static void mult_rows(const gsl_matrix *A, const gsl_vector *b, gsl_matrix *C) {
-    assert(A->size1 == b->size);
-    for (size_t j = 0; j < A->size2; j++)
-        for (size_t i = 0; i < A->size1; i++)
-            gsl_matrix_set(C, i, j,
-                           gsl_matrix_get(A, i, j) * gsl_vector_get(b, i));
-}
-
 /**
  * Lookup table on a uniform array & interpolation
  *
@@ -296,48 +299,55 @@ static void compute_gaussian_level(const int width, const int height,
     float *temp_raw = temp.data();
     float *out_raw = out.data();
 
+    // taps falling outside of the image are mirrored at its border: only
+    // the columns closer to the border than the kernel reach need it
+    const int reach = kernel_len_2 * step;
+    const int inner_begin = std::min(reach, width);
+    const int inner_end = std::max(width - reach, inner_begin);
+
 // Filter rows
 #pragma omp parallel for shared(in_raw, temp_raw, kernel)
     for (int r = 0; r < height; r++) {
+        const float *in_row = in_raw + r * width;
+        float *temp_row = temp_raw + r * width;
         for (int c = 0; c < width; c++) {
+            if (c == inner_begin) c = inner_end;
+            if (c == width) break;
             float sum = 0;
             for (int j = 0; j < kernel_len; j++) {
                 int l = (j - kernel_len_2) * step + c;
                 if (unlikely(l < 0)) l = -l;
                 if (unlikely(l >= width)) l = 2 * width - 2 - l;
-                sum += in_raw[r * width + l] * kernel[j];
+                sum += in_row[l] * kernel[j];
             }
-            temp_raw[r * width + c] = sum;
+            temp_row[c] = sum;
         }
-    }
-// Filter columns
-#pragma omp parallel for shared(temp_raw, out_raw, kernel)
-    // process 8 columns per iteration for better usage of cpu cache
-    for (int c = 0; c < width - 7; c+=8) {
-        for (int r = 0; r < height; r++) {
-            float sum[8] = {};
-            for(int cc = 0; cc < 8; ++cc) {
-                for (int j = 0; j < kernel_len; j++) {
-                    int l = (j - kernel_len_2) * step + r;
-                    if (unlikely(l < 0)) l = -l;
-                    if (unlikely(l >= height)) l = 2 * height - 2 - l;
-                    sum[cc] += temp_raw[l * width + c + cc] * kernel[j];
-                }
-                out_raw[r * width + c + cc] = sum[cc];
+        for (int c = inner_begin; c < inner_end; c++) {
+            float sum = 0;
+            for (int j = 0; j < kernel_len; j++) {
+                sum += in_row[(j - kernel_len_2) * step + c] * kernel[j];
             }
+            temp_row[c] = sum;
         }
     }
-    // remaining columns
-    for (int c = width - (width % 8); c < width; c++) {
-        for (int r = 0; r < height; r++) {
+// Filter columns: the rows of the taps are found once per output row, the
+// inner loop runs along contiguous memory
+#pragma omp parallel for shared(temp_raw, out_raw, kernel)
+    for (int r = 0; r < height; r++) {
+        const float *tap_rows[kernel_len];
+        for (int j = 0; j < kernel_len; j++) {
+            int l = (j - kernel_len_2) * step + r;
+            if (unlikely(l < 0)) l = -l;
+            if (unlikely(l >= height)) l = 2 * height - 2 - l;
+            tap_rows[j] = temp_raw + l * width;
+        }
+        float *out_row = out_raw + r * width;
+        for (int c = 0; c < width; c++) {
             float sum = 0;
             for (int j = 0; j < kernel_len; j++) {
-                int l = (j - kernel_len_2) * step + r;
-                if (unlikely(l < 0)) l = -l;
-                if (unlikely(l >= height)) l = 2 * height - 2 - l;
-                sum += temp_raw[l * width + c] * kernel[j];
+                sum += tap_rows[j][c] * kernel[j];
             }
-            out_raw[r * width + c] = sum;
+            out_row[c] = sum;
         }
     }
 }
@@ -467,30 +477,80 @@ std::unique_ptr<datmoConditionalDensity> datmo_compute_conditional_density(
         const int gi_tn = C->g_count / 2 - 1;
         const int gi_t = C->g_count / 2;
 
-#pragma omp parallel
+        const int bins = C->x_count * C->g_count;
+        const float *low_raw = LP_low->data();
+        const float *high_raw = LP_high->data();
+        bool out_of_range = false;
+
+        // each thread counts into its own histogram, merged at the end
+#pragma omp parallel reduction(|| : out_of_range)
 {
-        double *Cthr = new double[C->x_count * C->g_count];
-        for(int c = 0; c < C->x_count * C->g_count; c++) {
-            Cthr[c] = 0;
-        }
+        std::vector<unsigned int> Cthr(bins, 0);
+#ifdef __SSE2__
+        const vdouble l_minv = vcast_vd_d(C->l_min);
+        const vdouble g_minv = vcast_vd_d(-C->g_max);
+        const vdouble deltav = vcast_vd_d(C->delta);
+        const vfloat thrv = F2V(thr);
+        const vfloat half_deltav = F2V(C->delta / 2);
+        const vint zerov = _mm_setzero_si128();
+        const vint x_countv = _mm_set1_epi32(C->x_count);
+        const vint x_lastv = _mm_set1_epi32(C->x_count - 1);
+        const vint g_lastv = _mm_set1_epi32(C->g_count - 1);
+        const vint gi_tpv = _mm_set1_epi32(gi_tp);
+        const vint gi_tnv = _mm_set1_epi32(gi_tn);
+#endif
         #pragma omp for nowait
-        for (int i = 0; i < pix_count; i++) {
-            float g = (*LP_high)(i) - (*LP_low)(i);  // Compute band-pass
-            int x_i = round_int(((*LP_low)(i)-C->l_min) / C->delta);
-            if (unlikely(x_i < 0 || x_i >= C->x_count)) {
-                warn_out_of_range = true;
+        for (int i = 0; i < pix_count; i += 4) {
+            const int n = std::min(4, pix_count - i);
+#ifdef __SSE2__
+            if (n == 4) {
+                const vfloat lowv = LVFU(low_raw[i]);
+                const vfloat g = LVFU(high_raw[i]) - lowv;  // band-pass
+                const vint x_i = round_bin(lowv, l_minv, deltav);
+                vint g_i = round_bin(g, g_minv, deltav);
+                const vmask x_out = vorm(_mm_cmplt_epi32(x_i, zerov),
+                                         _mm_cmpgt_epi32(x_i, x_lastv));
+                if (_mm_movemask_epi8(x_out)) out_of_range = true;
+                const vmask g_out = vorm(_mm_cmplt_epi32(g_i, zerov),
+                                         _mm_cmpgt_epi32(g_i, g_lastv));
+                // above the threshold + or -
+                const vmask tp =
+                    vandm(vmaskf_gt(g, thrv), vmaskf_lt(g, half_deltav));
+                const vmask tn =
+                    vandm(vmaskf_lt(g, -thrv), vmaskf_gt(g, -half_deltav));
+                g_i = vorm(vandnotm(tp, g_i), vandm(tp, gi_tpv));
+                g_i = vorm(vandnotm(tn, g_i), vandm(tn, gi_tnv));
+                // g_i * x_count + x_i, the operands fit in 16 bits; -1 for
+                // the pixels out of range
+                const vint b =
+                    vorm(_mm_add_epi32(_mm_madd_epi16(g_i, x_countv), x_i),
+                         vorm(x_out, g_out));
+                int bin[4];
+                _mm_storeu_si128((__m128i *)bin, b);
+                for (int k = 0; k < 4; k++) {
+                    if (bin[k] != -1) Cthr[bin[k]]++;
+                }
                 continue;
             }
-            int g_i = round_int((g + C->g_max) / C->delta);
-            if (unlikely(g_i < 0 || g_i >= C->g_count)) continue;
-
-            if (g > thr && g < C->delta / 2) {
-                // above the threshold +
-                Cthr[gi_tp * C->x_count + x_i]++;
-            } else if (g < -thr && g > -C->delta / 2) {
-                // above the threshold -
-                Cthr[gi_tn * C->x_count + x_i]++;
-            } else {
+#endif
+            for (int k = 0; k < n; k++) {
+                const float g = high_raw[i + k] - low_raw[i + k];  // band-pass
+                const int x_i =
+                    round_int((low_raw[i + k] - C->l_min) / C->delta);
+                if (unlikely(x_i < 0 || x_i >= C->x_count)) {
+                    out_of_range = true;
+                    continue;
+                }
+                int g_i = round_int((g + C->g_max) / C->delta);
+                if (unlikely(g_i < 0 || g_i >= C->g_count)) continue;
+
+                if (g > thr && g < C->delta / 2) {
+                    // above the threshold +
+                    g_i = gi_tp;
+                } else if (g < -thr && g > -C->delta / 2) {
+                    // above the threshold -
+                    g_i = gi_tn;
+                }
                 Cthr[g_i * C->x_count + x_i]++;
             }
         }
@@ -501,9 +561,9 @@ std::unique_ptr<datmoConditionalDensity> datmo_compute_conditional_density(
                     (*C)(x, g, f) += Cthr[g * C->x_count + x];
                 }
             }
-            delete [] Cthr;
         }
 }
+        warn_out_of_range = warn_out_of_range || out_of_range;
 
         for (int i = 0; i < C->x_count; i++) {
             // Special case: flat field and no gradients
@@ -755,12 +815,15 @@ static void compute_y(double *y, const gsl_vector *x, int *skip_lut,
  *
  * @param y output luminance value for the nodes C->x_scale. y must be
  * a pre-allocated array and has the same size as C->x_scale.
+ * @param y_start tone curve, on the same nodes, the iterations start from,
+ * or NULL to start from a linear curve
  */
 static int optimize_tonecurve(datmoConditionalDensity *C_pub,
                               DisplayFunction *dm, DisplaySize * /*ds*/,
                               float enh_factor, double *y, const float white_y,
                               datmoVisualModel visual_model,
-                              double scene_l_adapt, pfs::Progress &ph) {
+                              double scene_l_adapt, const double *y_start,
+                              pfs::Progress &ph) {
     conditional_density *C = (conditional_density *)C_pub;
 
     double d_dr =
@@ -858,9 +921,20 @@ static int optimize_tonecurve(datmoConditionalDensity *C_pub,
     auto_vector ble(gsl_vector_calloc(L + 1));
     gsl_vector_set(ble, L, -d_dr);
 
-    auto_matrix A(gsl_matrix_calloc(M, L));
-    auto_vector B(gsl_vector_alloc(M));
-    auto_vector N(gsl_vector_alloc(M));
+    // Each row of A sums the variables of the nodes from..to-1 that are not
+    // skipped, which are consecutive: A is stored as the range
+    // [A_begin, A_end) of the ones in every row.
+    // var_before[l]: number of variables of the nodes before l
+    std::vector<int> var_before(C->x_count);
+    var_before[0] = 0;
+    for (int l = 0; l < C->x_count - 1; l++) {
+        var_before[l + 1] = var_before[l] + (skip_lut[l] != -1);
+    }
+
+    std::vector<int> A_begin(M);
+    std::vector<int> A_end(M);
+    std::vector<double> B(M);
+    std::vector<double> N(M);
 
     std::vector<size_t> band(M);    // Frequency band (index)
     std::vector<size_t> back_x(M);  // Background luminance (index)
@@ -883,23 +957,20 @@ static int optimize_tonecurve(datmoConditionalDensity *C_pub,
                 const int to = std::max(i, j);
 
                 //      A(k,min(i,j):(max(i,j)-1)) = 1;
-                for (int l = from; l <= to - 1; l++) {
-                    if (skip_lut[l] == -1) continue;
-                    gsl_matrix_set(A, k, skip_lut[l], 1);
-                }
+                A_begin[k] = var_before[from];
+                A_end[k] = var_before[to];
 
                 if (scene_l_adapt == -1) {
                     sensitivity = csf_lut[f].interp(C->x_scale[from]);
                 }
 
                 //      B(k,1) = l_scale(max(i,j)) - l_scale(min(i,j));
-                gsl_vector_set(
-                    B, k, contrast_transducer(
-                              (C->x_scale[to] - C->x_scale[from]) * enh_factor,
-                              sensitivity, visual_model));
+                B[k] = contrast_transducer(
+                    (C->x_scale[to] - C->x_scale[from]) * enh_factor,
+                    sensitivity, visual_model);
 
                 //      N(k,k) = jpf(j-i+max_neigh+1,i,band);
-                gsl_vector_set(N, k, (*C)(i, j - i + max_neigh, f));
+                N[k] = (*C)(i, j - i + max_neigh, f);
 
                 band[k] = f;
                 back_x[k] = i;
@@ -909,14 +980,10 @@ static int optimize_tonecurve(datmoConditionalDensity *C_pub,
     }
 
     if (white_y > 0) {
-        for (int l = white_i; l < C->x_count - 1; l++) {
-            if (skip_lut[l] == -1) continue;
-            gsl_matrix_set(A, k, skip_lut[l], 1);
-        }
-        gsl_vector_set(B, k, 0);
-        gsl_vector_set(
-            N, k,
-            C->total * 0.1);  // Strength of reference white anchoring
+        A_begin[k] = var_before[white_i];
+        A_end[k] = var_before[C->x_count - 1];
+        B[k] = 0;
+        N[k] = C->total * 0.1;  // Strength of reference white anchoring
         band[k] = 0;
         back_x[k] = white_i;
         k++;
@@ -932,10 +999,8 @@ static int optimize_tonecurve(datmoConditionalDensity *C_pub,
                 int to = i + 1;
                 while (!used_var[to]) to++;
                 assert(k < M);
-                for (int l = from; l <= to - 1; l++) {
-                    if (skip_lut[l] == -1) continue;
-                    gsl_matrix_set(A, k, skip_lut[l], 1);
-                }
+                A_begin[k] = var_before[from];
+                A_end[k] = var_before[to];
                 // const double sensitivity = csf_daly(
                 // C->f_scale[C->f_count-1], 0.,
                 // 1000., 1. );
@@ -952,14 +1017,11 @@ static int optimize_tonecurve(datmoConditionalDensity *C_pub,
                 // const double sensitivity = csf_datmo(
                 // C->f_scale[C->f_count-1],
                 // scene_l_adapt, visual_model );
-                gsl_vector_set(
-                    B, k, contrast_transducer(
-                              (C->x_scale[to] - C->x_scale[from]) * enh_factor,
-                              sensitivity, visual_model));
-
-                gsl_vector_set(
-                    N, k,
-                    C->total * 0.1);  // Strength of framework anchoring
+                B[k] = contrast_transducer(
+                    (C->x_scale[to] - C->x_scale[from]) * enh_factor,
+                    sensitivity, visual_model);
+
+                N[k] = C->total * 0.1;  // Strength of framework anchoring
                 band[k] = C->f_count - 1;
                 back_x[k] = to;
                 k++;
@@ -970,14 +1032,37 @@ static int optimize_tonecurve(datmoConditionalDensity *C_pub,
 
     auto_matrix H(gsl_matrix_alloc(L, L));
     auto_vector f(gsl_vector_alloc(L));
-    auto_matrix NA(gsl_matrix_alloc(M, L));
-    auto_matrix AK(gsl_matrix_alloc(M, L));
-    auto_vector Ax(gsl_vector_alloc(M));
-    auto_vector K(gsl_vector_alloc(M));
     auto_vector x(gsl_vector_alloc(L));
     auto_vector x_old(gsl_vector_alloc(L));
 
+    // prefix sums of x, and the difference tables H and f are integrated from
+    std::vector<double> x_sum(L + 1);
+    std::vector<double> H_diff((L + 1) * (L + 1));
+    std::vector<double> f_diff(L + 1);
+
     gsl_vector_set_all(x, d_dr / L);
+    if (y_start != NULL) {
+        // the contrast of the starting curve over the span of every variable
+        // (see compute_y())
+        double sum = 0;
+        for (int l = 0; l < C->x_count - 1; l++) {
+            if (skip_lut[l] == -1) continue;
+            int j;
+            for (j = l + 1; j < (C->x_count - 1) && skip_lut[j] == -1; j++) {
+            };
+            if (j == (C->x_count - 1)) j = l + 1;
+            const double d = std::max(y_start[j] - y_start[l], 0.);
+            gsl_vector_set(x, skip_lut[l], d);
+            sum += d;
+        }
+        if (sum > d_dr) {
+            for (int l = 0; l < L; l++) {
+                gsl_vector_set(x, l, gsl_vector_get(x, l) * d_dr / sum);
+            }
+        } else if (sum <= 0) {
+            gsl_vector_set_all(x, d_dr / L);
+        }
+    }
 
     int max_iter = 200;
     if (!(visual_model & vm_contrast_masking)) max_iter = 1;
@@ -989,35 +1074,57 @@ static int optimize_tonecurve(datmoConditionalDensity *C_pub,
         compute_y(y, x, &skip_lut[0], C->x_count, L, dm->display(0),
                   dm->display(1));
 
-        // Ax = A*x
-        gsl_blas_dgemv(CblasNoTrans, 1, A, x, 0, Ax);
+        x_sum[0] = 0;
+        for (int l = 0; l < L; l++) {
+            x_sum[l + 1] = x_sum[l] + gsl_vector_get(x, l);
+        }
+        std::fill(H_diff.begin(), H_diff.end(), 0.);
+        std::fill(f_diff.begin(), f_diff.end(), 0.);
 
-        // T(rng{band}) = cont_transd( Ax(rng{band}), band, DD(rng{band},:)*y' )
-        // ./
-        // Axd(rng{band});
         for (int k = 0; k < M; k++) {
+            const int a = A_begin[k];
+            const int b = A_end[k];
+
+            // Ax = A*x
+            const double Ax_k = x_sum[b] - x_sum[a];
+
+            // T(rng{band}) = cont_transd( Ax(rng{band}), band,
+            // DD(rng{band},:)*y' ) ./ Axd(rng{band});
             double sensitivity = csf_lut[band[k]].interp(y[back_x[k]]);
-            const double Ax_k = gsl_vector_get(Ax, k);
             const double denom = (fabs(Ax_k) < 0.0001 ? 1. : Ax_k);
-            // gsl_vector_set( K, k, contrast_transducer( Ax_k, sensitivity ) /
-            // denom
-            // );
-            gsl_vector_set(
-                K, k,
-                contrast_transducer(Ax_k, sensitivity, visual_model) / denom);
+            const double K_k =
+                contrast_transducer(Ax_k, sensitivity, visual_model) / denom;
+
+            // H = A'*K*N*K*A: row k of A adds K_k*N_k*K_k to the square
+            // [a,b)x[a,b) of H
+            const double w = K_k * N[k] * K_k;
+            H_diff[a * (L + 1) + a] += w;
+            H_diff[a * (L + 1) + b] -= w;
+            H_diff[b * (L + 1) + a] -= w;
+            H_diff[b * (L + 1) + b] += w;
+
+            // f = -B'*N*K*A: and -B_k*N_k*K_k to the range [a,b) of f
+            const double v = -B[k] * N[k] * K_k;
+            f_diff[a] += v;
+            f_diff[b] -= v;
         }
 
-        // AK = A*K;
-        mult_rows(A, K, AK);
-
-        // NA = N*A;
-        mult_rows(AK, N, NA);
-
-        // H = AK'*NA;
-        gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1, AK, NA, 0, H);
-
-        // f = -B'*NA = - NA' * B;
-        gsl_blas_dgemv(CblasTrans, -1, NA, B, 0, f);
+        // integrate the difference tables
+        double f_l = 0;
+        for (int l = 0; l < L; l++) {
+            f_l += f_diff[l];
+            gsl_vector_set(f, l, f_l);
+        }
+        for (int r = 0; r < L; r++) {
+            double *row = &H_diff[r * (L + 1)];
+            const double *previous = r > 0 ? row - (L + 1) : NULL;
+            double row_sum = 0;
+            for (int c = 0; c < L; c++) {
+                row_sum += row[c];
+                row[c] = row_sum + (previous ? previous[c] : 0.);
+                gsl_matrix_set(H, r, c, row[c]);
+            }
+        }
 
         gsl_vector_memcpy(x_old, x);
 
@@ -1063,11 +1170,17 @@ int datmo_compute_tone_curve(datmoToneCurve *tc,
                              DisplayFunction *df, DisplaySize *ds,
                              const float enh_factor, const float white_y,
                              datmoVisualModel visual_model,
-                             double scene_l_adapt, pfs::Progress &ph) {
+                             double scene_l_adapt, pfs::Progress &ph,
+                             const datmoToneCurve *previous) {
     conditional_density *c = (conditional_density *)cond_dens;
     tc->init(c->x_count, c->x_scale);
+    const double *y_start = NULL;
+    if (previous != NULL && previous->y_i != NULL &&
+        previous->size == (size_t)c->x_count) {
+        y_start = previous->y_i;
+    }
     return optimize_tonecurve(cond_dens, df, ds, enh_factor, tc->y_i, white_y,
-                              visual_model, scene_l_adapt, ph);
+                              visual_model, scene_l_adapt, y_start, ph);
 }
 
 /**
@@ -1182,6 +1295,11 @@ datmoToneCurve *datmoTCFilter::getToneCurvePtr() {
     return ring_buffer_org + pos;
 }
 
+const datmoToneCurve *datmoTCFilter::lastToneCurve() const {
+    if (sz == 0) return NULL;
+    return ring_buffer_org + pos;
+}
+
 datmoToneCurve *datmoTCFilter::filterToneCurve() {
     datmoToneCurve *tc_o = ring_buffer_org + pos;
     datmoToneCurve *tc_f = ring_buffer_filt + pos;
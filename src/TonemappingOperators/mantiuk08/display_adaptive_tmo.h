@@ -92,6 +92,13 @@ class datmoTCFilter {
      */
     datmoToneCurve *getToneCurvePtr();
 
+    /**
+     * Get the tone-curve of the previous frame, or NULL for the first
+     * frame. Call before getToneCurvePtr(), to start
+     * datmo_compute_tone_curve() from it.
+     */
+    const datmoToneCurve *lastToneCurve() const;
+
     /**
      * Get the filterted tone-curve.
      */
@@ -196,6 +203,11 @@ std::unique_ptr<datmoConditionalDensity> datmo_compute_conditional_density(
  * images).
  * @param progress_cb callback function for reporting progress or stopping
  * computations.
+ * @param previous tone-curve found for a similar image, usually the
+ * previous frame of a video (see datmoTCFilter::lastToneCurve()), or
+ * for the same image with other parameters. The iterations start from
+ * it and need fewer steps to converge. NULL to start from a linear
+ * tone-curve.
  * @return PFSTMO_OK if tone-mapping was sucessful, PFSTMO_ABORTED if
  * it was stopped from a callback function and PFSTMO_ERROR if an
  * error was encountered.
@@ -205,7 +217,8 @@ int datmo_compute_tone_curve(datmoToneCurve *tc,
                              DisplayFunction *df, DisplaySize *ds,
                              const float enh_factor, const float white_y,
                              datmoVisualModel visual_model,
-                             double scene_l_adapt, pfs::Progress &ph);
+                             double scene_l_adapt, pfs::Progress &ph,
+                             const datmoToneCurve *previous = NULL);
 
 /**
  * Deprectaied: use datmo_apply_tone_curve_cc()
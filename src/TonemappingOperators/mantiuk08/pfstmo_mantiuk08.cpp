@@ -33,8 +33,10 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "Libpfs/utils/msec_timer.h"
 #include "Libpfs/colorspace/colorspace.h"
@@ -44,9 +46,35 @@
 
 using namespace std;
 
+namespace {
+//! \brief What pfstmo_mantiuk08() derives from the input alone: the
+//! conditional density of the luminance, and the tone-curve found with the
+//! last contrast enhancement factor and reference white. The curve does not
+//! depend on the saturation factor, so changing it skips the optimisation.
+struct Mantiuk08Cache : public TonemapOperatorCache::Entry {
+    Mantiuk08Cache() : contrast_enhance_factor(0.f), white_y(0.f) {}
+
+    size_t bytes() const {
+        return (x_i.size() + y_i.size()) * sizeof(double);
+    }
+
+    std::unique_ptr<datmoConditionalDensity> density;
+    float contrast_enhance_factor;
+    float white_y;
+    std::vector<double> x_i;
+    std::vector<double> y_i;
+};
+}
+
+Mantiuk08Sequence::Mantiuk08Sequence() {}
+
+Mantiuk08Sequence::~Mantiuk08Sequence() {}
+
 void pfstmo_mantiuk08(pfs::Frame &frame, float saturation_factor,
                       float contrast_enhance_factor, float white_y,
-                      bool setluminance, pfs::Progress &ph) {
+                      bool setluminance, pfs::Progress &ph,
+                      TonemapOperatorCache *cache,
+                      Mantiuk08Sequence *sequence) {
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
     stop_watch.start();
@@ -139,31 +167,69 @@ void pfstmo_mantiuk08(pfs::Frame &frame, float saturation_factor,
       }
     */
 
-    std::unique_ptr<datmoConditionalDensity> C =
-        datmo_compute_conditional_density(cols, rows, inY->data(), ph);
-    if (C.get() == NULL) {
-        delete df;
-        delete ds;
-        throw pfs::Exception("failed to analyse the image");
+    std::unique_ptr<Mantiuk08Cache> computed;
+    Mantiuk08Cache *derived = cache ? cache->get<Mantiuk08Cache>() : NULL;
+    if (derived == NULL) {
+        computed.reset(new Mantiuk08Cache);
+        computed->density =
+            datmo_compute_conditional_density(cols, rows, inY->data(), ph);
+        if (computed->density.get() == NULL) {
+            delete df;
+            delete ds;
+            throw pfs::Exception("failed to analyse the image");
+        }
+        derived = computed.get();
+        // a canceled computation leaves the density incomplete
+        if (cache && !ph.canceled()) cache->set(computed.release());
     }
 
-    datmoTCFilter rc_filter(fps, log10(df->display(0)), log10(df->display(1)));
+    std::unique_ptr<datmoTCFilter> frame_filter;
+    datmoTCFilter *rc_filter;
+    if (sequence) {
+        if (!sequence->filter) {
+            sequence->filter.reset(new datmoTCFilter(
+                fps, log10(df->display(0)), log10(df->display(1))));
+        }
+        rc_filter = sequence->filter.get();
+    } else {
+        frame_filter.reset(new datmoTCFilter(fps, log10(df->display(0)),
+                                             log10(df->display(1))));
+        rc_filter = frame_filter.get();
+    }
 
-    // datmoToneCurve tc;
-    datmoToneCurve *tc = rc_filter.getToneCurvePtr();
+    // the curve of the previous frame of a video, if any, is close to the
+    // one of this frame. Curves found with other parameters are not: the
+    // optimisation would end on another of its fixed points
+    const datmoToneCurve *previous = rc_filter->lastToneCurve();
 
-    int res;
-    res = datmo_compute_tone_curve(tc, C.get(), df, ds, contrast_enhance_factor,
-                                   white_y, visual_model, scene_l_adapt, ph);
-    if (res != PFSTMO_OK) {
-        delete df;
-        delete ds;
-        throw pfs::Exception("failed to compute the tone-curve");
+    // datmoToneCurve tc;
+    datmoToneCurve *tc = rc_filter->getToneCurvePtr();
+
+    if (!derived->y_i.empty() &&
+        derived->contrast_enhance_factor == contrast_enhance_factor &&
+        derived->white_y == white_y) {
+        tc->init(derived->y_i.size(), &derived->x_i[0]);
+        std::copy(derived->y_i.begin(), derived->y_i.end(), tc->y_i);
+    } else {
+        int res = datmo_compute_tone_curve(
+            tc, derived->density.get(), df, ds, contrast_enhance_factor,
+            white_y, visual_model, scene_l_adapt, ph, previous);
+        if (res != PFSTMO_OK) {
+            delete df;
+            delete ds;
+            throw pfs::Exception("failed to compute the tone-curve");
+        }
+        if (!ph.canceled()) {
+            derived->contrast_enhance_factor = contrast_enhance_factor;
+            derived->white_y = white_y;
+            derived->x_i.assign(tc->x_i, tc->x_i + tc->size);
+            derived->y_i.assign(tc->y_i, tc->y_i + tc->size);
+        }
     }
 
-    datmoToneCurve *tc_filt = rc_filter.filterToneCurve();
+    datmoToneCurve *tc_filt = rc_filter->filterToneCurve();
 
-    res = datmo_apply_tone_curve_cc(
+    int res = datmo_apply_tone_curve_cc(
         inX->data(), R.data(), inZ->data(), cols, rows, inX->data(), R.data(),
         inZ->data(), inY->data(), tc_filt, df, saturation_factor);
     if (res != PFSTMO_OK) {
@@ -40,6 +40,7 @@
 #include "Libpfs/colorspace/colorspace.h"
 #include "Libpfs/exception.h"
 #include "Libpfs/frame.h"
+#include "Libpfs/manip/statistics.h"
 #include "Libpfs/progress.h"
 
 namespace {
@@ -95,13 +96,19 @@ void pfstmo_pattanaik00(pfs::Frame &frame, bool local, float multiplier,
     }
 
     if (!local) {
-        if (!timedependence) {
-            if (!autolum)
-                am->setAdaptation(Acone, Arod);
+        if (!timedependence && !autolum) {
+            am->setAdaptation(Acone, Arod);
+        } else {
+            // logarithmic average of the Y channel
+            const float logAvg =
+                std::exp(frame.statistics().meanLog(
+                    pfs::FrameStatistics::GREEN, 1e-4f)) -
+                1e-4f;
+            if (!timedependence)
+                am->setAdaptation(5.0f * logAvg, 5.0f * logAvg);
             else
-                am->setAdaptation(*Y);
-        } else
-            am->calculateAdaptation(*Y, 1.0f / fps);
+                am->calculateAdaptation(logAvg, logAvg, 1.0f / fps);
+        }
     }
     // tone mapping
     int w = Y->getWidth();
@@ -118,6 +125,9 @@ void pfstmo_pattanaik00(pfs::Frame &frame, bool local, float multiplier,
     } catch (...) {
         throw pfs::Exception("Tonemapping Failed!");
     }
+    // the channels are taken again for writing: the statistics read above
+    // are dropped
+    frame.getXYZChannels(X, Y, Z);
     pfs::transformColorSpace(pfs::CS_RGB, &R, &G, &B, pfs::CS_XYZ, X, Y, Z);
 
     if (!ph.canceled()) {
@@ -31,6 +31,7 @@
  * $Id: tmo_pattanaik00.cpp,v 1.3 2008/11/04 23:43:08 rafm Exp $
  */
 
+#include <algorithm>
 #include <cmath>
 
 #include "tmo_pattanaik00.h"
@@ -111,7 +112,7 @@ float calculateLocalAdaptation(const pfs::Array2Df &Y, int x, int y) {
     // 0 0 0 0 1 0 0 0 0
 
 #ifdef __SSE2__
-    if(x >= 4 && x < width -4 && y > 4 && y < height - 4) {
+    if(x >= 4 && x < width -4 && y >= 4 && y < height - 4) {
         vfloat pix_numv = ZEROV;
         vfloat pix_sumv = ZEROV;
         vfloat log5v = F2V(LOG5);
@@ -204,7 +205,7 @@ float calculateLocalAdaptation(const pfs::Array2Df &Y, int x, int y) {
         for (int ky = -kernel_size; ky <= kernel_size; ky++) {
             for (int kx = -kernel_size; kx <= kernel_size; kx++) {
                 if ((kx * kx + ky * ky) <= (kernel_size * kernel_size) &&
-                    x + kx > 0 && x + kx < width && y + ky > 0 && y + ky < height) {
+                    x + kx >= 0 && x + kx < width && y + ky >= 0 && y + ky < height) {
                     float L = Y(x + kx, y + ky);
                     float w = xexpf(-pow6(xlogf(L) / LOG5 - logLc));
                     pix_sum += w * L;
@@ -218,7 +219,7 @@ float calculateLocalAdaptation(const pfs::Array2Df &Y, int x, int y) {
     for (int ky = -kernel_size; ky <= kernel_size; ky++) {
         for (int kx = -kernel_size; kx <= kernel_size; kx++) {
             if ((kx * kx + ky * ky) <= (kernel_size * kernel_size) &&
-                x + kx > 0 && x + kx < width && y + ky > 0 && y + ky < height) {
+                x + kx >= 0 && x + kx < width && y + ky >= 0 && y + ky < height) {
                 float L = Y(x + kx, y + ky);
                 float w = xexpf(-pow6(xlogf(L) / LOG5 - logLc));
                 pix_sum += w * L;
@@ -233,6 +234,115 @@ float calculateLocalAdaptation(const pfs::Array2Df &Y, int x, int y) {
         return Y(x, y);
     }
 }
+
+/// half width of each row of the circular kernel of radius 4
+const int kernelHalfWidth[9] = {0, 2, 3, 3, 4, 3, 3, 2, 0};
+
+/**
+ * @brief Local adaptation for one pixel, from precomputed log5 luminance
+ */
+float calculateLocalAdaptation(const pfs::Array2Df &Y,
+                               const pfs::Array2Df &logY, int x, int y) {
+    const int width = Y.getCols();
+    const int height = Y.getRows();
+    const float logLc = logY(x, y);
+
+    float pix_num = 0.0;
+    float pix_sum = 0.0;
+
+    for (int ky = -4; ky <= 4; ky++) {
+        if (y + ky < 0 || y + ky >= height) continue;
+        const int hw = kernelHalfWidth[ky + 4];
+        for (int kx = std::max(-hw, -x); kx <= std::min(hw, width - 1 - x); kx++) {
+            float w = xexpf(-pow6(logY(x + kx, y + ky) - logLc));
+            pix_sum += w * Y(x + kx, y + ky);
+            pix_num += w;
+        }
+    }
+
+    if (pix_num > 0.0) {
+        return pix_sum / pix_num;
+    } else {
+        return Y(x, y);
+    }
+}
+}
+
+void calculateLocalAdaptation(const pfs::Array2Df &Y, pfs::Array2Df &adaptation,
+                              bool reference) {
+    const int width = Y.getCols();
+    const int height = Y.getRows();
+
+    if (reference) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic,16)
+#endif
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                adaptation(x, y) = calculateLocalAdaptation(Y, x, y);
+            }
+        }
+        return;
+    }
+
+    // the kernel weight only depends on log5 of the luminance: compute it
+    // once per pixel instead of once per tap
+    pfs::Array2Df logY(width, height);
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+#ifdef __SSE2__
+        const vfloat log5v = F2V(LOG5);
+#endif
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+        for (int y = 0; y < height; y++) {
+            int x = 0;
+#ifdef __SSE2__
+            for (; x < width - 3; x += 4) {
+                STVFU(logY(x, y), xlogf(LVFU(Y(x, y))) / log5v);
+            }
+#endif
+            for (; x < width; x++) {
+                logY(x, y) = xlogf(Y(x, y)) / LOG5;
+            }
+        }
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic,16)
+#endif
+    for (int y = 0; y < height; y++) {
+        int x = 0;
+#ifdef __SSE2__
+        if (y >= 4 && y < height - 4) {
+            for (; x < std::min(4, width); x++) {
+                adaptation(x, y) = calculateLocalAdaptation(Y, logY, x, y);
+            }
+            // four neighbouring centres at once, one exp per tap
+            for (; x < width - 7; x += 4) {
+                const vfloat logLcv = LVFU(logY(x, y));
+                vfloat pix_sumv = ZEROV;
+                vfloat pix_numv = ZEROV;
+                for (int ky = -4; ky <= 4; ky++) {
+                    const int hw = kernelHalfWidth[ky + 4];
+                    for (int kx = -hw; kx <= hw; kx++) {
+                        const vfloat Lv = LVFU(Y(x + kx, y + ky));
+                        const vfloat wv = xexpf(-pow6(LVFU(logY(x + kx, y + ky)) - logLcv));
+                        pix_sumv += wv * Lv;
+                        pix_numv += wv;
+                    }
+                }
+                STVFU(adaptation(x, y), vself(vmaskf_gt(pix_numv, ZEROV), pix_sumv / pix_numv, LVFU(Y(x, y))));
+            }
+        }
+#endif
+        for (; x < width; x++) {
+            adaptation(x, y) = calculateLocalAdaptation(Y, logY, x, y);
+        }
+    }
 }
 
 // tone mapping operator code
@@ -337,6 +447,12 @@ void tmo_pattanaik00(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B,
     ph.setValue(phVal);
     const float dsbydw = display_sigma / display_white;
 
+    pfs::Array2Df adaptation;
+    if (local) {
+        adaptation.resize(im_width, im_height);
+        calculateLocalAdaptation(Y, adaptation);
+    }
+
 #ifdef _OPENMP
     #pragma omp parallel for firstprivate(Bcone, Brod, sigma_cone, sigma_rod) schedule(dynamic,16)
 #endif
@@ -348,7 +464,7 @@ void tmo_pattanaik00(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B,
             float b = B(x, y) / l;
 
             if (local) {
-                float adapt = calculateLocalAdaptation(Y, x, y);
+                float adapt = adaptation(x, y);
                 Bcone = 2e6 / (2e6 + adapt);
                 Brod = 0.04f / (0.04f + adapt);
 
@@ -482,61 +598,9 @@ void VisualAdaptationModel::calculateAdaptation(float Gcone, float Grod,
     Brod += f;
 }
 
-void VisualAdaptationModel::calculateAdaptation(const pfs::Array2Df &Y,
-                                                float dt) {
-    float Acone = calculateLogAvgLuminance(Y);
-    calculateAdaptation(Acone, Acone, dt);
-}
-
 void VisualAdaptationModel::setAdaptation(float Gcone, float Grod) {
     Acone = Gcone;
     Arod = Grod;
     Bcone = 2e6 / (2e6 + Acone);
     Brod = 0.04f / (0.04f + Arod);
 }
-
-void VisualAdaptationModel::setAdaptation(const pfs::Array2Df &Y) {
-    float Acone = calculateLogAvgLuminance(Y) * 5.0f;
-    setAdaptation(Acone, Acone);
-}
-
-float VisualAdaptationModel::calculateLogAvgLuminance(const pfs::Array2Df &Y) {
-
-    float avLum = 0.0f;
-
-    size_t size = Y.getCols() * Y.getRows();
-#ifdef _OPENMP
-    #pragma omp parallel
-#endif
-{
-    float avLumThr = 0.f;
-#ifdef __SSE2__
-    vfloat avLumThrv = ZEROV;
-    vfloat c1v = F2V(1e-4f);
-#endif
-#ifdef _OPENMP
-    #pragma omp for nowait
-#endif
-    for (size_t y = 0; y < Y.getRows(); ++y) {
-        size_t x = 0;
-#ifdef __SSE2__
-        for (; x < Y.getCols() - 3; x+=4) {
-            avLumThrv += xlogf(LVFU(Y(x,y)) + c1v);
-        }
-#endif
-        for (; x < Y.getCols(); ++x) {
-            avLumThr += xlogf(Y(x,y) + 1e-4f);
-        }
-    }
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-{
-    avLum += avLumThr;
-#ifdef __SSE2__
-    avLum += vhadd(avLumThrv);
-#endif
-}
-}
-    return xexpf(avLum / size) - 1e-4;
-}
@@ -59,6 +59,18 @@ void tmo_pattanaik00(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B,
                      const pfs::Array2Df &Y, VisualAdaptationModel *am,
                      bool local /*= false*/, pfs::Progress &ph);
 
+//!
+//! \brief Local adaptation luminance of every pixel, computed over a circular
+//! neighbourhood weighted by the log5 luminance difference ("Adaptive Gain
+//! Control" by Pattanaik 2002)
+//!
+//! \param Y luminance map
+//! \param adaptation [out] local adaptation map, same size as Y
+//! \param reference use the slow per-pixel implementation (for tests)
+//!
+void calculateLocalAdaptation(const pfs::Array2Df &Y, pfs::Array2Df &adaptation,
+                              bool reference = false);
+
 //!
 //! @brief Time-dependent Visual Adaptation Model
 //!
@@ -78,9 +90,6 @@ class VisualAdaptationModel {
     //! rod's bleaching term
     float Brod;
 
-    //! calculate logarithmic average of Y
-    float calculateLogAvgLuminance(const pfs::Array2Df &Y);
-
    public:
     //!
     //! \brief Constructor
@@ -95,21 +104,11 @@ class VisualAdaptationModel {
     //! \param dt time [s] that passed after last calculation of adaptation
     void calculateAdaptation(float Gcone, float Grod, float dt);
 
-    //! @brief Calculate adaptation level according to Visual Adaptation Model
-    //!
-    //! \param Y luminance map of HDR image
-    //! \param dt time [s] that passed after last calculation of adaptation
-    void calculateAdaptation(const pfs::Array2Df &Y, float dt);
-
     //! \brief Set adaptation level to given values
     //! \param Gcone goal adaptation value for cones
     //! \param Grod goal adaptation value for rods
     void setAdaptation(float Gcone, float Grod);
 
-    //! @brief Set adaptation level appropriate for given lumiance map
-    //! \param Y luminance map of HDR image
-    void setAdaptation(const pfs::Array2Df &Y);
-
     //! Get cone adaptation level
     float getAcone() { return Acone; }
 
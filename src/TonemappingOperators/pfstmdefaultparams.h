@@ -98,5 +98,6 @@
 
 // Lischinski 06
 #define LISCHINSKI06_ALPHA 1.f
+#define LISCHINSKI06_SOLVE_WIDTH 0
 
 #endif  // PFSTMDEFAULTPARAMS_H
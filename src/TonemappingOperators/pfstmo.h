@@ -29,11 +29,16 @@
 #ifndef PFSTMO_H
 #define PFSTMO_H
 
+#include <cstddef>
+#include <memory>
+
 namespace pfs {
 class Frame;
 class Progress;
 }
 
+class datmoTCFilter;
+
 #ifdef BRANCH_PREDICTION
 #define likely(x) __builtin_expect((x), 1)
 #define unlikely(x) __builtin_expect((x), 0)
@@ -47,38 +52,138 @@ class Progress;
 #define PFSTMO_ABORTED -1 /* User aborted (from callback) */
 #define PFSTMO_ERROR -2   /* Failed, encountered error */
 
+//! \brief Quantities an operator derives from the whole image.
+//!
+//! Operators that accept them take a pointer as their last argument. If it
+//! is NULL, they work as usual. If the statistics are not \c valid yet, the
+//! operator fills them in from the frame it tonemaps, which is then the whole
+//! image or a reduced copy of it. If they are \c valid, the operator uses them
+//! in place of those of the frame, which is then a region of the image: the
+//! region is mapped as it would be in a tonemap of the whole image.
+struct TonemapOperatorStatistics {
+    TonemapOperatorStatistics() : valid(false) {}
+    bool valid;
+};
+
+//! \brief Data an operator derives from its input alone, whatever its
+//! parameters, kept across runs on the same input (see
+//! TonemapOperator::setInput()).
+//!
+//! Operators that accept it take a pointer as their last argument. If it is
+//! NULL, they work as usual. If it holds an Entry of the operator, the frame
+//! is the input the entry was derived from and the operator reuses it; else
+//! the operator stores the entry it derives from the frame.
+class TonemapOperatorCache {
+   public:
+    struct Entry {
+        virtual ~Entry() {}
+
+        //! \brief memory held by the entry
+        virtual size_t bytes() const = 0;
+    };
+
+    //! \return the entry if it has type \a T, else NULL
+    template <typename T>
+    T *get() const {
+        return dynamic_cast<T *>(m_entry.get());
+    }
+
+    //! \brief replace the entry, taking ownership of \a entry
+    void set(Entry *entry) { m_entry.reset(entry); }
+
+    size_t bytes() const { return m_entry ? m_entry->bytes() : 0; }
+
+   private:
+    std::unique_ptr<Entry> m_entry;
+};
+
+struct Drago03Statistics : public TonemapOperatorStatistics {
+    float avLum;
+    float maxLum;
+};
+
+struct Reinhard05Statistics : public TonemapOperatorStatistics {
+    float channelAverage[3];
+    float channelMin[3];
+    float channelMax[3];
+    float lumMin;
+    float lumMax;
+    float lumAverage;
+    float lumAdaptedAverage;
+    float outputMin;
+    float outputMax;
+};
+
+struct Ferwerda96Statistics : public TonemapOperatorStatistics {
+    float maxLum;
+    float maxChannel;
+};
+
+struct KimKautz08Statistics : public TonemapOperatorStatistics {
+    float logMean;
+    float logMin;
+    float logMax;
+    float outputMin;
+    float outputMax;
+};
+
+//! \brief Tone-curves of the previous frames of a video tonemapped by
+//! pfstmo_mantiuk08(), one frame after the other and with the same
+//! parameters: the curve of every frame is searched from that of the
+//! previous frame, and filtered over time.
+struct Mantiuk08Sequence {
+    Mantiuk08Sequence();
+    ~Mantiuk08Sequence();
+
+    std::unique_ptr<datmoTCFilter> filter;
+};
+
+struct Durand02Statistics : public TonemapOperatorStatistics {
+    float minPositive;
+    float logMin;
+    float logMax;
+    float baseMin;
+    float baseMax;
+};
+
 void pfstmo_ashikhmin02(pfs::Frame &frame, bool simple_flag, float lc_value,
                         int eq, pfs::Progress &ph);
-void pfstmo_drago03(pfs::Frame &frame, float biasValue, pfs::Progress &ph);
+void pfstmo_drago03(pfs::Frame &frame, float biasValue, pfs::Progress &ph,
+                    Drago03Statistics *stats = NULL);
 void pfstmo_durand02(pfs::Frame &frame, float sigma_s, float sigma_r,
-                     float baseContrast, pfs::Progress &ph);
+                     float baseContrast, pfs::Progress &ph,
+                     Durand02Statistics *stats = NULL);
 void pfstmo_fattal02(pfs::Frame &frame, float opt_alpha, float opt_beta,
                      float opt_saturation, float opt_noise, bool newfattal,
-                     bool fftsolver, int detail_level, pfs::Progress &ph);
+                     bool fftsolver, int detail_level, pfs::Progress &ph,
+                     TonemapOperatorCache *cache = NULL);
 void pfstmo_ferradans11(pfs::Frame &frame, float opt_rho, float opt_inv_alpha,
                         pfs::Progress &ph);
 void pfstmo_ferwerda96(pfs::Frame &frame, float Ld_Max, float L_da,
-                        pfs::Progress &ph);
+                        pfs::Progress &ph, Ferwerda96Statistics *stats = NULL);
 void pfstmo_kimkautz08(pfs::Frame &frame, float KK_c1, float KK_c2,
-                        pfs::Progress &ph);
+                        pfs::Progress &ph, KimKautz08Statistics *stats = NULL);
 void pfstmo_mai11(pfs::Frame &frame, pfs::Progress &ph);
 void pfstmo_mantiuk06(pfs::Frame &frame, float scaleFactor,
                       float saturationFactor, float detailFactor, bool cont_eq,
-                      pfs::Progress &ph);
+                      pfs::Progress &ph, TonemapOperatorCache *cache = NULL);
 void pfstmo_mantiuk08(pfs::Frame &frame, float saturation_factor,
                       float contrast_enhance_factor, float white_y,
-                      bool setluminance, pfs::Progress &ph);
+                      bool setluminance, pfs::Progress &ph,
+                      TonemapOperatorCache *cache = NULL,
+                      Mantiuk08Sequence *sequence = NULL);
 void pfstmo_pattanaik00(pfs::Frame &frame, bool local, float multiplier,
                         float Acone, float Arod, bool autolum,
                         pfs::Progress &ph);
 void pfstmo_reinhard02(pfs::Frame &frame, float key, float phi, int num,
-                       int low, int high, bool use_scales, pfs::Progress &ph);
+                       int low, int high, bool use_scales, pfs::Progress &ph,
+                       TonemapOperatorCache *cache = NULL);
 void pfstmo_reinhard05(pfs::Frame &frame, float brightness,
                        float chromaticadaptation, float lightadaptation,
-                       pfs::Progress &ph);
+                       pfs::Progress &ph, Reinhard05Statistics *stats = NULL);
 void pfstmo_vanhateren06(pfs::Frame &frame, float pupil_area,
                         pfs::Progress &ph);
 
 void pfstmo_lischinski06(pfs::Frame &frame, float alpha,
-                        pfs::Progress &ph);
+                        pfs::Progress &ph, int solveWidth = 0);
 #endif
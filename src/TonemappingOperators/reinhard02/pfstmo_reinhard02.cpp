@@ -38,11 +38,13 @@
 #include "Libpfs/exception.h"
 #include "Libpfs/frame.h"
 #include "Libpfs/progress.h"
+#include "TonemappingOperators/pfstmo.h"
 #include "tmo_reinhard02.h"
 #include "../../opthelper.h"
 
 void pfstmo_reinhard02(pfs::Frame &frame, float key, float phi, int num,
-                       int low, int high, bool use_scales, pfs::Progress &ph) {
+                       int low, int high, bool use_scales, pfs::Progress &ph,
+                       TonemapOperatorCache *cache) {
 
     //--- default tone mapping parameters;
     // float key = 0.18;
@@ -79,7 +81,7 @@ void pfstmo_reinhard02(pfs::Frame &frame, float key, float phi, int num,
     pfs::Array2Df L(w, h);
 
     Reinhard02 tmoperator(Y, &L, use_scales, key, phi, num, low, high,
-                          temporal_coherent, ph);
+                          temporal_coherent, ph, cache);
 
     try {
         tmoperator.tmo_reinhard02();
@@ -41,6 +41,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 #include <arch/math.h>
 
 #include "tmo_reinhard02.h"
@@ -81,7 +82,7 @@ static CVTS      cvts             = {0, 0};
 static bool temporal_coherent;
 */
 #define pow_F(a,b) (xexpf(b*xlogf(a)))
-#define V1(x, y, i) (m_convolved_image[i][y][x])
+#define V1(x, y, i) (m_midtone * m_convolved->images[i][(y) * m_cvts.xmax + (x)])
 
 #define SIGMA_I(i) \
     (m_sigma_0 + ((float)i / (float)m_range) * (m_sigma_1 - m_sigma_0))
@@ -91,6 +92,31 @@ static bool temporal_coherent;
     ((V1(x, y, i) - V2(x, y, i)) / \
      (((m_key * m_twopowphi) / lhdrengine::SQR(S_I(i))) + V1(x, y, i)))
 
+//! \brief What the local version derives from the input alone: the luminance
+//! convolved with the Gaussian of every scale. It depends on the scales too,
+//! and is computed again when they change.
+struct Reinhard02Cache : public TonemapOperatorCache::Entry {
+    Reinhard02Cache(int range, int low, int high, size_t length)
+        : range(range),
+          low(low),
+          high(high),
+          images(range, std::vector<float>(length)) {}
+
+    bool matches(int otherRange, int otherLow, int otherHigh) const {
+        return range == otherRange && low == otherLow && high == otherHigh;
+    }
+
+    size_t bytes() const {
+        return images.empty() ? 0 : images.size() * images[0].size() *
+                                        sizeof(float);
+    }
+
+    int range;
+    int low;
+    int high;
+    std::vector<std::vector<float>> images;
+};
+
 //
 // Kaiser-Bessel stuff
 //
@@ -197,7 +223,7 @@ void Reinhard02::build_gaussian_fft() {
 #endif
 }
 
-void Reinhard02::build_image_fft() {
+void Reinhard02::build_image_fft(const float *image) {
 
 #ifndef NDEBUG
     fprintf(stderr, "Computing image FFT\n");
@@ -222,7 +248,7 @@ void Reinhard02::build_image_fft() {
     #pragma omp parallel for
     for (int y = 0; y < m_cvts.ymax; y++) {
         for (int x = 0; x < m_cvts.xmax; x++) {
-            m_image_fft[y * m_cvts.xmax + x][0] = m_image[y][x];
+            m_image_fft[y * m_cvts.xmax + x][0] = image[y * m_cvts.xmax + x];
             m_image_fft[y * m_cvts.xmax + x][1] = 0;
         }
     }
@@ -270,18 +296,42 @@ void Reinhard02::convolve_filter(int scale, fftwf_complex *convolution_fft) {
     fftwf_destroy_plan(p);
     FFTW_MUTEX::fftw_mutex_destroy_plan.unlock();
 
+    float *convolved = &m_localConvolved->images[scale][0];
 #pragma omp parallel for
-    for (int y = 0; y < m_cvts.ymax; y++)
-        for (int x = 0, i = y * m_cvts.xmax; x < m_cvts.xmax; x++, i++)
-            m_convolved_image[scale][y][x] = m_convolution_fft[i][0];
+    for (int i = 0; i < m_cvts.xmax * m_cvts.ymax; i++)
+        convolved[i] = convolution_fft[i][0];
 }
 
 void Reinhard02::compute_fourier_convolution() {
 
+    // m_image varies with the border, and its convolutions with the key:
+    // the luminance alone can be kept in the cache
+    const bool cached = m_cache && !m_use_border;
+    if (cached) {
+        Reinhard02Cache *derived = m_cache->get<Reinhard02Cache>();
+        if (derived && derived->matches(m_range, m_scale_low, m_scale_high)) {
+            m_convolved = derived;
+            return;
+        }
+    }
+
+    const int length = m_cvts.xmax * m_cvts.ymax;
+    m_localConvolved.reset(
+        new Reinhard02Cache(m_range, m_scale_low, m_scale_high, length));
+
+    FFTW_MUTEX::fftw_mutex_alloc.lock();
+    m_image_fft = (fftwf_complex *)fftwf_alloc_complex(length);
+    m_filter_fft = (fftwf_complex **)fftwf_alloc_complex(m_range);
+    for (int scale = 0; scale < m_range; scale++) {
+        m_filter_fft[scale] = (fftwf_complex *)fftwf_alloc_complex(length);
+    }
+    m_convolution_fft = (fftwf_complex *)fftwf_alloc_complex(length);
+    FFTW_MUTEX::fftw_mutex_alloc.unlock();
+
     // activate parallel execution of fft routines
     init_fftw();
     //initialise_fft(m_cvts.xmax, m_cvts.ymax);
-    build_image_fft();
+    build_image_fft(m_use_border ? m_L->data() : m_Y->data());
 
     build_gaussian_fft();
 
@@ -296,6 +346,20 @@ void Reinhard02::compute_fourier_convolution() {
 #ifndef NDEBUG
     fprintf(stderr, "\n");
 #endif
+
+    FFTW_MUTEX::fftw_mutex_free.lock();
+    for (int scale = 0; scale < m_range; scale++) {
+        fftwf_free(m_filter_fft[scale]);
+    }
+    fftwf_free(m_filter_fft);
+    fftwf_free(m_convolution_fft);
+    fftwf_free(m_image_fft);
+    FFTW_MUTEX::fftw_mutex_free.unlock();
+
+    m_convolved = m_localConvolved.get();
+    if (cached) {
+        m_cache->set(m_localConvolved.release());
+    }
 }
 
 //
@@ -392,6 +456,9 @@ void Reinhard02::scale_to_midtone() {
     int hh = m_cvts.ymax >> 1;
 
     float scale_factor = 1.0f / log_average();
+    // without the border, the scale is uniform and the convolutions of the
+    // luminance are scaled by it instead
+    m_midtone = m_use_border ? 1.f : scale_factor * m_key;
     #pragma omp parallel for
     for (int y = 0; y < m_cvts.ymax; y++) {
         for (int x = 0; x < m_cvts.xmax; x++) {
@@ -422,11 +489,13 @@ void Reinhard02::scale_to_midtone() {
  * @param num number of scales to use in computation (default: 8)
  * @param low size in pixels of smallest scale (should be kept at 1)
  * @param high size in pixels of largest scale (default 1.6^8 = 43)
+ * @param cache see TonemapOperatorCache
  */
 
 Reinhard02::Reinhard02(const pfs::Array2Df *Y, pfs::Array2Df *L,
                        bool use_scales, float key, float phi, int num, int low,
-                       int high, bool temporal_coherent, pfs::Progress &ph)
+                       int high, bool temporal_coherent, pfs::Progress &ph,
+                       TonemapOperatorCache *cache)
     : m_cvts(CVTS()),
       m_sigma_0(0),
       m_sigma_1(0),
@@ -446,14 +515,18 @@ Reinhard02::Reinhard02(const pfs::Array2Df *Y, pfs::Array2Df *L,
       m_bbeta(0.f),
       m_threshold(0.05f),
       m_k(1.f / (2.f * 1.4142136f)),
-      m_ph(ph)
+      m_ph(ph),
+      m_cache(cache),
+      m_filter_fft(NULL),
+      m_image_fft(NULL),
+      m_convolution_fft(NULL),
+      m_convolved(NULL),
+      m_midtone(1.f)
 {
 
     m_cvts.xmax = m_Y->getCols();
     m_cvts.ymax = m_Y->getRows();
 
-    int length = m_cvts.xmax * m_cvts.ymax;
-
     m_sigma_0 = logf(m_scale_low);
     m_sigma_1 = logf(m_scale_high);
 
@@ -463,40 +536,10 @@ Reinhard02::Reinhard02(const pfs::Array2Df *Y, pfs::Array2Df *L,
     for (int y = 0; y < m_cvts.ymax; y++) {
         m_image[y] = &(*m_L)(0,y);
     }
-    if (use_scales) {
-        m_convolved_image = (float ***)malloc(m_range * sizeof(float **));
-        FFTW_MUTEX::fftw_mutex_alloc.lock();
-        m_image_fft = (fftwf_complex *)fftwf_alloc_complex(length);
-        m_filter_fft = (fftwf_complex **)fftwf_alloc_complex(m_range);
-        for (int scale = 0; scale < m_range; scale++) {
-            m_filter_fft[scale] = (fftwf_complex *)fftwf_alloc_complex(length);
-            m_convolved_image[scale] = (float **)malloc(m_cvts.ymax * sizeof(float *));
-            m_convolved_image[scale][0] = (float *)malloc(length * sizeof(float));
-            for (int y = 1; y < m_cvts.ymax; y++)
-                m_convolved_image[scale][y] = m_convolved_image[scale][0] + y * m_cvts.xmax;
-        }
-        m_convolution_fft = (fftwf_complex *)fftwf_alloc_complex(m_cvts.xmax * m_cvts.ymax);
-        FFTW_MUTEX::fftw_mutex_alloc.unlock();
-    }
 }
 
 Reinhard02::~Reinhard02() {
     free(m_image);
-    if (m_use_scales) {
-        FFTW_MUTEX::fftw_mutex_free.lock();
-        for (int scale = 0; scale < m_range; scale++) {
-            fftwf_free(m_filter_fft[scale]);
-        }
-        fftwf_free(m_filter_fft);
-        fftwf_free(m_convolution_fft);
-        fftwf_free(m_image_fft);
-        FFTW_MUTEX::fftw_mutex_free.unlock();
-        for (int scale = 0; scale < m_range; scale++) {
-            free(m_convolved_image[scale][0]);
-            free(m_convolved_image[scale]);
-        }
-        free(m_convolved_image);
-    }
 }
 
 void Reinhard02::tmo_reinhard02() {
@@ -34,12 +34,15 @@
 
 #include <fftw3.h>
 #include <boost/thread/mutex.hpp>
+#include <memory>
 
 #include <Libpfs/array2d_fwd.h>
 
 namespace pfs {
 class Progress;
 }
+class TonemapOperatorCache;
+struct Reinhard02Cache;
 
 //--- from defines.h
 typedef struct { int xmax, ymax; /* image dimensions */ } CVTS;
@@ -61,12 +64,15 @@ typedef float COLOR[3]; /* red, green, blue (or X,Y,Z) */
  * @param num number of scales to use in computation (default: 8)
  * @param low size in pixels of smallest scale (should be kept at 1)
  * @param high size in pixels of largest scale (default 1.6^8 = 43)
+ * @param cache see TonemapOperatorCache: keeps the luminance convolved at
+ * every scale, which depends on the input, num, low and high alone
  */
 class Reinhard02 {
    public:
     Reinhard02(const pfs::Array2Df *Y, pfs::Array2Df *L, bool use_scales,
                float key, float phi, int num, int low, int high,
-               bool temporal_coherent, pfs::Progress &ph);
+               bool temporal_coherent, pfs::Progress &ph,
+               TonemapOperatorCache *cache = NULL);
 
     ~Reinhard02();
 
@@ -88,11 +94,18 @@ class Reinhard02 {
     float m_threshold;
     float m_k;
     pfs::Progress &m_ph;
+    TonemapOperatorCache *m_cache;
 
     fftwf_complex **m_filter_fft;
     fftwf_complex *m_image_fft;
     fftwf_complex *m_convolution_fft;
-    float ***m_convolved_image;
+
+    //! \brief the luminance convolved at every scale, owned by the cache or
+    //! by m_localConvolved. The image the operator works on is these times
+    //! m_midtone, the factor scale_to_midtone() applies.
+    Reinhard02Cache *m_convolved;
+    std::unique_ptr<Reinhard02Cache> m_localConvolved;
+    float m_midtone;
 
     float bessel(float);
     float kaiserbessel(float, float, float);
@@ -102,7 +115,7 @@ class Reinhard02 {
     void scale_to_midtone();
     void gaussian_filter(fftwf_complex *, float, float);
     void build_gaussian_fft();
-    void build_image_fft();
+    void build_image_fft(const float *);
     void convolve_filter(int, fftwf_complex *);
     void compute_fourier_convolution();
 };
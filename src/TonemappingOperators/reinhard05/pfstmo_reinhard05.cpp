@@ -40,11 +40,13 @@
 #include "Libpfs/colorspace/colorspace.h"
 #include "Libpfs/exception.h"
 #include "Libpfs/frame.h"
+#include "Libpfs/manip/statistics.h"
 #include "Libpfs/progress.h"
+#include "TonemappingOperators/pfstmo.h"
 
 void pfstmo_reinhard05(pfs::Frame &frame, float brightness,
                        float chromaticadaptation, float lightadaptation,
-                       pfs::Progress &ph) {
+                       pfs::Progress &ph, Reinhard05Statistics *stats) {
 
 //--- default tone mapping parameters;
 // float brightness = 0.0f;
@@ -64,6 +66,26 @@ void pfstmo_reinhard05(pfs::Frame &frame, float brightness,
 
     ph.setValue(0);
 
+    // the reductions over the input are shared with the other users of the
+    // frame. Read before the channels are taken for writing, which drops
+    // the statistics of the frame
+    Reinhard05Statistics input;
+    if (!stats || !stats->valid) {
+        typedef pfs::FrameStatistics FS;
+        const FS frameStatistics = frame.statistics();
+        const FS::Signal channels[] = {FS::RED, FS::GREEN, FS::BLUE};
+        for (int c = 0; c < 3; c++) {
+            input.channelAverage[c] = frameStatistics.mean(channels[c]);
+            input.channelMin[c] = frameStatistics.minimum(channels[c]);
+            input.channelMax[c] = frameStatistics.maximum(channels[c]);
+        }
+        input.lumMin = frameStatistics.minimum(FS::LUMINANCE);
+        input.lumMax = frameStatistics.maximum(FS::LUMINANCE);
+        input.lumAverage = frameStatistics.mean(FS::LUMINANCE);
+        input.lumAdaptedAverage = frameStatistics.meanLog(FS::LUMINANCE, 2.3e-5f);
+        input.valid = true;
+    }
+
     pfs::Channel *R, *G, *B;
     frame.getXYZChannels(R, G, B);
     //---
@@ -81,11 +103,12 @@ void pfstmo_reinhard05(pfs::Frame &frame, float brightness,
     // I am pretty sure there is!
     pfs::Array2Df Y(width, height);
     pfs::transformRGB2Y(R, G, B, &Y);
+
     try {
         tmo_reinhard05(
             width, height, R->data(), G->data(), B->data(), Y.data(),
             Reinhard05Params(brightness, chromaticadaptation, lightadaptation),
-            ph);
+            ph, stats, input.valid ? &input : NULL);
     } catch (...) {
         throw pfs::Exception("Tonemapping Failed!");
     }
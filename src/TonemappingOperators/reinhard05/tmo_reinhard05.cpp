@@ -34,12 +34,14 @@
 #include "Libpfs/progress.h"
 #include "Libpfs/utils/msec_timer.h"
 #include "TonemappingOperators/pfstmo.h"
+#include "TonemappingOperators/tonecurve.h"
 
 #include <assert.h>
 #include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <numeric>
 #include "../../opthelper.h"
 #include "../../sleef.c"
@@ -49,23 +51,32 @@ using namespace std;
 
 namespace {
 
-void computeAverage(const float *samples, size_t width, size_t height, float &average) {
+void computeAverage(const float *samples, size_t width, size_t height, float &average,
+                    float &minimum, float &maximum) {
 
     double summation = 0.0; // always use double precision for large summations
+    float minSample = samples[0];
+    float maxSample = samples[0];
 #ifdef _OPENMP
-    #pragma omp parallel for reduction(+:summation)
+    #pragma omp parallel for reduction(+:summation) reduction(min:minSample) reduction(max:maxSample)
 #endif
     for (size_t y = 0; y < height; ++y) {
         for (size_t x = 0; x < width; ++x) {
             summation += samples[y * width + x];
+            minSample = std::min(minSample, samples[y * width + x]);
+            maxSample = std::max(maxSample, samples[y * width + x]);
         }
     }
     average = summation / (width * height);
+    minimum = minSample;
+    maximum = maxSample;
 }
 
 struct LuminanceProperties {
     float max;
     float min;
+    float linearMax;
+    float linearMin;
     float adaptedAverage;
     float average;
     float imageKey;
@@ -73,6 +84,9 @@ struct LuminanceProperties {
     float imageBrightness;
 };
 
+void completeLuminanceProperties(LuminanceProperties &luminanceProperties,
+                                 const Reinhard05Params &params);
+
 void computeLuminanceProperties(const float *samples, size_t width, size_t height,
                                 LuminanceProperties &luminanceProperties,
                                 const Reinhard05Params &params) {
@@ -137,11 +151,21 @@ void computeLuminanceProperties(const float *samples, size_t width, size_t heigh
 }
 }
 
-    luminanceProperties.max = xlogf(max_lum);
-    luminanceProperties.min = xlogf(min_lum);
+    luminanceProperties.linearMax = max_lum;
+    luminanceProperties.linearMin = min_lum;
     luminanceProperties.adaptedAverage = adapted_lum / (width * height);
     luminanceProperties.average = avg_lum / (width * height);
 
+    completeLuminanceProperties(luminanceProperties, params);
+}
+
+//! \brief image key, contrast and brightness from the linear extrema and the
+//! averages of the luminance
+void completeLuminanceProperties(LuminanceProperties &luminanceProperties,
+                                 const Reinhard05Params &params) {
+    luminanceProperties.max = xlogf(luminanceProperties.linearMax);
+    luminanceProperties.min = xlogf(luminanceProperties.linearMin);
+
     // image key (k)
     luminanceProperties.imageKey =
         (luminanceProperties.max - luminanceProperties.adaptedAverage) /
@@ -246,6 +270,48 @@ void transformChannel(const float *samplesChannel,
 }
 }
 
+//! \brief same as transformChannel, with the photoreceptor semi-saturation
+//! taken from a lookup table of the adaptation level
+void transformChannelLUT(const float *samplesChannel,
+                         const float *samplesLuminance,
+                         float *outputSamples, size_t size,
+                         float channelAverage,
+                         const Reinhard05Params &params,
+                         const LuminanceProperties &lumProps,
+                         const ToneCurveLUT &semiSaturation,
+                         float &minSample, float &maxSample) {
+    // global light adaptation
+    const float Ig =
+        (params.m_chromaticAdaptation * channelAverage) +
+        ((1.f - params.m_chromaticAdaptation) * lumProps.average);
+
+    float minSampleThr = minSample;
+    float maxSampleThr = maxSample;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(min:minSampleThr) reduction(max:maxSampleThr)
+#endif
+    for (size_t i = 0; i < size; ++i) {
+        float chval = samplesChannel[i];
+        float yval = samplesLuminance[i];
+        if (yval != 0.0f && chval != 0.0f) {
+            // local light adaptation
+            float Il = (params.m_chromaticAdaptation * chval) +
+                       ((1.f - params.m_chromaticAdaptation) * yval);
+            // interpolated light adaptation
+            float Ia = (params.m_lightAdaptation * Il) +
+                       ((1.f - params.m_lightAdaptation) * Ig);
+            // photoreceptor equation
+            chval /= chval + semiSaturation(Ia);
+
+            maxSampleThr = std::max(chval, maxSampleThr);
+            minSampleThr = std::min(chval, minSampleThr);
+        }
+        outputSamples[i] = chval;
+    }
+    minSample = minSampleThr;
+    maxSample = maxSampleThr;
+}
+
 void normalizeChannel(float *samples, size_t width, size_t height, float min, float max) {
 
     float dividor = max - min;
@@ -264,46 +330,106 @@ void normalizeChannel(float *samples, size_t width, size_t height, float min, fl
 
 void tmo_reinhard05(size_t width, size_t height, float *nR, float *nG,
                     float *nB, const float *nY, const Reinhard05Params &params,
-                    pfs::Progress &ph) {
+                    pfs::Progress &ph, Reinhard05Statistics *stats,
+                    const Reinhard05Statistics *input) {
 #ifdef TIMER_PROFILING
     msec_timer stop_watch;
     stop_watch.start();
 #endif
 
     float Cav[] = {0.0f, 0.0f, 0.0f};
-
-    computeAverage(nR, width, height, Cav[0]);
-    ph.setValue(2);
-
-    computeAverage(nG, width, height, Cav[1]);
-    ph.setValue(4);
-
-    computeAverage(nB, width, height, Cav[2]);
-    ph.setValue(6);
-
+    float Cmin[3];
+    float Cmax[3];
     LuminanceProperties luminanceProperties;
-    computeLuminanceProperties(nY, width, height, luminanceProperties, params);
-    ph.setValue(11);
+
+    const Reinhard05Statistics *known = (stats && stats->valid) ? stats : input;
+    if (known) {
+        for (int c = 0; c < 3; c++) {
+            Cav[c] = known->channelAverage[c];
+            Cmin[c] = known->channelMin[c];
+            Cmax[c] = known->channelMax[c];
+        }
+        luminanceProperties.linearMin = known->lumMin;
+        luminanceProperties.linearMax = known->lumMax;
+        luminanceProperties.average = known->lumAverage;
+        luminanceProperties.adaptedAverage = known->lumAdaptedAverage;
+        completeLuminanceProperties(luminanceProperties, params);
+        ph.setValue(11);
+    } else {
+        computeAverage(nR, width, height, Cav[0], Cmin[0], Cmax[0]);
+        ph.setValue(2);
+
+        computeAverage(nG, width, height, Cav[1], Cmin[1], Cmax[1]);
+        ph.setValue(4);
+
+        computeAverage(nB, width, height, Cav[2], Cmin[2], Cmax[2]);
+        ph.setValue(6);
+
+        computeLuminanceProperties(nY, width, height, luminanceProperties,
+                                   params);
+        ph.setValue(11);
+    }
 
     // output
     float max_col = std::numeric_limits<float>::min();
     float min_col = std::numeric_limits<float>::max();
 
 
-    // transform Red Channel
-    transformChannel(nR, nY, nR, width, height, Cav[0], params, luminanceProperties,
-                     min_col, max_col);
-    ph.setValue(38);
+    // large images: tabulate the semi-saturation over the range of the
+    // adaptation level, which is increasing in the channel and the luminance
+    std::unique_ptr<ToneCurveLUT> semiSaturation;
+    if (ToneCurveLUT::worthwhile(width * height)) {
+        const float ca = params.m_chromaticAdaptation;
+        const float la = params.m_lightAdaptation;
+        float minIa = numeric_limits<float>::max();
+        float maxIa = 0.f;
+        for (int c = 0; c < 3; c++) {
+            const float Ig = (ca * Cav[c]) + ((1.f - ca) * luminanceProperties.average);
+            const float lo = la * (ca * Cmin[c] + (1.f - ca) * luminanceProperties.linearMin) + (1.f - la) * Ig;
+            const float hi = la * (ca * Cmax[c] + (1.f - ca) * luminanceProperties.linearMax) + (1.f - la) * Ig;
+            minIa = std::min(minIa, lo);
+            maxIa = std::max(maxIa, hi);
+        }
+        const float brightness = luminanceProperties.imageBrightness;
+        const float contrast = luminanceProperties.imageContrast;
+        semiSaturation.reset(new ToneCurveLUT(
+            [=](float Ia) { return pow_F(brightness * Ia, contrast); },
+            0.999f * minIa, 1.001f * maxIa, 1e-5f));
+        if (!semiSaturation->valid()) {
+            semiSaturation.reset();
+        }
+    }
 
-    // transform Green Channel
-    transformChannel(nG, nY, nG, width, height, Cav[1], params, luminanceProperties,
-                     min_col, max_col);
-    ph.setValue(58);
+    float *channels[] = {nR, nG, nB};
+    for (int c = 0; c < 3; c++) {
+        if (semiSaturation) {
+            transformChannelLUT(channels[c], nY, channels[c], width * height, Cav[c],
+                                params, luminanceProperties, *semiSaturation,
+                                min_col, max_col);
+        } else {
+            transformChannel(channels[c], nY, channels[c], width, height, Cav[c],
+                             params, luminanceProperties, min_col, max_col);
+        }
+        ph.setValue(38 + 20 * c);
+    }
 
-    // transform Blue Channel
-    transformChannel(nB, nY, nB, width, height, Cav[2], params, luminanceProperties,
-                     min_col, max_col);
-    ph.setValue(78);
+    if (stats && stats->valid) {
+        min_col = stats->outputMin;
+        max_col = stats->outputMax;
+    } else if (stats) {
+        for (int c = 0; c < 3; c++) {
+            stats->channelAverage[c] = Cav[c];
+            stats->channelMin[c] = Cmin[c];
+            stats->channelMax[c] = Cmax[c];
+        }
+        stats->lumMin = luminanceProperties.linearMin;
+        stats->lumMax = luminanceProperties.linearMax;
+        stats->lumAverage = luminanceProperties.average;
+        stats->lumAdaptedAverage = luminanceProperties.adaptedAverage;
+        stats->outputMin = min_col;
+        stats->outputMax = max_col;
+        stats->valid = true;
+    }
 
     //--- normalize intensities
     // normalize RED channel
@@ -38,6 +38,7 @@
 namespace pfs {
 class Progress;
 }
+struct Reinhard05Statistics;
 
 struct Reinhard05Params {
     Reinhard05Params(float brightness, float chromaticAdaptation,
@@ -65,8 +66,12 @@ struct Reinhard05Params {
 //! \param br brightness level -8:8 (def 0)
 //! \param ca amount of chromatic adaptation 0:1 (saturation, def 0)
 //! \param la amount of light adaptation 0:1 (local/global, def 1)
+//! \param stats statistics of the whole image, see TonemapOperatorStatistics
+//! \param input statistics of R, G, B and Y already known to the caller, used
+//! when \a stats holds none. Its output range is ignored
 void tmo_reinhard05(size_t width, size_t height, float *R, float *G, float *B,
                     const float *Y, const Reinhard05Params &params,
-                    pfs::Progress &ph);
+                    pfs::Progress &ph, Reinhard05Statistics *stats = NULL,
+                    const Reinhard05Statistics *input = NULL);
 
 #endif  // TMO_REINHARD05_H
@@ -0,0 +1,163 @@
+/**
+ * @brief Lookup tables for the luminance mapping of global operators
+ *
+ * This file is a part of LuminanceHDR package.
+ * ----------------------------------------------------------------------
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef PFSTMO_TONECURVE_H
+#define PFSTMO_TONECURVE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+//! \brief Scalar curve y = f(x), x > 0, compiled into a dense lookup table
+//! with knots evenly spaced in log(x)
+//!
+//! The table is indexed directly by the bits of the IEEE representation of x:
+//! the exponent and the leading mantissa bits select the segment, the
+//! remaining mantissa bits give the interpolation weight. Each segment lies
+//! inside one octave, so the lookup is a piecewise linear interpolation in x
+//! and needs no transcendental function. A monotone curve stays monotone.
+//!
+//! The number of segments per octave is chosen at construction: it grows until
+//! the interpolation error is below absTolerance + relTolerance * |f(x)|. The
+//! error is an estimate, sampled at the quarters of every segment. When the
+//! tolerance cannot be achieved, or the curve is not finite over the range,
+//! valid() returns false and the caller should evaluate the curve directly.
+//! Inputs are clamped to [minX, maxX].
+class ToneCurveLUT {
+   public:
+    //! \brief compile \a curve over [\a minX, \a maxX]. \a curve is called
+    //! concurrently and must be thread safe.
+    template <typename Curve>
+    ToneCurveLUT(const Curve &curve, float minX, float maxX,
+                 float relTolerance, float absTolerance = 0.f)
+        : m_minX(std::max(minX, 1e-30f)),
+          m_maxX(std::max(maxX, m_minX)),
+          m_valid(false) {
+        int bits = s_initialBits;
+        while (bits <= s_maximumBits) {
+            const float error = compile(curve, bits, relTolerance, absTolerance);
+            if (error <= 1.f) {
+                m_valid = true;
+                break;
+            }
+            // NaN or infinity: more segments will not help
+            if (!std::isfinite(error)) break;
+            // the interpolation error shrinks by 4 for every additional bit
+            bits += std::max(1, int(std::ceil(std::log(error) / std::log(4.f))));
+        }
+    }
+
+    //! \brief below about a megapixel compiling the table costs more than
+    //! evaluating the curve on every pixel
+    static bool worthwhile(size_t pixels) { return pixels >= (size_t(1) << 20); }
+
+    bool valid() const { return m_valid; }
+
+    //! \brief number of segments per octave is 2^bitsPerOctave()
+    int bitsPerOctave() const { return 23 - m_shift; }
+
+    size_t size() const { return m_table.size(); }
+
+    float operator()(float x) const {
+        x = (x > m_minX) ? x : m_minX;
+        x = (x < m_maxX) ? x : m_maxX;
+        const uint32_t rel = floatBits(x) - m_baseBits;
+        const uint32_t index = rel >> m_shift;
+        const float w = (rel & m_mask) * m_weight;
+        return m_table[index] + w * (m_table[index + 1] - m_table[index]);
+    }
+
+   private:
+    static const int s_initialBits = 7;
+    static const int s_maximumBits = 14;
+
+    static uint32_t floatBits(float x) {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return bits;
+    }
+
+    static float bitsFloat(uint32_t bits) {
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        return x;
+    }
+
+    //! \brief sample \a curve with 2^bits segments per octave, return an
+    //! estimate of the largest error relative to the tolerance, or infinity
+    //! when the curve is not finite
+    template <typename Curve>
+    float compile(const Curve &curve, int bits, float relTolerance,
+                  float absTolerance) {
+        m_shift = 23 - bits;
+        m_mask = (uint32_t(1) << m_shift) - 1;
+        m_weight = 1.f / float(uint32_t(1) << m_shift);
+        m_baseBits = floatBits(m_minX) & ~m_mask;
+
+        const int segments = ((floatBits(m_maxX) - m_baseBits) >> m_shift) + 1;
+        m_table.resize(segments + 1);
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int k = 0; k <= segments; k++) {
+            m_table[k] = curve(bitsFloat(m_baseBits + (uint32_t(k) << m_shift)));
+        }
+
+        // linear interpolation errs the most inside the segments: check at
+        // their quarters
+        float error = 0.f;
+#ifdef _OPENMP
+        #pragma omp parallel for reduction(max:error)
+#endif
+        for (int k = 0; k < segments; k++) {
+            for (int q = 1; q < 4; q++) {
+                const float x = bitsFloat(m_baseBits + (uint32_t(k) << m_shift) +
+                                          (uint32_t(q) << (m_shift - 2)));
+                const float exact = curve(x);
+                const float approx =
+                    m_table[k] + 0.25f * q * (m_table[k + 1] - m_table[k]);
+                const float e = std::fabs(approx - exact) /
+                                (absTolerance + relTolerance * std::fabs(exact) +
+                                 1e-30f);
+                error = std::isfinite(e)
+                            ? std::max(error, e)
+                            : std::numeric_limits<float>::infinity();
+            }
+        }
+        return error;
+    }
+
+    float m_minX;
+    float m_maxX;
+    bool m_valid;
+
+    int m_shift;
+    uint32_t m_mask;
+    float m_weight;
+    uint32_t m_baseBits;
+    std::vector<float> m_table;
+};
+
+#endif  // PFSTMO_TONECURVE_H
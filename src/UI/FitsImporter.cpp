@@ -29,6 +29,8 @@
 #include <QImage>
 #include <QLabel>
 #include <QMessageBox>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QPixmap>
 #include <QRgb>
 #include <QtConcurrentFilter>
@@ -54,6 +56,30 @@ using namespace pfs::colorspace;
 static const int previewWidth = 300;
 static const int previewHeight = 200;
 
+namespace {
+//! \brief LoadFile for the concurrent loads of the channels: keeps the first
+//! error, to be reported once every load is over
+struct LoadFitsFile {
+    LoadFitsFile(QString &error, QMutex &mutex)
+        : m_error(error), m_mutex(mutex) {}
+
+    void operator()(HdrCreationItem &currentItem) const {
+        try {
+            LoadFile(true)(currentItem);
+        } catch (std::runtime_error &err) {
+            qDebug() << err.what();
+            QMutexLocker locker(&m_mutex);
+            if (m_error.isEmpty()) {
+                m_error = QString(err.what());
+            }
+        }
+    }
+
+    QString &m_error;
+    QMutex &m_mutex;
+};
+}
+
 FitsImporter::~FitsImporter() {}
 
 FitsImporter::FitsImporter(QWidget *parent)
@@ -193,21 +219,14 @@ void FitsImporter::on_pushButtonLoad_clicked() {
     m_tmpdata.push_back(HdrCreationItem(m_luminosityChannel));
     m_tmpdata.push_back(HdrCreationItem(m_hChannel));
 
-    // parallel load of the data...
-    // connect(&m_futureWatcher, SIGNAL(finished()), this,
-    // SLOT(loadFilesDone()),
-    // Qt::DirectConnection);
-
-    // Start the computation.
-    // m_futureWatcher.setFuture( QtConcurrent::map(m_tmpdata.begin(),
-    // m_tmpdata.end(), LoadFile()) );
+    // parallel load of the data: one reader per file, as cfitsio cannot
+    // share a file between threads
     QString error_string;
-    try {
-        std::for_each(m_tmpdata.begin(), m_tmpdata.end(), LoadFile(true));
-    } catch (std::runtime_error &err) {
+    QMutex error_mutex;
+    QtConcurrent::blockingMap(m_tmpdata,
+                              LoadFitsFile(error_string, error_mutex));
+    if (!error_string.isEmpty()) {
         QApplication::restoreOverrideCursor();
-        error_string = QString(err.what());
-        qDebug() << err.what();
     }
 
     loadFilesDone(error_string);
@@ -39,6 +39,11 @@ namespace {
 const static QString IMAGE_QUALITY_KEY =
     QStringLiteral("imagequalitydialog/quality");
 const static int IMAGE_QUALITY_DEFAULT = 98;
+
+const static QString JPEG_PROGRESSIVE_KEY =
+    QStringLiteral("imagequalitydialog/progressive");
+const static QString JPEG_OPTIMIZE_CODING_KEY =
+    QStringLiteral("imagequalitydialog/optimize_coding");
 }
 
 ImageQualityDialog::ImageQualityDialog(const pfs::Frame *frame,
@@ -58,12 +63,20 @@ ImageQualityDialog::ImageQualityDialog(const pfs::Frame *frame,
     } else {
         m_ui->spinBox->setValue(100);
     }
+    setJpegOptions(m_options->value(JPEG_PROGRESSIVE_KEY, false).toBool(),
+                   m_options->value(JPEG_OPTIMIZE_CODING_KEY, false).toBool());
+    m_ui->jpegOptionsPanel->setVisible(
+        m_format.startsWith(QLatin1String("jp")));
 
     if (frame) {
         connect(m_ui->spinBox, SIGNAL(valueChanged(int)), this,
                 SLOT(reset(int)));
         connect(m_ui->horizontalSlider, &QAbstractSlider::valueChanged, this,
                 &ImageQualityDialog::reset);
+        connect(m_ui->progressiveCheckBox, &QAbstractButton::toggled, this,
+                &ImageQualityDialog::reset);
+        connect(m_ui->optimizeCodingCheckBox, &QAbstractButton::toggled, this,
+                &ImageQualityDialog::reset);
     } else {
         m_ui->fileSizePanel->setVisible(false);
     }
@@ -78,14 +91,34 @@ ImageQualityDialog::~ImageQualityDialog() {
     if (m_frame) {
         m_options->setValue(IMAGE_QUALITY_KEY, getQuality());
     }
+    if (m_format.startsWith(QLatin1String("jp"))) {
+        m_options->setValue(JPEG_PROGRESSIVE_KEY, getProgressive());
+        m_options->setValue(JPEG_OPTIMIZE_CODING_KEY, getOptimizeCoding());
+    }
 }
 
 int ImageQualityDialog::getQuality(void) const {
     return m_ui->spinBox->value();
 }
 
+bool ImageQualityDialog::getProgressive() const {
+    return m_ui->progressiveCheckBox->isChecked();
+}
+
+bool ImageQualityDialog::getOptimizeCoding() const {
+    return m_ui->optimizeCodingCheckBox->isChecked();
+}
+
+void ImageQualityDialog::setJpegOptions(bool progressive,
+                                        bool optimizeCoding) {
+    m_ui->progressiveCheckBox->setChecked(progressive);
+    m_ui->optimizeCodingCheckBox->setChecked(optimizeCoding);
+}
+
 void ImageQualityDialog::on_getSizeButton_clicked() {
     pfs::Params params("quality", (size_t)getQuality());
+    params.set("progressive", getProgressive());
+    params.set("optimize_coding", getOptimizeCoding());
 
     setCursor(QCursor(Qt::WaitCursor));
     int size = 0;
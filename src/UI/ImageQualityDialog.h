@@ -47,6 +47,11 @@ class ImageQualityDialog : public QDialog {
 
     int getQuality(void) const;
 
+    //! \brief JPEG encoding options, unused for the other formats
+    bool getProgressive() const;
+    bool getOptimizeCoding() const;
+    void setJpegOptions(bool progressive, bool optimizeCoding);
+
    protected slots:
     void on_getSizeButton_clicked();
     void reset(int);
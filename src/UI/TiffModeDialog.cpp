@@ -33,6 +33,10 @@ const static int TIFF_MODE_HDR_VALUE = 0;
 const static QString TIFF_MODE_LDR_KEY =
     QStringLiteral("tiffmodedialog/mode/ldr");
 const static int TIFF_MODE_LDR_VALUE = 0;
+
+const static QString TIFF_DEFLATE_LEVEL_KEY =
+    QStringLiteral("tiffmodedialog/deflate_level");
+const static int TIFF_DEFLATE_LEVEL_VALUE = -1;
 }
 
 TiffModeDialog::TiffModeDialog(bool hdrMode, int defaultValue, QWidget *parent)
@@ -66,6 +70,18 @@ TiffModeDialog::TiffModeDialog(bool hdrMode, int defaultValue, QWidget *parent)
                 m_options->value(TIFF_MODE_LDR_KEY, TIFF_MODE_LDR_VALUE)
                     .toInt());
     }
+    m_ui->deflateLevelSpinBox->setValue(
+        m_options->value(TIFF_DEFLATE_LEVEL_KEY, TIFF_DEFLATE_LEVEL_VALUE)
+            .toInt());
+
+    // LogLuv files are not deflated
+    connect(m_ui->comboBox, static_cast<void (QComboBox::*)(int)>(
+                                &QComboBox::currentIndexChanged),
+            this, [this]() {
+                m_ui->deflateLevelSpinBox->setEnabled(getTiffWriterMode() !=
+                                                      3);
+            });
+    m_ui->deflateLevelSpinBox->setEnabled(getTiffWriterMode() != 3);
 
 #ifdef Q_OS_MACOS
     this->setWindowModality(
@@ -79,6 +95,7 @@ TiffModeDialog::~TiffModeDialog() {
     } else {
         m_options->setValue(TIFF_MODE_LDR_KEY, m_ui->comboBox->currentIndex());
     }
+    m_options->setValue(TIFF_DEFLATE_LEVEL_KEY, getDeflateLevel());
 }
 
 int TiffModeDialog::getTiffWriterMode() {
@@ -88,3 +105,11 @@ int TiffModeDialog::getTiffWriterMode() {
         return m_ui->comboBox->currentIndex();
     }
 }
+
+int TiffModeDialog::getDeflateLevel() const {
+    return m_ui->deflateLevelSpinBox->value();
+}
+
+void TiffModeDialog::setDeflateLevel(int level) {
+    m_ui->deflateLevelSpinBox->setValue(level);
+}
@@ -41,6 +41,10 @@ class TiffModeDialog : public QDialog {
 
     int getTiffWriterMode();
 
+    //! \brief zlib level of the deflated strips, -1 for the zlib default
+    int getDeflateLevel() const;
+    void setDeflateLevel(int level);
+
    private:
     bool m_hdrMode;
     QScopedPointer<Ui::TiffModeDialog> m_ui;
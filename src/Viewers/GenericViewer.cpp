@@ -48,6 +48,7 @@ GenericViewer::GenericViewer(pfs::Frame *frame, QWidget *parent, bool ns)
     : QWidget(parent),
       mViewerMode(FIT_WINDOW),
       mNeedsSaving(ns),
+      mIsPreview(false),
       mFrame(frame) {
     mVBL = new QVBoxLayout(this);
     mVBL->setSpacing(0);
@@ -336,7 +337,10 @@ void GenericViewer::syncViewer(GenericViewer *src) {
 
 float GenericViewer::getScaleFactor() { return mView->transform().m11(); }
 
-QImage GenericViewer::getQImage() const { return mPixmap->pixmap().toImage(); }
+QImage GenericViewer::getQImage() {
+    completePixmap();
+    return mPixmap->pixmap().toImage();
+}
 
 void GenericViewer::setQImage(const QImage &qimage) {
     QPixmap pixmap = QPixmap::fromImage(qimage);
@@ -386,6 +390,8 @@ void GenericViewer::setFrame(pfs::Frame *new_frame,
 pfs::Frame *GenericViewer::getFrame() const { return mFrame.get(); }
 
 void GenericViewer::startDragging() {
+    completePixmap();
+
     QDrag *drag = new QDrag(this);
     QMimeData *mimeData = new QMimeData;
     mimeData->setImageData(mPixmap->pixmap().toImage());
@@ -115,6 +115,11 @@ class GenericViewer : public QWidget {
     bool needsSaving();
     void setNeedsSaving(bool);
 
+    //! \brief true while the frame is only a coarse pass of a progressive
+    //! tonemapping, which must not be saved
+    bool isPreview() const;
+    void setPreview(bool);
+
     //! \brief get filename if set, or an empty string
     const QString &getFileName() const;
 
@@ -144,7 +149,7 @@ class GenericViewer : public QWidget {
     virtual QString getExifComment() = 0;
 
     //! \brief returns a QImage that reflects the content of the viewerport
-    QImage getQImage() const;
+    QImage getQImage();
 
     //! \brief set new QImage
     void setQImage(const QImage &qimage);
@@ -176,6 +181,10 @@ class GenericViewer : public QWidget {
     virtual void retranslateUi();
     virtual void changeEvent(QEvent *event);
 
+    //! \brief Bring the pixmap up to date with the frame, for the viewers
+    //! that update it lazily. Called before the pixmap is handed out
+    virtual void completePixmap() {}
+
     void closeEvent(QCloseEvent *event);
 
     QToolBar *mToolBar;
@@ -204,6 +213,7 @@ class GenericViewer : public QWidget {
     float getScaleFactor();
 
     bool mNeedsSaving;
+    bool mIsPreview;
     std::shared_ptr<pfs::Frame> mFrame;
 
     QAction *m_actionClose;
@@ -224,6 +234,10 @@ inline bool GenericViewer::needsSaving(void) { return mNeedsSaving; }
 
 inline void GenericViewer::setNeedsSaving(bool s) { mNeedsSaving = s; }
 
+inline bool GenericViewer::isPreview() const { return mIsPreview; }
+
+inline void GenericViewer::setPreview(bool p) { mIsPreview = p; }
+
 inline const QString &GenericViewer::getFileName() const { return mFileName; }
 
 inline void GenericViewer::setFileName(const QString &fn) { mFileName = fn; }
@@ -30,6 +30,7 @@
 #include <QDebug>
 #include <QFileInfo>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include "arch/math.h"
@@ -38,27 +39,22 @@
 
 #include "Fileformat/pfsoutldrimage.h"
 #include "Viewers/IGraphicsPixmapItem.h"
+#include "Viewers/IGraphicsView.h"
 #include "Viewers/LuminanceRangeWidget.h"
 
 #include "Libpfs/array2d.h"
 #include "Libpfs/channel.h"
 #include "Libpfs/frame.h"
+#include "Libpfs/manip/pyramid.h"
 #include "Libpfs/utils/msec_timer.h"
 #include "Libpfs/utils/sse.h"
 
-namespace  // anonymous namespace
-{
-// Implementation details stay inside an anonymous namespace
-// In this way, we let know the compiler it can mess up as much as it wants with
-// the code,
-// because it will only used inside this compilation unit
-
-const pfs::Array2Df *getPrimaryChannel(const pfs::Frame &frame) {
-    return frame.getChannel("Y");
+namespace {
+//! \brief the whole frame is mapped again once the range window or the
+//! mapping method have not changed for this long (msec)
+const int s_refreshDelay = 300;
 }
 
-}  // end anonymous namespace
-
 HdrViewer::HdrViewer(pfs::Frame *frame, QWidget *parent, bool ns)
     : GenericViewer(frame, parent, ns),
       m_mappingMethod(MAP_GAMMA2_2),
@@ -66,12 +62,25 @@ HdrViewer::HdrViewer(pfs::Frame *frame, QWidget *parent, bool ns)
       m_maxValue(1.f) {
     initUi();
 
+    m_preview = new QGraphicsPixmapItem(mPixmap);
+    m_preview->setTransformationMode(Qt::SmoothTransformation);
+    // mouse events (selection, dragging) go to the pixmap below
+    m_preview->setAcceptedMouseButtons(Qt::NoButton);
+    m_preview->hide();
+
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(s_refreshDelay);
+    connect(m_refreshTimer, &QTimer::timeout, this, &HdrViewer::refreshPixmap);
+    // panned or zoomed
+    connect(this, &GenericViewer::changed, this, &HdrViewer::updatePreview);
+
     if (frame != nullptr)
     {
     // I prefer to do everything by hand, so the flow of the calls is clear
     m_lumRange->blockSignals(true);
 
-    m_lumRange->setHistogramImage(getPrimaryChannel(*getFrame()));
+    m_lumRange->setHistogramFrame(getFrame());
     m_lumRange->fitToDynamicRange();
 
     m_mappingMethod =
@@ -135,14 +144,82 @@ void HdrViewer::retranslateUi() {
 }
 
 void HdrViewer::refreshPixmap() {
+    m_refreshTimer->stop();
     setCursor(Qt::WaitCursor);
 
     QScopedPointer<QImage> qImage(mapFrameToImage(getFrame()));
     mPixmap->setPixmap(QPixmap::fromImage(*qImage));
 
+    m_preview->hide();
+    m_preview->setPixmap(QPixmap());
+
     unsetCursor();
 }
 
+void HdrViewer::completePixmap() {
+    if (m_refreshTimer->isActive()) refreshPixmap();
+}
+
+//! \brief Interactive changes of the range window or of the mapping method
+//! only map the area in view: the pixmap of the whole frame is mapped again
+//! when the changes stop
+void HdrViewer::refreshPreview() {
+    if (getFrame() == NULL) return;
+
+    m_refreshTimer->start();
+    updatePreview();
+}
+
+//! \brief The area in view is mapped from the smallest level of the pyramid
+//! of the frame that still has a pixel for every pixel on screen, so the cost
+//! depends on the size of the view, not on the size of the frame
+void HdrViewer::updatePreview() {
+    pfs::Frame *frame = getFrame();
+    if (!m_refreshTimer->isActive() || frame == NULL) return;
+
+    const int width = frame->getWidth();
+    const int height = frame->getHeight();
+
+    const QRectF visible =
+        mPixmap
+            ->mapFromScene(
+                mView->mapToScene(mView->viewport()->rect()).boundingRect())
+            .boundingRect() &
+        QRectF(0, 0, width, height);
+    if (visible.isEmpty()) {
+        m_preview->hide();
+        return;
+    }
+
+    const qreal scale = mView->transform().m11() * devicePixelRatio();
+    std::shared_ptr<const pfs::Frame> levelPtr = frame->pyramid()->levelFor(
+        std::max<size_t>(1, static_cast<size_t>(std::ceil(width * scale))));
+    const pfs::Frame &level = *levelPtr;
+    const qreal sx = qreal(width) / level.getWidth();
+    const qreal sy = qreal(height) / level.getHeight();
+
+    const int left = static_cast<int>(std::floor(visible.left() / sx));
+    const int top = static_cast<int>(std::floor(visible.top() / sy));
+    const int right = std::min<int>(
+        static_cast<int>(std::ceil(visible.right() / sx)), level.getWidth());
+    const int bottom = std::min<int>(
+        static_cast<int>(std::ceil(visible.bottom() / sy)), level.getHeight());
+    const QRect rect(left, top, right - left, bottom - top);
+    if (rect.isEmpty()) {
+        m_preview->hide();
+        return;
+    }
+
+    QImage image(rect.size(), QImage::Format_RGB32);
+    mapFrameToQImage(level, rect, image, m_minValue, m_maxValue,
+                     m_mappingMethod);
+
+    m_preview->setPixmap(QPixmap::fromImage(image));
+    m_preview->setOffset(rect.topLeft());
+    m_preview->setTransform(QTransform::fromScale(sx, sy));
+    m_preview->show();
+}
+
 void HdrViewer::updatePixmap() {
 #ifdef QT_DEBUG
     qDebug() << "void HdrViewer::updatePixmap()";
@@ -153,7 +230,7 @@ void HdrViewer::updatePixmap() {
     refreshPixmap();
 
     // I need to set the histogram again during the setFrame function
-    m_lumRange->setHistogramImage(getPrimaryChannel(*getFrame()));
+    m_lumRange->setHistogramFrame(getFrame());
     m_lumRange->fitToDynamicRange();
     m_lumRange->blockSignals(false);
 }
@@ -169,7 +246,7 @@ void HdrViewer::setRangeWindow(float min, float max) {
     m_minValue = min;
     m_maxValue = max;
 
-    refreshPixmap();
+    refreshPreview();
 }
 
 int HdrViewer::getLumMappingMethod() {
@@ -180,7 +257,7 @@ void HdrViewer::setLumMappingMethod(int method) {
     m_mappingMethodCB->setCurrentIndex(method);
     m_mappingMethod = static_cast<RGBMappingType>(method);
 
-    refreshPixmap();
+    refreshPreview();
 }
 
 //! empty dtor
@@ -32,10 +32,12 @@
 #define IMAGEHDRVIEWER_H
 
 #include <QComboBox>
+#include <QGraphicsPixmapItem>
 #include <QImage>
 #include <QKeyEvent>
 #include <QLabel>
 #include <QScopedPointer>
+#include <QTimer>
 #include <iostream>
 
 #include "GenericViewer.h"
@@ -79,11 +81,20 @@ class HdrViewer : public GenericViewer {
    protected Q_SLOTS:
     virtual void updatePixmap();
 
+   private Q_SLOTS:
+    //! \brief map the whole frame into the pixmap
+    void refreshPixmap();
+
+    //! \brief while the pixmap is out of date, map the part of the frame in
+    //! view into the preview on top of it
+    void updatePreview();
+
    protected:
     // Methods
     virtual void retranslateUi();
     void setRangeWindow(float min, float max);
     void keyPressEvent(QKeyEvent *event);
+    void completePixmap();
 
     // UI
     LuminanceRangeWidget *m_lumRange;
@@ -93,12 +104,18 @@ class HdrViewer : public GenericViewer {
 
    private:
     void initUi();
-    void refreshPixmap();
+    void refreshPreview();
 
     RGBMappingType m_mappingMethod;
     float m_minValue;
     float m_maxValue;
 
+    //! \brief the area in view, mapped with the current settings while the
+    //! pixmap below is out of date
+    QGraphicsPixmapItem *m_preview;
+    //! \brief pending refresh of the whole pixmap
+    QTimer *m_refreshTimer;
+
     QImage *mapFrameToImage(pfs::Frame *in_frame);
 };
 
@@ -79,6 +79,29 @@ void Histogram::computeLog(const pfs::Array2Df *image, float min, float max) {
     for (int i = 0; i < bins; i++) P[i] /= (float)(count / accuracy);
 }
 
+void Histogram::computeLog(const std::vector<size_t> &counts, float countsMin,
+                           float countsMax, float min, float max) {
+    // Empty all bins
+    for (int i = 0; i < bins; i++) P[i] = 0;
+
+    float count = 0;
+    float binWidth = (max - min) / (float)bins;
+    float countsWidth = (countsMax - countsMin) / (float)counts.size();
+    for (size_t j = 0; j < counts.size(); j++) {
+        if (counts[j] == 0) continue;
+        float v = countsMin + ((float)j + 0.5f) * countsWidth;
+        int bin = (int)((v - min) / binWidth);
+        if (bin > bins || bin < 0) continue;
+        if (bin == bins) bin = bins - 1;
+        P[bin] += counts[j];
+        count += counts[j];
+    }
+
+    // Normalize, to get probability
+    if (count > 0)
+        for (int i = 0; i < bins; i++) P[i] /= count;
+}
+
 float Histogram::getMaxP() const {
     float maxP = -1;
     for (int i = 0; i < bins; i++) {
@@ -28,6 +28,8 @@
  */
 
 #include <assert.h>
+#include <cstddef>
+#include <vector>
 #include "Libpfs/array2d_fwd.h"
 
 class Histogram {
@@ -43,6 +45,11 @@ class Histogram {
     void computeLog(const pfs::Array2Df *image);
     void computeLog(const pfs::Array2Df *image, float min, float max);
 
+    //! \brief rebin \a counts, a finer histogram evenly spaced in log10 over
+    //! [\a countsMin, \a countsMax], to the range [\a min, \a max]
+    void computeLog(const std::vector<size_t> &counts, float countsMin,
+                    float countsMax, float min, float max);
+
     int getBins() const { return bins; }
 
     float getMaxP() const;
@@ -38,7 +38,8 @@
 #include <QMouseEvent>
 #include <cassert>
 
-#include <Libpfs/array2d.h>
+#include <Libpfs/frame.h>
+#include <Libpfs/manip/statistics.h>
 
 #include "Histogram.h"
 
@@ -58,7 +59,7 @@ LuminanceRangeWidget::LuminanceRangeWidget(QWidget *parent)
       showVP(false),
       valuePointer(0.f),
       histogram(NULL),
-      histogramImage(NULL)
+      histogramFrame(NULL)
 
 {
     setFrameStyle(QFrame::Panel | QFrame::Sunken);
@@ -102,16 +103,23 @@ void LuminanceRangeWidget::paintEvent(QPaintEvent * /*pe */) {
     }
 
     // Paint histogram
-    if (histogramImage != NULL) {
+    if (histogramFrame != NULL) {
         if (histogram == NULL || histogram->getBins() != fRect.width()) {
             delete histogram;
-            // Build histogram from at least 5000 pixels
-            int accuracy =
-                histogramImage->getRows() * histogramImage->getCols() / 5000;
-            //       int accuracy =1;
-            if (accuracy < 1) accuracy = 1;
-            histogram = new Histogram(fRect.width(), accuracy);
-            histogram->computeLog(histogramImage, minValue, maxValue);
+            // rebin the histogram of the whole frame, computed once
+            const pfs::FrameStatistics statistics =
+                histogramFrame->statistics();
+            const pfs::FrameStatistics::Signal Y = pfs::FrameStatistics::GREEN;
+            histogram = new Histogram(fRect.width());
+            if (statistics.minimumPositive(Y) > 0.f) {
+                histogram->computeLog(*statistics.logHistogram(Y),
+                                      log10(statistics.minimumPositive(Y)),
+                                      log10(statistics.maximum(Y)), minValue,
+                                      maxValue);
+            } else {
+                histogram->computeLog(std::vector<size_t>(), 0.f, 0.f,
+                                      minValue, maxValue);
+            }
         }
 
         float maxP = histogram->getMaxP();
@@ -254,26 +262,18 @@ void LuminanceRangeWidget::shrinkRange() {
     emit updateRangeWindow();
 }
 
-void LuminanceRangeWidget::setHistogramImage(const pfs::Array2Df *image) {
-    histogramImage = image;
+void LuminanceRangeWidget::setHistogramFrame(const pfs::Frame *frame) {
+    histogramFrame = frame;
     delete histogram;
     histogram = NULL;
     update();
 }
 
 void LuminanceRangeWidget::fitToDynamicRange() {
-    if (histogramImage != NULL) {
-        float min = 99999999.0f;
-        float max = -99999999.0f;
-
-        int size = histogramImage->getRows() * histogramImage->getCols();
-        for (int i = 0; i < size; i++) {
-            float v = (*histogramImage)(i);
-            if (v > max)
-                max = v;
-            else if (v < min)
-                min = v;
-        }
+    if (histogramFrame != NULL) {
+        const pfs::FrameStatistics statistics = histogramFrame->statistics();
+        float min = statistics.minimum(pfs::FrameStatistics::GREEN);
+        float max = statistics.maximum(pfs::FrameStatistics::GREEN);
 
         if (min <= 0.000001f)
             min = 0.000001f;  // If data contains negative values
@@ -28,9 +28,12 @@
 #define LUMINANCERANGE_WIDGET_H
 
 #include <QFrame>
-#include "Libpfs/array2d_fwd.h"
 #include "Viewers/Histogram.h"
 
+namespace pfs {
+class Frame;
+}
+
 class LuminanceRangeWidget : public QFrame {
     Q_OBJECT
    public:
@@ -75,7 +78,7 @@ class LuminanceRangeWidget : public QFrame {
     float valuePointer;
 
     Histogram *histogram;
-    const pfs::Array2Df *histogramImage;
+    const pfs::Frame *histogramFrame;
 
     QRect getPaintRect() const;
 
@@ -85,7 +88,9 @@ class LuminanceRangeWidget : public QFrame {
 
     void setRangeWindowMinMax(float min, float max);
 
-    void setHistogramImage(const pfs::Array2Df *image);
+    //! \brief show the histogram of the Y channel of \a frame, taken from
+    //! its statistics
+    void setHistogramFrame(const pfs::Frame *frame);
 
     void showValuePointer(float value);
     void hideValuePointer();
@@ -0,0 +1,343 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#include <gtest/gtest.h>
+
+#include <Libpfs/array2d.h>
+#include <Libpfs/progress.h>
+#include <TonemappingOperators/ashikhmin02/pyramid.h>
+#include <TonemappingOperators/ashikhmin02/tmo_ashikhmin02.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+//! \brief The Gaussian pyramid and the local adaptation luminance as they
+//! were computed before the pyramid was moved to a single float buffer:
+//! double precision arithmetic, one array per level, and the original edge
+//! handling of the lookups
+class BaselinePyramid {
+   public:
+    static const int PYRAMID = 20;
+
+    explicit BaselinePyramid(const pfs::Array2Df &Y) {
+        const double w1[5] = {0.05, 0.25, 0.4, 0.25, 0.05};
+        for (int m = 0; m < 5; m++) {
+            for (int n = 0; n < 5; n++) {
+                weights[m][n] = w1[m] * w1[n];
+            }
+        }
+
+        init(0, Y.getCols(), Y.getRows(), 1, 1.0);
+        std::copy(Y.begin(), Y.end(), p[0].data.begin());
+
+        int current = 0;
+        while (p[current].kernel_size < PYRAMID) {
+            current = constructNext(current);
+        }
+
+        int bottom = 0, top = 1;
+        while (bottom < PYRAMID - 1) {
+            while (!p[top].flag) top++;
+            interpolate(bottom, top);
+            bottom = top;
+            top++;
+        }
+    }
+
+    //! \brief local adaptation luminance at (\a x, \a y)
+    float lal(int x, int y, float localContrast) const {
+        float g = 0.f, gg;
+        for (int s = 1; s <= 10; s++) {
+            g = interpolated(x, y, s);
+            gg = interpolated(x, y, 2 * s);
+            if (std::fabs((g - gg) / g) >= localContrast) return g;
+        }
+        return g;
+    }
+
+   private:
+    struct Level {
+        Level() : width(0), height(0), kernel_size(0), flag(0), lambda(0.) {}
+        int width, height, kernel_size, flag;
+        double lambda;
+        std::vector<float> data;
+        float at(int x, int y) const { return data[size_t(y) * width + x]; }
+    };
+
+    void init(int index, int w, int h, int k, double lambda) {
+        p[index].width = w;
+        p[index].height = h;
+        p[index].kernel_size = k;
+        p[index].lambda = lambda;
+        p[index].flag = 1;
+        p[index].data.assign(size_t(w) * h, 0.f);
+    }
+
+    int constructNext(int c) {
+        const Level &cur = p[c];
+        const int w = cur.width / 2;
+        const int h = cur.height / 2;
+        const int k = (cur.kernel_size == 1) ? 5 : 2 * cur.kernel_size;
+        const int next = k - 1;
+        init(next, w, h, k, cur.lambda * 0.5);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                double sum = 0.0;
+                for (int n = -2; n < 3; n++) {
+                    for (int m = -2; m < 3; m++) {
+                        const int X = std::min(std::max(2 * x + m, 0), cur.width - 1);
+                        const int Y = std::min(std::max(2 * y + n, 0), cur.height - 1);
+                        sum += weights[m + 2][n + 2] * p[c].at(X, Y);
+                    }
+                }
+                p[next].data[size_t(y) * w + x] = float(sum);
+            }
+        }
+        return next;
+    }
+
+    static double noInterpolate(int x, int y, const Level &l) {
+        if (x < l.width - 1 && y < l.height - 1) return l.at(x, y);
+        if (x < l.width - 1 && y >= l.height) return l.at(x, l.height - 1);
+        if (x >= l.width && y < l.height - 1) return l.at(l.width - 1, y);
+        return l.at(l.width - 1, l.height - 1);
+    }
+
+    void interpolate(int bottom, int top) {
+        for (int i = bottom + 1; i < top && i < PYRAMID; i++) {
+            const double lambda =
+                1.0 - double(p[bottom].kernel_size - (i + 1)) /
+                          double(p[bottom].kernel_size - p[top].kernel_size) *
+                          0.5;
+            init(i, int(p[bottom].width * lambda),
+                 int(p[bottom].height * lambda), i + 1,
+                 lambda * p[bottom].lambda);
+            for (int y = 0; y < p[i].height; y++) {
+                for (int x = 0; x < p[i].width; x++) {
+                    const double topLum = noInterpolate(
+                        int(x / (lambda + lambda)), int(y / (lambda + lambda)),
+                        p[top]);
+                    const double bottomLum =
+                        noInterpolate(int(x / lambda), int(y / lambda), p[bottom]);
+                    p[i].data[size_t(y) * p[i].width + x] =
+                        float((1.0 - lambda) * topLum + lambda * bottomLum);
+                }
+            }
+        }
+    }
+
+    float interpolated(int x, int y, int s) const {
+        const Level &l = p[s - 1];
+        const float ratio = float(l.lambda);
+        const float newX = x * ratio;
+        const float newY = y * ratio;
+        size_t X = size_t(newX);
+        size_t Y = size_t(newY);
+        const float dx = newX - X, dy = newY - Y;
+        const size_t w = l.width, h = l.height;
+        if (X < w - 1 && Y < h - 1) {
+            return (1 - dx) * (1 - dy) * l.at(X, Y) + dx * (1 - dy) * l.at(X + 1, Y) +
+                   (1 - dx) * dy * l.at(X, Y + 1) + dx * dy * l.at(X + 1, Y + 1);
+        } else if (X < w - 1) {
+            return (1 - dx) * l.at(X, h - 1) + dx * l.at(X + 1, h - 1);
+        } else if (Y < h - 1) {
+            return (1 - dy) * l.at(w - 1, Y) + dy * l.at(w - 1, Y + 1);
+        }
+        return l.at(w - 1, h - 1);
+    }
+
+    Level p[PYRAMID];
+    double weights[5][5];
+};
+
+//! \brief linearly approximated TVI function of the operator
+float tvi(float l) {
+    if (l <= 1e-20f) return 0.f;
+    if (l < 0.0034f) return l / 0.0014f;
+    if (l < 1.f) return 2.4483f + std::log(l / 0.0034f) / 0.4027f;
+    if (l < 7.2444f) return 16.5630f + (l - 1.f) / 0.4027f;
+    return 32.0693f + std::log(l / 7.2444f) / 0.0556f;
+}
+
+//! \brief HDR test image: smooth gradients over three decades, a bright
+//! window and fine texture
+void buildLuminance(pfs::Array2Df &Y) {
+    for (size_t y = 0; y < Y.getRows(); y++) {
+        for (size_t x = 0; x < Y.getCols(); x++) {
+            float l = std::pow(10.f, 3.f * x / Y.getCols() - 1.f) *
+                      (1.2f + 0.2f * std::sin(0.9f * x) * std::cos(0.7f * y));
+            if (x > Y.getCols() / 3 && x < Y.getCols() / 2 &&
+                y > Y.getRows() / 4 && y < Y.getRows() / 2) {
+                l *= 30.f;
+            }
+            Y(x, y) = l;
+        }
+    }
+}
+}
+
+TEST(TestAshikhminPyramid, ConstantImage) {
+    const int width = 157;
+    const int height = 93;
+    pfs::Array2Df Y(width, height);
+    Y.fill(3.5f);
+
+    GaussianPyramid pyramid(Y);
+    for (int i = 0; i < GaussianPyramid::PYRAMID; i++) {
+        const GaussianPyramid::Level &l = pyramid.level(i);
+        EXPECT_EQ(l.kernel_size, i + 1);
+        const float *d = pyramid.data(i);
+        for (int j = 0; j < l.width * l.height; j++) {
+            ASSERT_NEAR(d[j], 3.5f, 1e-5f) << "level " << i << " pixel " << j;
+        }
+    }
+
+    // the last image row and column must not read outside the level
+    std::vector<float> row(width);
+    for (int i = 0; i < GaussianPyramid::PYRAMID; i++) {
+        pyramid.interpolateRow(i, height - 1, width, row.data());
+        for (int x = 0; x < width; x++) {
+            ASSERT_NEAR(row[x], 3.5f, 1e-5f) << "level " << i << " col " << x;
+        }
+    }
+}
+
+TEST(TestAshikhminPyramid, LevelZeroIsInput) {
+    const int width = 64;
+    const int height = 48;
+    pfs::Array2Df Y(width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            Y(x, y) = std::exp(0.05f * x - 0.03f * y);
+        }
+    }
+
+    GaussianPyramid pyramid(Y);
+    std::vector<float> row(width);
+    for (int y = 0; y < height; y++) {
+        pyramid.interpolateRow(0, y, width, row.data());
+        for (int x = 0; x < width; x++) {
+            ASSERT_FLOAT_EQ(row[x], Y(x, y));
+        }
+    }
+
+    // levels 4, 9 and 19 halve the resolution
+    EXPECT_EQ(pyramid.level(4).width, width / 2);
+    EXPECT_EQ(pyramid.level(9).width, width / 4);
+    EXPECT_EQ(pyramid.level(19).height, height / 8);
+}
+
+// The float pyramid differs from the baseline in two ways:
+// - single precision arithmetic;
+// - lookups past the last row or column of a level clamp to the edge,
+//   instead of falling back to the corner pixel of the level.
+// The second change is deliberate and affects the pixels whose footprint in
+// the coarsest levels (1/8 of the resolution) reaches the last row or column:
+// the last s_border rows and columns are not compared. Elsewhere either
+// change can flip the scale chosen for a pixel whose contrast is right at
+// the threshold: at most 0.5% of the pixels may differ by more than 1e-4
+// (relative), and the mean relative difference must stay below 2e-4.
+const int s_border = 24;
+const int s_width = 311;
+const int s_height = 207;
+const float s_localContrast = 0.5f;
+
+bool inside(int x, int y) {
+    return x < s_width - s_border && y < s_height - s_border;
+}
+
+TEST(TestAshikhminPyramid, LocalAdaptationMatchesBaseline) {
+    pfs::Array2Df Y(s_width, s_height);
+    buildLuminance(Y);
+
+    BaselinePyramid baseline(Y);
+    GaussianPyramid pyramid(Y);
+
+    std::vector<float> levelRows;
+    std::vector<int> active;
+    std::vector<float> la(s_width);
+    size_t compared = 0;
+    size_t differing = 0;
+    double sumDiff = 0.0;
+    for (int y = 0; y < s_height; y++) {
+        LALRow(pyramid, y, s_width, s_localContrast, levelRows, active,
+               la.data());
+        for (int x = 0; x < s_width; x++) {
+            if (!inside(x, y)) continue;
+            const float expected = baseline.lal(x, y, s_localContrast);
+            const float diff = std::fabs(la[x] - expected) / expected;
+            compared++;
+            sumDiff += diff;
+            if (diff > 1e-4f) differing++;
+        }
+    }
+
+    EXPECT_LT(differing, compared / 200);
+    EXPECT_LT(sumDiff / compared, 2e-4);
+}
+
+// Same bounds on the output of the whole operator, equation 2. The output is
+// normalised by its extremes, which may lie in the excluded border: both
+// outputs are normalised again over the compared area.
+TEST(TestAshikhminPyramid, OperatorMatchesBaseline) {
+    pfs::Array2Df Y(s_width, s_height);
+    buildLuminance(Y);
+    const float maxLum = *std::max_element(Y.begin(), Y.end());
+    const float minLum = *std::min_element(Y.begin(), Y.end());
+
+    pfs::Array2Df L(s_width, s_height);
+    pfs::Progress progress;
+    tmo_ashikhmin02(&Y, &L, maxLum, minLum, 0.f, false, s_localContrast, 2,
+                    progress);
+
+    // equation 2 of the paper over the baseline adaptation luminance
+    BaselinePyramid baseline(Y);
+    std::vector<float> expected;
+    std::vector<float> result;
+    for (int y = 0; y < s_height; y++) {
+        for (int x = 0; x < s_width; x++) {
+            if (!inside(x, y)) continue;
+            float la = baseline.lal(x, y, s_localContrast);
+            la = (la == 0.f) ? 0.00001f : la;
+            expected.push_back(Y(x, y) * (tvi(la) - tvi(minLum)) / la);
+            result.push_back(L(x, y));
+        }
+    }
+    const float expectedLo = *std::min_element(expected.begin(), expected.end());
+    const float expectedHi = *std::max_element(expected.begin(), expected.end());
+    const float resultLo = *std::min_element(result.begin(), result.end());
+    const float resultHi = *std::max_element(result.begin(), result.end());
+
+    size_t differing = 0;
+    double sumDiff = 0.0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        const float e = (expected[i] - expectedLo) / (expectedHi - expectedLo);
+        const float r = (result[i] - resultLo) / (resultHi - resultLo);
+        const float diff = std::fabs(r - e);
+        sumDiff += diff;
+        if (diff > 1e-4f) differing++;
+    }
+
+    EXPECT_LT(differing, expected.size() / 200);
+    EXPECT_LT(sumDiff / expected.size(), 2e-4);
+}
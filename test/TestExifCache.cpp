@@ -0,0 +1,128 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Cache of the Exif data parsed by pfs::exif::ExifData
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <Libpfs/exif/filecache.h>
+
+using pfs::exif::FileCache;
+using pfs::exif::FileStamp;
+
+namespace {
+
+// ExifData keeps the last 256 files
+const size_t s_capacity = 256;
+
+FileStamp stamp(int64_t size, int64_t modified) {
+    FileStamp s = {size, modified};
+    return s;
+}
+
+std::string fileName(int i) {
+    return "IMG_" + std::to_string(i) + ".JPG";
+}
+}
+
+TEST(TestExifCache, HitAndMiss) {
+    FileCache<int> cache(s_capacity);
+    int value = -1;
+
+    EXPECT_FALSE(cache.find("a.jpg", stamp(100, 1000), value));
+    cache.insert("a.jpg", stamp(100, 1000), 1);
+    cache.insert("b.jpg", stamp(200, 1000), 2);
+
+    ASSERT_TRUE(cache.find("a.jpg", stamp(100, 1000), value));
+    EXPECT_EQ(1, value);
+    ASSERT_TRUE(cache.find("b.jpg", stamp(200, 1000), value));
+    EXPECT_EQ(2, value);
+    EXPECT_FALSE(cache.find("c.jpg", stamp(100, 1000), value));
+
+    // inserting again replaces the value
+    cache.insert("a.jpg", stamp(100, 1000), 3);
+    ASSERT_TRUE(cache.find("a.jpg", stamp(100, 1000), value));
+    EXPECT_EQ(3, value);
+    EXPECT_EQ(2u, cache.size());
+}
+
+TEST(TestExifCache, ChangedFile) {
+    FileCache<int> cache(s_capacity);
+    int value = -1;
+
+    cache.insert("a.jpg", stamp(100, 1000), 1);
+    cache.insert("b.jpg", stamp(100, 1000), 2);
+
+    // another size, another modification time
+    EXPECT_FALSE(cache.find("a.jpg", stamp(101, 1000), value));
+    EXPECT_FALSE(cache.find("b.jpg", stamp(100, 1001), value));
+
+    // the stale entries are dropped, even for their old stamps
+    EXPECT_FALSE(cache.find("a.jpg", stamp(100, 1000), value));
+    EXPECT_FALSE(cache.find("b.jpg", stamp(100, 1000), value));
+    EXPECT_EQ(0u, cache.size());
+}
+
+// writing the metadata of a file may keep its size, and its modification
+// time within the resolution of the file system: ExifOperations::copyExifData
+// calls ExifData::forget() on the file written
+TEST(TestExifCache, ForgetAfterWrite) {
+    FileCache<int> cache(s_capacity);
+    int value = -1;
+
+    cache.insert("a.jpg", stamp(100, 1000), 1);
+    cache.insert("b.jpg", stamp(100, 1000), 2);
+    cache.erase("a.jpg");
+
+    EXPECT_FALSE(cache.find("a.jpg", stamp(100, 1000), value));
+    ASSERT_TRUE(cache.find("b.jpg", stamp(100, 1000), value));
+    EXPECT_EQ(2, value);
+
+    // forgetting a file not cached is harmless
+    cache.erase("c.jpg");
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST(TestExifCache, LeastRecentlyUsed) {
+    FileCache<int> cache(s_capacity);
+    int value = -1;
+
+    for (int i = 0; i < int(s_capacity); ++i) {
+        cache.insert(fileName(i), stamp(i, 1000), i);
+    }
+    EXPECT_EQ(s_capacity, cache.size());
+
+    // the oldest file is used again: the second one is the least recent
+    ASSERT_TRUE(cache.find(fileName(0), stamp(0, 1000), value));
+    cache.insert(fileName(int(s_capacity)), stamp(0, 1000), -2);
+    EXPECT_EQ(s_capacity, cache.size());
+
+    EXPECT_FALSE(cache.find(fileName(1), stamp(1, 1000), value));
+    for (int i = 2; i <= int(s_capacity); ++i) {
+        EXPECT_TRUE(cache.find(fileName(i), stamp(i == int(s_capacity) ? 0 : i,
+                                                  1000),
+                               value))
+            << fileName(i);
+    }
+    ASSERT_TRUE(cache.find(fileName(0), stamp(0, 1000), value));
+    EXPECT_EQ(0, value);
+}
@@ -0,0 +1,273 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Check the FFT based Ferradans11 operator against a direct
+//! evaluation of the contrast term, and its behaviour on cancel
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Libpfs/array2d.h>
+#include <Libpfs/progress.h>
+#include <TonemappingOperators/ferradans11/tmo_ferradans11.h>
+
+namespace {
+
+// even sizes: the kernel is centred by swapping the quadrants
+const int s_width = 32;
+const int s_height = 24;
+const float s_rho = -2.f;
+const float s_invAlpha = 5.f;
+
+void buildChannels(pfs::Array2Df &R, pfs::Array2Df &G, pfs::Array2Df &B) {
+    for (int y = 0; y < s_height; y++) {
+        for (int x = 0; x < s_width; x++) {
+            const float l = std::exp(3.f * std::sin(x * 0.3f) *
+                                     std::cos(y * 0.4f)) *
+                            (1.f + ((x * 7 + y * 13) % 11) / 30.f);
+            R(x, y) = l;
+            G(x, y) = 0.8f * l;
+            B(x, y) = l * (0.5f + ((x * 3 + y * 5) % 7) / 20.f);
+        }
+    }
+}
+
+//! \brief Ferradans11 with the convolutions evaluated directly, in double
+//! precision: the contrast term of a pixel is the kernel weighted sum of the
+//! odd polynomial of the differences against every other pixel, with the
+//! kernel wrapping around the image as in the circular convolution
+void reference(std::vector<double> channels[3], int fil, int col) {
+    const int length = fil * col;
+    const double dt = 0.2;
+    const double thresholdDiff = dt / 20.0;
+
+    std::vector<double> orig[3];
+    double med[3];
+    for (int k = 0; k < 3; k++) {
+        std::vector<double> &v = orig[k];
+        v.resize(length);
+        for (int i = 0; i < length; i++) {
+            v[i] = std::max(channels[k][i], 0.0) + 1e-6;
+        }
+        std::vector<double> aux(v);
+        std::nth_element(aux.begin(), aux.begin() + (length - 1) / 2,
+                         aux.end());
+        const double median = aux[(length - 1) / 2];
+        double mean = 0.0;
+        for (int i = 0; i < length; i++) mean += v[i];
+        mean /= length;
+
+        // Naka-Rushton response joined with Weber-Fechner below Ir
+        double mu = std::sqrt(mean) * std::sqrt(median);
+        mu *= std::pow(10.0, -0.37 * (std::log10(mu) + 4 - s_rho) + 1.9);
+        const double n = 0.74;
+        const double I0 = mu / std::pow(10.0, 1.2);
+        const double sigmaN = std::pow(mu, n);
+        const double K = (k == 2) ? 100.0 / 8.7 : 100.0 / 1.85;
+        const double Ir = std::pow(10.0, std::log10(mu) + 2);
+        const double mKlogc = std::pow(Ir, n) / (std::pow(Ir, n) + sigmaN) -
+                              K * std::log10(Ir + I0);
+        for (int i = 0; i < length; i++) {
+            if (v[i] <= Ir) {
+                v[i] = K * std::log10(v[i] + I0) + mKlogc;
+            } else {
+                const double In = std::pow(v[i], n);
+                v[i] = In / (In + sigmaN);
+            }
+        }
+        const double lo = *std::min_element(v.begin(), v.end());
+        for (int i = 0; i < length; i++) v[i] -= lo;
+        const double scale = 1.0 / (*std::max_element(v.begin(), v.end()) + 1e-12);
+        for (int i = 0; i < length; i++) v[i] *= scale;
+
+        mean = 0.0;
+        for (int i = 0; i < length; i++) mean += v[i];
+        med[k] = mean / length;
+    }
+
+    // gaussian kernel, rescaled to [0, 1], centred on (0, 0) and normalized
+    const double alpha = std::min(col, fil) / s_invAlpha;
+    std::vector<double> kernel(length);
+    for (int i = 0; i < fil; i++) {
+        for (int j = 0; j < col; j++) {
+            const int di = (i + fil / 2) % fil - fil / 2;
+            const int dj = (j + col / 2) % col - col / 2;
+            kernel[i * col + j] =
+                std::exp(-(di * di + dj * dj) / (2 * alpha * alpha));
+        }
+    }
+    const double kmin = *std::min_element(kernel.begin(), kernel.end());
+    const double kmax = *std::max_element(kernel.begin(), kernel.end());
+    double sum = 0.0;
+    for (int i = 0; i < length; i++) {
+        kernel[i] = (kernel[i] - kmin) / (kmax - kmin);
+        sum += kernel[i];
+    }
+    for (int i = 0; i < length; i++) kernel[i] /= sum;
+
+    std::vector<double> u[3];
+    for (int k = 0; k < 3; k++) u[k] = orig[k];
+
+    const double norm1 = 1.0 + dt * (1.0 + 255.0 / 253.0);
+    std::vector<double> R(length);
+    double difference = 1000.0;
+    while (difference > thresholdDiff) {
+        difference = 0.0;
+        for (int k = 0; k < 3; k++) {
+            double mabsv = 0.0;
+            for (int xi = 0; xi < fil; xi++) {
+                for (int xj = 0; xj < col; xj++) {
+                    const double ux = u[k][xi * col + xj];
+                    double r = 0.0;
+                    for (int yi = 0; yi < fil; yi++) {
+                        for (int yj = 0; yj < col; yj++) {
+                            const double t = ux - u[k][yi * col + yj];
+                            const double t2 = t * t;
+                            const double p =
+                                t * (3.7891 +
+                                     t2 * (-11.013 +
+                                           t2 * (15.836 + t2 * -7.7456)));
+                            r += kernel[((xi - yi + fil) % fil) * col +
+                                        (xj - yj + col) % col] *
+                                 p;
+                        }
+                    }
+                    r = std::max(std::min(r, 1.0), -1.0);
+                    R[xi * col + xj] = r;
+                    mabsv = std::max(mabsv, std::fabs(r));
+                }
+            }
+
+            const double multiplier = 0.5 / mabsv;
+            double mse = 0.0;
+            for (int i = 0; i < length; i++) {
+                double next = (u[k][i] + dt * (orig[k][i] + multiplier * R[i] +
+                                               255.0 / 253.0 * med[k])) /
+                              norm1;
+                next = std::max(std::min(next, 1.0), 0.0);
+                mse += std::fabs(u[k][i] - next);
+                u[k][i] = next;
+            }
+            difference += mse / length;
+        }
+    }
+
+    for (int k = 0; k < 3; k++) {
+        const double lo = *std::min_element(u[k].begin(), u[k].end());
+        const double hi = *std::max_element(u[k].begin(), u[k].end());
+        for (int i = 0; i < length; i++) {
+            channels[k][i] = (u[k][i] - lo) / (hi - lo);
+        }
+    }
+}
+
+float maxDifference(const pfs::Array2Df &a, const pfs::Array2Df &b) {
+    float diff = 0.f;
+    for (size_t i = 0; i < a.size(); i++) {
+        diff = std::max(diff, std::fabs(a(i) - b(i)));
+    }
+    return diff;
+}
+
+//! \brief cancel as soon as the operator reports \a value
+class CancelAt : public pfs::Progress {
+   public:
+    explicit CancelAt(int value) : m_value(value) {}
+
+    void setValue(int value) {
+        pfs::Progress::setValue(value);
+        if (value >= m_value) cancel();
+    }
+
+   private:
+    int m_value;
+};
+}
+
+// The operator works in single precision and expands the polynomial of the
+// differences into convolutions of the powers of the channel: the output
+// stays within 1e-5 of the direct double precision evaluation
+TEST(TestFerradans11, MatchesDirectConvolution) {
+    pfs::Array2Df R(s_width, s_height), G(s_width, s_height),
+        B(s_width, s_height);
+    buildChannels(R, G, B);
+
+    std::vector<double> expected[3];
+    const pfs::Array2Df *in[3] = {&R, &G, &B};
+    for (int k = 0; k < 3; k++) {
+        expected[k].assign(in[k]->begin(), in[k]->end());
+    }
+    reference(expected, s_height, s_width);
+
+    for (int lowMemory = 0; lowMemory < 2; lowMemory++) {
+        pfs::Array2Df outR(R), outG(G), outB(B);
+        pfs::Progress ph;
+        tmo_ferradans11(outR, outG, outB, s_rho, s_invAlpha, ph,
+                        lowMemory != 0);
+
+        const pfs::Array2Df *out[3] = {&outR, &outG, &outB};
+        for (int k = 0; k < 3; k++) {
+            for (size_t i = 0; i < out[k]->size(); i++) {
+                ASSERT_NEAR((*out[k])(i), expected[k][i], 1e-5)
+                    << "lowMemory " << lowMemory << ", channel " << k
+                    << ", pixel " << i;
+            }
+        }
+    }
+}
+
+TEST(TestFerradans11, LowMemoryMatchesBatched) {
+    pfs::Array2Df R(s_width, s_height), G(s_width, s_height),
+        B(s_width, s_height);
+    buildChannels(R, G, B);
+
+    pfs::Array2Df R1(R), G1(G), B1(B);
+    pfs::Progress ph1;
+    tmo_ferradans11(R1, G1, B1, s_rho, s_invAlpha, ph1, false);
+
+    pfs::Array2Df R2(R), G2(G), B2(B);
+    pfs::Progress ph2;
+    tmo_ferradans11(R2, G2, B2, s_rho, s_invAlpha, ph2, true);
+
+    EXPECT_LT(maxDifference(R1, R2), 1e-5f);
+    EXPECT_LT(maxDifference(G1, G2), 1e-5f);
+    EXPECT_LT(maxDifference(B1, B2), 1e-5f);
+}
+
+// a cancel before the evolution starts leaves the channels untouched
+TEST(TestFerradans11, CancelKeepsInput) {
+    const int values[] = {15, 20, 30};
+    for (int value : values) {
+        pfs::Array2Df R(s_width, s_height), G(s_width, s_height),
+            B(s_width, s_height);
+        buildChannels(R, G, B);
+        pfs::Array2Df R0(R), G0(G), B0(B);
+
+        CancelAt ph(value);
+        tmo_ferradans11(R, G, B, s_rho, s_invAlpha, ph);
+
+        EXPECT_EQ(maxDifference(R, R0), 0.f) << "cancel at " << value;
+        EXPECT_EQ(maxDifference(G, G0), 0.f) << "cancel at " << value;
+        EXPECT_EQ(maxDifference(B, B0), 0.f) << "cancel at " << value;
+    }
+}
@@ -27,6 +27,7 @@
 
 #include <Libpfs/colorspace/rgbremapper.h>
 #include <Libpfs/colorspace/copy.h>
+#include <Libpfs/frame.h>
 #include <Libpfs/utils/clamp.h>
 #include <Libpfs/utils/chain.h>
 
@@ -190,3 +191,44 @@ TEST(FloatRgbConverter, Uint8_Test3)
     EXPECT_EQ(static_cast<int>(outGreen), 0);
     EXPECT_EQ(static_cast<int>(outBlue), 0);
 }
+
+TEST(FloatRgbConverter, QImage_Region)
+{
+    const int width = 67;
+    const int height = 13;
+    pfs::Frame frame(width, height);
+    pfs::Channel *R, *G, *B;
+    frame.createXYZChannels(R, G, B);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            (*R)(x, y) = 1.4f * x / width - 0.2f;
+            (*G)(x, y) = 0.01f * y;
+            (*B)(x, y) = float((x * 7 + y * 13) % 29) / 28.f;
+        }
+    }
+
+    // every mapping, whole rows and a region with a tail shorter than a vector
+    const QRect regions[] = {QRect(0, 0, width, height),
+                             QRect(5, 3, width - 11, height - 4)};
+    for (int m = MAP_LINEAR; m <= MAP_LOGARITHMIC; m++) {
+        QRgbRemapper d(0.05f, 0.9f, RGBMappingType(m));
+        for (const QRect &rect : regions) {
+            QImage image(rect.size(), QImage::Format_RGB32);
+            mapFrameToQImage(frame, rect, image, 0.05f, 0.9f,
+                             RGBMappingType(m));
+
+            for (int y = 0; y < rect.height(); y++) {
+                const QRgb *line =
+                    reinterpret_cast<const QRgb *>(image.constScanLine(y));
+                for (int x = 0; x < rect.width(); x++) {
+                    QRgb rgb;
+                    d((*R)(rect.left() + x, rect.top() + y),
+                      (*G)(rect.left() + x, rect.top() + y),
+                      (*B)(rect.left() + x, rect.top() + y), rgb);
+                    ASSERT_EQ(line[x], rgb) << "mapping " << m << " at " << x
+                                            << ", " << y;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,144 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "Libpfs/exception.h"
+#include "Libpfs/frame.h"
+#include "Libpfs/manip/pyramid.h"
+#include "Libpfs/manip/resize.h"
+
+using namespace pfs;
+
+namespace {
+void fill(Frame &frame, float value) {
+    Channel *X;
+    Channel *Y;
+    Channel *Z;
+    frame.createXYZChannels(X, Y, Z);
+    std::fill(X->begin(), X->end(), value);
+    std::fill(Y->begin(), Y->end(), value);
+    std::fill(Z->begin(), Z->end(), value);
+}
+}
+
+TEST(TestFramePyramid, LevelSelection) {
+    Frame frame(1000, 600);
+    fill(frame, 1.f);
+
+    std::shared_ptr<FramePyramid> pyramid(frame.pyramid());
+    EXPECT_EQ(size_t(1), pyramid->builtLevels());
+
+    // larger than the frame: level 0
+    EXPECT_EQ(&frame, pyramid->levelFor(2000).get());
+    EXPECT_EQ(&frame, pyramid->levelFor(1000).get());
+
+    std::shared_ptr<const Frame> level = pyramid->levelFor(120);
+    EXPECT_EQ(size_t(125), level->getWidth());
+    EXPECT_EQ(size_t(75), level->getHeight());
+    EXPECT_EQ(size_t(4), pyramid->builtLevels());
+
+    // memoised
+    EXPECT_EQ(level, pyramid->levelFor(120));
+    EXPECT_EQ(size_t(4), pyramid->builtLevels());
+
+    // never below the minimum size
+    std::shared_ptr<const Frame> smallest = pyramid->levelFor(1);
+    EXPECT_LE(size_t(16), smallest->getWidth());
+    EXPECT_LE(size_t(16), smallest->getHeight());
+}
+
+TEST(TestFramePyramid, ConstantFrame) {
+    Frame frame(333, 211);
+    fill(frame, 42.f);
+
+    std::shared_ptr<const Frame> level = frame.pyramid()->levelFor(40);
+    const Channel *X;
+    const Channel *Y;
+    const Channel *Z;
+    level->getXYZChannels(X, Y, Z);
+    ASSERT_TRUE(Y != NULL);
+    for (size_t idx = 0; idx < Y->size(); ++idx) {
+        ASSERT_NEAR(42.f, (*Y)(idx), 1e-3f);
+    }
+}
+
+TEST(TestFramePyramid, ResizeMatchesGeometry) {
+    Frame frame(1001, 667);
+    fill(frame, 3.f);
+
+    std::unique_ptr<Frame> reference(resize(&frame, 120, BilinearInterp));
+    std::unique_ptr<Frame> resized(
+        frame.pyramid()->resize(120, BilinearInterp));
+
+    EXPECT_EQ(reference->getWidth(), resized->getWidth());
+    EXPECT_EQ(reference->getHeight(), resized->getHeight());
+    EXPECT_EQ(reference->getChannels().size(), resized->getChannels().size());
+}
+
+TEST(TestFramePyramid, Invalidation) {
+    Frame frame(256, 256);
+    fill(frame, 1.f);
+
+    std::shared_ptr<FramePyramid> pyramid(frame.pyramid());
+    EXPECT_EQ(pyramid, frame.pyramid());
+
+    frame.createChannel("ALPHA");
+    EXPECT_NE(pyramid, frame.pyramid());
+
+    pyramid = frame.pyramid();
+    frame.invalidateCaches();
+    EXPECT_NE(pyramid, frame.pyramid());
+}
+
+// a pyramid kept by someone else never reads the frame once it has changed or
+// is gone, the levels handed out before stay valid
+TEST(TestFramePyramid, DetachedFromTheFrame) {
+    std::shared_ptr<FramePyramid> pyramid;
+    std::shared_ptr<const Frame> level;
+    {
+        Frame frame(256, 256);
+        fill(frame, 2.f);
+
+        pyramid = frame.pyramid();
+        level = pyramid->levelFor(64);
+        EXPECT_FALSE(pyramid->detached());
+
+        frame.invalidateCaches();
+        EXPECT_TRUE(pyramid->detached());
+        EXPECT_THROW(pyramid->levelFor(64), pfs::Exception);
+        EXPECT_THROW(pyramid->resize(64, BilinearInterp), pfs::Exception);
+
+        pyramid = frame.pyramid();
+        EXPECT_FALSE(pyramid->detached());
+    }
+    EXPECT_TRUE(pyramid->detached());
+    EXPECT_THROW(pyramid->levelFor(64), pfs::Exception);
+
+    EXPECT_EQ(size_t(64), level->getWidth());
+    const Channel *X;
+    const Channel *Y;
+    const Channel *Z;
+    level->getXYZChannels(X, Y, Z);
+    ASSERT_TRUE(Y != NULL);
+    EXPECT_NEAR(2.f, (*Y)(10, 10), 1e-3f);
+}
@@ -0,0 +1,229 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+
+#include "Libpfs/colorspace/colorspace.h"
+#include "Libpfs/colorspace/xyz.h"
+#include "Libpfs/exception.h"
+#include "Libpfs/frame.h"
+#include "Libpfs/manip/copy.h"
+#include "Libpfs/manip/pointpipeline.h"
+#include "Libpfs/manip/statistics.h"
+
+using namespace pfs;
+
+namespace {
+//! \brief odd sized frame over five decades, with a few zeros
+std::unique_ptr<Frame> buildFrame() {
+    std::unique_ptr<Frame> frame(new Frame(301, 77));
+    Channel *X;
+    Channel *Y;
+    Channel *Z;
+    frame->createXYZChannels(X, Y, Z);
+    for (size_t i = 0; i < X->size(); i++) {
+        (*X)(i) = std::pow(10.f, 5.f * float(i % 97) / 96.f - 2.f);
+        (*Y)(i) = (i % 89) ? std::pow(10.f, 5.f * float(i % 89) / 88.f - 3.f)
+                           : 0.f;
+        (*Z)(i) = 0.5f * std::pow(10.f, 4.f * float(i % 83) / 82.f - 1.f);
+    }
+    return frame;
+}
+
+float luminance(const Frame &frame, size_t i) {
+    const Channel *R, *G, *B;
+    frame.getXYZChannels(R, G, B);
+    return colorspace::rgb2xyzD65Mat[1][0] * (*R)(i) +
+           colorspace::rgb2xyzD65Mat[1][1] * (*G)(i) +
+           colorspace::rgb2xyzD65Mat[1][2] * (*B)(i);
+}
+
+float sample(const Frame &frame, FrameStatistics::Signal s, size_t i) {
+    const Channel *R, *G, *B;
+    frame.getXYZChannels(R, G, B);
+    switch (s) {
+        case FrameStatistics::RED:
+            return (*R)(i);
+        case FrameStatistics::GREEN:
+            return (*G)(i);
+        case FrameStatistics::BLUE:
+            return (*B)(i);
+        default:
+            return luminance(frame, i);
+    }
+}
+}
+
+TEST(TestFrameStatistics, MatchesBruteForce) {
+    std::unique_ptr<Frame> frame(buildFrame());
+    const FrameStatistics statistics = frame->statistics();
+
+    const FrameStatistics::Signal signals[] = {
+        FrameStatistics::RED, FrameStatistics::GREEN, FrameStatistics::BLUE,
+        FrameStatistics::LUMINANCE};
+    for (int k = 0; k < 4; k++) {
+        const FrameStatistics::Signal s = signals[k];
+        float minimum = sample(*frame, s, 0);
+        float maximum = minimum;
+        float minimumPositive = 1e30f;
+        double sum = 0.;
+        double sumLog = 0.;
+        for (size_t i = 0; i < frame->size(); i++) {
+            const float v = sample(*frame, s, i);
+            minimum = std::min(minimum, v);
+            maximum = std::max(maximum, v);
+            if (v > 0.f) minimumPositive = std::min(minimumPositive, v);
+            sum += v;
+            sumLog += std::log(v + 1e-4);
+        }
+
+        EXPECT_FLOAT_EQ(minimum, statistics.minimum(s)) << "signal " << s;
+        EXPECT_FLOAT_EQ(maximum, statistics.maximum(s)) << "signal " << s;
+        EXPECT_FLOAT_EQ(minimumPositive, statistics.minimumPositive(s))
+            << "signal " << s;
+        EXPECT_NEAR(sum / frame->size(), statistics.mean(s),
+                    1e-5 * std::fabs(sum / frame->size()))
+            << "signal " << s;
+        EXPECT_NEAR(sumLog / frame->size(), statistics.meanLog(s, 1e-4f),
+                    1e-4)
+            << "signal " << s;
+    }
+}
+
+TEST(TestFrameStatistics, LogHistogram) {
+    std::unique_ptr<Frame> frame(buildFrame());
+    const FrameStatistics statistics = frame->statistics();
+
+    std::shared_ptr<const std::vector<size_t> > histogram =
+        statistics.logHistogram(FrameStatistics::GREEN);
+    ASSERT_EQ(FrameStatistics::s_histogramBins, histogram->size());
+
+    size_t positive = 0;
+    for (size_t i = 0; i < frame->size(); i++) {
+        if (sample(*frame, FrameStatistics::GREEN, i) > 0.f) positive++;
+    }
+    EXPECT_EQ(positive,
+              std::accumulate(histogram->begin(), histogram->end(), size_t(0)));
+    EXPECT_GT(histogram->front(), 0u);
+    EXPECT_GT(histogram->back(), 0u);
+
+    // memoised
+    EXPECT_EQ(histogram.get(),
+              statistics.logHistogram(FrameStatistics::GREEN).get());
+}
+
+// copies have statistics of their own: writing into one of them never
+// changes the statistics of the other
+TEST(TestFrameStatistics, NotSharedByCopies) {
+    std::unique_ptr<Frame> frame(buildFrame());
+    const float maximum = frame->statistics().maximum(FrameStatistics::RED);
+
+    std::unique_ptr<Frame> copied(pfs::copy(frame.get()));
+    EXPECT_NE(frame->contentKey(), copied->contentKey());
+
+    Channel *R, *G, *B;
+    copied->getXYZChannels(R, G, B);
+    (*R)(0) = 2.f * maximum;
+    EXPECT_EQ(2.f * maximum,
+              copied->statistics().maximum(FrameStatistics::RED));
+    EXPECT_EQ(maximum, frame->statistics().maximum(FrameStatistics::RED));
+}
+
+TEST(TestFrameStatistics, InvalidatedByPointPipeline) {
+    std::unique_ptr<Frame> frame(buildFrame());
+    const float maximum = frame->statistics().maximum(FrameStatistics::GREEN);
+
+    PointPipeline pipeline;
+    pipeline.gamma(0.5f);
+    pipeline.apply(*frame);
+
+    EXPECT_FLOAT_EQ(std::pow(maximum, 0.5f),
+                    frame->statistics().maximum(FrameStatistics::GREEN));
+
+    // an empty pipeline copies the input
+    Frame out(frame->getWidth(), frame->getHeight());
+    PointPipeline().apply(*frame, out);
+    EXPECT_EQ(frame->statistics().maximum(FrameStatistics::GREEN),
+              out.statistics().maximum(FrameStatistics::GREEN));
+}
+
+// statistics kept past a change of the frame, or past the frame itself,
+// never read it again
+TEST(TestFrameStatistics, DetachedFromTheFrame) {
+    std::unique_ptr<Frame> frame(buildFrame());
+    const FrameStatistics before = frame->statistics();
+    EXPECT_GT(before.maximum(FrameStatistics::RED), 0.f);
+
+    frame->invalidateCaches();
+    EXPECT_THROW(before.maximum(FrameStatistics::RED), pfs::Exception);
+    EXPECT_THROW(before.meanLog(FrameStatistics::LUMINANCE, 1e-6f),
+                 pfs::Exception);
+
+    const FrameStatistics after = frame->statistics();
+    frame.reset();
+    EXPECT_THROW(after.logHistogram(FrameStatistics::GREEN), pfs::Exception);
+}
+
+// the accessors that return the channels for writing, and the in-place color
+// transform, drop the statistics: the const accessors keep them
+TEST(TestFrameStatistics, InvalidatedByWriteAccess) {
+    std::unique_ptr<Frame> frame(buildFrame());
+    const Frame &constFrame = *frame;
+
+    std::shared_ptr<const void> key = frame->contentKey();
+    const Channel *cR, *cG, *cB;
+    constFrame.getXYZChannels(cR, cG, cB);
+    constFrame.getChannel("X");
+    constFrame.getChannels();
+    EXPECT_EQ(key, frame->contentKey());
+
+    Channel *R, *G, *B;
+    frame->getXYZChannels(R, G, B);
+    EXPECT_NE(key, frame->contentKey());
+
+    key = frame->contentKey();
+    frame->getChannel("Y");
+    EXPECT_NE(key, frame->contentKey());
+
+    key = frame->contentKey();
+    frame->getChannels();
+    EXPECT_NE(key, frame->contentKey());
+
+    key = frame->contentKey();
+    frame->createChannel("Z");
+    EXPECT_NE(key, frame->contentKey());
+
+    // the green signal is the Y channel once in XYZ
+    const FrameStatistics before = frame->statistics();
+    EXPECT_GT(before.maximum(FrameStatistics::GREEN), 0.f);
+    transformColorSpace(CS_RGB, CS_XYZ, *frame);
+    EXPECT_THROW(before.maximum(FrameStatistics::GREEN), pfs::Exception);
+
+    float maximum = -1.f;
+    for (size_t i = 0; i < G->size(); i++) {
+        maximum = std::max(maximum, (*G)(i));
+    }
+    EXPECT_EQ(maximum, frame->statistics().maximum(FrameStatistics::GREEN));
+}
@@ -0,0 +1,143 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief the basis images of hdrhtml::compute_basis_images() match one
+//! UniformArrayLUT::interp() per basis image, the code it replaced: on the
+//! nodes, between them and out of the range of the tone-curves
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "HdrHTML/hdrhtmlbasis.h"
+
+using namespace hdrhtml;
+
+namespace {
+const int s_lutSize = 25;
+const int s_bases = 4;
+const float s_exposure = -2.f;
+
+//! \brief nodes every half f-stop over [-12, 0], then the tone-curves
+struct BasisTable {
+    BasisTable() : columns(s_bases + 1, std::vector<float>(s_lutSize)) {
+        for (int i = 0; i < s_lutSize; i++) {
+            columns[0][i] = -12.f + 0.5f * i;
+            for (int b = 0; b < s_bases; b++) {
+                columns[b + 1][i] =
+                    0.5f + 0.5f * std::sin(0.37f * i * (b + 1) + b);
+            }
+        }
+        for (int c = 0; c <= s_bases; c++) {
+            data.push_back(columns[c].data());
+        }
+    }
+
+    std::vector<std::vector<float> > columns;
+    std::vector<const float *> data;
+};
+
+//! \brief log2 samples: exactly on every node once exposed, below and above
+//! the range, and in between
+std::vector<float> buildSamples() {
+    std::vector<float> samples;
+    for (int i = 0; i < s_lutSize; i++) {
+        samples.push_back(-12.f + 0.5f * i - s_exposure);
+    }
+    samples.push_back(-40.f);
+    samples.push_back(-12.5f - s_exposure);
+    samples.push_back(0.25f - s_exposure);
+    samples.push_back(30.f);
+    unsigned int seed = 4321;
+    for (int i = 0; i < 500; i++) {
+        seed = seed * 1103515245u + 12345u;
+        samples.push_back(-15.f + 18.f * (seed >> 8) / 16777216.f -
+                          s_exposure);
+    }
+    return samples;
+}
+}
+
+TEST(TestHdrHtmlBasis, MatchesUniformArrayLUT) {
+    const BasisTable table;
+    const float max_value = (float)std::numeric_limits<unsigned char>::max();
+
+    // every sample as red, green and blue, in different pixels, so that
+    // each one goes through both the vector path and the scalar tail
+    const std::vector<float> samples = buildSamples();
+    const int pixels = 3 * int(samples.size()) + 3;
+    std::vector<float> R(pixels);
+    std::vector<float> G(pixels);
+    std::vector<float> B(pixels);
+    for (int pix = 0; pix < pixels; pix++) {
+        R[pix] = samples[pix % samples.size()];
+        G[pix] = samples[(pix + 1) % samples.size()];
+        B[pix] = samples[(pix + 2) % samples.size()];
+    }
+
+    std::vector<std::vector<unsigned char> > images(
+        s_bases, std::vector<unsigned char>(size_t(pixels) * 3));
+    compute_basis_images(R.data(), G.data(), B.data(), pixels, s_exposure,
+                         table.data.data(), s_lutSize, s_bases, images);
+
+    const float *channels[] = {R.data(), G.data(), B.data()};
+    for (int b = 0; b < s_bases; b++) {
+        UniformArrayLUT lut(s_lutSize, table.data[0],
+                            const_cast<float *>(table.data[b + 1]));
+        size_t errors = 0;
+        for (int pix = 0; pix < pixels; pix++) {
+            for (int c = 0; c < 3; c++) {
+                const unsigned char expected = (unsigned char)(
+                    lut.interp(channels[c][pix] + s_exposure) * max_value);
+                if (images[b][size_t(pix) * 3 + c] != expected) {
+                    ++errors;
+                }
+            }
+        }
+        EXPECT_EQ(0u, errors) << "basis " << b;
+    }
+}
+
+//! \brief only the last segment of a page uses a single basis image
+TEST(TestHdrHtmlBasis, SingleBasis) {
+    const BasisTable table;
+    const float R[] = {-40.f, -12.f - s_exposure, 30.f};
+    const float G[] = {-6.f - s_exposure, -5.75f - s_exposure, 0.f};
+    const float B[] = {1.f, 2.f, 3.f};
+
+    std::vector<std::vector<unsigned char> > images(
+        1, std::vector<unsigned char>(9));
+    compute_basis_images(R, G, B, 3, s_exposure, table.data.data(),
+                         s_lutSize, 1, images);
+
+    UniformArrayLUT lut(s_lutSize, table.data[0],
+                        const_cast<float *>(table.data[1]));
+    const float *channels[] = {R, G, B};
+    for (int pix = 0; pix < 3; pix++) {
+        for (int c = 0; c < 3; c++) {
+            EXPECT_EQ((unsigned char)(lut.interp(channels[c][pix] + s_exposure) *
+                                      255.f),
+                      images[0][pix * 3 + c])
+                << "pixel " << pix << ", channel " << c;
+        }
+    }
+}
@@ -0,0 +1,273 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief PNG and TIFF files written by PngWriter, TiffWriter and
+//! TiffRowWriter read back by libpng and libtiff. The writers deflate in
+//! parallel and write the compressed data themselves (PNG IDAT and IEND
+//! chunks, raw TIFF strips).
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <png.h>
+#include <tiffio.h>
+
+#include <Libpfs/colorspace/rgbremapper.h>
+#include <Libpfs/frame.h>
+#include <Libpfs/io/pngwriter.h>
+#include <Libpfs/io/tiffwriter.h>
+#include <Libpfs/manip/cut.h>
+
+namespace {
+
+const char *s_pngFileName = "TestImageWriters.png";
+const char *s_tiffFileName = "TestImageWriters.tif";
+
+// more than one 1 MiB PNG band, more than one band of 32 TIFF strips in every
+// mode, odd width
+const size_t s_width = 641;
+const size_t s_height = 1200;
+
+//! \brief noise and gradients, with values out of [0, 1] to check the clamp
+void fillFrame(pfs::Frame &frame) {
+    pfs::Channel *R;
+    pfs::Channel *G;
+    pfs::Channel *B;
+    frame.createXYZChannels(R, G, B);
+
+    unsigned int seed = 12345;
+    for (size_t y = 0; y < frame.getHeight(); ++y) {
+        for (size_t x = 0; x < frame.getWidth(); ++x) {
+            seed = seed * 1103515245u + 12345u;
+            (*R)(x, y) = (x % 50 < 25) ? -0.1f + 1.2f * (seed >> 8) / 16777216.f
+                                       : float(x) / frame.getWidth();
+            (*G)(x, y) = float(y) / frame.getHeight();
+            (*B)(x, y) = 0.5f + 0.6f * std::sin(x * 0.05f + y * 0.03f);
+        }
+    }
+}
+
+float clamped(float v) { return std::max(0.f, std::min(v, 1.f)); }
+
+//! \brief counts the samples of \a frame that \a row does not match, once
+//! mapped by \a remapper
+template <typename T, typename Remapper>
+size_t compareRow(const pfs::Frame &frame, size_t y, const T *row,
+                  const Remapper &remapper) {
+    const pfs::Channel *in[3];
+    frame.getXYZChannels(in[0], in[1], in[2]);
+
+    size_t errors = 0;
+    for (size_t x = 0; x < frame.getWidth(); ++x) {
+        for (int c = 0; c < 3; ++c) {
+            if (row[3 * x + c] != remapper(clamped((*in[c])(x, y)))) {
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+struct FloatRemapper {
+    float operator()(float sample) const { return sample; }
+};
+
+//! \brief quality 100 stores the rows unfiltered at zlib level 0, lower
+//! qualities filter them and deflate at higher levels
+void pngRoundTrip(size_t quality) {
+    pfs::Frame frame(s_width, s_height);
+    fillFrame(frame);
+
+    pfs::Params params;
+    params.set("quality", quality);
+    {
+        pfs::io::PngWriter writer(s_pngFileName);
+        ASSERT_TRUE(writer.write(frame, params));
+    }
+
+    FILE *file = std::fopen(s_pngFileName, "rb");
+    ASSERT_TRUE(file != NULL);
+    png_structp png =
+        png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png_create_info_struct(png);
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        std::fclose(file);
+        std::remove(s_pngFileName);
+        FAIL() << "libpng error, quality " << quality;
+    }
+    png_init_io(png, file);
+    png_read_info(png, info);
+    ASSERT_EQ(s_width, png_get_image_width(png, info));
+    ASSERT_EQ(s_height, png_get_image_height(png, info));
+    ASSERT_EQ(8, png_get_bit_depth(png, info));
+    ASSERT_EQ(PNG_COLOR_TYPE_RGB, png_get_color_type(png, info));
+
+    Remapper<png_byte> remapper(MAP_LINEAR);
+    std::vector<png_byte> row(s_width * 3);
+    size_t errors = 0;
+    for (size_t y = 0; y < s_height; ++y) {
+        png_read_row(png, row.data(), NULL);
+        errors += compareRow(frame, y, row.data(), remapper);
+    }
+    // reads the IEND chunk and checks the CRCs left
+    png_read_end(png, NULL);
+    png_destroy_read_struct(&png, &info, NULL);
+    std::fclose(file);
+    std::remove(s_pngFileName);
+
+    EXPECT_EQ(0u, errors) << "quality " << quality;
+}
+
+//! \brief write \a frame with TiffRowWriter, in bands of uneven sizes that
+//! do not match its strips
+void writeTiffByRows(const pfs::Frame &frame, const pfs::Params &params) {
+    pfs::io::TiffRowWriter writer(s_tiffFileName, frame.getWidth(),
+                                  frame.getHeight(), params);
+    const size_t bands[] = {1, 37, 300, 2, 511};
+    size_t y = 0;
+    for (size_t i = 0; y < frame.getHeight(); ++i) {
+        const size_t rows = std::min(bands[i % 5], frame.getHeight() - y);
+        std::unique_ptr<pfs::Frame> band(
+            pfs::cut(&frame, 0, y, frame.getWidth(), y + rows));
+        EXPECT_FALSE(writer.complete());
+        writer.write(*band);
+        y += rows;
+    }
+    EXPECT_TRUE(writer.complete());
+}
+
+//! \brief \a level is the zlib level of the deflated strips, the size of the
+//! file is stored in \a fileSize if given
+template <typename T, typename Remapper>
+void tiffRoundTrip(int mode, bool deflate, const Remapper &remapper,
+                   bool byRows = false, int level = -1,
+                   long *fileSize = NULL) {
+    pfs::Frame frame(s_width, s_height);
+    fillFrame(frame);
+
+    pfs::Params params;
+    params.set("tiff_mode", mode);
+    params.set("deflateCompression", deflate);
+    params.set("deflate_level", level);
+    if (byRows) {
+        writeTiffByRows(frame, params);
+    } else {
+        pfs::io::TiffWriter writer(s_tiffFileName);
+        ASSERT_TRUE(writer.write(frame, params));
+    }
+
+    TIFF *tif = TIFFOpen(s_tiffFileName, "r");
+    ASSERT_TRUE(tif != NULL);
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint16_t compression = 0;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression);
+    EXPECT_EQ(s_width, width);
+    EXPECT_EQ(s_height, height);
+    EXPECT_EQ(deflate ? COMPRESSION_DEFLATE : COMPRESSION_NONE,
+              compression);
+    EXPECT_LT(32u, TIFFNumberOfStrips(tif));
+    ASSERT_EQ(tsize_t(s_width * 3 * sizeof(T)), TIFFScanlineSize(tif));
+
+    std::vector<T> row(s_width * 3);
+    size_t errors = 0;
+    for (uint32_t y = 0; y < height; ++y) {
+        ASSERT_EQ(1, TIFFReadScanline(tif, row.data(), y, 0)) << "row " << y;
+        errors += compareRow(frame, y, row.data(), remapper);
+    }
+    TIFFClose(tif);
+    if (fileSize) {
+        FILE *file = std::fopen(s_tiffFileName, "rb");
+        ASSERT_TRUE(file != NULL);
+        std::fseek(file, 0, SEEK_END);
+        *fileSize = std::ftell(file);
+        std::fclose(file);
+    }
+    std::remove(s_tiffFileName);
+
+    EXPECT_EQ(0u, errors) << "mode " << mode << ", deflate " << deflate
+                          << ", by rows " << byRows << ", level " << level;
+}
+}
+
+TEST(TestImageWriters, PngStored) { pngRoundTrip(100); }
+
+TEST(TestImageWriters, PngDeflated) {
+    pngRoundTrip(50);
+    pngRoundTrip(0);
+}
+
+TEST(TestImageWriters, Tiff8) {
+    tiffRoundTrip<uint8_t>(0, false, Remapper<uint8_t>(MAP_LINEAR));
+    tiffRoundTrip<uint8_t>(0, true, Remapper<uint8_t>(MAP_LINEAR));
+}
+
+TEST(TestImageWriters, Tiff16) {
+    tiffRoundTrip<uint16_t>(1, false,
+                            Remapper<uint16_t>(MAP_LINEAR));
+    tiffRoundTrip<uint16_t>(1, true, Remapper<uint16_t>(MAP_LINEAR));
+}
+
+TEST(TestImageWriters, TiffFloat) {
+    tiffRoundTrip<float>(2, false, FloatRemapper());
+    tiffRoundTrip<float>(2, true, FloatRemapper());
+}
+
+TEST(TestImageWriters, TiffByRows) {
+    tiffRoundTrip<uint8_t>(0, false, Remapper<uint8_t>(MAP_LINEAR), true);
+    tiffRoundTrip<uint8_t>(0, true, Remapper<uint8_t>(MAP_LINEAR), true);
+    tiffRoundTrip<uint16_t>(1, true, Remapper<uint16_t>(MAP_LINEAR), true);
+}
+
+TEST(TestImageWriters, TiffDeflateLevel) {
+    long fastest = 0;
+    long smallest = 0;
+    tiffRoundTrip<uint16_t>(1, true, Remapper<uint16_t>(MAP_LINEAR), false, 1,
+                            &fastest);
+    tiffRoundTrip<uint16_t>(1, true, Remapper<uint16_t>(MAP_LINEAR), false, 9,
+                            &smallest);
+    EXPECT_LT(smallest, fastest);
+}
+
+TEST(TestImageWriters, TiffByRowsOutOfTheImage) {
+    pfs::Params params;
+    params.set("tiff_mode", 0);
+    {
+        pfs::io::TiffRowWriter writer(s_tiffFileName, 8, 4, params);
+        pfs::Frame rows(8, 5);
+        fillFrame(rows);
+        EXPECT_THROW(writer.write(rows), pfs::io::WriteException);
+    }
+    std::remove(s_tiffFileName);
+
+    params.set("tiff_mode", 2);
+    EXPECT_THROW(pfs::io::TiffRowWriter(s_tiffFileName, 8, 4, params),
+                 pfs::io::WriteException);
+    std::remove(s_tiffFileName);
+}
@@ -0,0 +1,268 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Linear merge of RAW brackets and bilinear demosaicing
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <HdrCreation/linear.h>
+#include <Libpfs/frame.h>
+#include <Libpfs/io/rawreader.h>
+#include <Libpfs/manip/demosaic.h>
+
+using namespace libhdr::fusion;
+
+namespace {
+
+const size_t s_width = 64;
+const size_t s_height = 48;
+
+//! \brief radiance over five decades, rising from left to right
+float radiance(size_t x, size_t y) {
+    return 1e-4f * std::pow(10.f, 5.f * x / (s_width - 1)) *
+           (1.f + 0.5f * y / s_height);
+}
+
+pfs::BayerFrame capture(float exposure) {
+    pfs::BayerFrame bayer;
+    bayer.saturation = 0.97f;
+    bayer.data.resize(s_width, s_height);
+    for (size_t y = 0; y < s_height; ++y) {
+        for (size_t x = 0; x < s_width; ++x) {
+            bayer.data(x, y) = std::min(radiance(x, y) * exposure, 1.f);
+        }
+    }
+    return bayer;
+}
+}
+
+TEST(TestLinearMerge, BayerBrackets) {
+    std::vector<float> exposures;
+    exposures.push_back(1.f);
+    exposures.push_back(16.f);
+    exposures.push_back(256.f);
+
+    std::vector<pfs::BayerFrame> brackets;
+    for (size_t i = 0; i < exposures.size(); ++i) {
+        brackets.push_back(capture(exposures[i]));
+    }
+
+    pfs::BayerFrame merged;
+    mergeBayerFrames(brackets, exposures, merged);
+
+    ASSERT_EQ(merged.data.getCols(), s_width);
+    ASSERT_EQ(merged.data.getRows(), s_height);
+    for (size_t y = 0; y < s_height; ++y) {
+        for (size_t x = 0; x < s_width; ++x) {
+            // clipped in every bracket: the shortest exposure
+            const float expected = std::min(radiance(x, y), 1.f);
+            EXPECT_NEAR(merged.data(x, y), expected, 1e-5f * expected)
+                << x << ", " << y;
+        }
+    }
+}
+
+TEST(TestLinearMerge, BayerSizeMismatch) {
+    std::vector<pfs::BayerFrame> brackets(2);
+    brackets[0].data.resize(4, 4);
+    brackets[1].data.resize(4, 2);
+    std::vector<float> exposures(2, 1.f);
+
+    pfs::BayerFrame merged;
+    EXPECT_THROW(mergeBayerFrames(brackets, exposures, merged),
+                 std::runtime_error);
+}
+
+TEST(TestLinearMerge, DemosaicFlatField) {
+    // below the saturation level once white balanced
+    const float color[3] = {0.2f, 0.5f, 0.6f};
+    // RGGB and GBRG
+    const int patterns[2][2][2] = {{{0, 1}, {1, 2}}, {{1, 2}, {0, 1}}};
+
+    for (int p = 0; p < 2; ++p) {
+        pfs::BayerFrame bayer;
+        std::copy(&patterns[p][0][0], &patterns[p][0][0] + 4, &bayer.cfa[0][0]);
+        bayer.whiteBalance[0] = 2.f;
+        bayer.whiteBalance[2] = 1.5f;
+        bayer.data.resize(7, 5);
+        for (size_t y = 0; y < 5; ++y) {
+            for (size_t x = 0; x < 7; ++x) {
+                bayer.data(x, y) = color[bayer.color(x, y)];
+            }
+        }
+
+        pfs::Frame frame;
+        pfs::demosaic(bayer, frame);
+
+        const pfs::Channel *C[3];
+        frame.getXYZChannels(C[0], C[1], C[2]);
+        ASSERT_TRUE(C[0] != NULL);
+        ASSERT_EQ(frame.getWidth(), 7u);
+        ASSERT_EQ(frame.getHeight(), 5u);
+        for (int c = 0; c < 3; ++c) {
+            for (size_t k = 0; k < C[c]->size(); ++k) {
+                EXPECT_NEAR((*C[c])(k), color[c] * bayer.whiteBalance[c],
+                            1e-6f)
+                    << "pattern " << p << ", channel " << c << ", " << k;
+            }
+        }
+    }
+}
+
+// photosites clipped in every bracket must come out white, not tinted by
+// the white balance multipliers
+TEST(TestLinearMerge, ClippedHighlights) {
+    std::vector<float> exposures;
+    exposures.push_back(1.f);
+    exposures.push_back(4.f);
+    exposures.push_back(16.f);
+
+    // the left half is brighter than the shortest exposure can record
+    const float gain[3] = {0.4f, 1.f, 0.625f};
+    std::vector<pfs::BayerFrame> brackets(exposures.size());
+    for (size_t i = 0; i < exposures.size(); ++i) {
+        pfs::BayerFrame &bayer = brackets[i];
+        bayer.saturation = 0.97f;
+        bayer.whiteBalance[0] = 2.5f;
+        bayer.whiteBalance[2] = 1.6f;
+        // camera to sRGB matrices keep neutral colours neutral
+        const float rgbCam[3][3] = {
+            {1.6f, -0.5f, -0.1f}, {-0.2f, 1.5f, -0.3f}, {0.f, -0.4f, 1.4f}};
+        std::copy(&rgbCam[0][0], &rgbCam[0][0] + 9, &bayer.rgbCam[0][0]);
+        bayer.data.resize(s_width, s_height);
+        for (size_t y = 0; y < s_height; ++y) {
+            for (size_t x = 0; x < s_width; ++x) {
+                const float scene = (x < s_width / 2) ? 10.f : 0.05f;
+                bayer.data(x, y) = std::min(
+                    scene * gain[bayer.color(x, y)] * exposures[i], 1.f);
+            }
+        }
+    }
+
+    pfs::BayerFrame merged;
+    mergeBayerFrames(brackets, exposures, merged);
+    pfs::Frame frame;
+    pfs::demosaic(merged, frame);
+
+    const pfs::Channel *C[3];
+    frame.getXYZChannels(C[0], C[1], C[2]);
+    for (size_t y = 0; y < s_height; ++y) {
+        // away from the edge of the clipped area
+        for (size_t x = 0; x + 2 < s_width / 2; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                ASSERT_NEAR((*C[c])(x, y), merged.saturation, 1e-5f)
+                    << x << ", " << y << ", channel " << c;
+            }
+        }
+        // the white balance makes the rest of the scene grey
+        for (size_t x = s_width / 2 + 2; x < s_width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                ASSERT_NEAR((*C[c])(x, y), 0.05f, 1e-6f)
+                    << x << ", " << y << ", channel " << c;
+            }
+        }
+    }
+}
+
+TEST(TestLinearMerge, UnpackBayer) {
+    // a 6x4 image inside a 10x8 sensor, GBRG with a second green of its own
+    const size_t pitch = 10;
+    const int left = 1;
+    const int top = 2;
+    const int color[2][2] = {{1, 2}, {0, 3}};
+    const float black[4] = {100.f, 110.f, 120.f, 130.f};
+    const float maximum = 4095.f;
+
+    std::vector<unsigned short> raw(pitch * 8, 0);
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 6; ++x) {
+            raw[(y + top) * pitch + x + left] =
+                (unsigned short)(500 + 100 * y + 10 * x);
+        }
+    }
+    // below the black level, and a white point from the data
+    raw[top * pitch + left] = 50;
+    raw[(top + 3) * pitch + left + 5] = 4000;
+
+    pfs::BayerFrame bayer;
+    pfs::io::unpackBayer(raw.data(), pitch, left, top, 6, 4, color, black,
+                         maximum, bayer);
+
+    ASSERT_EQ(6u, bayer.data.getCols());
+    ASSERT_EQ(4u, bayer.data.getRows());
+    const int cfa[2][2] = {{1, 2}, {0, 1}};
+    for (int row = 0; row < 2; ++row) {
+        for (int col = 0; col < 2; ++col) {
+            EXPECT_EQ(cfa[row][col], bayer.cfa[row][col]);
+        }
+    }
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 6; ++x) {
+            const float b = black[color[y & 1][x & 1]];
+            const float v = raw[(y + top) * pitch + x + left];
+            EXPECT_NEAR(std::max(0.f, (v - b) / (maximum - b)),
+                        bayer.data(x, y), 1e-6f)
+                << x << ", " << y;
+        }
+    }
+    EXPECT_EQ(0.f, bayer.data(0, 0));
+    // the highest black level clips first
+    EXPECT_NEAR(0.97f * (4000.f - 130.f) / (maximum - 130.f),
+                bayer.saturation, 1e-6f);
+}
+
+TEST(TestLinearMerge, LinearOperator) {
+    std::vector<FrameEnhanced> frames;
+    const float exposures[2] = {1.f, 8.f};
+    for (int i = 0; i < 2; ++i) {
+        pfs::FramePtr frame(new pfs::Frame(s_width, s_height));
+        pfs::Channel *C[3];
+        frame->createXYZChannels(C[0], C[1], C[2]);
+        for (size_t y = 0; y < s_height; ++y) {
+            for (size_t x = 0; x < s_width; ++x) {
+                const float v = float(x) / (s_width - 1);
+                for (int c = 0; c < 3; ++c) {
+                    (*C[c])(x, y) = std::min(v * exposures[i], 1.f);
+                }
+            }
+        }
+        frames.push_back(FrameEnhanced(frame, exposures[i]));
+    }
+
+    ResponseCurve response(RESPONSE_LINEAR);
+    WeightFunction weight(WEIGHT_TRIANGULAR);
+    FusionOperatorPtr op = IFusionOperator::build(LINEAR);
+    ASSERT_EQ(op->getType(), LINEAR);
+    std::unique_ptr<pfs::Frame> hdr(
+        op->computeFusion(response, weight, frames));
+
+    const pfs::Channel *C[3];
+    hdr->getXYZChannels(C[0], C[1], C[2]);
+    for (size_t x = 0; x < s_width; ++x) {
+        const float v = float(x) / (s_width - 1);
+        // both exposures see the dark end, the short one alone the bright end
+        EXPECT_NEAR((*C[1])(x, 0), v, 2e-3f) << x;
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#include <gtest/gtest.h>
+
+#include <Libpfs/array2d.h>
+#include <TonemappingOperators/lischinski06/lischinski_minimization.h>
+
+#include <cmath>
+
+using namespace pfs;
+
+// constant constraints are an exact solution, whatever the luminance
+TEST(LischinskiMinimization, ConstantExposure)
+{
+    const int width = 700;
+    const int height = 450;
+    Array2Df L(width, height);
+    Array2Df g(width, height);
+    Array2Df F(width, height);
+
+    for (int j = 0; j < height; j++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            L(i, j) = 1.f + 0.5f * std::sin(i * 0.05f) * std::cos(j * 0.07f);
+            g(i, j) = -1.5f;
+        }
+    }
+
+    LischinskiMinimization(L, g, F);
+
+    for (int j = 0; j < height; j++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            ASSERT_NEAR(F(i, j), -1.5f, 1e-2f);
+        }
+    }
+}
+
+// at full resolution the exposure map must keep a luminance edge sharp,
+// the upsampled coarse solve alone blurs it over a few pixels
+TEST(LischinskiMinimization, FullResolutionEdge)
+{
+    const int width = 700;
+    const int height = 450;
+    const int edge = 301;
+    Array2Df L(width, height);
+    Array2Df g(width, height);
+    Array2Df F(width, height);
+
+    for (int j = 0; j < height; j++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            L(i, j) = (i < edge) ? 0.1f : 5.f;
+            g(i, j) = (i < edge) ? 1.f : -2.f;
+        }
+    }
+
+    LischinskiMinimization(L, g, F);
+
+    for (int j = 0; j < height; j++)
+    {
+        ASSERT_NEAR(F(edge - 1, j), 1.f, 5e-2f);
+        ASSERT_NEAR(F(edge, j), -2.f, 5e-2f);
+        ASSERT_GE(F(edge - 1, j) - F(edge, j), 2.9f);
+    }
+}
+
+// a solve width between the coarse grid and the image refines on its own
+// grid, the result is upsampled to the size of the image
+TEST(LischinskiMinimization, IntermediateSolveWidth)
+{
+    const int width = 700;
+    const int height = 450;
+    Array2Df L(width, height);
+    Array2Df g(width, height);
+    Array2Df F(width, height);
+
+    for (int j = 0; j < height; j++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            L(i, j) = 1.f + 0.5f * std::sin(i * 0.05f) * std::cos(j * 0.07f);
+            g(i, j) = -1.5f;
+        }
+    }
+
+    LischinskiMinimization(L, g, F, 1.0f, 0.4f, 1e-4f, 0.07f, 400);
+
+    for (int j = 0; j < height; j++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            ASSERT_NEAR(F(i, j), -1.5f, 1e-2f);
+        }
+    }
+}
@@ -0,0 +1,182 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Check the tone-curves Mantiuk08 finds against those of the solver
+//! that built the quadratic programme from the dense constraint matrix, from
+//! a linear curve and from the curve of the previous frame
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <Libpfs/progress.h>
+#include <TonemappingOperators/pfstmo.h>
+#include <TonemappingOperators/mantiuk08/display_adaptive_tmo.h>
+#include <TonemappingOperators/mantiuk08/display_function.h>
+#include <TonemappingOperators/mantiuk08/display_size.h>
+
+namespace {
+
+// a pixel count that is not a multiple of 4 leaves pixels to the scalar path
+const int s_width = 203;
+const int s_height = 131;
+
+// the nodes compared, every s_nodeStep from s_firstNode: the curve is flat
+// outside of them
+const int s_firstNode = 56;
+const int s_nodeStep = 2;
+const int s_nodes = 29;
+
+struct ToneCurveCase {
+    float enhFactor;
+    float whiteY;
+    double expected[s_nodes];
+};
+
+// computed by the dense solver for the image of buildLuminance(), lcd
+// display, 30 inch at 0.5 m, full visual model
+const ToneCurveCase s_cases[] = {
+    {1.f,
+     -1.f,
+     {
+         -0.003933, -0.003933, -0.003933, -0.003933, -0.003933, -0.003933,
+         0.015088, 0.049672, 0.090848, 0.135890, 0.185420, 0.249458,
+         0.332937, 0.424733, 0.524357, 0.630124, 0.746345, 0.870982,
+         0.965969, 1.095459, 1.237728, 1.386499, 1.538721, 1.690369,
+         1.838105, 1.965171, 2.104915, 2.252398, 2.301445,
+     }},
+    {1.5f,
+     -1.f,
+     {
+         -0.003933, -0.003933, -0.003933, -0.003933, -0.003933, -0.003933,
+         -0.003933, -0.003933, -0.003933, -0.003933, 0.010130, 0.067098,
+         0.152423, 0.247496, 0.351422, 0.461307, 0.588302, 0.727598,
+         0.796617, 0.935465, 1.104192, 1.287502, 1.476804, 1.658837,
+         1.822681, 1.941108, 2.086731, 2.261319, 2.301445,
+     }},
+    {1.f,
+     100.f,
+     {
+         -0.003932, -0.003932, 0.089764, 0.118799, 0.160025, 0.206666,
+         0.262095, 0.326894, 0.405052, 0.495970, 0.591634, 0.694981,
+         0.805713, 0.924706, 1.052889, 1.189625, 1.331705, 1.484575,
+         1.631964, 1.796692, 1.969924, 2.155346, 2.266030, 2.278233,
+         2.278233, 2.278233, 2.278233, 2.301445, 2.301445,
+     }},
+};
+
+//! \brief HDR test card: a ramp over five decades with a bright window,
+//! modulated so that every band of the pyramid sees some contrast. Later
+//! frames of the video are brighter, and their window and modulation move.
+std::vector<float> buildLuminance(int frame = 0) {
+    std::vector<float> L(s_width * s_height);
+    for (int y = 0; y < s_height; y++) {
+        for (int x = 0; x < s_width; x++) {
+            float l = std::pow(10.f, 5.f * x / (s_width - 1) - 2.f) *
+                      (1.f + 0.3f * std::sin(x * 0.05f + 0.2f * frame) *
+                                 std::cos(y * 0.07f));
+            if (x > s_width / 3 + 2 * frame && x < s_width / 2 + 2 * frame &&
+                y > s_height / 4 && y < s_height / 2) {
+                l *= 80.f;
+            }
+            l *= 1.f + 0.02f * ((x * 7 + y * 13) % 11 - 5);
+            L[y * s_width + x] = l * (1.f + 0.05f * frame);
+        }
+    }
+    return L;
+}
+
+class TestMantiuk08ToneCurve : public ::testing::TestWithParam<ToneCurveCase> {
+};
+}
+
+TEST_P(TestMantiuk08ToneCurve, MatchesDenseSolver) {
+    const ToneCurveCase &param = GetParam();
+    const std::vector<float> L = buildLuminance();
+
+    pfs::Progress ph;
+    DisplayFunctionGGBA df("lcd");
+    DisplaySize ds(30.f, 0.5f);
+    std::unique_ptr<datmoConditionalDensity> C =
+        datmo_compute_conditional_density(s_width, s_height, L.data(), ph);
+    ASSERT_TRUE(C.get() != NULL);
+
+    datmoToneCurve tc;
+    ASSERT_EQ(datmo_compute_tone_curve(&tc, C.get(), &df, &ds,
+                                       param.enhFactor, param.whiteY, vm_full,
+                                       -1, ph),
+              PFSTMO_OK);
+    ASSERT_GE(tc.size, size_t(s_firstNode + s_nodeStep * (s_nodes - 1) + 1));
+
+    // the curve is in log10 of the display luminance
+    for (int n = 0; n < s_nodes; n++) {
+        const int i = s_firstNode + s_nodeStep * n;
+        EXPECT_NEAR(tc.y_i[i], param.expected[n], 1e-4) << "node " << i;
+    }
+}
+
+//! \brief the second frame of a video starts from the curve of the first one,
+//! which datmoTCFilter keeps, and ends close to the curve found from a
+//! linear start: the iterations stop once no variable moves by more than a
+//! tenth of a bin
+TEST_P(TestMantiuk08ToneCurve, VideoStartsFromThePreviousCurve) {
+    const ToneCurveCase &param = GetParam();
+
+    pfs::Progress ph;
+    DisplayFunctionGGBA df("lcd");
+    DisplaySize ds(30.f, 0.5f);
+    datmoTCFilter filter(25, std::log10(df.display(0)),
+                         std::log10(df.display(1)));
+    EXPECT_TRUE(filter.lastToneCurve() == NULL);
+
+    for (int frame = 0; frame < 2; frame++) {
+        const std::vector<float> L = buildLuminance(frame);
+        std::unique_ptr<datmoConditionalDensity> C =
+            datmo_compute_conditional_density(s_width, s_height, L.data(), ph);
+        ASSERT_TRUE(C.get() != NULL);
+
+        datmoToneCurve cold;
+        ASSERT_EQ(datmo_compute_tone_curve(&cold, C.get(), &df, &ds,
+                                           param.enhFactor, param.whiteY,
+                                           vm_full, -1, ph),
+                  PFSTMO_OK);
+
+        const datmoToneCurve *previous = filter.lastToneCurve();
+        EXPECT_EQ(frame > 0, previous != NULL);
+        datmoToneCurve *tc = filter.getToneCurvePtr();
+        ASSERT_NE(previous, tc);
+        ASSERT_EQ(datmo_compute_tone_curve(tc, C.get(), &df, &ds,
+                                           param.enhFactor, param.whiteY,
+                                           vm_full, -1, ph, previous),
+                  PFSTMO_OK);
+        filter.filterToneCurve();
+
+        ASSERT_EQ(cold.size, tc->size);
+        for (size_t i = 0; i < tc->size; i++) {
+            EXPECT_NEAR(tc->y_i[i], cold.y_i[i], frame > 0 ? 0.05 : 1e-12)
+                << "frame " << frame << ", node " << i;
+        }
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(Mantiuk08, TestMantiuk08ToneCurve,
+                        ::testing::ValuesIn(s_cases));
@@ -0,0 +1,93 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Streams compressed by ParallelDeflate must inflate back to the input
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <zlib.h>
+
+#include <Libpfs/io/paralleldeflate.h>
+
+using pfs::io::ParallelDeflate;
+
+namespace {
+
+//! \brief half noise, half runs: both stored and well compressed blocks
+std::vector<unsigned char> buildData(size_t size) {
+    std::vector<unsigned char> data(size);
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (i % 1000 < 500) ? (unsigned char)(seed >> 16)
+                                   : (unsigned char)(i / 7);
+    }
+    return data;
+}
+
+std::vector<unsigned char> inflateAll(const std::vector<unsigned char> &in,
+                                      size_t expected) {
+    std::vector<unsigned char> out(expected + 16);
+    uLongf size = out.size();
+    EXPECT_EQ(Z_OK, uncompress(out.data(), &size, in.data(), in.size()));
+    out.resize(size);
+    return out;
+}
+}
+
+TEST(TestParallelDeflate, SingleCall) {
+    const std::vector<unsigned char> data = buildData(1000000);
+    const int levels[] = {-1, 0, 1, 9};
+
+    for (int l = 0; l < 4; ++l) {
+        std::vector<unsigned char> compressed;
+        ParallelDeflate deflater(levels[l]);
+        deflater.append(data.data(), data.size(), true, compressed);
+
+        EXPECT_EQ(data, inflateAll(compressed, data.size()))
+            << "level " << levels[l];
+    }
+}
+
+TEST(TestParallelDeflate, SeveralCalls) {
+    const std::vector<unsigned char> data = buildData(700000);
+    // shorter and longer than the 32 KiB window, then an empty closing call
+    const size_t cuts[] = {0, 100, 20000, 60000, 500000, data.size()};
+
+    std::vector<unsigned char> compressed;
+    ParallelDeflate deflater(6);
+    for (int c = 0; c < 5; ++c) {
+        deflater.append(data.data() + cuts[c], cuts[c + 1] - cuts[c], false,
+                        compressed);
+    }
+    deflater.append(NULL, 0, true, compressed);
+
+    EXPECT_EQ(data, inflateAll(compressed, data.size()));
+}
+
+TEST(TestParallelDeflate, EmptyStream) {
+    std::vector<unsigned char> compressed;
+    ParallelDeflate deflater(9);
+    deflater.append(NULL, 0, true, compressed);
+
+    EXPECT_TRUE(inflateAll(compressed, 0).empty());
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#include <gtest/gtest.h>
+
+#include <Libpfs/array2d.h>
+#include <TonemappingOperators/pattanaik00/tmo_pattanaik00.h>
+
+#include <cmath>
+#include <cstdlib>
+
+using namespace pfs;
+
+// the fast local adaptation must match the per-pixel reference, borders
+// included
+TEST(Pattanaik00LocalAdaptation, MatchesReference)
+{
+    const int width = 203;
+    const int height = 117;
+    Array2Df Y(width, height);
+    Array2Df fast(width, height);
+    Array2Df reference(width, height);
+
+    srand(1);
+    for (int i = 0; i < width * height; i++)
+    {
+        Y(i) = std::exp((rand() % 1000) / 1000.f * 12.f - 6.f);
+    }
+
+    calculateLocalAdaptation(Y, fast);
+    calculateLocalAdaptation(Y, reference, true);
+
+    for (int i = 0; i < width * height; i++)
+    {
+        ASSERT_NEAR(fast(i), reference(i), 1e-4f * reference(i));
+    }
+}
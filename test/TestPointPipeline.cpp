@@ -0,0 +1,124 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include "Libpfs/frame.h"
+#include "Libpfs/manip/copy.h"
+#include "Libpfs/manip/gamma.h"
+#include "Libpfs/manip/pointpipeline.h"
+#include "Libpfs/manip/saturation.h"
+
+using namespace pfs;
+
+namespace {
+//! \brief odd sized frame, so that the last tile is partial, with values in
+//! [-0.1, 1.1]
+std::unique_ptr<Frame> buildFrame() {
+    std::unique_ptr<Frame> frame(new Frame(301, 77));
+    Channel *X;
+    Channel *Y;
+    Channel *Z;
+    frame->createXYZChannels(X, Y, Z);
+    for (size_t i = 0; i < X->size(); i++) {
+        (*X)(i) = -0.1f + 1.2f * float(i % 97) / 96.f;
+        (*Y)(i) = -0.1f + 1.2f * float(i % 89) / 88.f;
+        (*Z)(i) = -0.1f + 1.2f * float(i % 83) / 82.f;
+    }
+    frame->getTags().setTag("TAG", "value");
+    return frame;
+}
+
+float maxDifference(const Frame &a, const Frame &b) {
+    const Channel *aX, *aY, *aZ;
+    const Channel *bX, *bY, *bZ;
+    a.getXYZChannels(aX, aY, aZ);
+    b.getXYZChannels(bX, bY, bZ);
+
+    float diff = 0.f;
+    for (size_t i = 0; i < aX->size(); i++) {
+        diff = std::max(diff, std::fabs((*aX)(i) - (*bX)(i)));
+        diff = std::max(diff, std::fabs((*aY)(i) - (*bY)(i)));
+        diff = std::max(diff, std::fabs((*aZ)(i) - (*bZ)(i)));
+    }
+    return diff;
+}
+}
+
+TEST(TestPointPipeline, SaturationThenGamma) {
+    std::unique_ptr<Frame> reference(buildFrame());
+    applySaturation(reference.get(), 1.3f);
+    applyGamma(reference.get(), 2.2f);
+
+    std::unique_ptr<Frame> frame(buildFrame());
+    PointPipeline pipeline;
+    pipeline.saturation(1.3f).gamma(1.f / 2.2f);
+    pipeline.apply(*frame);
+
+    EXPECT_LT(maxDifference(*reference, *frame), 1e-5f);
+}
+
+TEST(TestPointPipeline, CopyAndGamma) {
+    std::unique_ptr<Frame> input(buildFrame());
+    input->createChannel("EXTRA");
+
+    std::unique_ptr<Frame> reference(copy(input.get()));
+    applyGamma(reference.get(), 0.8f);
+
+    Frame frame(input->getWidth(), input->getHeight());
+    PointPipeline pipeline;
+    pipeline.gamma(1.f / 0.8f);
+    pipeline.apply(*input, frame);
+
+    EXPECT_LT(maxDifference(*reference, frame), 1e-5f);
+    EXPECT_TRUE(frame.getChannel("EXTRA") != NULL);
+    EXPECT_EQ("value", frame.getTags().getTag("TAG"));
+}
+
+TEST(TestPointPipeline, Identity) {
+    PointPipeline pipeline;
+    pipeline.gamma(1.f).saturation(1.f);
+    EXPECT_TRUE(pipeline.empty());
+
+    std::unique_ptr<Frame> reference(buildFrame());
+    std::unique_ptr<Frame> frame(buildFrame());
+    pipeline.apply(*frame);
+    EXPECT_EQ(0.f, maxDifference(*reference, *frame));
+}
+
+TEST(TestPointPipeline, Levels) {
+    std::unique_ptr<Frame> frame(buildFrame());
+    PointPipeline pipeline;
+    pipeline.levels(0.1f, 0.9f, 0.f, 1.f);
+    pipeline.apply(*frame);
+
+    const Channel *X, *Y, *Z;
+    frame->getXYZChannels(X, Y, Z);
+    std::unique_ptr<Frame> input(buildFrame());
+    const Channel *iX = input->getChannel("X");
+    for (size_t i = 0; i < X->size(); i++) {
+        const float expected =
+            std::max(0.f, std::min((*iX)(i) - 0.1f, 0.8f) / 0.8f);
+        EXPECT_NEAR(expected, (*X)(i), 1e-5f);
+    }
+}
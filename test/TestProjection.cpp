@@ -0,0 +1,264 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Batched spherical projections: round trips through the directions,
+//! transforms of several channels at once and remap tables
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <Libpfs/array2d.h>
+#include <Libpfs/manip/projection.h>
+
+namespace {
+
+const size_t s_side = 37;
+
+//! \brief sample points inside the domain of every projection, away from the
+//! poles and from the seam of the cylindrical ones
+void buildPoints(std::vector<float> &u, std::vector<float> &v) {
+    for (size_t j = 0; j < s_side; j++) {
+        for (size_t i = 0; i < s_side; i++) {
+            const float a = 0.2f + 0.6f * i / (s_side - 1);
+            const float b = 0.2f + 0.6f * j / (s_side - 1);
+            u.push_back(a);
+            v.push_back(b);
+        }
+    }
+}
+
+void roundTrip(const Projection &projection) {
+    std::vector<float> u;
+    std::vector<float> v;
+    buildPoints(u, v);
+    const size_t n = u.size();
+
+    std::vector<float> x(n), y(n), z(n);
+    projection.uvToDirection(u.data(), v.data(), n, x.data(), y.data(),
+                             z.data());
+
+    std::vector<float> u2(n), v2(n);
+    projection.directionToUV(x.data(), y.data(), z.data(), n, u2.data(),
+                             v2.data());
+
+    for (size_t i = 0; i < n; i++) {
+        ASSERT_NEAR(x[i] * x[i] + y[i] * y[i] + z[i] * z[i], 1.f, 1e-5f)
+            << "sample " << i;
+        ASSERT_NEAR(u[i], u2[i], 1e-5f) << "sample " << i;
+        ASSERT_NEAR(v[i], v2[i], 1e-5f) << "sample " << i;
+    }
+}
+
+void fillSource(pfs::Array2Df &a) {
+    for (size_t r = 0; r < a.getRows(); r++) {
+        for (size_t c = 0; c < a.getCols(); c++) {
+            a(c, r) = std::sin(0.3f * c) + 0.1f * r;
+        }
+    }
+}
+}
+
+TEST(TestProjection, RoundTripPolar) {
+    roundTrip(PolarProjection::singleton);
+}
+
+TEST(TestProjection, RoundTripCylindrical) {
+    roundTrip(CylindricalProjection::singleton);
+}
+
+TEST(TestProjection, RoundTripAngular) {
+    roundTrip(AngularProjection::singleton);
+}
+
+TEST(TestProjection, RoundTripMirrorBall) {
+    roundTrip(MirrorBallProjection::singleton);
+}
+
+TEST(TestProjection, ChannelsShareTheGeometry) {
+    const size_t inCols = 64;
+    const size_t inRows = 32;
+    pfs::Array2Df red(inCols, inRows);
+    pfs::Array2Df green(inCols, inRows);
+    for (size_t r = 0; r < inRows; r++) {
+        for (size_t c = 0; c < inCols; c++) {
+            red(c, r) = std::sin(0.3f * c) + 0.1f * r;
+            green(c, r) = std::cos(0.2f * r) * c;
+        }
+    }
+
+    TransformInfo info;
+    info.srcProjection = &PolarProjection::singleton;
+    info.dstProjection = &AngularProjection::singleton;
+    info.xRotate = 20;
+    info.zRotate = -35;
+    info.oversampleFactor = 3;
+
+    pfs::Array2Df redOut(48, 48);
+    pfs::Array2Df greenOut(48, 48);
+    pfs::Array2Df redSingle(48, 48);
+    pfs::Array2Df greenSingle(48, 48);
+    std::fill(redOut.begin(), redOut.end(), 0.f);
+    std::fill(greenOut.begin(), greenOut.end(), 0.f);
+    std::fill(redSingle.begin(), redSingle.end(), 0.f);
+    std::fill(greenSingle.begin(), greenSingle.end(), 0.f);
+
+    std::vector<const pfs::Array2Df *> in;
+    in.push_back(&red);
+    in.push_back(&green);
+    std::vector<pfs::Array2Df *> out;
+    out.push_back(&redOut);
+    out.push_back(&greenOut);
+    transformArrays(in, out, &info);
+
+    transformArray(&red, &redSingle, &info);
+    transformArray(&green, &greenSingle, &info);
+
+    for (size_t i = 0; i < redOut.size(); i++) {
+        ASSERT_EQ(redSingle(i), redOut(i)) << "pixel " << i;
+        ASSERT_EQ(greenSingle(i), greenOut(i)) << "pixel " << i;
+    }
+}
+
+TEST(TestProjection, RemapTableMatchesTransform) {
+    pfs::Array2Df source(64, 32);
+    fillSource(source);
+
+    TransformInfo info;
+    info.srcProjection = &PolarProjection::singleton;
+    info.dstProjection = &MirrorBallProjection::singleton;
+    info.yRotate = 15;
+    info.oversampleFactor = 2;
+
+    pfs::Array2Df direct(40, 40);
+    pfs::Array2Df remapped(40, 40);
+    std::fill(direct.begin(), direct.end(), 0.f);
+    std::fill(remapped.begin(), remapped.end(), 0.f);
+
+    transformArray(&source, &direct, &info);
+    RemapTable table(info, 64, 32, 40, 40);
+    table.apply(std::vector<const pfs::Array2Df *>(1, &source),
+                std::vector<pfs::Array2Df *>(1, &remapped),
+                RemapTable::BILINEAR);
+
+    // the positions are rounded to 1/256 of a pixel
+    for (size_t i = 0; i < direct.size(); i++) {
+        ASSERT_NEAR(direct(i), remapped(i), 5e-3f) << "pixel " << i;
+    }
+
+    EXPECT_TRUE(table.matches(info, 64, 32, 40, 40));
+    EXPECT_FALSE(table.matches(info, 64, 32, 40, 20));
+    info.oversampleFactor = 1;
+    EXPECT_FALSE(table.matches(info, 64, 32, 40, 40));
+}
+
+TEST(TestProjection, RemapTableFile) {
+    pfs::Array2Df source(48, 48);
+    fillSource(source);
+
+    TransformInfo info;
+    info.srcProjection = &AngularProjection::singleton;
+    info.dstProjection = &CylindricalProjection::singleton;
+    info.zRotate = 30;
+
+    const std::string fileName = "TestProjection.remap";
+    RemapTable table(info, 48, 48, 64, 32);
+    table.writeToFile(fileName);
+
+    RemapTable loaded;
+    loaded.readFromFile(fileName);
+    EXPECT_TRUE(loaded.matches(info, 48, 48, 64, 32));
+
+    pfs::Array2Df expected(64, 32);
+    pfs::Array2Df result(64, 32);
+    table.apply(std::vector<const pfs::Array2Df *>(1, &source),
+                std::vector<pfs::Array2Df *>(1, &expected),
+                RemapTable::BICUBIC);
+    loaded.apply(std::vector<const pfs::Array2Df *>(1, &source),
+                 std::vector<pfs::Array2Df *>(1, &result),
+                 RemapTable::BICUBIC);
+    for (size_t i = 0; i < expected.size(); i++) {
+        ASSERT_EQ(expected(i), result(i)) << "pixel " << i;
+    }
+
+    // a truncated file is rejected
+    FILE *fp = fopen(fileName.c_str(), "wb");
+    ASSERT_TRUE(fp != NULL);
+    fwrite("LHDRREMAP1", 1, 11, fp);
+    fclose(fp);
+    EXPECT_THROW(loaded.readFromFile(fileName), std::runtime_error);
+    EXPECT_TRUE(loaded.matches(info, 48, 48, 64, 32));
+
+    // output sizes larger than the data of the file are rejected before the
+    // table is allocated: 2^22 x 2^22 samples would take 128 TiB
+    table.writeToFile(fileName);
+    std::vector<char> data;
+    fp = fopen(fileName.c_str(), "rb");
+    ASSERT_TRUE(fp != NULL);
+    for (int c = fgetc(fp); c != EOF; c = fgetc(fp)) {
+        data.push_back(char(c));
+    }
+    fclose(fp);
+    uint32_t transformSize;
+    memcpy(&transformSize, &data[11], sizeof(transformSize));
+    const uint64_t outSize = uint64_t(1) << 22;
+    memcpy(&data[15 + transformSize + 2 * sizeof(uint64_t)], &outSize,
+           sizeof(outSize));
+    memcpy(&data[15 + transformSize + 3 * sizeof(uint64_t)], &outSize,
+           sizeof(outSize));
+    fp = fopen(fileName.c_str(), "wb");
+    ASSERT_TRUE(fp != NULL);
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    EXPECT_THROW(loaded.readFromFile(fileName), std::runtime_error);
+    EXPECT_TRUE(loaded.matches(info, 48, 48, 64, 32));
+
+    remove(fileName.c_str());
+}
+
+TEST(TestProjection, RemapTableOnReuse) {
+    TransformInfo info;
+    info.srcProjection = &PolarProjection::singleton;
+    info.dstProjection = &CylindricalProjection::singleton;
+
+    // a first conversion goes without a table, the second one builds it
+    releaseRemapTable();
+    EXPECT_TRUE(getRemapTable(info, 64, 32, 40, 20).get() == NULL);
+    std::shared_ptr<const RemapTable> table =
+        getRemapTable(info, 64, 32, 40, 20);
+    ASSERT_TRUE(table.get() != NULL);
+    EXPECT_TRUE(table->matches(info, 64, 32, 40, 20));
+    EXPECT_EQ(table, getRemapTable(info, 64, 32, 40, 20));
+
+    // other parameters drop the table
+    info.zRotate = 10;
+    EXPECT_TRUE(getRemapTable(info, 64, 32, 40, 20).get() == NULL);
+    EXPECT_TRUE(getRemapTable(info, 64, 32, 40, 20).get() != NULL);
+    EXPECT_TRUE(getRemapTable(info, 64, 32, 40, 10).get() == NULL);
+
+    releaseRemapTable();
+    EXPECT_TRUE(getRemapTable(info, 64, 32, 40, 10).get() == NULL);
+    releaseRemapTable();
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Radiance RGBE files written by RGBEWriter read back by RGBEReader
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <Libpfs/frame.h>
+#include <Libpfs/io/rgbecommon.h>
+#include <Libpfs/io/rgbereader.h>
+#include <Libpfs/io/rgbewriter.h>
+
+namespace {
+
+const char *s_fileName = "TestRGBECodec.hdr";
+
+//! \brief radiance over eight decades, with black pixels and flat runs that
+//! the run length encoding compresses
+void fillFrame(pfs::Frame &frame) {
+    pfs::Channel *R;
+    pfs::Channel *G;
+    pfs::Channel *B;
+    frame.createXYZChannels(R, G, B);
+
+    const size_t width = frame.getWidth();
+    for (size_t y = 0; y < frame.getHeight(); ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            float l = std::pow(10.f, 8.f * x / width - 4.f);
+            if (x % 7 == 3) l = 0.f;
+            if (y % 3 == 1) l = 2.5f;
+            (*R)(x, y) = l * 1.3f;
+            (*G)(x, y) = l;
+            (*B)(x, y) = l * (0.5f + 0.1f * (y % 5));
+        }
+    }
+}
+
+//! \brief RGBE keeps 8 bits of mantissa against the largest component. The
+//! writer divides by the white efficacy, the reader returns the stored values.
+void roundTrip(size_t width, size_t height) {
+    pfs::Frame frame(width, height);
+    fillFrame(frame);
+
+    pfs::io::RGBEWriter writer(s_fileName);
+    ASSERT_TRUE(writer.write(frame, pfs::Params()));
+
+    pfs::Frame result(1, 1);
+    pfs::io::RGBEReader reader(s_fileName);
+    ASSERT_EQ(width, reader.width());
+    ASSERT_EQ(height, reader.height());
+    reader.read(result, pfs::Params());
+    std::remove(s_fileName);
+
+    const pfs::Channel *in[3];
+    const pfs::Channel *out[3];
+    frame.getXYZChannels(in[0], in[1], in[2]);
+    result.getXYZChannels(out[0], out[1], out[2]);
+
+    for (size_t i = 0; i < width * height; ++i) {
+        const float maximum =
+            std::max((*in[0])(i), std::max((*in[1])(i), (*in[2])(i)));
+        for (int c = 0; c < 3; ++c) {
+            EXPECT_NEAR((*in[c])(i), (*out[c])(i) * WHITE_EFFICACY,
+                        maximum / 128.f)
+                << "pixel " << i << ", channel " << c;
+        }
+    }
+}
+}
+
+TEST(TestRGBECodec, RunLengthEncoded) { roundTrip(301, 37); }
+
+// run length encoding is not defined below 8 pixels per scanline
+TEST(TestRGBECodec, FlatScanlines) { roundTrip(5, 11); }
+
+TEST(TestRGBECodec, TruncatedFile) {
+    pfs::Frame frame(64, 16);
+    fillFrame(frame);
+    pfs::io::RGBEWriter writer(s_fileName);
+    ASSERT_TRUE(writer.write(frame, pfs::Params()));
+
+    // drop the last 100 bytes
+    std::vector<char> data;
+    FILE *file = std::fopen(s_fileName, "rb");
+    ASSERT_TRUE(file != NULL);
+    for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file)) {
+        data.push_back(char(c));
+    }
+    std::fclose(file);
+    file = std::fopen(s_fileName, "wb");
+    ASSERT_TRUE(file != NULL);
+    std::fwrite(data.data(), 1, data.size() - 100, file);
+    std::fclose(file);
+
+    pfs::Frame result(1, 1);
+    pfs::io::RGBEReader reader(s_fileName);
+    EXPECT_ANY_THROW(reader.read(result, pfs::Params()));
+    std::remove(s_fileName);
+}
@@ -0,0 +1,266 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Separable resampling: Lanczos against a direct implementation,
+//! exact area averages, several channels at once and the kernel cache
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Libpfs/array2d.h"
+#include "Libpfs/manip/resize.h"
+
+using namespace pfs;
+
+namespace {
+
+void fill(Array2Df &a, float phase) {
+    for (size_t r = 0; r < a.getRows(); r++) {
+        for (size_t c = 0; c < a.getCols(); c++) {
+            a(c, r) = 2.f + std::sin(0.37f * c + phase) * std::cos(0.23f * r);
+        }
+    }
+}
+
+//! \brief Lanczos (a = 3) resampling, one output pixel at a time
+float lanczosAt(const Array2Df &in, float x0, float y0, float scX,
+                float scY) {
+    const float a = 3.f;
+    float sum = 0.f;
+    float ws = 0.f;
+    for (int r = 0; r < int(in.getRows()); r++) {
+        const float wy = detail::Lanc(scY * (y0 - r), a);
+        if (wy == 0.f || std::fabs(y0 - r) >= a / scY) {
+            continue;
+        }
+        for (int c = 0; c < int(in.getCols()); c++) {
+            const float wx = detail::Lanc(scX * (x0 - c), a);
+            if (wx == 0.f || std::fabs(x0 - c) >= a / scX) {
+                continue;
+            }
+            sum += wx * wy * in(c, r);
+            ws += wx * wy;
+        }
+    }
+    return sum / ws;
+}
+
+//! \brief average of \a in over output sample \a j of \a size2
+float areaAt(const std::vector<float> &in, size_t size2, size_t j) {
+    const double delta = double(in.size()) / size2;
+    double sum = 0.0;
+    for (size_t k = 0; k < in.size(); k++) {
+        const double overlap = std::min(k + 1.0, (j + 1) * delta) -
+                               std::max(double(k), j * delta);
+        if (overlap > 0.0) {
+            sum += overlap * in[k];
+        }
+    }
+    return float(sum / delta);
+}
+
+//! \brief \a in interpolated at output sample \a j of \a size2, at the
+//! positions of resizeBilinearGray()
+float bilinearAt(const std::vector<float> &in, size_t size2, size_t j) {
+    const double x = double(in.size() - 1) / size2 * j;
+    const size_t k = size_t(x);
+    const double diff = x - k;
+    return float((1.0 - diff) * in[k] + diff * in[k + 1]);
+}
+}
+
+TEST(TestResize, LanczosMatchesDirectFilter) {
+    Array2Df in(97, 61);
+    fill(in, 0.f);
+
+    const size_t sizes[][2] = {{40, 25}, {150, 90}, {13, 9}};
+    for (size_t s = 0; s < 3; s++) {
+        Array2Df out(sizes[s][0], sizes[s][1]);
+        resize(in, out, LanczosInterp);
+
+        const float dx = float(in.getCols()) / out.getCols();
+        const float dy = float(in.getRows()) / out.getRows();
+        for (size_t r = 0; r < out.getRows(); r++) {
+            for (size_t c = 0; c < out.getCols(); c++) {
+                const float expected =
+                    lanczosAt(in, (c + 0.5f) * dx - 0.5f, (r + 0.5f) * dy - 0.5f,
+                              std::min(1.f / dx, 1.f), std::min(1.f / dy, 1.f));
+                ASSERT_NEAR(expected, out(c, r), 1e-4f)
+                    << out.getCols() << "x" << out.getRows() << " at " << c
+                    << ", " << r;
+            }
+        }
+    }
+}
+
+TEST(TestResize, AreaAveragesBlocks) {
+    Array2Df in(12, 8);
+    fill(in, 1.f);
+
+    Array2Df out(3, 2);
+    resize(in, out, AreaInterp);
+    for (size_t r = 0; r < 2; r++) {
+        for (size_t c = 0; c < 3; c++) {
+            float sum = 0.f;
+            for (size_t y = 4 * r; y < 4 * r + 4; y++) {
+                for (size_t x = 4 * c; x < 4 * c + 4; x++) {
+                    sum += in(x, y);
+                }
+            }
+            EXPECT_NEAR(sum / 16.f, out(c, r), 1e-5f) << c << ", " << r;
+        }
+    }
+}
+
+TEST(TestResize, LargeBilinearShrinkDoesNotAlias) {
+    // one pixel checkerboard: any subset of its pixels averages to 0 or 1
+    Array2Df in(700, 500);
+    for (size_t r = 0; r < in.getRows(); r++) {
+        for (size_t c = 0; c < in.getCols(); c++) {
+            in(c, r) = float((r + c) % 2);
+        }
+    }
+
+    Array2Df out(53, 37);
+    resize(in, out, BilinearInterp);
+    for (size_t i = 0; i < out.size(); i++) {
+        ASSERT_NEAR(0.5f, out(i), 0.01f) << "pixel " << i;
+    }
+}
+
+// only the axis that shrinks more than twice is averaged, the other one is
+// interpolated
+TEST(TestResize, BilinearFilterPerAxis) {
+    const size_t W = 700;
+    const size_t H = 50;
+    std::vector<float> g(W);
+    std::vector<float> h(H);
+    for (size_t c = 0; c < W; c++) {
+        g[c] = float(c % 2) + 0.001f * c;
+    }
+    for (size_t r = 0; r < H; r++) {
+        h[r] = 0.01f * r * r;
+    }
+    // the filters are linear and normalised: they resample each term of the
+    // sum along its own axis
+    Array2Df in(W, H);
+    for (size_t r = 0; r < H; r++) {
+        for (size_t c = 0; c < W; c++) {
+            in(c, r) = g[c] + h[r];
+        }
+    }
+
+    Array2Df wide(53, 75);
+    resize(in, wide, BilinearInterp);
+    for (size_t r = 0; r < wide.getRows(); r++) {
+        for (size_t c = 0; c < wide.getCols(); c++) {
+            ASSERT_NEAR(areaAt(g, 53, c) + bilinearAt(h, 75, r), wide(c, r),
+                        1e-4f)
+                << c << ", " << r;
+        }
+    }
+
+    Array2Df transposed(H, W);
+    for (size_t r = 0; r < W; r++) {
+        for (size_t c = 0; c < H; c++) {
+            transposed(c, r) = in(r, c);
+        }
+    }
+    Array2Df tall(30, 100);
+    resize(transposed, tall, BilinearInterp);
+    for (size_t r = 0; r < tall.getRows(); r++) {
+        for (size_t c = 0; c < tall.getCols(); c++) {
+            ASSERT_NEAR(bilinearAt(h, 30, c) + areaAt(g, 100, r), tall(c, r),
+                        1e-4f)
+                << c << ", " << r;
+        }
+    }
+}
+
+TEST(TestResize, ChannelsTogether) {
+    Array2Df X(211, 107), Y(211, 107), Z(211, 107);
+    fill(X, 0.f);
+    fill(Y, 1.f);
+    fill(Z, 2.f);
+
+    const InterpolationMethod methods[] = {LanczosInterp, AreaInterp,
+                                           BilinearInterp};
+    for (size_t m = 0; m < 3; m++) {
+        Array2Df X2(50, 25), Y2(50, 25), Z2(50, 25);
+        std::vector<const Array2Df *> in;
+        in.push_back(&X);
+        in.push_back(&Y);
+        in.push_back(&Z);
+        std::vector<Array2Df *> out;
+        out.push_back(&X2);
+        out.push_back(&Y2);
+        out.push_back(&Z2);
+        resize(in, out, methods[m]);
+
+        for (size_t c = 0; c < 3; c++) {
+            Array2Df single(50, 25);
+            resize(*in[c], single, methods[m]);
+            for (size_t i = 0; i < single.size(); i++) {
+                ASSERT_EQ(single(i), (*out[c])(i))
+                    << "method " << m << ", channel " << c;
+            }
+        }
+    }
+}
+
+TEST(TestResize, IntegerSamples) {
+    Array2D<uint8_t> in(64, 48);
+    for (size_t r = 0; r < in.getRows(); r++) {
+        for (size_t c = 0; c < in.getCols(); c++) {
+            in(c, r) = uint8_t((c < 32) ? 0 : 255);
+        }
+    }
+
+    Array2D<uint8_t> out(16, 12);
+    resize(in, out, AreaInterp);
+    for (size_t r = 0; r < out.getRows(); r++) {
+        for (size_t c = 0; c < out.getCols(); c++) {
+            EXPECT_EQ((c < 8) ? 0 : 255, out(c, r));
+        }
+    }
+}
+
+TEST(TestResize, KernelCache) {
+    std::shared_ptr<const detail::ResizeKernel> k1 =
+        detail::ResizeKernel::get(1000, 333, LanczosInterp);
+    std::shared_ptr<const detail::ResizeKernel> k2 =
+        detail::ResizeKernel::get(1000, 333, AreaInterp);
+    EXPECT_NE(k1, k2);
+    EXPECT_EQ(k1, detail::ResizeKernel::get(1000, 333, LanczosInterp));
+    EXPECT_EQ(0, k1->taps() % 4);
+
+    // the weights of every output sample add up to one
+    for (size_t j = 0; j < k2->dstSize(); j++) {
+        float sum = 0.f;
+        for (int k = 0; k < k2->taps(); k++) {
+            sum += k2->weights(j)[k];
+        }
+        ASSERT_NEAR(1.f, sum, 1e-5f) << "sample " << j;
+    }
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Termination requests sent to a TMWorker cancel the jobs announced
+//! before them, whether they are queued, starting or running
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include <Core/TMWorker.h>
+#include <Core/TonemappingOptions.h>
+#include <Libpfs/frame.h>
+
+namespace {
+
+const int s_width = 64;
+const int s_height = 48;
+
+std::unique_ptr<pfs::Frame> buildFrame(int width, int height) {
+    std::unique_ptr<pfs::Frame> frame(new pfs::Frame(width, height));
+    pfs::Channel *R;
+    pfs::Channel *G;
+    pfs::Channel *B;
+    frame->createXYZChannels(R, G, B);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const float l = std::pow(10.f, 4.f * x / (width - 1) - 2.f);
+            (*R)(x, y) = l;
+            (*G)(x, y) = l;
+            (*B)(x, y) = l * (1.f - 0.2f * y / height);
+        }
+    }
+    return frame;
+}
+
+//! \brief run one job on \a worker, return whether it produced a frame
+bool runJob(TMWorker &worker) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame(s_width, s_height));
+    TonemappingOptions opts;
+    opts.tmoperator = drago;
+    opts.origxsize = s_width;
+    opts.xsize = s_width;
+
+    std::unique_ptr<pfs::Frame> result(
+        worker.computeTonemap(frame.get(), &opts, BilinearInterp));
+    return result != NULL;
+}
+
+//! \brief run one job in two passes on \a worker, return whether it produced
+//! a frame
+bool runProgressiveJob(TMWorker &worker) {
+    const int width = 2 * TMWorker::s_progressiveWidth;
+    std::unique_ptr<pfs::Frame> frame(buildFrame(width, 16));
+    TonemappingOptions opts;
+    opts.tmoperator = drago;
+    opts.origxsize = width;
+    opts.xsize = width;
+
+    std::unique_ptr<pfs::Frame> result(
+        worker.computeTonemapProgressive(frame.get(), &opts, BilinearInterp));
+    return result != NULL;
+}
+}
+
+TEST(TestTMWorker, RunsWithoutTermination) {
+    TMWorker worker;
+    EXPECT_TRUE(runJob(worker));
+    worker.announceJob();
+    EXPECT_TRUE(runJob(worker));
+}
+
+// the preview panel announces the job, registers the worker, and the label
+// may be invalidated while the frame is still being prepared
+TEST(TestTMWorker, TerminationBeforeTheJobStarts) {
+    TMWorker worker;
+    worker.announceJob();
+    emit worker.tonemapRequestTermination(true);
+    EXPECT_FALSE(runJob(worker));
+}
+
+TEST(TestTMWorker, TerminationBeforeTheOperatorRuns) {
+    TMWorker worker;
+    QObject::connect(&worker, &TMWorker::tonemapBegin, [&worker]() {
+        emit worker.tonemapRequestTermination(true);
+    });
+    worker.announceJob();
+    EXPECT_FALSE(runJob(worker));
+}
+
+// a termination request does not reach the jobs announced after it
+TEST(TestTMWorker, TerminationSparesLaterJobs) {
+    TMWorker worker;
+    emit worker.tonemapRequestTermination(true);
+    worker.announceJob();
+    EXPECT_TRUE(runJob(worker));
+
+    worker.announceJob();
+    emit worker.tonemapRequestTermination(true);
+    worker.announceJob();
+    EXPECT_FALSE(runJob(worker));
+    EXPECT_TRUE(runJob(worker));
+}
+
+// jobs still queued when the termination is requested are canceled as well
+TEST(TestTMWorker, TerminationCancelsQueuedJobs) {
+    TMWorker worker;
+    worker.announceJob();
+    worker.announceJob();
+    emit worker.tonemapRequestTermination(true);
+    EXPECT_FALSE(runJob(worker));
+    EXPECT_FALSE(runJob(worker));
+    EXPECT_TRUE(runJob(worker));
+}
+
+// the main window supersedes a progressive job still queued or running
+TEST(TestTMWorker, TerminationCancelsQueuedProgressiveJobs) {
+    TMWorker worker;
+    worker.announceJob();
+    worker.announceJob();
+    emit worker.tonemapRequestTermination(true);
+    worker.announceJob();
+    EXPECT_FALSE(runProgressiveJob(worker));
+    EXPECT_FALSE(runProgressiveJob(worker));
+    EXPECT_TRUE(runProgressiveJob(worker));
+}
+
+TEST(TestTMWorker, TerminationStopsTheRemainingPasses) {
+    TMWorker worker;
+    int refined = 0;
+    QObject::connect(&worker, &TMWorker::tonemapRefined,
+                     [&worker, &refined](pfs::Frame *frame,
+                                         TonemappingOptions *) {
+                         delete frame;
+                         ++refined;
+                         emit worker.tonemapRequestTermination(true);
+                     });
+    worker.announceJob();
+    EXPECT_FALSE(runProgressiveJob(worker));
+    EXPECT_EQ(refined, 1);
+}
@@ -0,0 +1,298 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Tonemap a frame in tiles and check it against a tonemap of the
+//! whole frame
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <Core/TonemappingOptions.h>
+#include <Libpfs/frame.h>
+#include <Libpfs/manip/copy.h>
+#include <Libpfs/progress.h>
+#include <Libpfs/tm/TiledTonemapper.h>
+#include <Libpfs/tm/TonemapOperator.h>
+
+namespace {
+
+const int s_width = 300;
+const int s_height = 200;
+const int s_tileSize = 64;
+
+// wider than TiledTonemapper::s_proxyWidth: the statistics come from a
+// reduced copy
+const int s_wideWidth = 2300;
+const int s_wideHeight = 300;
+const int s_wideTileSize = 256;
+const int s_overlap = 32;
+
+//! \brief HDR test card: a horizontal ramp over four decades, a bright window
+//! and a vertical ramp in the chroma
+std::unique_ptr<pfs::Frame> buildFrame(int width = s_width,
+                                       int height = s_height) {
+    std::unique_ptr<pfs::Frame> frame(new pfs::Frame(width, height));
+    pfs::Channel *R;
+    pfs::Channel *G;
+    pfs::Channel *B;
+    frame->createXYZChannels(R, G, B);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float l = std::pow(10.f, 4.f * x / (width - 1) - 2.f);
+            if (x > width / 3 && x < width / 2 && y > height / 4 &&
+                y < height / 2) {
+                l *= 50.f;
+            }
+            (*R)(x, y) = l * (1.f + 0.2f * y / height);
+            (*G)(x, y) = l;
+            (*B)(x, y) = l * (1.2f - 0.2f * y / height);
+        }
+    }
+    return frame;
+}
+
+//! \brief reduced copy of \a frame, averaging blocks of \a factor x
+//! \a factor pixels in the order TiledTonemapper does
+std::unique_ptr<pfs::Frame> buildProxy(const pfs::Frame &frame,
+                                       size_t factor) {
+    const size_t width = frame.getWidth();
+    const size_t height = frame.getHeight();
+    std::unique_ptr<pfs::Frame> proxy(new pfs::Frame(
+        (width + factor - 1) / factor, (height + factor - 1) / factor));
+
+    const pfs::Channel *X, *Y, *Z;
+    frame.getXYZChannels(X, Y, Z);
+    const pfs::Channel *channels[] = {X, Y, Z};
+    pfs::Channel *pX, *pY, *pZ;
+    proxy->createXYZChannels(pX, pY, pZ);
+    pfs::Channel *proxyChannels[] = {pX, pY, pZ};
+
+    for (size_t py = 0; py < proxy->getHeight(); py++) {
+        const size_t y0 = py * factor;
+        const size_t y1 = std::min(y0 + factor, height);
+        for (size_t px = 0; px < proxy->getWidth(); px++) {
+            const size_t x0 = px * factor;
+            const size_t x1 = std::min(x0 + factor, width);
+            const float norm = 1.f / ((y1 - y0) * (x1 - x0));
+            for (int c = 0; c < 3; c++) {
+                float sum = 0.f;
+                for (size_t j = y0; j < y1; j++) {
+                    for (size_t i = x0; i < x1; i++) {
+                        sum += (*channels[c])(i, j);
+                    }
+                }
+                (*proxyChannels[c])(px, py) = sum * norm;
+            }
+        }
+    }
+    return proxy;
+}
+
+std::unique_ptr<pfs::Frame> tonemapWhole(const pfs::Frame &frame,
+                                         TonemappingOptions &opts) {
+    std::unique_ptr<pfs::Frame> result(pfs::copy(&frame));
+    pfs::Progress progress;
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(opts.tmoperator));
+    tmEngine->tonemapFrame(*result, &opts, progress);
+    return result;
+}
+
+//! \brief largest and average absolute difference of the RGB channels
+void difference(const pfs::Frame &a, const pfs::Frame &b, float &maxDiff,
+                float &meanDiff) {
+    const pfs::Channel *aX, *aY, *aZ;
+    const pfs::Channel *bX, *bY, *bZ;
+    a.getXYZChannels(aX, aY, aZ);
+    b.getXYZChannels(bX, bY, bZ);
+
+    const pfs::Channel *ca[] = {aX, aY, aZ};
+    const pfs::Channel *cb[] = {bX, bY, bZ};
+    maxDiff = 0.f;
+    double sum = 0.;
+    for (int c = 0; c < 3; c++) {
+        for (size_t i = 0; i < ca[c]->size(); i++) {
+            const float d = std::fabs((*ca[c])(i) - (*cb[c])(i));
+            maxDiff = std::max(maxDiff, d);
+            sum += d;
+        }
+    }
+    meanDiff = float(sum / (3 * ca[0]->size()));
+}
+
+//! \brief largest absolute difference of the RGB channels within \a overlap
+//! pixels of the borders between tiles of size \a tileSize
+float seamDifference(const pfs::Frame &a, const pfs::Frame &b,
+                     size_t tileSize, size_t overlap) {
+    const pfs::Channel *aX, *aY, *aZ;
+    const pfs::Channel *bX, *bY, *bZ;
+    a.getXYZChannels(aX, aY, aZ);
+    b.getXYZChannels(bX, bY, bZ);
+
+    const pfs::Channel *ca[] = {aX, aY, aZ};
+    const pfs::Channel *cb[] = {bX, bY, bZ};
+    const size_t width = a.getWidth();
+    const size_t height = a.getHeight();
+
+    // distance to the nearest border between two tiles
+    auto nearSeam = [&](size_t x, size_t n) {
+        const size_t before = x % tileSize;
+        const size_t after = tileSize - before;
+        return (x >= tileSize && before < overlap) ||
+               (x + after < n && after <= overlap);
+    };
+
+    float diff = 0.f;
+    for (size_t y = 0; y < height; y++) {
+        const bool seamRow = nearSeam(y, height);
+        for (size_t x = 0; x < width; x++) {
+            if (!seamRow && !nearSeam(x, width)) continue;
+            for (int c = 0; c < 3; c++) {
+                diff = std::max(diff,
+                                std::fabs((*ca[c])(x, y) - (*cb[c])(x, y)));
+            }
+        }
+    }
+    return diff;
+}
+
+//! \brief record the rows written, then assemble the frame
+class RecordingSink : public TiledTonemapper::FrameSink {
+   public:
+    RecordingSink(pfs::Frame &frame)
+        : TiledTonemapper::FrameSink(frame), next(0), ordered(true) {}
+
+    void write(const pfs::Frame &rows, size_t y) {
+        ordered = ordered && (y == next);
+        next = y + rows.getHeight();
+        TiledTonemapper::FrameSink::write(rows, y);
+    }
+
+    size_t next;
+    bool ordered;
+};
+
+class TestTiledTonemapper : public ::testing::TestWithParam<TMOperator> {};
+}
+
+TEST_P(TestTiledTonemapper, MatchesWholeFrame) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame());
+
+    TonemappingOptions opts;
+    opts.tmoperator = GetParam();
+    opts.origxsize = s_width;
+    opts.xsize = s_width;
+    ASSERT_TRUE(TiledTonemapper::supports(opts.tmoperator));
+
+    std::unique_ptr<pfs::Frame> reference(tonemapWhole(*frame, opts));
+
+    pfs::Frame tiled(s_width, s_height);
+    RecordingSink sink(tiled);
+    pfs::Progress progress;
+    TiledTonemapper(s_tileSize).tonemap(*frame, &opts, sink, progress);
+
+    EXPECT_TRUE(sink.ordered);
+    EXPECT_EQ(size_t(s_height), sink.next);
+
+    // the frame is narrower than the proxy: the statistics are exact, and
+    // the halo covers the support of local operators
+    float maxDiff, meanDiff;
+    difference(*reference, tiled, maxDiff, meanDiff);
+    EXPECT_LT(maxDiff, 1e-4f);
+}
+
+INSTANTIATE_TEST_CASE_P(RegionOperators, TestTiledTonemapper,
+                        ::testing::Values(drago, reinhard05, ferwerda,
+                                          kimkautz, durand));
+
+// the reference is the whole frame tonemapped with the statistics of the
+// same reduced copy: every difference comes from the tiling
+TEST_P(TestTiledTonemapper, WideFrameHasNoSeams) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame(s_wideWidth, s_wideHeight));
+
+    TonemappingOptions opts;
+    opts.tmoperator = GetParam();
+    opts.origxsize = s_wideWidth;
+    opts.xsize = s_wideWidth;
+
+    const size_t factor = (s_wideWidth + TiledTonemapper::s_proxyWidth - 1) /
+                          TiledTonemapper::s_proxyWidth;
+    ASSERT_GT(factor, size_t(1));
+
+    pfs::Progress progress;
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(opts.tmoperator));
+    std::unique_ptr<pfs::Frame> proxy(buildProxy(*frame, factor));
+    std::unique_ptr<TonemapStatistics> statistics(
+        tmEngine->computeStatistics(*proxy, &opts, progress));
+    std::unique_ptr<pfs::Frame> reference(pfs::copy(frame.get()));
+    tmEngine->tonemapRegion(*reference, &opts, *statistics, progress);
+
+    pfs::Frame tiled(s_wideWidth, s_wideHeight);
+    TiledTonemapper::FrameSink sink(tiled);
+    TiledTonemapper(s_wideTileSize, s_overlap)
+        .tonemap(*frame, &opts, sink, progress);
+
+    EXPECT_LT(seamDifference(*reference, tiled, s_wideTileSize, s_overlap),
+              1e-4f);
+    float maxDiff, meanDiff;
+    difference(*reference, tiled, maxDiff, meanDiff);
+    EXPECT_LT(maxDiff, 1e-4f);
+}
+
+TEST(TestTiledTonemapper, BlendsOverlappingTiles) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame());
+
+    TonemappingOptions opts;
+    opts.tmoperator = durand;
+    opts.origxsize = s_width;
+    opts.xsize = s_width;
+
+    // the tile size does not divide the frame, and a tile is narrower than
+    // the overlap
+    pfs::Frame tiled(s_width, s_height);
+    TiledTonemapper::FrameSink sink(tiled);
+    pfs::Progress progress;
+    TiledTonemapper(98, 16).tonemap(*frame, &opts, sink, progress);
+
+    std::unique_ptr<pfs::Frame> reference(tonemapWhole(*frame, opts));
+    float maxDiff, meanDiff;
+    difference(*reference, tiled, maxDiff, meanDiff);
+    EXPECT_LT(maxDiff, 1e-4f);
+}
+
+TEST(TestTiledTonemapper, RejectsGlobalOperators) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame());
+
+    TonemappingOptions opts;
+    opts.tmoperator = mantiuk06;
+    EXPECT_FALSE(TiledTonemapper::supports(opts.tmoperator));
+
+    pfs::Frame tiled(s_width, s_height);
+    TiledTonemapper::FrameSink sink(tiled);
+    pfs::Progress progress;
+    EXPECT_ANY_THROW(
+        TiledTonemapper().tonemap(*frame, &opts, sink, progress));
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+#include <gtest/gtest.h>
+
+#include <TonemappingOperators/tonecurve.h>
+
+#include <cmath>
+#include <limits>
+
+TEST(TestToneCurveLUT, RelativeTolerance) {
+    auto curve = [](float x) { return std::pow(x, 0.6f); };
+    const ToneCurveLUT lut(curve, 1e-4f, 1e5f, 1e-5f);
+    ASSERT_TRUE(lut.valid());
+
+    for (float x = 1e-4f; x < 1e5f; x *= 1.0137f) {
+        const float exact = curve(x);
+        ASSERT_NEAR(lut(x), exact, 2e-5f * exact) << "x = " << x;
+    }
+}
+
+TEST(TestToneCurveLUT, AbsoluteToleranceAndMonotonicity) {
+    auto curve = [](float x) { return std::log(x + 1.f) / std::log(1001.f); };
+    const ToneCurveLUT lut(curve, 1e-6f, 1000.f, 0.f, 1e-5f);
+    ASSERT_TRUE(lut.valid());
+
+    float previous = lut(0.f);
+    for (float x = 1e-6f; x < 1000.f; x *= 1.001f) {
+        const float value = lut(x);
+        ASSERT_NEAR(value, curve(x), 2e-5f) << "x = " << x;
+        ASSERT_GE(value, previous) << "x = " << x;
+        previous = value;
+    }
+}
+
+TEST(TestToneCurveLUT, Clamping) {
+    auto curve = [](float x) { return x * x; };
+    const ToneCurveLUT lut(curve, 0.5f, 2.f, 1e-5f);
+    ASSERT_TRUE(lut.valid());
+
+    EXPECT_NEAR(lut(0.f), 0.25f, 1e-6f);
+    EXPECT_NEAR(lut(-3.f), 0.25f, 1e-6f);
+    EXPECT_NEAR(lut(10.f), 4.f, 1e-5f);
+    EXPECT_NEAR(lut(1.f), 1.f, 1e-5f);
+}
+
+TEST(TestToneCurveLUT, ConstantDomain) {
+    auto curve = [](float x) { return 3.f * x; };
+    const ToneCurveLUT lut(curve, 2.f, 2.f, 1e-5f);
+    ASSERT_TRUE(lut.valid());
+    EXPECT_NEAR(lut(2.f), 6.f, 1e-5f);
+    EXPECT_NEAR(lut(5.f), 6.f, 1e-5f);
+}
+
+TEST(TestToneCurveLUT, NonFiniteCurve) {
+    // NaN below 1
+    auto nan = [](float x) { return std::sqrt(std::log(x)); };
+    EXPECT_FALSE(ToneCurveLUT(nan, 0.1f, 10.f, 1e-5f).valid());
+
+    // infinite above 100
+    auto inf = [](float x) {
+        return (x > 100.f) ? std::numeric_limits<float>::infinity() : x;
+    };
+    EXPECT_FALSE(ToneCurveLUT(inf, 1.f, 1000.f, 1e-5f).valid());
+}
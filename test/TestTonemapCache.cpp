@@ -0,0 +1,200 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Tonemap the same input several times with one operator instance, as
+//! the tonemapping panel does, and check the results against fresh instances
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include <Core/TonemappingOptions.h>
+#include <Libpfs/frame.h>
+#include <Libpfs/manip/copy.h>
+#include <Libpfs/progress.h>
+#include <Libpfs/tm/TonemapOperator.h>
+
+namespace {
+
+const int s_width = 96;
+const int s_height = 64;
+
+//! \brief HDR test card: a horizontal ramp over four decades with a bright
+//! window and a coloured cast
+std::unique_ptr<pfs::Frame> buildFrame(float window) {
+    std::unique_ptr<pfs::Frame> frame(new pfs::Frame(s_width, s_height));
+    pfs::Channel *R;
+    pfs::Channel *G;
+    pfs::Channel *B;
+    frame->createXYZChannels(R, G, B);
+
+    for (int y = 0; y < s_height; y++) {
+        for (int x = 0; x < s_width; x++) {
+            float l = std::pow(10.f, 4.f * x / (s_width - 1) - 2.f);
+            if (x > s_width / 3 && x < s_width / 2 && y > s_height / 4 &&
+                y < s_height / 2) {
+                l *= window;
+            }
+            (*R)(x, y) = l * (1.f + 0.2f * y / s_height);
+            (*G)(x, y) = l;
+            (*B)(x, y) = l * (1.2f - 0.2f * y / s_height);
+        }
+    }
+    return frame;
+}
+
+TonemappingOptions options(const pfs::Frame &frame, TMOperator op) {
+    TonemappingOptions opts;
+    opts.tmoperator = op;
+    opts.origxsize = frame.getWidth();
+    opts.xsize = frame.getWidth();
+    opts.operator_options.reinhard02options.scales = true;
+    return opts;
+}
+
+TonemapInput inputOf(const pfs::Frame &frame) {
+    TonemapInput input;
+    input.content = frame.contentKey();
+    input.width = frame.getWidth();
+    return input;
+}
+
+//! \brief tonemap a copy of \a frame with \a tmEngine, given \a input
+std::unique_ptr<pfs::Frame> tonemap(TonemapOperator &tmEngine,
+                                    const pfs::Frame &frame,
+                                    TonemappingOptions opts,
+                                    const TonemapInput *input) {
+    std::unique_ptr<pfs::Frame> result(pfs::copy(&frame));
+    if (input) {
+        tmEngine.setInput(*input);
+    }
+    pfs::Progress progress;
+    tmEngine.tonemapFrame(*result, &opts, progress);
+    return result;
+}
+
+//! \brief tonemap a copy of \a frame with a fresh instance of the operator
+std::unique_ptr<pfs::Frame> tonemap(const pfs::Frame &frame,
+                                    const TonemappingOptions &opts) {
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(opts.tmoperator));
+    return tonemap(*tmEngine, frame, opts, NULL);
+}
+
+//! \brief the operators reuse what they derived from the input, and compute
+//! the rest as usual: only the order OpenMP adds partial sums in may differ
+const float s_tolerance = 1e-5f;
+
+float maxDifference(const pfs::Frame &a, const pfs::Frame &b) {
+    const pfs::Channel *aX, *aY, *aZ;
+    const pfs::Channel *bX, *bY, *bZ;
+    a.getXYZChannels(aX, aY, aZ);
+    b.getXYZChannels(bX, bY, bZ);
+
+    const pfs::Channel *ca[] = {aX, aY, aZ};
+    const pfs::Channel *cb[] = {bX, bY, bZ};
+    float diff = 0.f;
+    for (int c = 0; c < 3; c++) {
+        for (size_t i = 0; i < ca[c]->size(); i++) {
+            diff = std::max(diff, std::fabs((*ca[c])(i) - (*cb[c])(i)));
+        }
+    }
+    return diff;
+}
+
+class TestTonemapCache : public ::testing::TestWithParam<TMOperator> {};
+}
+
+//! \brief change the parameters between runs on the same input, then go back
+//! to an input seen before
+TEST_P(TestTonemapCache, ReusedInput) {
+    std::unique_ptr<pfs::Frame> first(buildFrame(50.f));
+    std::unique_ptr<pfs::Frame> second(buildFrame(5.f));
+    const TonemapInput firstInput = inputOf(*first);
+    const TonemapInput secondInput = inputOf(*second);
+
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(GetParam()));
+
+    for (int run = 0; run < 3; run++) {
+        TonemappingOptions opts = options(*first, GetParam());
+        opts.operator_options.mantiuk06options.contrastfactor = 0.1f + 0.1f * run;
+        opts.operator_options.fattaloptions.alpha = 1.f + 0.5f * run;
+        opts.operator_options.reinhard02options.key = 0.18f + 0.1f * run;
+
+        std::unique_ptr<pfs::Frame> cold(tonemap(*first, opts));
+        std::unique_ptr<pfs::Frame> warm(
+            tonemap(*tmEngine, *first, opts, &firstInput));
+        EXPECT_LT(maxDifference(*cold, *warm), s_tolerance) << "run " << run;
+    }
+
+    TonemappingOptions opts = options(*second, GetParam());
+    std::unique_ptr<pfs::Frame> cold(tonemap(*second, opts));
+    std::unique_ptr<pfs::Frame> warm(
+        tonemap(*tmEngine, *second, opts, &secondInput));
+    EXPECT_LT(maxDifference(*cold, *warm), s_tolerance);
+
+    opts = options(*first, GetParam());
+    cold = tonemap(*first, opts);
+    warm = tonemap(*tmEngine, *first, opts, &firstInput);
+    EXPECT_LT(maxDifference(*cold, *warm), s_tolerance);
+}
+
+//! \brief writing into the image gives a new input, even if the frame is the
+//! same object
+TEST_P(TestTonemapCache, ModifiedInput) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame(50.f));
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(GetParam()));
+
+    const TonemappingOptions opts = options(*frame, GetParam());
+    TonemapInput input = inputOf(*frame);
+    tonemap(*tmEngine, *frame, opts, &input);
+
+    std::unique_ptr<pfs::Frame> other(buildFrame(5.f));
+    frame->swap(*other);
+    frame->invalidateCaches();
+    EXPECT_FALSE(input == inputOf(*frame));
+
+    input = inputOf(*frame);
+    std::unique_ptr<pfs::Frame> cold(tonemap(*frame, opts));
+    std::unique_ptr<pfs::Frame> warm(tonemap(*tmEngine, *frame, opts, &input));
+    EXPECT_LT(maxDifference(*cold, *warm), s_tolerance);
+}
+
+//! \brief what was derived from an image is released once the image is gone
+TEST_P(TestTonemapCache, ReleasedInput) {
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(GetParam()));
+
+    std::unique_ptr<pfs::Frame> frame(buildFrame(50.f));
+    const TonemappingOptions opts = options(*frame, GetParam());
+    const TonemapInput input = inputOf(*frame);
+    tonemap(*tmEngine, *frame, opts, &input);
+    EXPECT_GT(tmEngine->cachedBytes(), 0u);
+
+    frame.reset();
+    tmEngine->trimCache();
+    EXPECT_EQ(tmEngine->cachedBytes(), 0u);
+}
+
+INSTANTIATE_TEST_CASE_P(CachingOperators, TestTonemapCache,
+                        ::testing::Values(mantiuk06, fattal, reinhard02));
@@ -0,0 +1,135 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Run every tonemapping operator concurrently, as the preview panel
+//! does, and check the results against a serial run
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <Core/TonemappingOptions.h>
+#include <Libpfs/frame.h>
+#include <Libpfs/manip/copy.h>
+#include <Libpfs/progress.h>
+#include <Libpfs/tm/TonemapOperator.h>
+
+namespace {
+
+const int s_width = 96;
+const int s_height = 64;
+const int s_operators = lischinski + 1;
+const int s_rounds = 3;
+
+//! \brief HDR test card: a horizontal ramp over four decades with a bright
+//! window and a coloured cast
+std::unique_ptr<pfs::Frame> buildFrame() {
+    std::unique_ptr<pfs::Frame> frame(new pfs::Frame(s_width, s_height));
+    pfs::Channel *R;
+    pfs::Channel *G;
+    pfs::Channel *B;
+    frame->createXYZChannels(R, G, B);
+
+    for (int y = 0; y < s_height; y++) {
+        for (int x = 0; x < s_width; x++) {
+            float l = std::pow(10.f, 4.f * x / (s_width - 1) - 2.f);
+            if (x > s_width / 3 && x < s_width / 2 && y > s_height / 4 &&
+                y < s_height / 2) {
+                l *= 50.f;
+            }
+            (*R)(x, y) = l * (1.f + 0.2f * y / s_height);
+            (*G)(x, y) = l;
+            (*B)(x, y) = l * (1.2f - 0.2f * y / s_height);
+        }
+    }
+    return frame;
+}
+
+//! \brief tonemap a copy of \a frame with the default parameters of \a op
+std::unique_ptr<pfs::Frame> tonemap(const pfs::Frame &frame, TMOperator op) {
+    std::unique_ptr<pfs::Frame> result(pfs::copy(&frame));
+
+    TonemappingOptions opts;
+    opts.tmoperator = op;
+    opts.origxsize = frame.getWidth();
+    opts.xsize = frame.getWidth();
+
+    pfs::Progress progress;
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(op));
+    tmEngine->tonemapFrame(*result, &opts, progress);
+    return result;
+}
+
+float maxDifference(const pfs::Frame &a, const pfs::Frame &b) {
+    const pfs::Channel *aX, *aY, *aZ;
+    const pfs::Channel *bX, *bY, *bZ;
+    a.getXYZChannels(aX, aY, aZ);
+    b.getXYZChannels(bX, bY, bZ);
+
+    const pfs::Channel *ca[] = {aX, aY, aZ};
+    const pfs::Channel *cb[] = {bX, bY, bZ};
+    float diff = 0.f;
+    for (int c = 0; c < 3; c++) {
+        for (size_t i = 0; i < ca[c]->size(); i++) {
+            diff = std::max(diff, std::fabs((*ca[c])(i) - (*cb[c])(i)));
+        }
+    }
+    return diff;
+}
+}
+
+TEST(TestTonemapConcurrency, AllOperatorsInParallel) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame());
+
+    std::vector<std::unique_ptr<pfs::Frame>> reference(s_operators);
+    for (int op = 0; op < s_operators; op++) {
+        ASSERT_NO_THROW(reference[op] = tonemap(*frame, TMOperator(op)))
+            << "operator " << op;
+    }
+
+    for (int round = 0; round < s_rounds; round++) {
+        std::vector<std::unique_ptr<pfs::Frame>> result(s_operators);
+        std::vector<int> failed(s_operators, 0);
+        std::vector<std::thread> threads;
+        for (int op = 0; op < s_operators; op++) {
+            threads.push_back(std::thread([&, op]() {
+                try {
+                    result[op] = tonemap(*frame, TMOperator(op));
+                } catch (...) {
+                    failed[op] = 1;
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+
+        for (int op = 0; op < s_operators; op++) {
+            ASSERT_FALSE(failed[op]) << "operator " << op << " threw";
+            ASSERT_TRUE(result[op] != NULL);
+            EXPECT_LT(maxDifference(*reference[op], *result[op]), 1e-3f)
+                << "operator " << op << ", round " << round;
+        }
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * This file is a part of Luminance HDR package
+ * ----------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * ----------------------------------------------------------------------
+ */
+
+//! \brief Tonemap a region of a frame with the statistics of the whole frame
+//! and check it against the same region of the tonemapped frame
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include <Core/TonemappingOptions.h>
+#include <Libpfs/frame.h>
+#include <Libpfs/manip/copy.h>
+#include <Libpfs/manip/cut.h>
+#include <Libpfs/progress.h>
+#include <Libpfs/tm/TonemapOperator.h>
+
+namespace {
+
+const int s_width = 96;
+const int s_height = 64;
+
+std::unique_ptr<pfs::Frame> buildFrame() {
+    std::unique_ptr<pfs::Frame> frame(new pfs::Frame(s_width, s_height));
+    pfs::Channel *R;
+    pfs::Channel *G;
+    pfs::Channel *B;
+    frame->createXYZChannels(R, G, B);
+
+    for (int y = 0; y < s_height; y++) {
+        for (int x = 0; x < s_width; x++) {
+            float l = std::pow(10.f, 4.f * x / (s_width - 1) - 2.f);
+            if (x > s_width / 3 && x < s_width / 2 && y > s_height / 4 &&
+                y < s_height / 2) {
+                l *= 50.f;
+            }
+            (*R)(x, y) = l * (1.f + 0.2f * y / s_height);
+            (*G)(x, y) = l;
+            (*B)(x, y) = l * (1.2f - 0.2f * y / s_height);
+        }
+    }
+    return frame;
+}
+
+float maxDifference(const pfs::Frame &a, const pfs::Frame &b) {
+    const pfs::Channel *aX, *aY, *aZ;
+    const pfs::Channel *bX, *bY, *bZ;
+    a.getXYZChannels(aX, aY, aZ);
+    b.getXYZChannels(bX, bY, bZ);
+
+    const pfs::Channel *ca[] = {aX, aY, aZ};
+    const pfs::Channel *cb[] = {bX, bY, bZ};
+    float diff = 0.f;
+    for (int c = 0; c < 3; c++) {
+        for (size_t i = 0; i < ca[c]->size(); i++) {
+            diff = std::max(diff, std::fabs((*ca[c])(i) - (*cb[c])(i)));
+        }
+    }
+    return diff;
+}
+
+class TestTonemapRegion : public ::testing::TestWithParam<TMOperator> {};
+}
+
+TEST_P(TestTonemapRegion, MatchesWholeFrame) {
+    const int x_ul = 20, y_ul = 10, x_br = 70, y_br = 50;
+
+    std::unique_ptr<pfs::Frame> frame(buildFrame());
+
+    TonemappingOptions opts;
+    opts.tmoperator = GetParam();
+    opts.origxsize = s_width;
+    opts.xsize = s_width;
+
+    pfs::Progress progress;
+    std::unique_ptr<TonemapOperator> tmEngine(
+        TonemapOperator::getTonemapOperator(GetParam()));
+    ASSERT_TRUE(tmEngine->tonemapsRegions());
+
+    // computeStatistics() tonemaps the whole frame as well
+    std::unique_ptr<pfs::Frame> whole(pfs::copy(frame.get()));
+    std::unique_ptr<TonemapStatistics> statistics(
+        tmEngine->computeStatistics(*whole, &opts, progress));
+    ASSERT_TRUE(statistics != NULL);
+
+    // the region is tonemapped with its halo, which is then cut away
+    const int halo = tmEngine->regionHalo(&opts);
+    const int left = std::max(x_ul - halo, 0);
+    const int top = std::max(y_ul - halo, 0);
+    const int right = std::min(x_br + halo, s_width);
+    const int bottom = std::min(y_br + halo, s_height);
+
+    std::unique_ptr<pfs::Frame> region(
+        pfs::cut(frame.get(), left, top, right, bottom));
+    tmEngine->tonemapRegion(*region, &opts, *statistics, progress);
+    region.reset(pfs::cut(region.get(), x_ul - left, y_ul - top,
+                          x_br - left, y_br - top));
+
+    std::unique_ptr<pfs::Frame> reference(
+        pfs::cut(whole.get(), x_ul, y_ul, x_br, y_br));
+    EXPECT_LT(maxDifference(*reference, *region), 1e-4f);
+}
+
+INSTANTIATE_TEST_CASE_P(RegionOperators, TestTonemapRegion,
+                        ::testing::Values(drago, reinhard05, ferwerda,
+                                          kimkautz, durand));
+
+// the pyramid levels Ashikhmin02 adapts to are sampled on a grid that depends
+// on the size of the frame: a region cannot match the whole frame
+TEST(TestTonemapRegion, AshikhminTonemapsTheCropAlone) {
+    std::unique_ptr<TonemapOperator> ashikhmin02(
+        TonemapOperator::getTonemapOperator(ashikhmin));
+    EXPECT_FALSE(ashikhmin02->tonemapsRegions());
+}
+
+TEST(TestTonemapRegion, RejectsForeignStatistics) {
+    std::unique_ptr<pfs::Frame> frame(buildFrame());
+
+    TonemappingOptions opts;
+    opts.tmoperator = drago;
+    pfs::Progress progress;
+
+    std::unique_ptr<TonemapOperator> drago03(
+        TonemapOperator::getTonemapOperator(drago));
+    std::unique_ptr<TonemapStatistics> statistics(
+        drago03->computeStatistics(*frame, &opts, progress));
+
+    opts.tmoperator = reinhard05;
+    std::unique_ptr<TonemapOperator> reinhard(
+        TonemapOperator::getTonemapOperator(reinhard05));
+    EXPECT_ANY_THROW(
+        reinhard->tonemapRegion(*frame, &opts, *statistics, progress));
+}